@@ -2,4 +2,16 @@ g_config = g_config or {
     app_type = 2,
     ip = "127.0.0.1",
     port = 8080,
+    log_level = 300,    -- lowest level logged, DEBUG 100, INFO 300, WARNING 500
+    log_queue_limit = 10000,    -- log lines waiting for g3log, more are dropped, 0 is unbounded
+    admin_port = 8081,  -- prometheus metrics on GET /metrics, 0 turns it off
+    trace_sample_rate = 0,  -- one read in N is traced, GET /trace dumps them, 0 turns it off
+    tick_rate = 20,     -- on_tick per second, 0 dispatches every message at once
+    route_port = 8082,  -- route links connect here, 0 turns it off
+    route_id = 1,       -- the backend id the route config gives this server
+    send_high_water_mask = 256 * 1024,  -- bytes queued on a session before send_policy applies, 0 turns it off
+    send_low_water_mask = 64 * 1024,    -- a paused session resumes once drained to this
+    send_hard_limit = 4 * 1024 * 1024,  -- a session with more bytes queued is aborted, 0 turns it off
+    send_policy = 1,    -- over high water: 0 pauses (on_send_pause), 1 drops the oldest droppable messages, 2 aborts
+    send_memory_limit = 256 * 1024 * 1024,  -- bytes queued on all sessions, the largest senders are aborted past it, 0 turns it off
 }
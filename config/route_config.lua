@@ -0,0 +1,14 @@
+g_config = g_config or {
+    app_type = 1,
+    ip = "127.0.0.1",
+    port = 8090,
+    log_level = 300,    -- lowest level logged, DEBUG 100, INFO 300, WARNING 500
+    log_queue_limit = 10000,    -- log lines waiting for g3log, more are dropped, 0 is unbounded
+    admin_port = 8091,  -- prometheus metrics on GET /metrics, 0 turns it off
+    trace_sample_rate = 0,  -- one read in N is traced, GET /trace dumps them, 0 turns it off
+    -- frames addressed to a backend id are forwarded over its links, port
+    -- is the route_port of that GAME server
+    backends = {
+        { id = 1, ip = "127.0.0.1", port = 8082, links = 2 },
+    },
+}
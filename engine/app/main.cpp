@@ -1,16 +1,27 @@
 #include <cstdio>
+#include <memory>
 #include <string>
 
 #include <third_party/g3log/g3log/g3log.hpp>
 #include <third_party/g3log/g3log/logworker.hpp>
 #include <engine/common/common.h>
+#include <engine/common/logger.h>
+#include <engine/common/raii.h>
+#include <engine/common/trace.h>
 #include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/handler/metrics_handler.h>
+#include <engine/handler/pbc_codec.h>
+#include <engine/handler/route_backend_handler.h>
+#include <engine/handler/route_handler.h>
 #include <engine/net/net_manager.h>
+#include <engine/net/router.h>
 #include <engine/net/server.h>
 
 using namespace engine;
 using namespace g3;
 
+static const uint32_t kMaxRouteFrameLength = 64 * 1024;
+
 class handler : public abstract_handler
 {
 public:
@@ -27,8 +38,8 @@ public:
 
     virtual void decode(context* ctx, std::unique_ptr<any> msg)
     {
-        read_data data = any_cast<read_data>(*msg);
-        net_manager::on_message(ctx->session_id(), data.data, data.len);
+        const pbc_message& message = *any_cast<pbc_message>(msg.get());
+        net_manager::on_message(ctx->session_id(), message);
     }
 
     virtual void notify_closed(context* ctx)
@@ -37,6 +48,62 @@ public:
     }
 };
 
+// GET /metrics and GET /trace on g_config.admin_port, read with g_config on
+// the top of the lua stack. no admin_port, no admin server
+static std::unique_ptr<server> start_admin(lua_State* L, const std::string& ip)
+{
+    lua_getfield(L, -1, "trace_sample_rate");
+    if (lua_isnumber(L, -1)) {
+        trace::set_sample_rate(static_cast<uint32_t>(lua_tointeger(L, -1)));
+    }
+    lua_pop(L, 1);
+
+    lua_getfield(L, -1, "admin_port");
+    int admin_port = lua_isnumber(L, -1) ? (int)lua_tointeger(L, -1) : 0;
+    lua_pop(L, 1);
+    if (admin_port <= 0) {
+        return nullptr;
+    }
+
+    printf("admin ip = %s, port = %d\n", ip.c_str(), admin_port);
+    std::unique_ptr<server> admin(new server(ip.c_str(), admin_port, 1));
+    admin->set_init_handlers(metrics_handler::init_handlers);
+    admin->run();
+    return admin;
+}
+
+// the send budget of every client session and the pending byte limit of
+// the process, read with g_config on the top of the lua stack. a missing
+// field is 0, which turns that check off
+static void set_send_budget(lua_State* L, server& s)
+{
+    auto field = [L](const char* name)->std::size_t {
+        lua_getfield(L, -1, name);
+        std::size_t value = lua_isnumber(L, -1) ? static_cast<std::size_t>(lua_tointeger(L, -1)) : 0;
+        lua_pop(L, 1);
+        return value;
+    };
+    send_budget budget;
+    budget.high_water_mask  = field("send_high_water_mask");
+    budget.low_water_mask   = field("send_low_water_mask");
+    budget.hard_limit       = field("send_hard_limit");
+    std::size_t policy      = field("send_policy");
+    if (policy > static_cast<std::size_t>(send_overflow_policy::DISCONNECT)) {
+        printf("unknown send_policy = %zu, producers are paused\n", policy);
+        policy = 0;
+    }
+    budget.policy           = static_cast<send_overflow_policy>(policy);
+    send_memory::set_limit(field("send_memory_limit"));
+
+    // the pause comes from inside a write, which may hold the lua lock
+    s.set_send_budget(budget, [](std::shared_ptr<session> session, bool paused){
+        uint32_t session_id = session->id();
+        session->work_service().post([session_id, paused](){
+            net_manager::on_send_pause(session_id, paused);
+        });
+    });
+}
+
 int main(int argc, char* argv[])
 {
     if (argc != 2) {
@@ -49,9 +116,12 @@ int main(int argc, char* argv[])
     std::unique_ptr<LogWorker> logworker{ LogWorker::createLogWorker() };
     //logworker->addSink(std2::make_unique<FileSink>(argv[0], "./"), &FileSink::fileWrite);
     initializeLogging(logworker.get());
+    // drains the deferred records before the log worker goes away
+    raii log_thread(logger::stop, logger::start);
 
     net_manager::init();
     lua_State* L = net_manager::get_lua_state();
+    std::unique_lock<std::mutex> lua_lock(net_manager::mutex());
 
     if (luaL_loadfile(L, filename) || lua_pcall(L,0,0,0)) {
         luaL_error(L, "loadfile error! %s \n", lua_tostring(L, -1));
@@ -63,6 +133,16 @@ int main(int argc, char* argv[])
         luaL_error(L, "loadfile error! %s \n", lua_tostring(L, -1));
         return 1;
     }
+    lua_getfield(L, -1, "log_level");
+    if (lua_isnumber(L, -1)) {
+        logger::set_level(static_cast<int>(lua_tointeger(L, -1)));
+    }
+    lua_pop(L, 1);
+    lua_getfield(L, -1, "log_queue_limit");
+    if (lua_isnumber(L, -1)) {
+        g3::setLogQueueLimit(static_cast<size_t>(lua_tointeger(L, -1)));
+    }
+    lua_pop(L, 1);
     lua_getfield(L, -1, "app_type");
 
     int app_type = static_cast<int>(lua_tonumber(L, -1));
@@ -78,8 +158,20 @@ int main(int argc, char* argv[])
         lua_getfield(L, -1, "port");
         int port = (int)lua_tonumber(L, -1);
         lua_pop(L, 1);
+        lua_getfield(L, -1, "tick_rate");
+        int tick_rate = (int)lua_tonumber(L, -1);
+        lua_pop(L, 1);
+        lua_getfield(L, -1, "route_port");
+        int route_port = (int)lua_tonumber(L, -1);
+        lua_pop(L, 1);
+        lua_getfield(L, -1, "route_id");
+        uint32_t route_id = static_cast<uint32_t>(lua_tointeger(L, -1));
+        lua_pop(L, 1);
 
         printf("app type = %d, ip = %s, port = %d\n", app_type, ip.c_str(), port);
+        std::unique_ptr<server> admin = start_admin(L, ip);
+        server s(ip.c_str(), port, 10);
+        set_send_budget(L, s);
 
         const char* main_lua = "./script/game/main.lua";
         if (luaL_loadfile(L, main_lua) || lua_pcall(L,0,0,0)) {
@@ -87,15 +179,42 @@ int main(int argc, char* argv[])
             return 1;
         }
 
-        server s(ip.c_str(), port, 10);
+        lua_lock.unlock();
+
+        if (tick_rate > 0) {
+            net_manager::start_tick(tick_rate);
+        }
 
-        s.set_init_handlers([](std::shared_ptr<session> session){
+        // with a tick the body is queued and only unpacked on the logic thread
+        std::shared_ptr<pbc_registry> registry = net_manager::get_pbc_registry();
+        bool decode_body = tick_rate <= 0;
+        s.set_init_handlers([registry, decode_body](std::shared_ptr<session> session){
             session->add_handler("decoder", std::make_shared<length_field_base_frame_decoder>(1024, 0, 2, 0, 2))
+                ->add_handler("codec", std::make_shared<pbc_codec>(registry, 2, true, decode_body))
                 ->add_handler("server_handler", std::make_shared<handler>());
         });
+        net_manager::set_broadcast_handler([&s](const std::vector<uint32_t>& session_ids,
+                    std::shared_ptr<const data_block> payload){
+            return s.broadcast(session_ids, payload);
+        });
+
+        // the links of a route, each client behind them a virtual session
+        std::unique_ptr<server> links;
+        if (route_port > 0) {
+            printf("route links ip = %s, port = %d, route id = %u\n", ip.c_str(), route_port, route_id);
+            links.reset(new server(ip.c_str(), route_port, 2));
+            links->set_init_handlers([registry, decode_body, route_id](std::shared_ptr<session> session){
+                session->add_handler("route", std::make_shared<route_backend_handler>(kMaxRouteFrameLength,
+                            route_id, registry, decode_body, [](pipeline& client){
+                                client.add_handler("server_handler", std::make_shared<handler>());
+                            }));
+            });
+            links->run();
+        }
 
         s.run();
 
+        lua_lock.lock();
         lua_getglobal(L, "test_write_message");
         lua_pushinteger(L, 1);
         lua_pushstring(L, "123456");
@@ -103,10 +222,86 @@ int main(int argc, char* argv[])
         if (lua_pcall(L, 2, 0, 0) != 0) {
             luaL_error(L, "test_write_message error! %s \n", lua_tostring(L, -1));
         }
+        lua_lock.unlock();
+
+        getchar();
+
+        s.stop();
+        if (links) {
+            links->stop();
+        }
+        if (admin) {
+            admin->stop();
+        }
+        net_manager::set_broadcast_handler(nullptr);
+    } else if (app_type == static_cast<int>(engine::AppType::ROUTE)) {
+        lua_pop(L, 1);
+        lua_getfield(L, -1, "ip");
+        if (!lua_isstring(L, -1)) {
+            luaL_error(L, "loadfile error! %s \n", lua_tostring(L, -1));
+            return 1;
+        }
+        std::string ip = lua_tostring(L, -1);
+        lua_pop(L, 1);
+        lua_getfield(L, -1, "port");
+        int port = (int)lua_tonumber(L, -1);
+        lua_pop(L, 1);
+
+        printf("app type = %d, ip = %s, port = %d\n", app_type, ip.c_str(), port);
+        std::unique_ptr<server> admin = start_admin(L, ip);
+
+        server s(ip.c_str(), port, 4);
+        router r(2);
+
+        // client frames go to the backend named in the header, answers come
+        // back on the links addressed to a client session
+        s.set_init_handlers([&r](std::shared_ptr<session> session){
+            session->add_handler("route", std::make_shared<route_handler>(kMaxRouteFrameLength,
+                        [&r](context*, uint32_t destination, uint32_t source,
+                            std::shared_ptr<data_block> frame){
+                            r.forward(destination, source, frame);
+                        }, true));
+        });
+        r.set_init_handlers([&s](std::shared_ptr<session> session){
+            session->add_handler("route", std::make_shared<route_handler>(kMaxRouteFrameLength,
+                        [&s](context*, uint32_t destination, uint32_t,
+                            std::shared_ptr<data_block> frame){
+                            s.write_shared(destination, frame);
+                        }, false));
+        });
+
+        lua_getfield(L, -1, "backends");
+        if (lua_istable(L, -1)) {
+            lua_Integer count = luaL_len(L, -1);
+            for (lua_Integer i = 1; i <= count; ++i) {
+                lua_rawgeti(L, -1, i);
+                lua_getfield(L, -1, "id");
+                lua_getfield(L, -2, "ip");
+                lua_getfield(L, -3, "port");
+                lua_getfield(L, -4, "links");
+                uint32_t id = static_cast<uint32_t>(lua_tointeger(L, -4));
+                std::string backend_ip = lua_tostring(L, -3);
+                int backend_port = (int)lua_tonumber(L, -2);
+                std::size_t links = lua_isnumber(L, -1) ? (std::size_t)lua_tointeger(L, -1) : 2;
+                lua_pop(L, 5);
+                printf("route backend id = %u, ip = %s, port = %d, links = %zu\n",
+                        id, backend_ip.c_str(), backend_port, links);
+                r.add_backend(id, backend_ip, backend_port, links);
+            }
+        }
+        lua_pop(L, 1);
+        lua_lock.unlock();
+
+        r.run();
+        s.run();
 
         getchar();
 
         s.stop();
+        r.stop();
+        if (admin) {
+            admin->stop();
+        }
     }
 
     net_manager::close();
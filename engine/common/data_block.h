@@ -3,6 +3,7 @@
 
 #include <cstddef>
 #include <cstring>
+#include <memory>
 
 namespace engine
 {
@@ -25,7 +26,7 @@ struct data_block
     data_block(const char* block, std::size_t block_len)
         : is_owner(true)
     {
-        data    = new char[len];
+        data    = new char[block_len];
         memcpy(data, block, block_len);
         len     = block_len;
     }
@@ -92,6 +93,13 @@ struct write_data
     {}
 };
 
+// a whole frame the session may drop while it is over its high water
+// mask, e.g. a position update that a newer one replaces
+struct droppable_data
+{
+    std::shared_ptr<data_block> block;
+};
+
 } // namespace engine
 
 #endif // ENGINE_COMMON_DATA_BLOCK_H
@@ -0,0 +1,652 @@
+#ifndef ENGINE_COMMON_LOGGER_H
+#define ENGINE_COMMON_LOGGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <third_party/g3log/g3log/logmessage.hpp>
+#include <engine/common/metrics.h>
+
+// calls below this level compile to a constant false test, 100 DEBUG,
+// 300 INFO, 500 WARNING, 1000 FATAL
+#ifndef JOKER_LOG_MIN_LEVEL
+#define JOKER_LOG_MIN_LEVEL 0
+#endif
+
+#define JOKER_LOG_ON(level)                                             \
+    (engine::logger::k##level >= JOKER_LOG_MIN_LEVEL                    \
+        && engine::logger::enabled(engine::logger::k##level))
+
+// LOGF behind the compile time and runtime level, a filtered call formats
+// nothing
+#define JOKER_LOGF(level, printf_like_message, ...)                     \
+    if (!JOKER_LOG_ON(level)) {} else LOGF(level, printf_like_message, ##__VA_ARGS__)
+
+// keeps the format pointer and the raw arguments on the calling thread,
+// the log thread formats them. the format must be a string literal
+#define JOKER_LOGF_DEFERRED(level, printf_like_message, ...)            \
+    if (!JOKER_LOG_ON(level)) {} else engine::logger::deferred(level,   \
+            __FILE__, __LINE__, __PRETTY_FUNCTION__, printf_like_message, ##__VA_ARGS__)
+
+// the state of one call site, a function static of a lambda unique to it
+#define JOKER_LOG_SITE(type, arg)                                       \
+    ([]() -> type& { static type site(arg); return site; }())
+
+// deferred, at most per_second lines a second from this call site. the
+// first line after some were suppressed is followed by their count
+#define JOKER_LOGF_RATE(level, per_second, printf_like_message, ...)    \
+    if (!JOKER_LOG_ON(level)) {} else if (uint64_t joker_passed_ =       \
+            JOKER_LOG_SITE(engine::logger::rate_limit, per_second).pass()) { \
+        engine::logger::deferred(level, __FILE__, __LINE__, __PRETTY_FUNCTION__, \
+                printf_like_message, ##__VA_ARGS__);                    \
+        if (joker_passed_ > 1) {                                        \
+            engine::logger::deferred(level, __FILE__, __LINE__, __PRETTY_FUNCTION__, \
+                    "suppressed %llu lines of this site before the last one", \
+                    static_cast<unsigned long long>(joker_passed_ - 1)); \
+        }                                                               \
+    } else {}
+
+// deferred, the first call of this site and then one in every
+#define JOKER_LOGF_EVERY_N(level, every, printf_like_message, ...)      \
+    if (!JOKER_LOG_ON(level)) {} else if (                              \
+            JOKER_LOG_SITE(engine::logger::sampler, every).pass()) {    \
+        engine::logger::deferred(level, __FILE__, __LINE__, __PRETTY_FUNCTION__, \
+                printf_like_message, ##__VA_ARGS__);                    \
+    } else {}
+
+namespace engine
+{
+
+/**
+ * a level filter in front of g3log and a deferred, binary log mode.
+ *
+ * a deferred call copies its arguments into a record of a single producer
+ * ring owned by the calling thread, without a lock or an allocation. the
+ * log thread drains every ring each kDrainInterval, formats the records
+ * and hands the text to g3log. strings are copied up to kTextBytes, every
+ * other argument is kept as a number or a pointer. a full ring drops the
+ * record and counts it in joker_log_dropped_total. a record keeps the time
+ * and thread of the call, not those of the drain.
+ *
+ * records of one thread keep their order, deferred and plain LOGF records
+ * of different calls may interleave differently than they were made.
+ * FATAL and every call made while the log thread is not running are
+ * formatted on the calling thread.
+ *
+ * a call site that may fire for every session at once, e.g. a read error
+ * when the network drops, is rate limited or sampled per site. the g3log
+ * queues behind are bounded by g3::setLogQueueLimit
+ */
+class logger
+{
+public:
+    static const int kDEBUG     = g3::kDebugValue;
+    static const int kINFO      = g3::kInfoValue;
+    static const int kWARNING   = g3::kWarningValue;
+    static const int kFATAL     = g3::kFatalValue;
+
+    static const uint32_t kRingRecords  = 1024;     // per thread, a power of two
+    static const uint32_t kMaxArgs      = 8;
+    static const uint32_t kTextBytes    = 128;      // per record, all strings
+    static const uint32_t kDrainInterval = 5;       // ms
+    static const uint32_t kLinesPerSecond = 10;     // a rate limited site by default
+
+    // lets at most per_second calls of a site through in each second
+    class rate_limit
+    {
+    public:
+        rate_limit(const rate_limit&) = delete;
+        rate_limit& operator=(const rate_limit&) = delete;
+        explicit rate_limit(uint32_t per_second)
+            : per_second_(per_second)
+            , second_(0)
+            , count_(0)
+            , suppressed_(0)
+        {
+        }
+
+        // 0 for a suppressed call, else 1 + the calls suppressed since the
+        // last one that passed
+        uint64_t pass()
+        {
+            int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+            int64_t second = second_.load(std::memory_order_relaxed);
+            if (now != second && second_.compare_exchange_strong(second, now,
+                        std::memory_order_relaxed)) {
+                count_.store(0, std::memory_order_relaxed);
+            }
+            if (count_.fetch_add(1, std::memory_order_relaxed) >= per_second_) {
+                suppressed_.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+            }
+            return 1 + suppressed_.exchange(0, std::memory_order_relaxed);
+        }
+
+    private:
+        uint32_t                per_second_;
+        std::atomic<int64_t>    second_;
+        std::atomic<uint32_t>   count_;
+        std::atomic<uint64_t>   suppressed_;
+    }; // class rate_limit
+
+    // lets the first call of a site through and then one in every
+    class sampler
+    {
+    public:
+        sampler(const sampler&) = delete;
+        sampler& operator=(const sampler&) = delete;
+        explicit sampler(uint32_t every)
+            : every_(every == 0 ? 1 : every)
+            , count_(0)
+        {
+        }
+
+        bool pass()
+        {
+            return count_.fetch_add(1, std::memory_order_relaxed) % every_ == 0;
+        }
+
+    private:
+        uint64_t                every_;
+        std::atomic<uint64_t>   count_;
+    }; // class sampler
+
+    // the lowest level that is logged
+    static void set_level(int level)
+    {
+        min_level().store(level, std::memory_order_relaxed);
+    }
+
+    static int level()
+    {
+        return min_level().load(std::memory_order_relaxed);
+    }
+
+    static bool enabled(int level)
+    {
+        return level >= min_level().load(std::memory_order_relaxed);
+    }
+
+    // starts the log thread, call after g3log is initialized
+    static void start()
+    {
+        state& s = get_state();
+        std::lock_guard<std::mutex> guard(s.mutex);
+        if (s.thread) {
+            return;
+        }
+        s.running = true;
+        static uint32_t collector = metrics::add_collector("joker_log_queue_dropped",
+                "log messages dropped on full g3log queues",
+                [](std::vector<metrics::sample>& samples){
+                    samples.push_back(metrics::sample{"",
+                            static_cast<double>(g3::droppedLogMessages())});
+                });
+        (void)collector;
+        s.thread.reset(new std::thread([](){
+            metrics::set_thread_name("log_thread");
+            state& s = get_state();
+            while (s.running.load(std::memory_order_acquire)) {
+                drain();
+                std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int>(kDrainInterval)));
+            }
+        }));
+    }
+
+    // formats what the rings hold now on the calling thread
+    static void flush()
+    {
+        drain();
+    }
+
+    // deferred records dropped on a full ring so far
+    static uint64_t dropped()
+    {
+        return get_dropped().value();
+    }
+
+    // formats what is left in the rings, call before g3log shuts down. a
+    // call that still saw the log thread running drains its own record
+    // if it lands after the last drain here
+    static void stop()
+    {
+        state& s = get_state();
+        std::unique_ptr<std::thread> thread;
+        {
+            std::lock_guard<std::mutex> guard(s.mutex);
+            s.running = false;
+            thread = std::move(s.thread);
+        }
+        if (thread) {
+            thread->join();
+        }
+        drain();
+    }
+
+    template<typename... Args>
+    static void deferred(const LEVELS& level, const char* file, int line,
+            const char* function, const char* format, const Args&... args)
+    {
+        static_assert(sizeof...(Args) <= kMaxArgs, "too many arguments for a deferred log");
+        if (level.value >= kFATAL || !get_state().running.load(std::memory_order_relaxed)) {
+            record r;
+            fill(r, level, file, line, function, format, args...);
+            emit(r);
+            return;
+        }
+
+        ring* owner = local_ring();
+        uint32_t head = owner->head.load(std::memory_order_relaxed);
+        if (head - owner->tail.load(std::memory_order_acquire) == kRingRecords) {
+            get_dropped().add();
+            return;
+        }
+        fill(owner->records[head & (kRingRecords - 1)], level, file, line, function,
+                format, args...);
+        // sequentially consistent with the flag stop() clears and the head
+        // its drain reads: either that drain sees the record or this call
+        // sees the flag cleared
+        owner->head.store(head + 1, std::memory_order_seq_cst);
+        if (!get_state().running.load(std::memory_order_seq_cst)) {
+            drain();
+        }
+    }
+
+private:
+    enum class arg_type : uint8_t
+    {
+        SIGNED,
+        UNSIGNED,
+        DOUBLE,
+        POINTER,
+        TEXT,       // value.text is the offset in record::text
+    }; // enum class arg_type
+
+    struct arg
+    {
+        arg_type                type;
+        union
+        {
+            long long           i;
+            unsigned long long  u;
+            double              d;
+            const void*         p;
+            uint32_t            text;
+        } value;
+    }; // struct arg
+
+    struct record
+    {
+        const LEVELS*                   level;
+        const char*                     file;
+        const char*                     function;
+        const char*                     format;
+        int                             line;
+        g3::high_resolution_time_point  time;
+        std::thread::id                 thread;
+        uint32_t                        count;
+        uint32_t                        text_used;
+        arg                             args[kMaxArgs];
+        char                            text[kTextBytes];
+    }; // struct record
+
+    // one producer, the thread that owns it, and one consumer, the log thread
+    struct ring
+    {
+        ring()
+            : head(0)
+            , tail(0)
+            , records(kRingRecords)
+            , in_use(true)
+        {
+        }
+
+        std::atomic<uint32_t>   head;
+        std::atomic<uint32_t>   tail;
+        std::vector<record>     records;
+        bool                    in_use;
+    }; // struct ring
+
+    struct state
+    {
+        std::mutex                          mutex;      // guards rings and thread
+        std::vector<std::unique_ptr<ring>>  rings;
+        std::unique_ptr<std::thread>        thread;
+        std::atomic_bool                    running{false};
+    }; // struct state
+
+    // gives the ring back when its thread exits, what is left in it is
+    // still drained
+    struct ring_owner
+    {
+        ring_owner()
+            : owned(acquire())
+        {
+        }
+
+        ~ring_owner()
+        {
+            state& s = get_state();
+            std::lock_guard<std::mutex> guard(s.mutex);
+            owned->in_use = false;
+        }
+
+        ring* owned;
+    }; // struct ring_owner
+
+    static std::atomic<int>& min_level()
+    {
+        static std::atomic<int> level(0);
+        return level;
+    }
+
+    // never destroyed, threads may log during static destruction
+    static state& get_state()
+    {
+        static state* s = new state;
+        return *s;
+    }
+
+    static const metrics::counter& get_dropped()
+    {
+        static metrics::counter dropped("joker_log_dropped_total",
+                "deferred log records dropped on a full ring");
+        return dropped;
+    }
+
+    static ring* local_ring()
+    {
+        static thread_local ring_owner owner;
+        return owner.owned;
+    }
+
+    static ring* acquire()
+    {
+        state& s = get_state();
+        std::lock_guard<std::mutex> guard(s.mutex);
+        for (auto& r : s.rings) {
+            if (!r->in_use) {
+                r->in_use = true;
+                return r.get();
+            }
+        }
+        s.rings.emplace_back(new ring);
+        return s.rings.back().get();
+    }
+
+    template<typename... Args>
+    static void fill(record& r, const LEVELS& level, const char* file, int line,
+            const char* function, const char* format, const Args&... args)
+    {
+        r.level     = &level;
+        r.file      = file;
+        r.line      = line;
+        r.function  = function;
+        r.format    = format;
+        r.time      = std::chrono::high_resolution_clock::now();
+        r.thread    = std::this_thread::get_id();
+        r.count     = 0;
+        r.text_used = 0;
+        put(r, args...);
+    }
+
+    static void put(record& r)
+    {
+    }
+
+    template<typename T, typename... Rest>
+    static void put(record& r, const T& value, const Rest&... rest)
+    {
+        encode(r.args[r.count++], r, value);
+        put(r, rest...);
+    }
+
+    template<typename T>
+    static typename std::enable_if<(std::is_integral<T>::value && std::is_signed<T>::value)
+        || std::is_enum<T>::value>::type
+    encode(arg& a, record&, const T& value)
+    {
+        a.type      = arg_type::SIGNED;
+        a.value.i   = static_cast<long long>(value);
+    }
+
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+    encode(arg& a, record&, const T& value)
+    {
+        a.type      = arg_type::UNSIGNED;
+        a.value.u   = static_cast<unsigned long long>(value);
+    }
+
+    template<typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    encode(arg& a, record&, const T& value)
+    {
+        a.type      = arg_type::DOUBLE;
+        a.value.d   = static_cast<double>(value);
+    }
+
+    template<typename T>
+    static void encode(arg& a, record&, T* const& value)
+    {
+        a.type      = arg_type::POINTER;
+        a.value.p   = value;
+    }
+
+    static void encode(arg& a, record& r, const char* const& value)
+    {
+        copy_text(a, r, value ? value : "(null)", value ? strlen(value) : 6);
+    }
+
+    static void encode(arg& a, record& r, char* const& value)
+    {
+        encode(a, r, const_cast<const char* const&>(value));
+    }
+
+    template<std::size_t N>
+    static void encode(arg& a, record& r, const char (&value)[N])
+    {
+        copy_text(a, r, value, strlen(value));
+    }
+
+    static void encode(arg& a, record& r, const std::string& value)
+    {
+        copy_text(a, r, value.data(), value.size());
+    }
+
+    // what does not fit in the record is cut
+    static void copy_text(arg& a, record& r, const char* data, std::size_t len)
+    {
+        std::size_t room = kTextBytes - r.text_used;
+        if (room == 0) {
+            a.type          = arg_type::TEXT;
+            a.value.text    = kTextBytes - 1;   // the last nul of a full record
+            return;
+        }
+        len = std::min(len, room - 1);
+        memcpy(r.text + r.text_used, data, len);
+        r.text[r.text_used + len] = '\0';
+        a.type          = arg_type::TEXT;
+        a.value.text    = r.text_used;
+        r.text_used     += static_cast<uint32_t>(len + 1);
+    }
+
+    // log thread, and the stop after it
+    static void drain()
+    {
+        state& s = get_state();
+        std::lock_guard<std::mutex> guard(s.mutex);
+        for (auto& owner : s.rings) {
+            uint32_t tail = owner->tail.load(std::memory_order_relaxed);
+            uint32_t head = owner->head.load(std::memory_order_seq_cst);
+            for (; tail != head; ++tail) {
+                emit(owner->records[tail & (kRingRecords - 1)]);
+                owner->tail.store(tail + 1, std::memory_order_release);
+            }
+        }
+    }
+
+    // a FATAL record never waits in a ring, it goes through LogCapture for
+    // the fatal handling
+    static void emit(const record& r)
+    {
+        std::string text = format(r);
+        if (r.level->value >= kFATAL) {
+            LogCapture(r.file, r.line, r.function, *r.level).capturef("%s", text.c_str());
+            return;
+        }
+        std::unique_ptr<g3::LogMessage> message(new g3::LogMessage(r.file, r.line, r.function, *r.level));
+        message->_timestamp         = r.time;
+        message->_call_thread_id    = r.thread;
+        message->write().append(text);
+        g3::internal::pushMessageToLogger(g3::LogMessagePtr(std::move(message)));
+    }
+
+    // printf of the record, each conversion takes the next argument as the
+    // type it was recorded with, length modifiers of the format are ignored
+    static std::string format(const record& r)
+    {
+        std::string out;
+        uint32_t next = 0;
+        auto take = [&r, &next]() -> const arg* {
+            return next < r.count ? &r.args[next++] : nullptr;
+        };
+
+        for (const char* p = r.format; *p; ++p) {
+            if (*p != '%') {
+                out += *p;
+                continue;
+            }
+            if (p[1] == '%') {
+                out += '%';
+                ++p;
+                continue;
+            }
+
+            std::string spec = "%";
+            const char* q = p + 1;
+            for (; *q && strchr("-+ #0123456789.*", *q); ++q) {
+                if (*q == '*') {
+                    const arg* width = take();
+                    spec += std::to_string(width ? as_signed(*width) : 0);
+                } else {
+                    spec += *q;
+                }
+            }
+            while (*q && strchr("hlLqjzt", *q)) {
+                ++q;
+            }
+            if (!*q) {
+                break;
+            }
+            p = q;
+
+            const arg* a = take();
+            if (!a) {
+                out += "(missing)";
+                continue;
+            }
+            switch (*q) {
+                case 'd':
+                case 'i':
+                    append(out, (spec + "ll" + *q).c_str(), as_signed(*a));
+                    break;
+                case 'u':
+                case 'o':
+                case 'x':
+                case 'X':
+                    append(out, (spec + "ll" + *q).c_str(), as_unsigned(*a));
+                    break;
+                case 'c':
+                    append(out, (spec + *q).c_str(), static_cast<int>(as_signed(*a)));
+                    break;
+                case 'f':
+                case 'F':
+                case 'e':
+                case 'E':
+                case 'g':
+                case 'G':
+                case 'a':
+                case 'A':
+                    append(out, (spec + *q).c_str(), as_double(*a));
+                    break;
+                case 's':
+                    append(out, (spec + *q).c_str(),
+                            a->type == arg_type::TEXT ? r.text + a->value.text : "(?)");
+                    break;
+                case 'p':
+                    append(out, (spec + *q).c_str(),
+                            a->type == arg_type::POINTER ? a->value.p : nullptr);
+                    break;
+                default:
+                    out += "(?)";
+                    break;
+            }
+        }
+        return out;
+    }
+
+    template<typename T>
+    static void append(std::string& out, const char* spec, T value)
+    {
+        char piece[256];
+        int len = snprintf(piece, sizeof piece, spec, value);
+        if (len < 0) {
+            return;
+        }
+        if (static_cast<std::size_t>(len) < sizeof piece) {
+            out.append(piece, len);
+            return;
+        }
+        std::vector<char> large(len + 1);
+        snprintf(large.data(), large.size(), spec, value);
+        out.append(large.data(), len);
+    }
+
+    static long long as_signed(const arg& a)
+    {
+        switch (a.type) {
+            case arg_type::SIGNED:      return a.value.i;
+            case arg_type::UNSIGNED:    return static_cast<long long>(a.value.u);
+            case arg_type::DOUBLE:      return static_cast<long long>(a.value.d);
+            default:                    return 0;
+        }
+    }
+
+    static unsigned long long as_unsigned(const arg& a)
+    {
+        switch (a.type) {
+            case arg_type::SIGNED:      return static_cast<unsigned long long>(a.value.i);
+            case arg_type::UNSIGNED:    return a.value.u;
+            case arg_type::DOUBLE:      return static_cast<unsigned long long>(a.value.d);
+            case arg_type::POINTER:     return reinterpret_cast<uintptr_t>(a.value.p);
+            default:                    return 0;
+        }
+    }
+
+    static double as_double(const arg& a)
+    {
+        switch (a.type) {
+            case arg_type::SIGNED:      return static_cast<double>(a.value.i);
+            case arg_type::UNSIGNED:    return static_cast<double>(a.value.u);
+            case arg_type::DOUBLE:      return a.value.d;
+            default:                    return 0;
+        }
+    }
+}; // class logger
+
+} // namespace engine
+
+#endif // ENGINE_COMMON_LOGGER_H
@@ -0,0 +1,475 @@
+#ifndef ENGINE_COMMON_METRICS_H
+#define ENGINE_COMMON_METRICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace engine
+{
+
+/**
+ * process wide counters, gauges and latency histograms in the prometheus
+ * text format.
+ *
+ * every thread updates its own shard of cells, an update is a relaxed load
+ * and store with no lock and no cache line shared with another thread. a
+ * scrape sums the cells of every shard. the same name and labels always
+ * map to the same cells, so handles can live in function statics of
+ * header only code.
+ *
+ * a gauge may go up on one thread and down on another, only its sum is
+ * meaningful. a per thread metric is exported once per thread with a
+ * thread label, use it for values that stay on one thread, e.g. bytes
+ * read on an io thread. the shard of an exited thread is kept and handed
+ * to the next new thread, counts are never lost
+ */
+class metrics
+{
+public:
+    static const uint32_t kCells            = 4096;     // per thread shard
+    static const uint32_t kSubBuckets       = 8;        // per power of two, 12.5% precision
+    static const uint32_t kMaxPower         = 40;       // 2^40 ns, about 18 minutes
+    static const uint32_t kHistogramBuckets = kSubBuckets * (kMaxPower - 2);
+    static const uint32_t kHistogramCells   = kHistogramBuckets + 2;   // buckets, count, sum
+
+    enum class kind
+    {
+        COUNTER     = 0,
+        GAUGE       = 1,
+        SUMMARY     = 2,    // a latency histogram, exported as quantiles
+    }; // enum class kind
+
+    class counter
+    {
+    public:
+        counter()
+            : cell_(0)
+        {
+        }
+
+        counter(const std::string& name, const std::string& help,
+                const std::string& labels = "", bool per_thread = false)
+            : cell_(metrics::allocate(name, help, labels, kind::COUNTER, per_thread, 1))
+        {
+        }
+
+        void add(uint64_t n = 1) const
+        {
+            metrics::add(cell_, n);
+        }
+
+        // summed over every thread, e.g. for a benchmark
+        uint64_t value() const
+        {
+            registry& r = get_registry();
+            std::lock_guard<std::mutex> guard(r.mutex);
+            return sum(r, cell_);
+        }
+    private:
+        uint32_t cell_;
+    }; // class counter
+
+    class gauge
+    {
+    public:
+        gauge()
+            : cell_(0)
+        {
+        }
+
+        gauge(const std::string& name, const std::string& help,
+                const std::string& labels = "", bool per_thread = false)
+            : cell_(metrics::allocate(name, help, labels, kind::GAUGE, per_thread, 1))
+        {
+        }
+
+        void add(int64_t n = 1) const
+        {
+            metrics::add(cell_, static_cast<uint64_t>(n));
+        }
+
+        void sub(int64_t n = 1) const
+        {
+            metrics::add(cell_, static_cast<uint64_t>(-n));
+        }
+    private:
+        uint32_t cell_;
+    }; // class gauge
+
+    // log linear buckets over nanoseconds, like an hdr histogram with one
+    // significant digit: kSubBuckets per power of two up to 2^kMaxPower
+    class histogram
+    {
+    public:
+        histogram()
+            : cell_(0)
+        {
+        }
+
+        histogram(const std::string& name, const std::string& help,
+                const std::string& labels = "")
+            : cell_(metrics::allocate(name, help, labels, kind::SUMMARY, false, kHistogramCells))
+        {
+        }
+
+        void record(uint64_t ns) const
+        {
+            if (cell_ == 0) {
+                return;
+            }
+            metrics::add(cell_ + bucket(ns), 1);
+            metrics::add(cell_ + kHistogramBuckets, 1);
+            metrics::add(cell_ + kHistogramBuckets + 1, ns);
+        }
+
+        void record_since(std::chrono::steady_clock::time_point start) const
+        {
+            record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - start).count()));
+        }
+
+        static uint32_t bucket(uint64_t ns)
+        {
+            if (ns < kSubBuckets) {
+                return static_cast<uint32_t>(ns);
+            }
+            uint32_t power = 63 - __builtin_clzll(ns);
+            if (power >= kMaxPower) {
+                return kHistogramBuckets - 1;
+            }
+            uint32_t sub = static_cast<uint32_t>(ns >> (power - 3)) & (kSubBuckets - 1);
+            return kSubBuckets + (power - 3) * kSubBuckets + sub;
+        }
+
+        // the middle of a bucket
+        static double value(uint32_t bucket)
+        {
+            if (bucket < kSubBuckets) {
+                return bucket;
+            }
+            uint32_t power = (bucket - kSubBuckets) / kSubBuckets + 3;
+            uint64_t sub = (bucket - kSubBuckets) % kSubBuckets;
+            uint64_t width = 1ULL << (power - 3);
+            return static_cast<double>((kSubBuckets + sub) * width) + width / 2.0;
+        }
+    private:
+        uint32_t cell_;
+    }; // class histogram
+
+    struct sample
+    {
+        std::string labels;
+        double      value;
+    }; // struct sample
+
+    typedef std::function<void(std::vector<sample>&)> collector;
+
+    // a gauge computed at scrape time, e.g. sessions per io thread. the
+    // callback runs on the scraping thread under the registry lock
+    static uint32_t add_collector(const std::string& name, const std::string& help,
+            const collector& callback)
+    {
+        registry& r = get_registry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        uint32_t id = ++r.next_collector_id;
+        r.collectors[id] = collector_entry{name, help, callback};
+        return id;
+    }
+
+    static void remove_collector(uint32_t id)
+    {
+        registry& r = get_registry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        r.collectors.erase(id);
+    }
+
+    // names the shard of the calling thread in per thread metrics
+    static void set_thread_name(const std::string& name)
+    {
+        shard* s = local_shard();
+        registry& r = get_registry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        s->name = name;
+    }
+
+    static std::string thread_name()
+    {
+        shard* s = local_shard();
+        registry& r = get_registry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        return s->name;
+    }
+
+    // prometheus text exposition format 0.0.4
+    static std::string scrape()
+    {
+        registry& r = get_registry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+
+        std::vector<family> families;
+        std::map<std::string, std::size_t> family_index;
+        auto find_family = [&](const std::string& name, const std::string& help,
+                const char* type)->family& {
+            auto it = family_index.find(name);
+            if (it == family_index.end()) {
+                family_index[name] = families.size();
+                families.push_back(family{name, help, type, {}});
+                return families.back();
+            }
+            return families[it->second];
+        };
+
+        for (const metric& m : r.metrics) {
+            const char* type = m.type == kind::COUNTER ? "counter"
+                : m.type == kind::GAUGE ? "gauge" : "summary";
+            family& f = find_family(m.name, m.help, type);
+            if (m.type == kind::SUMMARY) {
+                add_summary(r, m, f);
+            } else if (m.per_thread) {
+                // shards of threads sharing a name, e.g. the io pools of two
+                // servers, are one series. threads that never touched the
+                // metric have none
+                std::map<std::string, int64_t> per_name;
+                for (std::size_t i = 0; i < r.shards.size(); ++i) {
+                    int64_t value = static_cast<int64_t>(
+                            r.shards[i]->cells[m.cell].load(std::memory_order_relaxed));
+                    if (value != 0) {
+                        per_name[shard_name(r, i)] += value;
+                    }
+                }
+                for (auto& pair : per_name) {
+                    f.lines.push_back(line(m.name, join(m.labels, "thread=\"" + pair.first + "\""),
+                                static_cast<double>(pair.second)));
+                }
+            } else {
+                f.lines.push_back(line(m.name, m.labels, static_cast<double>(sum(r, m.cell))));
+            }
+        }
+
+        for (auto& pair : r.collectors) {
+            const collector_entry& c = pair.second;
+            family& f = find_family(c.name, c.help, "gauge");
+            std::vector<sample> samples;
+            c.callback(samples);
+            for (const sample& s : samples) {
+                f.lines.push_back(line(c.name, s.labels, s.value));
+            }
+        }
+
+        std::string text;
+        for (const family& f : families) {
+            text += "# HELP " + f.name + " " + f.help + "\n";
+            text += "# TYPE " + f.name + " " + f.type + "\n";
+            for (const std::string& l : f.lines) {
+                text += l;
+            }
+        }
+        return text;
+    }
+private:
+    struct shard
+    {
+        shard()
+            : in_use(true)
+        {
+            for (auto& cell : cells) {
+                cell.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        std::atomic<uint64_t>   cells[kCells];
+        std::string             name;       // under the registry lock
+        bool                    in_use;     // under the registry lock
+    }; // struct shard
+
+    struct metric
+    {
+        std::string name;
+        std::string help;
+        std::string labels;
+        kind        type;
+        bool        per_thread;
+        uint32_t    cell;
+    }; // struct metric
+
+    struct collector_entry
+    {
+        std::string name;
+        std::string help;
+        collector   callback;
+    }; // struct collector_entry
+
+    struct family
+    {
+        std::string                 name;
+        std::string                 help;
+        const char*                 type;
+        std::vector<std::string>    lines;
+    }; // struct family
+
+    struct registry
+    {
+        std::mutex                              mutex;
+        std::vector<metric>                     metrics;
+        std::vector<std::unique_ptr<shard>>     shards;
+        std::map<uint32_t, collector_entry>     collectors;
+        uint32_t                                next_cell = 1;  // cell 0 takes what did not fit
+        uint32_t                                next_collector_id = 0;
+    }; // struct registry
+
+    // gives the shard back for the next thread when its thread exits
+    struct shard_owner
+    {
+        shard_owner()
+            : owned(acquire())
+        {
+        }
+
+        ~shard_owner()
+        {
+            registry& r = get_registry();
+            std::lock_guard<std::mutex> guard(r.mutex);
+            owned->in_use = false;
+        }
+
+        shard* owned;
+    }; // struct shard_owner
+
+    // never destroyed, threads may still count during static destruction
+    static registry& get_registry()
+    {
+        static registry* r = new registry;
+        return *r;
+    }
+
+    static shard* local_shard()
+    {
+        static thread_local shard_owner owner;
+        return owner.owned;
+    }
+
+    static shard* acquire()
+    {
+        registry& r = get_registry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        for (auto& s : r.shards) {
+            if (!s->in_use) {
+                s->in_use = true;
+                s->name.clear();
+                return s.get();
+            }
+        }
+        r.shards.emplace_back(new shard);
+        return r.shards.back().get();
+    }
+
+    static void add(uint32_t cell, uint64_t n)
+    {
+        std::atomic<uint64_t>& c = local_shard()->cells[cell];
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    static uint32_t allocate(const std::string& name, const std::string& help,
+            const std::string& labels, kind type, bool per_thread, uint32_t cells)
+    {
+        registry& r = get_registry();
+        std::lock_guard<std::mutex> guard(r.mutex);
+        for (const metric& m : r.metrics) {
+            if (m.name == name && m.labels == labels) {
+                return m.cell;
+            }
+        }
+        if (r.next_cell + cells > kCells) {
+            fprintf(stderr, "metrics: no cells left for %s{%s}\n", name.c_str(), labels.c_str());
+            return 0;
+        }
+        r.metrics.push_back(metric{name, help, labels, type, per_thread, r.next_cell});
+        r.next_cell += cells;
+        return r.metrics.back().cell;
+    }
+
+    static uint64_t sum(const registry& r, uint32_t cell)
+    {
+        uint64_t total = 0;
+        for (auto& s : r.shards) {
+            total += s->cells[cell].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    static std::string shard_name(const registry& r, std::size_t index)
+    {
+        if (!r.shards[index]->name.empty()) {
+            return r.shards[index]->name;
+        }
+        return "thread_" + std::to_string(index);
+    }
+
+    static std::string join(const std::string& labels, const std::string& more)
+    {
+        if (labels.empty()) {
+            return more;
+        }
+        return more.empty() ? labels : labels + "," + more;
+    }
+
+    static std::string line(const std::string& name, const std::string& labels, double value)
+    {
+        char number[32];
+        if (value == static_cast<double>(static_cast<int64_t>(value))) {
+            snprintf(number, sizeof number, "%lld", static_cast<long long>(value));
+        } else {
+            snprintf(number, sizeof number, "%.9g", value);
+        }
+        if (labels.empty()) {
+            return name + " " + number + "\n";
+        }
+        return name + "{" + labels + "} " + number + "\n";
+    }
+
+    // quantiles, sum and count in seconds, from the buckets of every shard
+    static void add_summary(const registry& r, const metric& m, family& f)
+    {
+        if (m.cell == 0) {
+            return;
+        }
+        std::vector<uint64_t> buckets(kHistogramBuckets);
+        for (uint32_t i = 0; i < kHistogramBuckets; ++i) {
+            buckets[i] = sum(r, m.cell + i);
+        }
+        uint64_t count = sum(r, m.cell + kHistogramBuckets);
+        uint64_t total_ns = sum(r, m.cell + kHistogramBuckets + 1);
+
+        const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+        for (double q : quantiles) {
+            double value = 0;
+            uint64_t rank = static_cast<uint64_t>(q * count);
+            uint64_t seen = 0;
+            for (uint32_t i = 0; i < kHistogramBuckets && count > 0; ++i) {
+                seen += buckets[i];
+                if (seen > rank) {
+                    value = histogram::value(i);
+                    break;
+                }
+            }
+            char quantile[32];
+            snprintf(quantile, sizeof quantile, "quantile=\"%g\"", q);
+            f.lines.push_back(line(m.name, join(m.labels, quantile), value / 1e9));
+        }
+        f.lines.push_back(line(m.name + "_sum", m.labels, total_ns / 1e9));
+        f.lines.push_back(line(m.name + "_count", m.labels, static_cast<double>(count)));
+    }
+}; // class metrics
+
+} // namespace engine
+
+#endif // ENGINE_COMMON_METRICS_H
@@ -0,0 +1,81 @@
+#ifndef ENGINE_COMMON_MPSC_QUEUE_H
+#define ENGINE_COMMON_MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+namespace engine
+{
+
+// intrusive multi producer single consumer queue (Dmitry Vyukov).
+// push is wait free and may be called from any thread, pop must only be
+// called from the single consumer thread
+template<typename T>
+class mpsc_queue
+{
+public:
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+    mpsc_queue()
+        : head_(new node())
+    {
+        tail_ = head_.load(std::memory_order_relaxed);
+    }
+
+    ~mpsc_queue()
+    {
+        T value;
+        while (pop(value)) {
+        }
+        delete tail_;
+    }
+
+    void push(T value)
+    {
+        node* n = new node(std::move(value));
+        node* prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    bool pop(T& value)
+    {
+        node* tail = tail_;
+        node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        value = std::move(next->value);
+        tail_ = next;
+        delete tail;
+        return true;
+    }
+
+    // only meaningful on the consumer thread
+    bool empty() const
+    {
+        return tail_->next.load(std::memory_order_acquire) == nullptr;
+    }
+private:
+    struct node
+    {
+        std::atomic<node*>  next;
+        T                   value;
+        node()
+            : next(nullptr)
+        {
+        }
+
+        explicit node(T&& v)
+            : next(nullptr)
+            , value(std::move(v))
+        {
+        }
+    }; // struct node
+
+    std::atomic<node*>  head_;
+    node*               tail_;
+}; // class mpsc_queue
+
+} // namespace engine
+
+#endif // ENGINE_COMMON_MPSC_QUEUE_H
@@ -4,6 +4,7 @@
 #include <cassert>
 #include <functional>
 #include <type_traits>
+#include <utility>
 
 namespace engine
 {
@@ -115,25 +116,105 @@ private:
     rel_type    release_;
 }; // class raii_var
 
+/**
+ * a raii that keeps its release callable inline, no std::function and no
+ * allocation, so a guard is as cheap as the call it makes. converts to a
+ * raii where the type has to be erased
+ */
+template<typename F>
+class scope_guard
+{
+public:
+    explicit scope_guard(F release, bool default_com = true) noexcept
+        : release_(std::move(release))
+        , commit_(default_com)
+    {
+    }
+
+    ~scope_guard() noexcept
+    {
+        if (commit_) {
+            release_();
+        }
+    }
+
+    scope_guard(scope_guard&& rv) noexcept
+        : release_(std::move(rv.release_))
+        , commit_(rv.commit_)
+    {
+        rv.commit_ = false;
+    }
+
+    scope_guard(const scope_guard&) = delete;
+    scope_guard& operator=(const scope_guard&) = delete;
+
+    scope_guard& commit(bool c = true) noexcept
+    {
+        commit_ = c;
+        return *this;
+    }
+
+    // hands the release over to a raii
+    operator raii() noexcept
+    {
+        bool c = commit_;
+        commit_ = false;
+        return raii(release_, [] {}, c);
+    }
+private:
+    F       release_;
+    bool    commit_;
+}; // class scope_guard
+
+// calls a member function of a resource, what make_raii keeps in its guard
+template<typename RES, typename M_FUN>
+struct member_call
+{
+    void operator()() const
+    {
+        (res->*fun)();
+    }
+
+    RES*    res;
+    M_FUN   fun;
+}; // struct member_call
+
+template<typename RES, typename M_REL>
+using member_raii = scope_guard<member_call<typename no_const<RES>::type, M_REL>>;
+
+template<typename F>
+scope_guard<F> make_scope_guard(F release, bool default_com = true) noexcept
+{
+    return scope_guard<F>(std::move(release), default_com);
+}
+
+template<typename F, typename A>
+scope_guard<F> make_scope_guard(F release, A acquire, bool default_com = true) noexcept
+{
+    acquire();
+    return scope_guard<F>(std::move(release), default_com);
+}
+
 template<typename RES, typename M_REL, typename M_ACQ>
-raii make_raii(RES& res, M_REL rel, M_ACQ acq, bool default_com = true) noexcept
+member_raii<RES, M_REL> make_raii(RES& res, M_REL rel, M_ACQ acq, bool default_com = true) noexcept
 {
     static_assert(std::is_class<RES>::value, "RES is not a class or struct type.");
     static_assert(std::is_member_function_pointer<M_REL>::value, "M_REL is not a member function.");
     static_assert(std::is_member_function_pointer<M_ACQ>::value, "M_ACQ is not a member function.");
     assert(nullptr != rel && nullptr != acq);
     auto p_res = std::addressof(const_cast<typename no_const<RES>::type&>(res));
-    return raii(std::bind(rel, p_res), std::bind(acq, p_res), default_com);
+    (p_res->*acq)();
+    return member_raii<RES, M_REL>({p_res, rel}, default_com);
 }
 
 template<typename RES, typename M_REL>
-raii make_raii(RES& res, M_REL rel, bool default_com = true) noexcept
+member_raii<RES, M_REL> make_raii(RES& res, M_REL rel, bool default_com = true) noexcept
 {
     static_assert(std::is_class<RES>::value, "RES is not a class or struct type.");
     static_assert(std::is_member_function_pointer<M_REL>::value, "M_REL is not a member function.");
     assert(nullptr != rel);
     auto p_res = std::addressof(const_cast<typename no_const<RES>::type&>(res));
-    return raii(std::bind(rel, p_res), [] {}, default_com);
+    return member_raii<RES, M_REL>({p_res, rel}, default_com);
 }
 
 } // namespace engine
@@ -0,0 +1,150 @@
+#ifndef ENGINE_COMMON_SCALABLE_RW_LOCK_H
+#define ENGINE_COMMON_SCALABLE_RW_LOCK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+namespace engine
+{
+
+/**
+ * a big reader lock that prefers writers, a drop in for wfirst_rw_lock.
+ *
+ * every reader thread is given one of kSlots cache line sized counters
+ * and a read lock is an increment of it, so readers on different threads
+ * never write to the same line. a writer announces itself in writers_,
+ * new readers that see it undo their increment and wait on a condition
+ * variable until the last writer is gone, the writer waits for every
+ * slot to drain. writers take turns on a mutex.
+ *
+ * the read side costs two atomic operations on a line of its own when no
+ * writer is around, the write side a scan of all the slots. a read lock
+ * must be released on the thread that took it
+ */
+class scalable_rw_lock
+{
+public:
+    static const std::size_t kSlots = 64;        // a power of two
+
+    // releases the lock on destruction, moved out by read_guard and
+    // write_guard without an allocation
+    template<void (scalable_rw_lock::*Unlock)()>
+    class guard
+    {
+    public:
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+        explicit guard(scalable_rw_lock* lock) noexcept
+            : lock_(lock)
+        {
+        }
+
+        guard(guard&& rv) noexcept
+            : lock_(rv.lock_)
+        {
+            rv.lock_ = nullptr;
+        }
+
+        ~guard() noexcept
+        {
+            if (lock_) {
+                (lock_->*Unlock)();
+            }
+        }
+
+    private:
+        scalable_rw_lock*   lock_;
+    }; // class guard
+
+    scalable_rw_lock(const scalable_rw_lock&) = delete;
+    scalable_rw_lock& operator=(const scalable_rw_lock&) = delete;
+    scalable_rw_lock() = default;
+    ~scalable_rw_lock() = default;
+
+    void read_lock()
+    {
+        std::atomic<std::size_t>& readers = slots_[local_slot()].readers;
+        for (;;) {
+            // pairs with the increment of writers_ and the scan in write_lock
+            readers.fetch_add(1, std::memory_order_seq_cst);
+            if (writers_.load(std::memory_order_seq_cst) == 0) {
+                return;
+            }
+            readers.fetch_sub(1, std::memory_order_release);
+            std::unique_lock<std::mutex> lock(wait_mutex_);
+            readers_cond_.wait(lock, [this]()->bool {
+                return writers_.load(std::memory_order_acquire) == 0;
+            });
+        }
+    }
+
+    void read_unlock()
+    {
+        slots_[local_slot()].readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void write_lock()
+    {
+        writers_.fetch_add(1, std::memory_order_seq_cst);
+        write_mutex_.lock();
+        for (std::size_t i = 0; i < kSlots; ++i) {
+            while (slots_[i].readers.load(std::memory_order_seq_cst) != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void write_unlock()
+    {
+        write_mutex_.unlock();
+        if (writers_.fetch_sub(1, std::memory_order_release) == 1) {
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            readers_cond_.notify_all();
+        }
+    }
+
+    typedef guard<&scalable_rw_lock::read_unlock>   read_guard_type;
+    typedef guard<&scalable_rw_lock::write_unlock>  write_guard_type;
+
+    read_guard_type read_guard() const noexcept
+    {
+        scalable_rw_lock* self = const_cast<scalable_rw_lock*>(this);
+        self->read_lock();
+        return read_guard_type(self);
+    }
+
+    write_guard_type write_guard() const noexcept
+    {
+        scalable_rw_lock* self = const_cast<scalable_rw_lock*>(this);
+        self->write_lock();
+        return write_guard_type(self);
+    }
+
+private:
+    struct alignas(64) slot
+    {
+        std::atomic<std::size_t>    readers{0};
+    }; // struct slot
+
+    // threads are dealt the slots in turn, the same for every lock
+    static std::size_t local_slot()
+    {
+        static std::atomic<std::size_t> next(0);
+        static thread_local std::size_t index =
+            next.fetch_add(1, std::memory_order_relaxed) & (kSlots - 1);
+        return index;
+    }
+
+    slot                        slots_[kSlots];
+    alignas(64) std::atomic<std::size_t> writers_{0};
+    std::mutex                  write_mutex_;
+    std::mutex                  wait_mutex_;
+    std::condition_variable     readers_cond_;
+}; // class scalable_rw_lock
+
+} // namespace engine
+
+#endif // ENGINE_COMMON_SCALABLE_RW_LOCK_H
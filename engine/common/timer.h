@@ -1,11 +1,11 @@
 #ifndef ENGINE_COMMON_TIMER_H
 #define ENGINE_COMMON_TIMER_H
 
-#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <functional>
-#include <map>
+#include <memory>
+#include <vector>
 
 namespace engine
 {
@@ -17,9 +17,13 @@ enum timer_type
 
 }; // enum timer_type
 
+// low 32 bits are the slot of the node in the timer slab, high 32 bits
+// are the generation of that slot, so a stale id never cancels a reused node
+typedef uint64_t timer_id;
+
 struct timer_task
 {
-    uint32_t                id;
+    timer_id                id;
     uint32_t                interval;
     timer_type              type;
     std::function<void()>   callback;
@@ -50,13 +54,22 @@ struct timer_node
     node_link   link;
     uint64_t    dead_time;
     timer_task  timer;
-    timer_node(timer_task t, uint64_t dt)
-        : dead_time(dt)
-        , timer(t)
+    uint32_t    slot;
+    uint32_t    generation;
+    bool        active;
+    timer_node()
+        : dead_time(0)
+        , slot(0)
+        , generation(1)
+        , active(false)
     {
     }
 }; // struct timer_node
 
+#define TIMER_CHUNK_BITS 10
+#define TIMER_CHUNK_SIZE (1 << TIMER_CHUNK_BITS) // 1024
+#define TIMER_CHUNK_MASK (TIMER_CHUNK_SIZE - 1)
+
 struct wheel
 {
     node_link*  spokes;
@@ -69,17 +82,10 @@ struct wheel
         spokes = new node_link[n];
     }
 
+    // nodes are owned by the timer slab, only the spokes belong to the wheel
     ~wheel()
     {
         if (spokes) {
-            for (uint32_t j = 0; j < size; ++j) {
-                node_link* link = (spokes + j)->next;
-                while (link != spokes + j) {
-                    timer_node* node = (timer_node*) link;
-                    link = node->link.next;
-                    delete node;
-                }
-            }
             delete []spokes;
             spokes = nullptr;
         }
@@ -94,17 +100,15 @@ static uint64_t get_current_millisec()
     return static_cast<uint64_t>(duration_in_ms.count());
 }
 
-static std::atomic<uint32_t> auto_timer_increase_id_{0};
-
-static uint32_t get_timer_increase_id()
-{
-    return ++auto_timer_increase_id_;
-}
-
 class timer 
 {
 public:
+    timer(const timer&) = delete;
+    timer& operator=(const timer&) = delete;
     timer()
+        : free_list_(nullptr)
+        , firing_node_(nullptr)
+        , active_count_(0)
     {
         checktime_ = get_current_millisec();
         wheels_[0] = new wheel(WHEEL_SIZE1);
@@ -149,48 +153,119 @@ public:
         do_timeout_callback();
     }
 
-    uint32_t add_task(uint32_t interval, timer_type type,
+    timer_id add_task(uint32_t interval, timer_type type,
             const std::function<void()>& callback)
     {
-        timer_task task;
-        task.id         = get_timer_increase_id();
-        task.interval   = interval;
-        task.type       = type;
-        task.callback   = callback;
-        timer_map_[task.id] = add_timer(interval, task);
-        return task.id;
+        timer_node* node = alloc_node();
+        node->timer.id          = make_id(node);
+        node->timer.interval    = interval;
+        node->timer.type        = type;
+        node->timer.callback    = callback;
+        node->dead_time         = get_current_millisec() + interval;
+        add_timer_node(interval, node);
+        return node->timer.id;
     }
 
-    void remove_task(uint32_t task_id)
+    void remove_task(timer_id task_id)
     {
-        std::map<uint32_t, timer_node*>::iterator it;
-        it = timer_map_.find(task_id);
-        if (it != timer_map_.end()) {
-            timer_node* node = it->second;
-            timer_map_.erase(it);
-            node_link* node_link = &(node->link);
-            if (node_link->prev) {
-                node_link->prev->next = node_link->next; 
-            }
-            if (node_link->next) {
-                node_link->next->prev = node_link->prev;
-            }
-            node_link->prev = nullptr;
-            node_link->next = nullptr;
+        timer_node* node = find_node(task_id);
+        if (node) {
+            unlink_node(node);
+            release_node(node);
+        }
+    }
 
-            delete node;
+    // grow the slab up front so add_task never allocates below count timers
+    void reserve(std::size_t count)
+    {
+        while (chunks_.size() * TIMER_CHUNK_SIZE < count) {
+            add_chunk();
         }
     }
 
+    std::size_t size() const
+    {
+        return active_count_;
+    }
+
 private:
-    timer_node* add_timer(uint32_t milseconds, timer_task timer)
+    static timer_id make_id(const timer_node* node)
+    {
+        return (static_cast<uint64_t>(node->generation) << 32) | node->slot;
+    }
+
+    void add_chunk()
+    {
+        uint32_t base = static_cast<uint32_t>(chunks_.size()) << TIMER_CHUNK_BITS;
+        std::unique_ptr<timer_node[]> chunk(new timer_node[TIMER_CHUNK_SIZE]);
+        for (uint32_t i = TIMER_CHUNK_SIZE; i > 0; --i) {
+            timer_node* node = &chunk[i - 1];
+            node->slot = base + i - 1;
+            node->link.next = (node_link*)free_list_;
+            free_list_ = node;
+        }
+        chunks_.push_back(std::move(chunk));
+    }
+
+    timer_node* alloc_node()
     {
-        uint64_t dead_time = get_current_millisec() + milseconds;
-        timer_node* node = new timer_node(timer, dead_time);
-        add_timer_node(milseconds, node);
+        if (!free_list_) {
+            add_chunk();
+        }
+        timer_node* node = free_list_;
+        free_list_ = (timer_node*)node->link.next;
+        node->link.prev = node->link.next = &node->link;
+        node->active = true;
+        ++active_count_;
         return node;
     }
 
+    timer_node* find_node(timer_id task_id)
+    {
+        uint32_t slot       = static_cast<uint32_t>(task_id);
+        uint32_t generation = static_cast<uint32_t>(task_id >> 32);
+        uint32_t chunk      = slot >> TIMER_CHUNK_BITS;
+        if (chunk >= chunks_.size()) {
+            return nullptr;
+        }
+        timer_node* node = &chunks_[chunk][slot & TIMER_CHUNK_MASK];
+        if (!node->active || node->generation != generation) {
+            return nullptr;
+        }
+        return node;
+    }
+
+    static void unlink_node(timer_node* node)
+    {
+        node_link* node_link = &(node->link);
+        node_link->prev->next = node_link->next;
+        node_link->next->prev = node_link->prev;
+        node_link->prev = node_link->next = node_link;
+    }
+
+    // bumping the generation invalidates every id handed out for this node.
+    // a node whose callback is running stays off the free list until it returns,
+    // so the callback may cancel itself and add new timers safely
+    void release_node(timer_node* node)
+    {
+        ++node->generation;
+        if (node->generation == 0) {
+            node->generation = 1;
+        }
+        node->active = false;
+        --active_count_;
+        if (node != firing_node_) {
+            recycle_node(node);
+        }
+    }
+
+    void recycle_node(timer_node* node)
+    {
+        node->timer.callback = nullptr;
+        node->link.next = (node_link*)free_list_;
+        free_list_ = node;
+    }
+
     uint32_t cascade(uint32_t wheel_index)
     {
         if (wheel_index < 1 || wheel_index >= WHEEL_NUM) {
@@ -273,31 +348,31 @@ private:
 
     void do_timeout_callback()
     {
-        node_link* link = ready_nodes_.next;
-        while (link != &ready_nodes_) {
-            timer_node* node = (timer_node*)link;
+        while (ready_nodes_.next != &ready_nodes_) {
+            timer_node* node = (timer_node*)ready_nodes_.next;
+            unlink_node(node);
             if (node->timer.type == TIMER_CIRCLE) {
-                timer_map_[node->timer.id] = 
-                    add_timer(node->timer.interval, node->timer);
-            } else {
-                std::map<uint32_t, timer_node*>::iterator it;
-                it = timer_map_.find(node->timer.id);
-                if (it != timer_map_.end()) {
-                    timer_map_.erase(it);
-                }
+                node->dead_time = get_current_millisec() + node->timer.interval;
+                add_timer_node(node->timer.interval, node);
             }
+            firing_node_ = node;
             node->timer.callback();
-            link = node->link.next;
-            delete node;
+            firing_node_ = nullptr;
+            if (!node->active) {
+                recycle_node(node);
+            } else if (node->timer.type != TIMER_CIRCLE) {
+                release_node(node);
+            }
         }
-        ready_nodes_.next = &ready_nodes_;
-        ready_nodes_.prev = &ready_nodes_;
     }
 
-    wheel*                          wheels_[WHEEL_NUM];
-    uint64_t                        checktime_;
-    node_link                       ready_nodes_;
-    std::map<uint32_t, timer_node*> timer_map_;
+    wheel*                                      wheels_[WHEEL_NUM];
+    uint64_t                                    checktime_;
+    node_link                                   ready_nodes_;
+    std::vector<std::unique_ptr<timer_node[]>>  chunks_;
+    timer_node*                                 free_list_;
+    timer_node*                                 firing_node_;
+    std::size_t                                 active_count_;
 }; // class timer
 
 } // namespace engine
@@ -0,0 +1,295 @@
+#ifndef ENGINE_COMMON_TRACE_H
+#define ENGINE_COMMON_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <engine/common/metrics.h>
+
+namespace engine
+{
+
+/**
+ * sampled per message stage timings in the chrome trace event format.
+ *
+ * one read in sample_rate is given a trace id where the io thread reads
+ * it, every stage the message passes afterwards (the work queue, the
+ * handler chain, the lua lock and call, the write post and the socket
+ * write) records a complete event under that id. events go to a ring of
+ * the recording thread, the oldest are overwritten. dump() returns the
+ * rings as json for chrome://tracing or perfetto, the stages of one id
+ * are joined by flow arrows.
+ *
+ * with sampling off a read costs one relaxed load, every other stage one
+ * thread local read
+ */
+class trace
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    static const std::size_t kRingEvents = 16384;   // per thread
+
+    // one read in every traced, 0 turns tracing off
+    static void set_sample_rate(uint32_t every)
+    {
+        sample_every().store(every, std::memory_order_relaxed);
+    }
+
+    static uint32_t sample_rate()
+    {
+        return sample_every().load(std::memory_order_relaxed);
+    }
+
+    // a new trace id for one read in sample_rate, 0 for the others
+    static uint64_t sample()
+    {
+        uint32_t every = sample_every().load(std::memory_order_relaxed);
+        if (every == 0) {
+            return 0;
+        }
+        static thread_local uint32_t countdown = 0;
+        if (++countdown < every) {
+            return 0;
+        }
+        countdown = 0;
+        static std::atomic<uint64_t> next_id(0);
+        return next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    // the trace the calling thread works for, 0 outside of a scope
+    static uint64_t current()
+    {
+        return current_id();
+    }
+
+    // makes id the current trace of the thread until the scope ends
+    class scope
+    {
+    public:
+        scope(const scope&) = delete;
+        scope& operator=(const scope&) = delete;
+        explicit scope(uint64_t id)
+            : saved_(current_id())
+        {
+            current_id() = id;
+        }
+
+        ~scope()
+        {
+            current_id() = saved_;
+        }
+
+    private:
+        uint64_t    saved_;
+    }; // class scope
+
+    // a stage of trace id that began at begin and ends now. stage must be a
+    // string literal, only the pointer is kept
+    static void record(uint64_t id, const char* stage, clock::time_point begin,
+            uint32_t session_id)
+    {
+        clock::time_point end = clock::now();
+        ring* r = local_ring();
+        std::lock_guard<std::mutex> guard(r->mutex);
+        event& e        = r->events[r->next];
+        e.stage         = stage;
+        e.id            = id;
+        e.session_id    = session_id;
+        e.begin         = begin;
+        e.end           = end;
+        r->next = (r->next + 1) % kRingEvents;
+        r->size = std::min(r->size + 1, static_cast<std::size_t>(kRingEvents));
+    }
+
+    // every event still in the rings, as a chrome trace event json object
+    static std::string dump()
+    {
+        registry& reg = get_registry();
+        std::lock_guard<std::mutex> registry_guard(reg.mutex);
+
+        std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        auto append = [&json, &first](const char* text){
+            json += first ? "\n" : ",\n";
+            json += text;
+            first = false;
+        };
+
+        char line[256];
+        std::map<uint64_t, std::vector<flow>> flows;
+        for (std::size_t tid = 0; tid < reg.rings.size(); ++tid) {
+            ring& r = *reg.rings[tid];
+            std::lock_guard<std::mutex> guard(r.mutex);
+            snprintf(line, sizeof line, "{\"name\":\"thread_name\",\"ph\":\"M\","
+                    "\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                    tid, r.name.empty() ? "thread" : r.name.c_str());
+            append(line);
+            for (std::size_t i = 0; i < r.size; ++i) {
+                const event& e = r.events[(r.next + kRingEvents - r.size + i) % kRingEvents];
+                double ts  = micros(e.begin.time_since_epoch());
+                double dur = micros(e.end - e.begin);
+                snprintf(line, sizeof line, "{\"name\":\"%s\",\"cat\":\"joker\",\"ph\":\"X\","
+                        "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%zu,"
+                        "\"args\":{\"trace\":%llu,\"session\":%u}}",
+                        e.stage, ts, dur, tid, static_cast<unsigned long long>(e.id),
+                        e.session_id);
+                append(line);
+                flows[e.id].push_back(flow{ts, tid});
+            }
+        }
+
+        // s on the first stage of a trace, t on the ones between, f on the last
+        for (auto& pair : flows) {
+            std::vector<flow>& steps = pair.second;
+            if (steps.size() < 2) {
+                continue;
+            }
+            std::sort(steps.begin(), steps.end(),
+                    [](const flow& a, const flow& b){return a.ts < b.ts;});
+            for (std::size_t i = 0; i < steps.size(); ++i) {
+                const char* phase = i == 0 ? "s" : (i + 1 == steps.size() ? "f" : "t");
+                snprintf(line, sizeof line, "{\"name\":\"message\",\"cat\":\"joker\","
+                        "\"ph\":\"%s\",\"bp\":\"e\",\"id\":%llu,\"ts\":%.3f,\"pid\":1,\"tid\":%zu}",
+                        phase, static_cast<unsigned long long>(pair.first),
+                        steps[i].ts, steps[i].tid);
+                append(line);
+            }
+        }
+        json += "\n]}\n";
+        return json;
+    }
+
+    // forgets every recorded event
+    static void clear()
+    {
+        registry& reg = get_registry();
+        std::lock_guard<std::mutex> registry_guard(reg.mutex);
+        for (auto& r : reg.rings) {
+            std::lock_guard<std::mutex> guard(r->mutex);
+            r->next = 0;
+            r->size = 0;
+        }
+    }
+
+private:
+    struct event
+    {
+        const char*         stage;
+        uint64_t            id;
+        uint32_t            session_id;
+        clock::time_point   begin;
+        clock::time_point   end;
+    }; // struct event
+
+    // only its thread records, the mutex is contended by a dump alone
+    struct ring
+    {
+        ring()
+            : events(kRingEvents)
+            , next(0)
+            , size(0)
+            , in_use(true)
+        {
+        }
+
+        std::mutex          mutex;
+        std::vector<event>  events;
+        std::size_t         next;
+        std::size_t         size;
+        std::string         name;
+        bool                in_use;
+    }; // struct ring
+
+    struct flow
+    {
+        double      ts;
+        std::size_t tid;
+    }; // struct flow
+
+    struct registry
+    {
+        std::mutex                          mutex;
+        std::vector<std::unique_ptr<ring>>  rings;
+    }; // struct registry
+
+    // gives the ring back for the next thread when its thread exits, the
+    // events in it stay until they are overwritten
+    struct ring_owner
+    {
+        ring_owner()
+            : owned(acquire())
+        {
+        }
+
+        ~ring_owner()
+        {
+            registry& reg = get_registry();
+            std::lock_guard<std::mutex> guard(reg.mutex);
+            owned->in_use = false;
+        }
+
+        ring* owned;
+    }; // struct ring_owner
+
+    static std::atomic<uint32_t>& sample_every()
+    {
+        static std::atomic<uint32_t> every(0);
+        return every;
+    }
+
+    static uint64_t& current_id()
+    {
+        static thread_local uint64_t id = 0;
+        return id;
+    }
+
+    // never destroyed, like the metrics registry
+    static registry& get_registry()
+    {
+        static registry* reg = new registry;
+        return *reg;
+    }
+
+    static ring* local_ring()
+    {
+        static thread_local ring_owner owner;
+        return owner.owned;
+    }
+
+    // the ring is created on the first record of a thread, the thread is
+    // named by then
+    static ring* acquire()
+    {
+        std::string name = metrics::thread_name();
+        registry& reg = get_registry();
+        std::lock_guard<std::mutex> guard(reg.mutex);
+        for (auto& r : reg.rings) {
+            if (!r->in_use) {
+                r->in_use = true;
+                r->name = name;
+                return r.get();
+            }
+        }
+        reg.rings.emplace_back(new ring);
+        reg.rings.back()->name = name;
+        return reg.rings.back().get();
+    }
+
+    static double micros(clock::duration d)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count() / 1000.0;
+    }
+}; // class trace
+
+} // namespace engine
+
+#endif // ENGINE_COMMON_TRACE_H
@@ -52,14 +52,16 @@ public:
         write_flag_ = false;
     }
 
-    raii read_guard() const noexcept
+    typedef member_raii<wfirst_rw_lock, void (wfirst_rw_lock::*)()> guard_type;
+
+    guard_type read_guard() const noexcept
     {
         return make_raii(*this, 
                 &wfirst_rw_lock::read_unlock, 
                 &wfirst_rw_lock::read_lock);
     }
 
-    raii write_guard() const noexcept
+    guard_type write_guard() const noexcept
     {
         return make_raii(*this,
                 &wfirst_rw_lock::write_unlock,
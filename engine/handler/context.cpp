@@ -21,8 +21,11 @@ void context::write(std::unique_ptr<any> msg)
     handler_->encode(this, std::move(msg));
 }
 
+// the owner may free a closed pipeline on another thread, e.g. a route
+// link its virtual sessions, not while the close still unwinds here
 void context::close()
 {
+    std::shared_ptr<pipeline> keep = pipeline_->keep_alive();
     handler_->close(this);
 }
 
@@ -46,4 +49,29 @@ any context::get_user_data()
     return pipeline_->get_user_data();
 }
 
+std::unique_lock<std::recursive_mutex> context::lock_write()
+{
+    return pipeline_->lock_write();
+}
+
+std::shared_ptr<asio_buffer> context::write_buffer()
+{
+    return pipeline_->write_buffer();
+}
+
+void context::notify_write(std::size_t length)
+{
+    pipeline_->notify_write(length);
+}
+
+bool context::closing()
+{
+    return pipeline_->closing();
+}
+
+void context::expect_read(std::size_t readable)
+{
+    pipeline_->expect_read(readable);
+}
+
 } // namespace engine
@@ -2,6 +2,7 @@
 #define ENGINE_HANDLER_CONTEXT_H
 
 #include <memory>
+#include <mutex>
 #include <string>
 
 namespace engine
@@ -9,6 +10,7 @@ namespace engine
 
 class abstract_handler;
 class any;
+class asio_buffer;
 class pipeline;
 
 class context
@@ -85,6 +87,22 @@ public:
 
     any get_user_data();
 
+    // the session's write buffer, for a handler next to the head that
+    // appends on its own and reports the bytes with notify_write, both
+    // under lock_write()
+    std::unique_lock<std::recursive_mutex> lock_write();
+
+    std::shared_ptr<asio_buffer> write_buffer();
+
+    void notify_write(std::size_t length);
+
+    // the session is closing, a handler appending on its own stops
+    bool closing();
+
+    // the read buffer has to hold readable bytes before this handler can
+    // go on, 0 when any byte will do
+    void expect_read(std::size_t readable);
+
     context*    prev;
     context*    next;
 protected:  
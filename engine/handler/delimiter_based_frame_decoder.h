@@ -6,6 +6,8 @@
 #include <vector>
 
 #include <engine/common/any.h>
+#include <engine/common/logger.h>
+#include <engine/common/metrics.h>
 #include <engine/handler/abstract_handler.h>
 #include <engine/net/asio_buffer.h>
 
@@ -59,8 +61,9 @@ public:
                 int min_delim_length = min_delim.size();
 
                 if (min_frame_length > max_frame_length_) {
-                    LOGF(WARNING, "min_frame_length = %d, max_frame_length = %d", 
+                    JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "min_frame_length = %d, max_frame_length = %d", 
                             min_frame_length, max_frame_length_);
+                    get_stats().errors.add();
                     buffer->retrieve(min_frame_length + min_delim_length);
                     return;
                 }
@@ -73,12 +76,31 @@ public:
                     data = buffer->read(min_frame_length + min_delim_length);
                 }
                 auto response = new any(read_data(*data));
+                get_stats().frames.add();
                 ctx->fire_read(std::unique_ptr<any>(response));
+            } else {
+                // wait for the rest of the frame instead of spinning on the
+                // work thread, which may be the one that has to read it
+                return;
             }
         }
     }
 
 private:
+    struct stats
+    {
+        metrics::counter    frames{"joker_decoded_frames_total",
+            "frames decoded", "decoder=\"delimiter\""};
+        metrics::counter    errors{"joker_decode_errors_total",
+            "frames dropped as malformed or too long", "decoder=\"delimiter\""};
+    };
+
+    static const stats& get_stats()
+    {
+        static stats s;
+        return s;
+    }
+
     static void validate_delimiter(const std::string& delimiter) {
         if (delimiter == "") {
             throw std::invalid_argument("string is empty");
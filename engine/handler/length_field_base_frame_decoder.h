@@ -2,7 +2,11 @@
 #define ENGINE_HANDLER_LENGTH_FIELD_BASE_FRAME_DECODER_H
 
 
+#include <cstring>
+
 #include <engine/common/any.h>
+#include <engine/common/logger.h>
+#include <engine/common/metrics.h>
 #include <engine/handler/abstract_handler.h>
 #include <engine/net/asio_buffer.h>
 
@@ -119,53 +123,42 @@ public:
         , length_adjustment_(length_adjustment)
         , initial_bytes_to_strip_(initial_bytes_to_strip)
         , big_endian_(big_endian)
+        , frame_length_(0)
     {
         length_field_end_offset_ = length_field_offset + length_field_length;
     }
 
+    // one decoder per session, the header of the frame in progress is
+    // parsed once and the session is told how many bytes it waits for
     virtual void decode(context* ctx, std::unique_ptr<any> msg)
     {
         auto buffer = any_cast<std::shared_ptr<asio_buffer>>(*msg); 
         assert(buffer);
         while (buffer->readable_bytes() > 0) {
-            if (buffer->readable_bytes() <= length_field_end_offset_) {
-                return;
-            }
-
-            uint64_t frame_length = get_unajust_frame_length(buffer, 
-                    length_field_offset_, length_field_length_, big_endian_);
-
-            if (length_adjustment_ < 0 &&
-                    abs(length_adjustment_) > length_field_end_offset_) {
-                LOGF(FATAL, "no enough length to adjsut, length_adjustment_ = %d, length_field_end_offset_ = %d",
-                        length_adjustment_, length_field_end_offset_);
-            }
-            frame_length += length_adjustment_ + length_field_end_offset_;
-            
-            if (frame_length < length_field_end_offset_) {
-                LOGF(WARNING, "Adjust frame length (%d) is less than length field end offset: %d",
-                        frame_length, length_field_end_offset_);
-                buffer->retrieve(length_field_end_offset_);
-                return;
+            if (frame_length_ == 0) {
+                if (buffer->readable_bytes() < length_field_end_offset_) {
+                    ctx->expect_read(length_field_end_offset_);
+                    return;
+                }
+                if (!parse_header(buffer)) {
+                    ctx->expect_read(0);
+                    return;
+                }
             }
 
-            if (frame_length > max_frame_length_) {
-                LOGF(WARNING, "frame_length = %d, max_frame_length = %d",
-                        frame_length, max_frame_length_);
-                return;
-            }
-
-            uint32_t frame_length_int = static_cast<uint32_t>(frame_length); 
-            if (buffer->readable_bytes() < frame_length_int) {
-                LOGF(WARNING, "readable_bytes = %d, frame_length_int = %d",
-                        buffer->readable_bytes(), frame_length_int);
+            if (buffer->readable_bytes() < frame_length_) {
+                ctx->expect_read(frame_length_);
                 return;
             }
 
+            uint32_t frame_length_int = frame_length_;
+            frame_length_ = 0;
             if (initial_bytes_to_strip_ > frame_length_int) {
-                LOGF(WARNING, "Adjusted frame length (%d) is less than initial bytes to strip: %d",
+                JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "Adjusted frame length (%d) is less than initial bytes to strip: %d",
                         frame_length_int, initial_bytes_to_strip_);
+                get_stats().errors.add();
                 buffer->retrieve(frame_length_int);
+                ctx->expect_read(0);
                 return;
             }
 
@@ -174,38 +167,96 @@ public:
             uint32_t actual_frame_length = frame_length_int - initial_bytes_to_strip_; 
             std::unique_ptr<data_block> data = buffer->read(actual_frame_length);
             auto response = new any(read_data(*data));
+            get_stats().frames.add();
             ctx->fire_read(std::unique_ptr<any>(response));
         }
+        ctx->expect_read(0);
     }
 private:
-    uint64_t get_unajust_frame_length(std::shared_ptr<asio_buffer> buf, 
+    struct stats
+    {
+        metrics::counter    frames{"joker_decoded_frames_total",
+            "frames decoded", "decoder=\"length_field\""};
+        metrics::counter    errors{"joker_decode_errors_total",
+            "frames dropped as malformed or too long", "decoder=\"length_field\""};
+    };
+
+    static const stats& get_stats()
+    {
+        static stats s;
+        return s;
+    }
+
+    // sets frame_length_ from the length field, false for a frame that is
+    // dropped or can never be decoded
+    bool parse_header(const std::shared_ptr<asio_buffer>& buffer)
+    {
+        uint64_t frame_length = get_unajust_frame_length(buffer, 
+                length_field_offset_, length_field_length_, big_endian_);
+
+        if (length_adjustment_ < 0 &&
+                abs(length_adjustment_) > length_field_end_offset_) {
+            JOKER_LOGF(FATAL, "no enough length to adjsut, length_adjustment_ = %d, length_field_end_offset_ = %d",
+                    length_adjustment_, length_field_end_offset_);
+        }
+        frame_length += length_adjustment_ + length_field_end_offset_;
+        
+        if (frame_length < length_field_end_offset_) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "Adjust frame length (%llu) is less than length field end offset: %d",
+                    static_cast<unsigned long long>(frame_length), length_field_end_offset_);
+            get_stats().errors.add();
+            buffer->retrieve(length_field_end_offset_);
+            return false;
+        }
+
+        if (frame_length > max_frame_length_) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "frame_length = %llu, max_frame_length = %d",
+                    static_cast<unsigned long long>(frame_length), max_frame_length_);
+            get_stats().errors.add();
+            return false;
+        }
+        frame_length_ = static_cast<uint32_t>(frame_length);
+        return true;
+    }
+
+    // the field is copied out of the buffer blocks, no block is made for it
+    uint64_t get_unajust_frame_length(const std::shared_ptr<asio_buffer>& buf, 
             uint32_t offset, uint32_t length, bool big_endian)
     {
+        char field[sizeof(uint64_t)];
         uint64_t frame_length = 0;
         switch(length) {
             case 1:
-                frame_length = buf->peek_index_endian<uint8_t>(
-                        offset, big_endian);
+                buf->peek_index(offset, field, length);
+                frame_length = static_cast<uint8_t>(field[0]);
                 break;
             case 2:
-                frame_length = buf->peek_index_endian<uint16_t>(
-                        offset, big_endian);
+                buf->peek_index(offset, field, length);
+                frame_length = adapte_endian<uint16_t>(load<uint16_t>(field), big_endian);
                 break;
             case 4:
-                frame_length = buf->peek_index_endian<uint32_t>(
-                        offset, big_endian);
+                buf->peek_index(offset, field, length);
+                frame_length = adapte_endian<uint32_t>(load<uint32_t>(field), big_endian);
                 break;
             case 8:
-                frame_length = buf->peek_index_endian<uint64_t>(
-                        offset, big_endian);
+                buf->peek_index(offset, field, length);
+                frame_length = adapte_endian<uint64_t>(load<uint64_t>(field), big_endian);
                 break;
             default:
-                LOGF(FATAL, "unsupported length field length: %d (expected: 1, 2, 4 or 8)", 
+                JOKER_LOGF(FATAL, "unsupported length field length: %d (expected: 1, 2, 4 or 8)", 
                         length);
         }
         return frame_length;
     }
 
+    template<typename BASE_DATA_TYPE>
+    static BASE_DATA_TYPE load(const char* data)
+    {
+        BASE_DATA_TYPE value;
+        memcpy(&value, data, sizeof value);
+        return value;
+    }
+
     uint32_t    max_frame_length_;
     uint32_t    length_field_offset_;
     uint32_t    length_field_length_;
@@ -213,6 +264,7 @@ private:
     uint32_t    length_field_end_offset_;
     uint32_t    initial_bytes_to_strip_;
     bool        big_endian_;
+    uint32_t    frame_length_;      // of the frame in progress, 0 before its header
 }; // class length_field_base_frame_decoder
 
 } // namespace
@@ -0,0 +1,276 @@
+#ifndef ENGINE_HANDLER_LENGTH_FIELD_PREPENDER_H
+#define ENGINE_HANDLER_LENGTH_FIELD_PREPENDER_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <engine/common/any.h>
+#include <engine/common/data_block.h>
+#include <engine/common/logger.h>
+#include <engine/common/metrics.h>
+#include <engine/handler/abstract_handler.h>
+#include <engine/net/asio_buffer.h>
+#include <engine/net/endian.h>
+
+namespace engine
+{
+
+/**
+ * the encoder of length_field_base_frame_decoder, with the same offset,
+ * length, adjustment and byte order.
+ *
+ * a message is the frame without its length field: the first
+ * length_field_offset bytes go before the field, the rest after it. the
+ * field holds the whole frame less length_field_offset + length_field_length
+ * + length_adjustment, so a decoder made with the same arguments gets the
+ * frame back.
+ *
+ * <pre>
+ * length_field_prepender(1, 2, -3, false) with "T" "E" "joker"
+ *
+ * +------+--------+------+---------+
+ * | HDR1 | Length | HDR2 | Content |
+ * | "T"  | 0x0009 | "E"  | "joker" |
+ * +------+--------+------+---------+
+ * </pre>
+ *
+ * read_data, write_data and std::string are one frame, a
+ * std::vector<read_data> a batch of frames. the frames go into the free
+ * space of the session's write buffer, length fields are reserved and
+ * backpatched once their body is in, and the batch is published with one
+ * has_written and one notify_write. the bodies are copied once, the
+ * reader never sees a frame without its length.
+ *
+ * writes straight to the buffer, so only handlers that pass writes on
+ * unchanged, like the decoders, may sit between it and the head. other
+ * messages are passed on as they are
+ */
+class length_field_prepender : public abstract_handler
+{
+public:
+    length_field_prepender(const length_field_prepender&) = delete;
+    length_field_prepender& operator=(const length_field_prepender&) = delete;
+
+    length_field_prepender(uint32_t length_field_offset,
+                            uint32_t length_field_length,
+                            int32_t length_adjustment = 0,
+                            bool big_endian = true)
+        : length_field_offset_(length_field_offset)
+        , length_field_length_(length_field_length)
+        , length_adjustment_(length_adjustment)
+        , big_endian_(big_endian)
+    {
+        if (length_field_length != 1 && length_field_length != 2
+                && length_field_length != 4 && length_field_length != 8) {
+            throw std::invalid_argument("length field length is not 1, 2, 4 or 8");
+        }
+    }
+
+    virtual void encode(context* ctx, std::unique_ptr<any> msg)
+    {
+        read_data body;
+        if (msg->type() == typeid(read_data)) {
+            body = any_cast<read_data>(*msg);
+        } else if (msg->type() == typeid(write_data)) {
+            write_data data = any_cast<write_data>(*msg);
+            body.data   = data.data;
+            body.len    = data.len;
+        } else if (msg->type() == typeid(std::string)) {
+            const std::string& str = any_cast<const std::string&>(*msg);
+            body.data   = str.data();
+            body.len    = str.size();
+        } else if (msg->type() == typeid(std::vector<read_data>)) {
+            const std::vector<read_data>& bodies = any_cast<const std::vector<read_data>&>(*msg);
+            write_frames(ctx, bodies.data(), bodies.size());
+            return;
+        } else {
+            ctx->fire_write(std::move(msg));
+            return;
+        }
+        write_frames(ctx, &body, 1);
+    }
+
+private:
+    struct stats
+    {
+        metrics::counter    frames{"joker_encoded_frames_total",
+            "frames encoded", "encoder=\"length_field\""};
+        metrics::counter    batches{"joker_encoded_batches_total",
+            "appends of one or more encoded frames", "encoder=\"length_field\""};
+        metrics::counter    errors{"joker_encode_errors_total",
+            "frames dropped as too short or too long for the length field",
+            "encoder=\"length_field\""};
+    };
+
+    static const stats& get_stats()
+    {
+        static stats s;
+        return s;
+    }
+
+    // writes into the free segments of a buffer, behind its write index
+    class segment_cursor
+    {
+    public:
+        explicit segment_cursor(std::vector<write_data>& segments)
+            : segments_(segments)
+            , segment_(0)
+            , offset_(0)
+        {
+        }
+
+        // where the next byte goes, for a later patch
+        std::pair<std::size_t, std::size_t> position() const
+        {
+            return std::make_pair(segment_, offset_);
+        }
+
+        void skip(std::size_t len)
+        {
+            advance(nullptr, len);
+        }
+
+        void put(const char* data, std::size_t len)
+        {
+            advance(data, len);
+        }
+
+        void patch(std::pair<std::size_t, std::size_t> at, const char* data, std::size_t len)
+        {
+            segment_cursor cursor(segments_);
+            cursor.segment_ = at.first;
+            cursor.offset_  = at.second;
+            cursor.put(data, len);
+        }
+
+    private:
+        void advance(const char* data, std::size_t len)
+        {
+            while (len > 0) {
+                if (offset_ == segments_[segment_].len) {
+                    segment_++;
+                    offset_ = 0;
+                }
+                std::size_t copy_len = std::min(len, segments_[segment_].len - offset_);
+                if (data) {
+                    memcpy(segments_[segment_].data + offset_, data, copy_len);
+                    data += copy_len;
+                }
+                offset_ += copy_len;
+                len     -= copy_len;
+            }
+        }
+
+        std::vector<write_data>&    segments_;
+        std::size_t                 segment_;
+        std::size_t                 offset_;
+    }; // class segment_cursor
+
+    void write_frames(context* ctx, const read_data* bodies, std::size_t count)
+    {
+        std::size_t total = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            total += bodies[i].len + length_field_length_;
+        }
+        if (total == 0) {
+            return;
+        }
+
+        auto lock = ctx->lock_write();
+        if (ctx->closing()) {
+            return;
+        }
+        std::shared_ptr<asio_buffer> buffer = ctx->write_buffer();
+        if (!buffer) {
+            return;
+        }
+        buffer->ensure_writable(total);
+        segment_cursor cursor(buffer->write_buffer());
+        std::size_t written = 0;
+        std::size_t frames  = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            const read_data& body = bodies[i];
+            uint64_t length;
+            if (!field_value(body.len, length)) {
+                get_stats().errors.add();
+                continue;
+            }
+            cursor.put(body.data, length_field_offset_);
+            auto field = cursor.position();
+            cursor.skip(length_field_length_);
+            cursor.put(body.data + length_field_offset_, body.len - length_field_offset_);
+            char bytes[sizeof(uint64_t)];
+            write_field(bytes, length);
+            cursor.patch(field, bytes, length_field_length_);
+            written += body.len + length_field_length_;
+            frames++;
+        }
+        if (written == 0) {
+            return;
+        }
+        buffer->has_written(written);
+        ctx->notify_write(written);
+        get_stats().frames.add(frames);
+        get_stats().batches.add();
+    }
+
+    // what the length field holds for a body of body_len, false if it does
+    // not fit
+    bool field_value(std::size_t body_len, uint64_t& length) const
+    {
+        if (body_len < length_field_offset_) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond,
+                    "frame body (%zu) is shorter than length field offset: %u",
+                    body_len, length_field_offset_);
+            return false;
+        }
+        int64_t value = static_cast<int64_t>(body_len) - length_field_offset_
+            - length_adjustment_;
+        uint64_t max = length_field_length_ == 8 ? UINT64_MAX
+            : (static_cast<uint64_t>(1) << (length_field_length_ * 8)) - 1;
+        if (value < 0 || static_cast<uint64_t>(value) > max) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond,
+                    "length field value %lld does not fit in %u bytes",
+                    static_cast<long long>(value), length_field_length_);
+            return false;
+        }
+        length = static_cast<uint64_t>(value);
+        return true;
+    }
+
+    void write_field(char* bytes, uint64_t length) const
+    {
+        switch (length_field_length_) {
+            case 1: {
+                uint8_t field = static_cast<uint8_t>(length);
+                memcpy(bytes, &field, sizeof field);
+                break;
+            }
+            case 2: {
+                uint16_t field = adapte_endian<uint16_t>(static_cast<uint16_t>(length), big_endian_);
+                memcpy(bytes, &field, sizeof field);
+                break;
+            }
+            case 4: {
+                uint32_t field = adapte_endian<uint32_t>(static_cast<uint32_t>(length), big_endian_);
+                memcpy(bytes, &field, sizeof field);
+                break;
+            }
+            default: {
+                uint64_t field = adapte_endian<uint64_t>(length, big_endian_);
+                memcpy(bytes, &field, sizeof field);
+                break;
+            }
+        }
+    }
+
+    uint32_t    length_field_offset_;
+    uint32_t    length_field_length_;
+    int32_t     length_adjustment_;
+    bool        big_endian_;
+}; // class length_field_prepender
+
+} // namespace engine
+
+#endif // ENGINE_HANDLER_LENGTH_FIELD_PREPENDER_H
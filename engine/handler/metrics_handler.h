@@ -0,0 +1,71 @@
+#ifndef ENGINE_HANDLER_METRICS_HANDLER_H
+#define ENGINE_HANDLER_METRICS_HANDLER_H
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include <engine/common/any.h>
+#include <engine/common/data_block.h>
+#include <engine/common/metrics.h>
+#include <engine/common/trace.h>
+#include <engine/handler/abstract_handler.h>
+#include <engine/handler/delimiter_based_frame_decoder.h>
+#include <engine/net/session.h>
+
+namespace engine
+{
+
+/**
+ * answers GET /metrics with metrics::scrape, GET /trace with the sampled
+ * stage timings of trace::dump, everything else with a 404.
+ * sits behind a delimiter_based_frame_decoder on "\r\n\r\n", so it gets
+ * one request head at a time. the connection is kept open for the next
+ * scrape, every response carries its Content-Length
+ */
+class metrics_handler : public abstract_handler
+{
+public:
+    static const uint32_t kMaxRequestLength = 8192;
+
+    metrics_handler(const metrics_handler&) = delete;
+    metrics_handler& operator=(const metrics_handler&) = delete;
+    metrics_handler()
+    {
+    }
+
+    // the handlers of an admin port session
+    static void init_handlers(std::shared_ptr<session> session)
+    {
+        session->add_handler("decoder", std::make_shared<delimiter_based_frame_decoder>(
+                    static_cast<uint32_t>(kMaxRequestLength), "\r\n\r\n"))
+            ->add_handler("metrics", std::make_shared<metrics_handler>());
+    }
+
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        read_data request = any_cast<read_data>(*msg);
+        std::string head(request.data, request.len);
+        std::string response;
+        if (head.compare(0, 13, "GET /metrics ") == 0) {
+            std::string body = metrics::scrape();
+            response = "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        } else if (head.compare(0, 11, "GET /trace ") == 0) {
+            std::string body = trace::dump();
+            response = "HTTP/1.1 200 OK\r\n"
+                "Content-Type: application/json\r\n"
+                "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+        } else {
+            response = "HTTP/1.1 404 Not Found\r\n"
+                "Content-Type: text/plain\r\n"
+                "Content-Length: 10\r\n\r\nnot found\n";
+        }
+        ctx->fire_write(std::unique_ptr<any>(new any(response)));
+    }
+}; // class metrics_handler
+
+} // namespace engine
+
+#endif // ENGINE_HANDLER_METRICS_HANDLER_H
@@ -0,0 +1,258 @@
+#ifndef ENGINE_HANDLER_PBC_CODEC_H
+#define ENGINE_HANDLER_PBC_CODEC_H
+
+#include <cassert>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include <engine/common/any.h>
+#include <engine/common/data_block.h>
+#include <engine/common/logger.h>
+#include <engine/common/metrics.h>
+#include <engine/handler/abstract_handler.h>
+#include <engine/handler/pbc_registry.h>
+#include <engine/net/endian.h>
+
+namespace engine
+{
+
+// decoded inbound message. the rmessage, the unpacked pattern data and
+// every string inside them point into the frame being decoded, so they
+// are only valid while the next handler's decode runs. a codec that does
+// not decode bodies leaves both rmessage and data null
+struct pbc_message
+{
+    uint32_t                id;
+    const pbc_message_type* type;
+    pbc_rmessage*           rmessage;   // set when the type has no pattern
+    const void*             data;       // set when the type has a pattern
+    read_data               body;
+}; // struct pbc_message
+
+// outbound message, written by the next encode through the codec. a
+// droppable one goes out as a whole frame the session may drop while it
+// is over its send budget
+struct pbc_out_message
+{
+    uint32_t                        id;
+    std::shared_ptr<pbc_wmessage>   wmessage;
+    bool                            droppable = false;
+}; // struct pbc_out_message
+
+/**
+ * <pre>
+ * decoder: length_field_base_frame_decoder(max, 0, 2, 0, 2)
+ *
+ * +--------+--------+----------------+      +--------+----------------+
+ * | Length | Msg id | Protobuf body  |----->| Msg id | Protobuf body  |----->pbc_message
+ * | 0x000E | 0x0001 | 12 bytes       |      | 0x0001 | 12 bytes       |
+ * +--------+--------+----------------+      +--------+----------------+
+ * </pre>
+ *
+ * encode turns a pbc_out_message into the whole frame, the length field
+ * counts the message id and the body. a length_field_length of 0 leaves
+ * the length to a handler in front of the codec.
+ *
+ * without decode_body the next handler gets the id, type and raw body
+ * only, for a handler that queues the body and unpacks it later itself
+ */
+class pbc_codec : public abstract_handler
+{
+public:
+    static const std::size_t kMaxHeaderLength = sizeof(uint32_t) + sizeof(uint16_t);
+
+    pbc_codec(const pbc_codec&) = delete;
+    pbc_codec& operator=(const pbc_codec&) = delete;
+    explicit pbc_codec(std::shared_ptr<pbc_registry> registry,
+                       uint32_t length_field_length = 2,
+                       bool big_endian = true,
+                       bool decode_body = true)
+        : registry_(registry)
+        , length_field_length_(length_field_length)
+        , big_endian_(big_endian)
+        , decode_body_(decode_body)
+    {
+        assert(length_field_length == 0 || length_field_length == 2
+                || length_field_length == 4);
+    }
+
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        read_data frame = any_cast<read_data>(*msg);
+        if (frame.len < sizeof(uint16_t)) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "pbc frame too short, len = %d", frame.len);
+            return;
+        }
+
+        pbc_message message;
+        message.id          = adapte_endian<uint16_t>(
+                *reinterpret_cast<const uint16_t*>(frame.data), big_endian_);
+        message.type        = registry_->find(message.id);
+        message.rmessage    = nullptr;
+        message.data        = nullptr;
+        message.body.data   = frame.data + sizeof(uint16_t);
+        message.body.len    = frame.len - sizeof(uint16_t);
+        if (!message.type) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "pbc unknown message id = %d", message.id);
+            return;
+        }
+        if (!decode_body_) {
+            ctx->fire_read(std::unique_ptr<any>(new any(message)));
+            return;
+        }
+
+        unpack(*registry_, message, unpacked_, [ctx](pbc_message& decoded){
+            ctx->fire_read(std::unique_ptr<any>(new any(decoded)));
+        });
+    }
+
+    // decodes the body of a message whose id, type and body are set, hands
+    // it to handler and releases what the decode allocated
+    template<typename HANDLER>
+    static bool unpack(pbc_registry& registry, pbc_message& message,
+            std::vector<char>& unpacked, HANDLER handler)
+    {
+        struct pbc_slice slice;
+        slice.buffer    = const_cast<char*>(message.body.data);
+        slice.len       = static_cast<int>(message.body.len);
+        if (message.type->pattern) {
+            if (unpacked.size() < message.type->pattern_size) {
+                unpacked.resize(message.type->pattern_size);
+            }
+            if (pbc_pattern_unpack(message.type->pattern, &slice, unpacked.data()) < 0) {
+                JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "pbc unpack %s error = %s", message.type->name.c_str(),
+                        pbc_error(registry.env()));
+                return false;
+            }
+            message.data = unpacked.data();
+            handler(message);
+            pbc_pattern_close_arrays(message.type->pattern, unpacked.data());
+        } else {
+            message.rmessage = pbc_rmessage_new(registry.env(),
+                    message.type->name.c_str(), &slice);
+            if (!message.rmessage) {
+                JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "pbc decode %s error = %s", message.type->name.c_str(),
+                        pbc_error(registry.env()));
+                return false;
+            }
+            handler(message);
+            pbc_rmessage_delete(message.rmessage);
+        }
+        return true;
+    }
+
+    virtual void encode(context* ctx, std::unique_ptr<any> msg)
+    {
+        if (msg->type() != typeid(pbc_out_message)) {
+            ctx->fire_write(std::move(msg));
+            return;
+        }
+
+        pbc_out_message& message = *any_cast<pbc_out_message>(msg.get());
+        if (!message.wmessage) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "pbc encode empty message id = %d", message.id);
+            return;
+        }
+        if (message.droppable) {
+            droppable_data data;
+            data.block = encode_frame(message.id, message.wmessage.get(),
+                    length_field_length_, big_endian_);
+            if (data.block) {
+                ctx->fire_write(std::unique_ptr<any>(new any(data)));
+            }
+            return;
+        }
+
+        struct pbc_slice slice;
+        pbc_wmessage_buffer(message.wmessage.get(), &slice);
+
+        // header and body are both copied by the pipeline straight into
+        // the session's write buffer, with no other writer in between
+        char header[kMaxHeaderLength];
+        std::size_t header_len = write_header(header, message.id, slice.len,
+                length_field_length_, big_endian_);
+        if (header_len == 0) {
+            return;
+        }
+        auto lock = ctx->lock_write();
+        read_data data;
+        data.data   = header;
+        data.len    = header_len;
+        ctx->fire_write(std::unique_ptr<any>(new any(data)));
+        data.data   = static_cast<const char*>(slice.buffer);
+        data.len    = slice.len;
+        ctx->fire_write(std::unique_ptr<any>(new any(data)));
+    }
+
+    // the whole frame in one block, for a payload shared by many sessions.
+    // null if the body does not fit the length field
+    static std::shared_ptr<data_block> encode_frame(uint32_t id, pbc_wmessage* wmessage,
+            uint32_t length_field_length = 2, bool big_endian = true)
+    {
+        struct pbc_slice slice;
+        pbc_wmessage_buffer(wmessage, &slice);
+        char header[kMaxHeaderLength];
+        std::size_t header_len = write_header(header, id, slice.len,
+                length_field_length, big_endian);
+        if (header_len == 0) {
+            return nullptr;
+        }
+        auto frame = std::make_shared<data_block>(header_len + slice.len);
+        memcpy(frame->data, header, header_len);
+        memcpy(frame->data + header_len, slice.buffer, slice.len);
+        return frame;
+    }
+
+    // the header length, 0 if the frame is too long for the length field.
+    // such a message is dropped, a truncated length would desync the peer
+    static std::size_t write_header(char* header, uint32_t id, std::size_t body_len,
+            uint32_t length_field_length, bool big_endian)
+    {
+        char* cursor = header;
+        std::size_t frame_len = sizeof(uint16_t) + body_len;
+        if ((length_field_length == 2 && frame_len > std::numeric_limits<uint16_t>::max())
+                || (length_field_length == 4 && frame_len > std::numeric_limits<uint32_t>::max())) {
+            get_stats().errors.add();
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "pbc encode message id = %u, frame len = %zu over a %u byte length field",
+                    id, frame_len, length_field_length);
+            return 0;
+        }
+        if (length_field_length == 2) {
+            *reinterpret_cast<uint16_t*>(cursor) = adapte_endian<uint16_t>(
+                    static_cast<uint16_t>(frame_len), big_endian);
+        } else if (length_field_length == 4) {
+            *reinterpret_cast<uint32_t*>(cursor) = adapte_endian<uint32_t>(
+                    static_cast<uint32_t>(frame_len), big_endian);
+        }
+        cursor += length_field_length;
+        *reinterpret_cast<uint16_t*>(cursor) = adapte_endian<uint16_t>(
+                static_cast<uint16_t>(id), big_endian);
+        cursor += sizeof(uint16_t);
+        return cursor - header;
+    }
+
+private:
+    struct stats
+    {
+        metrics::counter    errors{"joker_encode_errors_total",
+            "frames dropped as too short or too long for the length field",
+            "encoder=\"pbc\""};
+    };
+
+    static const stats& get_stats()
+    {
+        static stats s;
+        return s;
+    }
+
+    std::shared_ptr<pbc_registry>   registry_;
+    uint32_t                        length_field_length_;
+    bool                            big_endian_;
+    bool                            decode_body_;
+    std::vector<char>               unpacked_;  // pattern output, one codec per session
+}; // class pbc_codec
+
+} // namespace engine
+
+#endif // ENGINE_HANDLER_PBC_CODEC_H
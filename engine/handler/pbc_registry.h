@@ -0,0 +1,437 @@
+#ifndef ENGINE_HANDLER_PBC_REGISTRY_H
+#define ENGINE_HANDLER_PBC_REGISTRY_H
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <third_party/pbc/pbc.h>
+
+namespace engine
+{
+
+// google.protobuf.FieldDescriptorProto.Type
+enum pbc_field_type
+{
+    PBC_FIELD_DOUBLE    = 1,
+    PBC_FIELD_FLOAT     = 2,
+    PBC_FIELD_INT64     = 3,
+    PBC_FIELD_UINT64    = 4,
+    PBC_FIELD_INT32     = 5,
+    PBC_FIELD_FIXED64   = 6,
+    PBC_FIELD_FIXED32   = 7,
+    PBC_FIELD_BOOL      = 8,
+    PBC_FIELD_STRING    = 9,
+    PBC_FIELD_GROUP     = 10,
+    PBC_FIELD_MESSAGE   = 11,
+    PBC_FIELD_BYTES     = 12,
+    PBC_FIELD_UINT32    = 13,
+    PBC_FIELD_ENUM      = 14,
+    PBC_FIELD_SFIXED32  = 15,
+    PBC_FIELD_SFIXED64  = 16,
+    PBC_FIELD_SINT32    = 17,
+    PBC_FIELD_SINT64    = 18,
+}; // enum pbc_field_type
+
+// one field of a message as declared in the descriptor set
+struct pbc_field_desc
+{
+    std::string name;
+    uint32_t    number;
+    uint32_t    type;       // pbc_field_type
+    bool        repeated;
+    std::string type_name;  // message or enum type, without the leading dot
+}; // struct pbc_field_desc
+
+// where a pattern puts one field inside the unpacked struct
+struct pbc_field_layout
+{
+    std::string name;
+    uint32_t    number;
+    uint32_t    type;       // pbc_field_type
+    char        ctype;      // pattern ctype: d D f F b s a
+    uint32_t    offset;
+    std::string type_name;
+}; // struct pbc_field_layout
+
+struct pbc_message_type
+{
+    uint32_t                        id;
+    std::string                     name;
+    pbc_pattern*                    pattern;        // unpacks the whole message without key lookups
+    std::size_t                     pattern_size;   // bytes of the struct the pattern unpacks into
+    std::vector<pbc_field_layout>   fields;         // in field number order
+}; // struct pbc_message_type
+
+// owns the pbc_env and the message id to type table. schemas and ids are
+// registered once at startup, afterwards the registry is only read and may
+// be shared by every session and thread
+class pbc_registry
+{
+public:
+    pbc_registry(const pbc_registry&) = delete;
+    pbc_registry& operator=(const pbc_registry&) = delete;
+    pbc_registry()
+        : env_(pbc_new())
+    {
+    }
+
+    ~pbc_registry()
+    {
+        for (auto& pair : types_) {
+            if (pair.second.pattern) {
+                pbc_pattern_delete(pair.second.pattern);
+            }
+        }
+        for (auto& pair : nested_) {
+            if (pair.second.pattern) {
+                pbc_pattern_delete(pair.second.pattern);
+            }
+        }
+        types_.clear();
+        nested_.clear();
+        pbc_delete(env_);
+    }
+
+    // load a serialized FileDescriptorSet, as written by protoc -o
+    bool load(const std::string& filename)
+    {
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            LOGF(WARNING, "pbc registry can not open %s", filename.c_str());
+            return false;
+        }
+        std::vector<char> content((std::istreambuf_iterator<char>(file)),
+                std::istreambuf_iterator<char>());
+        struct pbc_slice slice;
+        slice.buffer    = content.data();
+        slice.len       = static_cast<int>(content.size());
+        if (pbc_register(env_, &slice) != 0) {
+            LOGF(WARNING, "pbc registry load %s error = %s", filename.c_str(), pbc_error(env_));
+            return false;
+        }
+
+        pbc_rmessage* set = pbc_rmessage_new(env_, "google.protobuf.FileDescriptorSet", &slice);
+        if (!set) {
+            LOGF(WARNING, "pbc registry read %s error = %s", filename.c_str(), pbc_error(env_));
+            return false;
+        }
+        for (int i = 0; i < pbc_rmessage_size(set, "file"); ++i) {
+            pbc_rmessage* proto = pbc_rmessage_message(set, "file", i);
+            std::string package = pbc_rmessage_string(proto, "package", 0, nullptr);
+            for (int j = 0; j < pbc_rmessage_size(proto, "message_type"); ++j) {
+                load_message(pbc_rmessage_message(proto, "message_type", j), package);
+            }
+        }
+        pbc_rmessage_delete(set);
+        return true;
+    }
+
+    // the pattern of the type is compiled here, once, unless the handlers
+    // of this id want a pbc_rmessage instead
+    bool register_message(uint32_t id, const std::string& type_name,
+            bool compile_pattern = true)
+    {
+        if (pbc_type(env_, type_name.c_str(), nullptr, nullptr) == 0) {
+            LOGF(WARNING, "pbc registry unknown message type %s", type_name.c_str());
+            return false;
+        }
+        pbc_message_type& type = types_[id];
+        if (type.pattern) {
+            pbc_pattern_delete(type.pattern);
+        }
+        type.id             = id;
+        type.name           = type_name;
+        type.pattern        = nullptr;
+        type.pattern_size   = 0;
+        type.fields.clear();
+        ids_[type_name]     = id;
+        return compile_pattern ? compile(type) : true;
+    }
+
+    // replace the compiled pattern by one matching a hand written struct.
+    // format follows pbc_pattern_new with the packed "@" layout,
+    // e.g. "x %d y %d" unpacks into struct { int32_t x; int32_t y; }
+    bool register_pattern(uint32_t id, const std::string& format, std::size_t size)
+    {
+        auto it = types_.find(id);
+        if (it == types_.end()) {
+            LOGF(WARNING, "pbc registry pattern for unregistered message id = %d", id);
+            return false;
+        }
+
+        std::vector<pbc_field_layout> fields;
+        std::vector<std::string> tokens = split(format);
+        uint32_t offset = 0;
+        for (std::size_t i = 0; i + 1 < tokens.size(); i += 2) {
+            const pbc_field_desc* desc = find_field(it->second.name, tokens[i]);
+            pbc_field_layout field;
+            field.name      = tokens[i];
+            field.number    = desc ? desc->number : 0;
+            field.type      = desc ? desc->type : 0;
+            field.ctype     = tokens[i + 1].size() == 2 ? tokens[i + 1][1] : 0;
+            field.offset    = offset;
+            field.type_name = desc ? desc->type_name : "";
+            offset += ctype_size(field.ctype);
+            fields.push_back(field);
+        }
+        return set_pattern(it->second, format, size, std::move(fields));
+    }
+
+    const pbc_message_type* find(uint32_t id) const
+    {
+        auto it = types_.find(id);
+        return it == types_.end() ? nullptr : &it->second;
+    }
+
+    const pbc_message_type* find(const std::string& type_name) const
+    {
+        auto it = ids_.find(type_name);
+        return it == ids_.end() ? nullptr : find(it->second);
+    }
+
+    // registered types and the message types of their fields, which get
+    // a compiled pattern along with the type using them
+    const pbc_message_type* find_type(const std::string& type_name) const
+    {
+        const pbc_message_type* type = find(type_name);
+        if (!type) {
+            auto it = nested_.find(type_name);
+            type = it == nested_.end() ? nullptr : &it->second;
+        }
+        return type;
+    }
+
+    const std::vector<pbc_field_desc>* find_fields(const std::string& type_name) const
+    {
+        auto it = messages_.find(type_name);
+        return it == messages_.end() ? nullptr : &it->second;
+    }
+
+    // write message for a registered id, deleted with the last reference
+    std::shared_ptr<pbc_wmessage> new_wmessage(uint32_t id)
+    {
+        const pbc_message_type* type = find(id);
+        if (!type) {
+            return nullptr;
+        }
+        return std::shared_ptr<pbc_wmessage>(
+                pbc_wmessage_new(env_, type->name.c_str()), pbc_wmessage_delete);
+    }
+
+    pbc_env* env()
+    {
+        return env_;
+    }
+
+    static std::size_t ctype_size(char ctype)
+    {
+        switch (ctype) {
+            case 'c': return sizeof(int8_t);
+            case 'h': return sizeof(int16_t);
+            case 'd': return sizeof(int32_t);
+            case 'D': return sizeof(int64_t);
+            case 'f': return sizeof(float);
+            case 'F': return sizeof(double);
+            case 'b': return sizeof(bool);
+            case 's': return sizeof(pbc_slice);
+            case 'a': return sizeof(pbc_array);
+            default : return 0;
+        }
+    }
+private:
+    static const uint32_t kLabelRepeated = 3;
+
+    void load_message(pbc_rmessage* message, const std::string& scope)
+    {
+        std::string name = pbc_rmessage_string(message, "name", 0, nullptr);
+        if (!scope.empty()) {
+            name = scope + "." + name;
+        }
+
+        std::vector<pbc_field_desc>& fields = messages_[name];
+        fields.clear();
+        for (int i = 0; i < pbc_rmessage_size(message, "field"); ++i) {
+            pbc_rmessage* field = pbc_rmessage_message(message, "field", i);
+            pbc_field_desc desc;
+            desc.name       = pbc_rmessage_string(field, "name", 0, nullptr);
+            desc.number     = pbc_rmessage_integer(field, "number", 0, nullptr);
+            desc.type       = pbc_rmessage_integer(field, "type", 0, nullptr);
+            desc.repeated   = pbc_rmessage_integer(field, "label", 0, nullptr) == kLabelRepeated;
+            desc.type_name  = pbc_rmessage_string(field, "type_name", 0, nullptr);
+            if (!desc.type_name.empty() && desc.type_name[0] == '.') {
+                desc.type_name.erase(0, 1);
+            }
+            fields.push_back(desc);
+        }
+        std::sort(fields.begin(), fields.end(),
+                [](const pbc_field_desc& a, const pbc_field_desc& b){
+                    return a.number < b.number;
+                });
+
+        for (int i = 0; i < pbc_rmessage_size(message, "nested_type"); ++i) {
+            load_message(pbc_rmessage_message(message, "nested_type", i), name);
+        }
+    }
+
+    const pbc_field_desc* find_field(const std::string& type_name, const std::string& field) const
+    {
+        const std::vector<pbc_field_desc>* fields = find_fields(type_name);
+        if (fields) {
+            for (auto& desc : *fields) {
+                if (desc.name == field) {
+                    return &desc;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    static char field_ctype(const pbc_field_desc& desc)
+    {
+        if (desc.repeated) {
+            return 'a';
+        }
+        switch (desc.type) {
+            case PBC_FIELD_DOUBLE:
+                return 'F';
+            case PBC_FIELD_FLOAT:
+                return 'f';
+            case PBC_FIELD_INT64:
+            case PBC_FIELD_UINT64:
+            case PBC_FIELD_FIXED64:
+            case PBC_FIELD_SFIXED64:
+            case PBC_FIELD_SINT64:
+                return 'D';
+            case PBC_FIELD_INT32:
+            case PBC_FIELD_UINT32:
+            case PBC_FIELD_FIXED32:
+            case PBC_FIELD_SFIXED32:
+            case PBC_FIELD_SINT32:
+            case PBC_FIELD_ENUM:
+                return 'd';
+            case PBC_FIELD_BOOL:
+                return 'b';
+            case PBC_FIELD_STRING:
+            case PBC_FIELD_BYTES:
+            case PBC_FIELD_MESSAGE:
+                return 's';
+            default:
+                return 0;
+        }
+    }
+
+    // lay the fields out by falling size, arrays and slices first, so every
+    // field of the packed "@" layout is naturally aligned. fields of the same
+    // size keep their field number order
+    bool compile(pbc_message_type& type)
+    {
+        const std::vector<pbc_field_desc>* descs = find_fields(type.name);
+        if (!descs) {
+            LOGF(WARNING, "pbc registry no descriptor for %s", type.name.c_str());
+            return false;
+        }
+
+        std::vector<pbc_field_layout> fields;
+        for (auto& desc : *descs) {
+            pbc_field_layout field;
+            field.name      = desc.name;
+            field.number    = desc.number;
+            field.type      = desc.type;
+            field.ctype     = field_ctype(desc);
+            field.offset    = 0;
+            field.type_name = desc.type_name;
+            if (!field.ctype) {
+                LOGF(WARNING, "pbc registry can not pattern field %s of %s",
+                        desc.name.c_str(), type.name.c_str());
+                return false;
+            }
+            fields.push_back(field);
+        }
+        std::stable_sort(fields.begin(), fields.end(),
+                [](const pbc_field_layout& a, const pbc_field_layout& b){
+                    return ctype_size(a.ctype) > ctype_size(b.ctype);
+                });
+
+        std::string format;
+        uint32_t offset = 0;
+        for (auto& field : fields) {
+            field.offset = offset;
+            offset += ctype_size(field.ctype);
+            // a trailing blank makes pbc scan no field at all
+            format.append(format.empty() ? "" : " ").append(field.name)
+                .append(" %").append(1, field.ctype);
+        }
+        std::sort(fields.begin(), fields.end(),
+                [](const pbc_field_layout& a, const pbc_field_layout& b){
+                    return a.number < b.number;
+                });
+
+        std::size_t size = (offset + sizeof(int64_t) - 1) / sizeof(int64_t) * sizeof(int64_t);
+        if (!set_pattern(type, format, size, std::move(fields))) {
+            return false;
+        }
+
+        for (auto& field : type.fields) {
+            if (field.type != PBC_FIELD_MESSAGE || find_type(field.type_name)) {
+                continue;
+            }
+            // inserted before compiling so recursive types stop here
+            pbc_message_type& nested = nested_[field.type_name];
+            nested.id           = 0;
+            nested.name         = field.type_name;
+            nested.pattern      = nullptr;
+            nested.pattern_size = 0;
+            if (!compile(nested)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool set_pattern(pbc_message_type& type, const std::string& format,
+            std::size_t size, std::vector<pbc_field_layout>&& fields)
+    {
+        std::string packed_format = "@" + format;
+        pbc_pattern* pattern = pbc_pattern_new(env_, type.name.c_str(), packed_format.c_str());
+        if (!pattern) {
+            LOGF(WARNING, "pbc registry pattern %s for %s error = %s", format.c_str(),
+                    type.name.c_str(), pbc_error(env_));
+            return false;
+        }
+        if (type.pattern) {
+            pbc_pattern_delete(type.pattern);
+        }
+        type.pattern        = pattern;
+        type.pattern_size   = size;
+        type.fields         = std::move(fields);
+        return true;
+    }
+
+    static std::vector<std::string> split(const std::string& format)
+    {
+        std::vector<std::string> tokens;
+        std::size_t begin = format.find_first_not_of(" \t\r\n");
+        while (begin != std::string::npos) {
+            std::size_t end = format.find_first_of(" \t\r\n", begin);
+            tokens.push_back(format.substr(begin, end - begin));
+            begin = format.find_first_not_of(" \t\r\n", end);
+        }
+        return tokens;
+    }
+
+    pbc_env*                                                        env_;
+    std::unordered_map<uint32_t, pbc_message_type>                  types_;
+    std::unordered_map<std::string, uint32_t>                       ids_;
+    std::unordered_map<std::string, pbc_message_type>               nested_;
+    std::unordered_map<std::string, std::vector<pbc_field_desc>>    messages_;
+}; // class pbc_registry
+
+} // namespace engine
+
+#endif // ENGINE_HANDLER_PBC_REGISTRY_H
@@ -10,24 +10,61 @@ std::shared_ptr<asio_buffer> pipeline::read_buffer()
     return session_->read_buffer();
 }
 
+// a decoder or an encoder may run on a pipeline of no session, its
+// writes have no buffer and go nowhere
+void pipeline::expect_read(std::size_t readable)
+{
+    if (session_) {
+        session_->expect_read(readable);
+    }
+}
+
+std::unique_lock<std::recursive_mutex> pipeline::lock_write()
+{
+    if (!session_) {
+        return std::unique_lock<std::recursive_mutex>();
+    }
+    return session_->lock_write();
+}
+
 std::shared_ptr<asio_buffer> pipeline::write_buffer()
 {
+    if (!session_) {
+        return nullptr;
+    }
     return session_->write_buffer();
 }
 
 void pipeline::notify_write(std::size_t length)
 {
-    session_->notify_write(length);
+    if (session_) {
+        session_->notify_write(length);
+    }
+}
+
+void pipeline::write_droppable(const std::shared_ptr<data_block>& block)
+{
+    session_->queue_droppable(block);
+}
+
+bool pipeline::closing()
+{
+    return session_ && session_->closing();
 }
 
 uint32_t pipeline::session_id()
 {
+    if (!session_) {
+        return session_id_;
+    }
     return session_->id();
 }
 
 void pipeline::close()
 {
-    session_->close();
+    if (session_) {
+        session_->close();
+    }
 }
 
 } // namespace engine
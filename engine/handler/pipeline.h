@@ -1,9 +1,13 @@
 #ifndef ENGINE_HANDLER_PIPELINE_H
 #define ENGINE_HANDLER_PIPELINE_H
 
+#include <memory>
+#include <mutex>
+
 #include <third_party/g3log/g3log/g3log.hpp>
 
 #include <engine/common/any.h>
+#include <engine/common/metrics.h>
 #include <engine/handler/context.h>
 #include <engine/net/asio_buffer.h>
 
@@ -16,8 +20,11 @@ class pipeline
 public:
     pipeline(const pipeline&) = delete;
     pipeline& operator=(const pipeline&) = delete;
-    explicit pipeline(session* session)
+    // a pipeline of no session, e.g. a client behind a route link, goes by
+    // the session id it is given
+    explicit pipeline(session* session, uint32_t session_id = 0)
         : session_(session)
+        , session_id_(session_id)
     {
         head_ = new head_context(this);
         tail_ = new tail_context(this);
@@ -34,15 +41,51 @@ public:
         head_ = nullptr;
     }    
 
+    // a pipeline shared by its owner, a close going through it holds it
+    // until the call returns
+    static std::shared_ptr<pipeline> create(session* session, uint32_t session_id = 0)
+    {
+        auto created = std::make_shared<pipeline>(session, session_id);
+        created->self_ = created;
+        return created;
+    }
+
+    // null for a pipeline its owner does not share
+    std::shared_ptr<pipeline> keep_alive()
+    {
+        return self_.lock();
+    }
+
     std::shared_ptr<asio_buffer> read_buffer();
 
+    void expect_read(std::size_t readable);
+
+    std::unique_lock<std::recursive_mutex> lock_write();
+
     std::shared_ptr<asio_buffer> write_buffer();
 
     void notify_write(std::size_t length);
 
+    // the session is closing, whatever is appended now is never sent
+    bool closing();
+
+    void write_droppable(const std::shared_ptr<data_block>& block);
+
+    // any thread, the append and its notify_write under the session's lock
     void write(std::unique_ptr<any> msg)
     {
-        if (write_data_struct<read_data>(*msg)) {}
+        get_stats().writes.add();
+        if (!session_) {
+            return;
+        }
+        auto lock = lock_write();
+        if (closing()) {
+            return;
+        }
+        if (msg->type() == typeid(droppable_data)) {
+            write_droppable(any_cast<droppable_data>(msg.get())->block);
+        }
+        else if (write_data_struct<read_data>(*msg)) {}
         else if (write_data_struct<write_data>(*msg)) {}
         else if (write_string_type<std::string>(*msg)) {}
         else if (write_string_type<std::string&>(*msg)) {}
@@ -60,6 +103,7 @@ public:
         else if (write_base_data_type<double>(*msg)) {}
         else if (write_base_data_type<long double>(*msg)) {}
         else {
+            get_stats().write_errors.add();
             throw std::bad_cast();
         }
     }
@@ -92,6 +136,12 @@ public:
                     std::unique_ptr<any>(wrap_buffer)));
     }
 
+    // a message its owner hands in, for a pipeline of no session
+    void fire_read(std::unique_ptr<any> msg)
+    {
+        head_->read(std::move(msg));
+    }
+
     void fire_closed()
     {
         head_->notify_closed();
@@ -108,6 +158,20 @@ public:
     }
 
 private:
+    struct stats
+    {
+        metrics::counter    writes{"joker_pipeline_writes_total",
+            "messages written through a pipeline head"};
+        metrics::counter    write_errors{"joker_pipeline_write_errors_total",
+            "messages of a type the pipeline head cannot write"};
+    };
+
+    static const stats& get_stats()
+    {
+        static stats s;
+        return s;
+    }
+
     template<typename BASE_DATA_TYPE>
     bool write_base_data_type(any msg)
     {
@@ -223,10 +287,12 @@ private:
     }; // class tail_context
 
     session*    session_;
+    uint32_t    session_id_;
     context*    head_;
     context*    tail_;
     std::vector<std::unique_ptr<context>> contexts_;
     any         user_data_;
+    std::weak_ptr<pipeline> self_;
 }; // class pipeline
 
 } // namespace engine
@@ -0,0 +1,232 @@
+#ifndef ENGINE_HANDLER_ROUTE_BACKEND_HANDLER_H
+#define ENGINE_HANDLER_ROUTE_BACKEND_HANDLER_H
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <engine/common/any.h>
+#include <engine/common/common.h>
+#include <engine/common/data_block.h>
+#include <engine/handler/abstract_handler.h>
+#include <engine/handler/pbc_codec.h>
+#include <engine/handler/pipeline.h>
+#include <engine/handler/route_handler.h>
+
+namespace engine
+{
+
+/**
+ * <pre>
+ * link:            route_backend_handler
+ * virtual session: codec(length 0) -> route reply -> the logic handlers
+ *
+ * +--------+-------------+--------+--------+---------------+
+ * | Length | Destination | Source | Msg id | Protobuf body |
+ * | 4 B    | 4 B         | 4 B    | 2 B    |               |
+ * +--------+-------------+--------+--------+---------------+
+ * </pre>
+ *
+ * the backend end of a route link. every Source seen on the link is a
+ * client of the route and gets a virtual session, a pipeline of no session
+ * with an id of its own, so the logic handlers and net_manager treat it as
+ * any other session. the route Length already frames the payload, which
+ * is a pbc frame without its length field.
+ *
+ * a reply written to a virtual session goes back on the link with
+ * Destination set to the client's Source and Source set to server_id. the
+ * route sends no close for a client, a virtual session lives until the
+ * logic closes it or the link goes down
+ */
+class route_backend_handler : public abstract_handler
+{
+public:
+    typedef std::function<void(pipeline&)> init_handler;
+
+    route_backend_handler(const route_backend_handler&) = delete;
+    route_backend_handler& operator=(const route_backend_handler&) = delete;
+    // init_handlers adds the logic handlers behind the codec of every
+    // virtual session
+    route_backend_handler(uint32_t max_frame_length, uint32_t server_id,
+            std::shared_ptr<pbc_registry> registry, bool decode_body,
+            const init_handler& init_handlers)
+        : framer_(max_frame_length, [this](context*, uint32_t, uint32_t source,
+                    std::shared_ptr<data_block> frame){dispatch(source, frame);}, false)
+        , server_id_(server_id)
+        , registry_(registry)
+        , decode_body_(decode_body)
+        , init_handlers_(init_handlers)
+        , link_(nullptr)
+    {
+    }
+
+    virtual void connect(context* ctx)
+    {
+        link_ = ctx;
+        ctx->fire_connect();
+    }
+
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        framer_.decode(ctx, std::move(msg));
+        close_clients(false);
+    }
+
+    virtual void notify_closed(context* ctx)
+    {
+        close_clients(true);
+        ctx->fire_closed();
+    }
+private:
+    // sits behind the codec so a reply reaches it whole
+    class reply_handler : public abstract_handler
+    {
+    public:
+        reply_handler(const reply_handler&) = delete;
+        reply_handler& operator=(const reply_handler&) = delete;
+        reply_handler(route_backend_handler* owner, uint32_t source)
+            : owner_(owner)
+            , source_(source)
+        {
+        }
+
+        virtual void encode(context* ctx, std::unique_ptr<any> msg)
+        {
+            if (msg->type() == typeid(pbc_out_message)) {
+                owner_->write_reply(source_, *any_cast<pbc_out_message>(msg.get()));
+            } else if (msg->type() == typeid(read_data)) {
+                const read_data& data = *any_cast<read_data>(msg.get());
+                owner_->write_reply(source_, nullptr, 0, data.data, data.len);
+            } else if (msg->type() == typeid(droppable_data)) {
+                // the link is shared by many clients, nothing on it is dropped
+                const data_block& block = *any_cast<droppable_data>(msg.get())->block;
+                owner_->write_reply(source_, nullptr, 0, block.data, block.len);
+            } else {
+                ctx->fire_write(std::move(msg));
+            }
+        }
+
+        virtual void close(context* ctx)
+        {
+            owner_->close_client(source_);
+        }
+    private:
+        route_backend_handler*  owner_;
+        uint32_t                source_;
+    }; // class reply_handler
+
+    // the io or work thread of the link
+    void dispatch(uint32_t source, std::shared_ptr<data_block> frame)
+    {
+        pipeline* client = nullptr;
+        bool opened = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::shared_ptr<pipeline>& slot = clients_[source];
+            if (!slot) {
+                slot = pipeline::create(nullptr, get_session_increase_id());
+                slot->add_handler("codec", std::make_shared<pbc_codec>(registry_, 0, true, decode_body_))
+                    .add_handler("route", std::make_shared<reply_handler>(this, source));
+                init_handlers_(*slot);
+                opened = true;
+            }
+            client = slot.get();
+        }
+        // only the link's thread frees a virtual session
+        if (opened) {
+            client->fire_connect();
+        }
+        read_data payload;
+        payload.data    = frame->data + route_handler::kHeaderLength;
+        payload.len     = frame->len - route_handler::kHeaderLength;
+        client->fire_read(std::unique_ptr<any>(new any(payload)));
+    }
+
+    // any thread, from inside the logic's close of the session. the link's
+    // thread may free the pipeline before that close returns, the close
+    // holds it meanwhile
+    void close_client(uint32_t source)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = clients_.find(source);
+        if (it != clients_.end()) {
+            closed_.push_back(std::move(it->second));
+            clients_.erase(it);
+        }
+    }
+
+    // the link's thread, outside of any lock the logic holds. all of them
+    // once the link is closed
+    void close_clients(bool all)
+    {
+        std::vector<std::shared_ptr<pipeline>> closing;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closing.swap(closed_);
+            if (all) {
+                for (auto& pair : clients_) {
+                    closing.push_back(std::move(pair.second));
+                }
+                clients_.clear();
+            }
+        }
+        for (auto& client : closing) {
+            client->fire_closed();
+        }
+    }
+
+    void write_reply(uint32_t source, const pbc_out_message& message)
+    {
+        if (!message.wmessage) {
+            return;
+        }
+        struct pbc_slice slice;
+        pbc_wmessage_buffer(message.wmessage.get(), &slice);
+        char id[pbc_codec::kMaxHeaderLength];
+        std::size_t id_len = pbc_codec::write_header(id, message.id, slice.len, 0, true);
+        write_reply(source, id, id_len, static_cast<const char*>(slice.buffer), slice.len);
+    }
+
+    // the route header, prefix and body copied into the link's write buffer
+    // with no other writer in between
+    void write_reply(uint32_t source, const char* prefix, std::size_t prefix_len,
+            const char* body, std::size_t body_len)
+    {
+        char header[route_handler::kHeaderLength];
+        route_handler::write_header(header, source, server_id_, prefix_len + body_len);
+        auto lock = link_->lock_write();
+        if (link_->closing()) {
+            return;
+        }
+        read_data data;
+        data.data   = header;
+        data.len    = sizeof header;
+        link_->fire_write(std::unique_ptr<any>(new any(data)));
+        if (prefix_len > 0) {
+            data.data   = prefix;
+            data.len    = prefix_len;
+            link_->fire_write(std::unique_ptr<any>(new any(data)));
+        }
+        if (body_len > 0) {
+            data.data   = body;
+            data.len    = body_len;
+            link_->fire_write(std::unique_ptr<any>(new any(data)));
+        }
+    }
+
+    route_handler                               framer_;
+    uint32_t                                    server_id_;
+    std::shared_ptr<pbc_registry>               registry_;
+    bool                                        decode_body_;
+    init_handler                                init_handlers_;
+    context*                                    link_;
+    std::mutex                                  mutex_;
+    std::map<uint32_t, std::shared_ptr<pipeline>> clients_;    // by Source
+    std::vector<std::shared_ptr<pipeline>>      closed_;    // closed by the logic, not yet notified
+}; // class route_backend_handler
+
+} // namespace engine
+
+#endif // ENGINE_HANDLER_ROUTE_BACKEND_HANDLER_H
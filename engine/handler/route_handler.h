@@ -0,0 +1,108 @@
+#ifndef ENGINE_HANDLER_ROUTE_HANDLER_H
+#define ENGINE_HANDLER_ROUTE_HANDLER_H
+
+#include <functional>
+#include <memory>
+
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/common/any.h>
+#include <engine/common/data_block.h>
+#include <engine/common/logger.h>
+#include <engine/handler/abstract_handler.h>
+#include <engine/net/asio_buffer.h>
+#include <engine/net/endian.h>
+
+namespace engine
+{
+
+/**
+ * <pre>
+ * +--------+-------------+--------+------------------+
+ * | Length | Destination | Source | Payload          |
+ * | 4 B    | 4 B         | 4 B    | Length - 8 bytes |
+ * +--------+-------------+--------+------------------+
+ * </pre>
+ *
+ * the route frame, big endian. Length counts everything after itself. a
+ * client addresses a backend server id and the route stamps its own
+ * session id as Source. a backend answers with Destination set to that
+ * session id.
+ *
+ * only the header is looked at. each frame is moved out of the read
+ * buffer once and handed to forward as a shared block, which the target
+ * session sends as is
+ */
+class route_handler : public abstract_handler
+{
+public:
+    static const std::size_t kHeaderLength          = 3 * sizeof(uint32_t);
+    static const std::size_t kDestinationOffset     = sizeof(uint32_t);
+    static const std::size_t kSourceOffset          = 2 * sizeof(uint32_t);
+
+    typedef std::function<void(context*, uint32_t, uint32_t, std::shared_ptr<data_block>)>
+        forward_handler;
+
+    route_handler(const route_handler&) = delete;
+    route_handler& operator=(const route_handler&) = delete;
+    // forward(ctx, destination, source, frame). with stamp_source the
+    // Source field is overwritten by the session id the frame came from
+    route_handler(uint32_t max_frame_length, const forward_handler& forward,
+            bool stamp_source)
+        : max_frame_length_(max_frame_length)
+        , forward_(forward)
+        , stamp_source_(stamp_source)
+    {
+    }
+
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        auto buffer = any_cast<std::shared_ptr<asio_buffer>>(*msg);
+        while (buffer->readable_bytes() >= kHeaderLength) {
+            uint32_t length = buffer->peek_index_endian<uint32_t>(0, true);
+            if (length < kHeaderLength - sizeof(uint32_t)
+                    || length + sizeof(uint32_t) > max_frame_length_) {
+                JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "route frame length = %d, max_frame_length = %d, close session id = %d",
+                        length, max_frame_length_, ctx->session_id());
+                buffer->retrieve(buffer->readable_bytes());
+                ctx->fire_close();
+                return;
+            }
+            std::size_t frame_length = length + sizeof(uint32_t);
+            if (buffer->readable_bytes() < frame_length) {
+                return;
+            }
+
+            std::shared_ptr<data_block> frame(buffer->read(frame_length).release());
+            uint32_t destination = adapte_endian<uint32_t>(*reinterpret_cast<uint32_t*>(
+                        frame->data + kDestinationOffset), true);
+            uint32_t source = ctx->session_id();
+            if (stamp_source_) {
+                *reinterpret_cast<uint32_t*>(frame->data + kSourceOffset) =
+                    adapte_endian<uint32_t>(source, true);
+            } else {
+                source = adapte_endian<uint32_t>(*reinterpret_cast<uint32_t*>(
+                            frame->data + kSourceOffset), true);
+            }
+            forward_(ctx, destination, source, frame);
+        }
+    }
+
+    // header of a frame carrying payload_length bytes, for the endpoints
+    static void write_header(char* header, uint32_t destination, uint32_t source,
+            std::size_t payload_length)
+    {
+        uint32_t* fields = reinterpret_cast<uint32_t*>(header);
+        fields[0] = adapte_endian<uint32_t>(
+                static_cast<uint32_t>(payload_length + kHeaderLength - sizeof(uint32_t)), true);
+        fields[1] = adapte_endian<uint32_t>(destination, true);
+        fields[2] = adapte_endian<uint32_t>(source, true);
+    }
+private:
+    uint32_t            max_frame_length_;
+    forward_handler     forward_;
+    bool                stamp_source_;
+}; // class route_handler
+
+} // namespace engine
+
+#endif // ENGINE_HANDLER_ROUTE_HANDLER_H
@@ -10,13 +10,14 @@ asio_buffer::asio_buffer(std::size_t initial_size)
     , high_water_mask_(0)
     , notify_behind_high_water_mask_(nullptr)
 {
-    block_ptr fake_block(new data_block(1));
-    buffer_.push_back(fake_block);
+    fake_block_.reset(new data_block(1));
+    buffer_.push_back(fake_block_);
     read_buffer_iter_ = buffer_.begin();
     write_buffer_iter_ = buffer_.begin();
     block_size_ = ((initial_size % kInitialSize == 0) 
         ? (initial_size / kInitialSize) 
         : (initial_size / kInitialSize + 1)) * kInitialSize;
+    pool_ = block_pool::shared(block_size_);
     readable_bytes_ = 0;
     writable_bytes_ = 1;
     total_bytes_    = 1;
@@ -24,16 +25,20 @@ asio_buffer::asio_buffer(std::size_t initial_size)
 
 asio_buffer::~asio_buffer()
 {
+    if (active_) {
+        for (auto& block : buffer_) {
+            pool_->release(std::move(block));
+        }
+    }
 }
 
 void asio_buffer::check_active()
 {
     if (!active_) {
         char first_char = (*buffer_.begin())->data[0];
-        (*buffer_.begin()).reset(new data_block(block_size_));
+        (*buffer_.begin()) = pool_->acquire();
         (*buffer_.begin())->data[0] = first_char;
-        block_ptr new_block(new data_block(block_size_));
-        buffer_.push_back(new_block);
+        buffer_.push_back(pool_->acquire());
         writable_bytes_ = 2 * block_size_;
         total_bytes_    = 2 * block_size_;
         active_ = true;
@@ -56,10 +61,19 @@ void asio_buffer::adjust_buffer(std::size_t len)
             low_use_count_ += 1;
         }
         if (low_use_count_ >= kLowUseCeilCount) {
+            buffer_iter write_buffer_iter;
+            std::size_t write_index;
+            get_write_index(write_buffer_iter, write_index);
             std::size_t reduce_len = total_bytes_ / 4;
-            while (reduce_len >= (*buffer_.rbegin())->len) {
+            // only whole free blocks behind the write block may go, and the
+            // pending write of len bytes must still leave a byte to write
+            while (reduce_len >= (*buffer_.rbegin())->len
+                    && std::prev(buffer_.end()) != write_buffer_iter
+                    && writable_bytes_ > len + (*buffer_.rbegin())->len) {
                 reduce_len -= (*buffer_.rbegin())->len;
                 total_bytes_ -= (*buffer_.rbegin())->len;
+                writable_bytes_ -= (*buffer_.rbegin())->len;
+                pool_->release(std::move(buffer_.back()));
                 buffer_.pop_back();
             } 
             low_use_count_ = 0;
@@ -92,10 +106,30 @@ void asio_buffer::check_to_add_block(std::size_t len)
     }
 }
 
+bool asio_buffer::release()
+{
+    if (!active_ || readable_bytes_ != 0) {
+        return false;
+    }
+
+    for (auto& block : buffer_) {
+        pool_->release(std::move(block));
+    }
+    buffer_.clear();
+    buffer_.push_back(fake_block_);
+    read_buffer_iter_   = buffer_.begin();
+    read_index_         = 0;
+    set_write_index(buffer_.begin(), 0);
+    writable_bytes_     = 1;
+    total_bytes_        = 1;
+    low_use_count_      = 0;
+    active_             = false;
+    return true;
+}
+
 std::size_t asio_buffer::add_block()
 {
-    block_ptr new_block(new data_block(block_size_));
-    buffer_.push_back(new_block);
+    buffer_.push_back(pool_->acquire());
     writable_bytes_ += block_size_;
     total_bytes_    += block_size_;
     return block_size_;
@@ -150,9 +184,11 @@ asio_buffer& asio_buffer::append(const char* /*restrict*/ data, std::size_t len)
         std::copy(data, data + remain_len, (*temp_write_buffer_iter)->data);
     }
 
+    // count the bytes before the write index exposes them, the io thread may
+    // send and retrieve them as soon as the index moves
+    write_bytes(len);
     adjust_index(len, write_buffer_iter, write_index);
     set_write_index(write_buffer_iter, write_index);
-    write_bytes(len);
     return *this;
 }
 
@@ -191,6 +227,46 @@ std::unique_ptr<data_block> asio_buffer::peek(std::size_t len)
     return block;
 }
 
+void asio_buffer::peek_index(std::size_t index, void* data, std::size_t len)
+{
+    assert(index + len <= readable_bytes_);
+    buffer_iter iter = read_buffer_iter_;
+    std::size_t offset = read_index_;
+    adjust_index(index, iter, offset);
+    char* out = static_cast<char*>(data);
+    while (len > 0) {
+        if (offset == (*iter)->len) {
+            iter++;
+            offset = 0;
+        }
+        std::size_t copy_len = std::min(len, (*iter)->len - offset);
+        std::copy((*iter)->data + offset, (*iter)->data + offset + copy_len, out);
+        out     += copy_len;
+        offset  += copy_len;
+        len     -= copy_len;
+    }
+}
+
+void asio_buffer::overwrite(std::size_t index, const void* data, std::size_t len)
+{
+    assert(index + len <= readable_bytes_);
+    buffer_iter iter = read_buffer_iter_;
+    std::size_t offset = read_index_;
+    adjust_index(index, iter, offset);
+    const char* in = static_cast<const char*>(data);
+    while (len > 0) {
+        if (offset == (*iter)->len) {
+            iter++;
+            offset = 0;
+        }
+        std::size_t copy_len = std::min(len, (*iter)->len - offset);
+        std::copy(in, in + copy_len, (*iter)->data + offset);
+        in      += copy_len;
+        offset  += copy_len;
+        len     -= copy_len;
+    }
+}
+
 void asio_buffer::retrieve(std::size_t len)
 {
     assert(len <= readable_bytes_);
@@ -215,9 +291,10 @@ void asio_buffer::has_written(std::size_t len)
     buffer_iter write_buffer_iter;
     std::size_t write_index;
     get_write_index(write_buffer_iter, write_index);
+    // counted before the index moves, as in append
+    write_bytes(len);
     adjust_index(len, write_buffer_iter, write_index);
     set_write_index(write_buffer_iter, write_index);
-    write_bytes(len);
 }
 
 std::vector<asio::mutable_buffer>& asio_buffer::mutable_buffer()
@@ -237,6 +314,27 @@ std::vector<asio::mutable_buffer>& asio_buffer::mutable_buffer()
     return mutable_buffer_;
 }
 
+std::vector<asio::mutable_buffer>& asio_buffer::mutable_buffer(std::size_t max_len)
+{
+    check_active();
+    buffer_iter write_buffer_iter;
+    std::size_t write_index;
+    get_write_index(write_buffer_iter, write_index);
+    mutable_buffer_.clear();
+    std::size_t len = std::min(max_len, (*write_buffer_iter)->len - write_index);
+    mutable_buffer_.push_back(
+        asio::buffer((*write_buffer_iter)->data + write_index, len));
+    max_len -= len;
+    buffer_iter iter = write_buffer_iter;
+    iter++;
+    for (; iter != buffer_.end() && max_len > 0; ++iter) {
+        len = std::min(max_len, (*iter)->len);
+        mutable_buffer_.push_back(asio::buffer((*iter)->data, len));
+        max_len -= len;
+    }
+    return mutable_buffer_;
+}
+
 const std::vector<asio::const_buffer>& asio_buffer::const_buffer()
 {
     buffer_iter write_buffer_iter;
@@ -1,10 +1,15 @@
 #ifndef ENGINE_NET_ASIO_BUFFER_H
 #define ENGINE_NET_ASIO_BUFFER_H
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <list>
 #include <mutex>
+#include <vector>
 #include <third_party/asio.hpp>
 #include <engine/common/data_block.h>
+#include <engine/net/block_pool.h>
 #include <engine/net/endian.h>
 
 namespace engine
@@ -44,6 +49,30 @@ public:
         return append_endian(x, true);
     }
 
+    // count values in one go, converted through a stack chunk so a long
+    // array costs a few appends instead of one per value
+    template<typename BASE_DATA_TYPE>
+    asio_buffer& append_endian(const BASE_DATA_TYPE* values, std::size_t count, bool big_endian)
+    {
+        const std::size_t kChunkValues = 256 / sizeof(BASE_DATA_TYPE);
+        BASE_DATA_TYPE chunk[256 / sizeof(BASE_DATA_TYPE)];
+        while (count > 0) {
+            std::size_t n = std::min(count, kChunkValues);
+            adapte_endian<BASE_DATA_TYPE>(chunk, values, n, big_endian);
+            append(chunk, n * sizeof(BASE_DATA_TYPE));
+            values  += n;
+            count   -= n;
+        }
+        return *this;
+    }
+
+    // big endian, like append of a single value
+    template<typename BASE_DATA_TYPE>
+    asio_buffer& append(const std::vector<BASE_DATA_TYPE>& values)
+    {
+        return append_endian(values.data(), values.size(), true);
+    }
+
     asio_buffer& append(const std::string& str)
     {
         return append(str.data(), str.size());
@@ -51,6 +80,13 @@ public:
 
     std::unique_ptr<data_block> peek(std::size_t len);
 
+    // copies len readable bytes from index on into data, without a block
+    void peek_index(std::size_t index, void* data, std::size_t len);
+
+    // replaces len readable bytes from index on, for a header that is only
+    // known once the body is in. only while no other thread sends them
+    void overwrite(std::size_t index, const void* data, std::size_t len);
+
     template<typename BASE_DATA_TYPE>
     BASE_DATA_TYPE peek_index_endian(std::size_t index, bool big_endian)
     {
@@ -103,6 +139,15 @@ public:
 
     void retrieve(std::size_t len);
     void has_written(std::size_t len);
+
+    // at least len free bytes after the written ones. filled through
+    // write_buffer() they stay invisible to the reader until has_written
+    void ensure_writable(std::size_t len)
+    {
+        check_active();
+        adjust_buffer(len);
+    }
+
     void set_notify_behind_high_water_mask(const std::function<void()>& handler, std::size_t mask)
     {
         notify_behind_high_water_mask_ = handler;
@@ -119,7 +164,25 @@ public:
         return writable_bytes_;
     }
 
+    // bytes of blocks held by the buffer, 1 while it is inactive
+    std::size_t total_bytes() const
+    {
+        return total_bytes_;
+    }
+
+    bool active() const
+    {
+        return active_;
+    }
+
+    // give every block back to the pool once everything was read, the
+    // buffer turns inactive until the next append or has_written
+    bool release();
+
     std::vector<asio::mutable_buffer>& mutable_buffer();
+    // expose at most max_len bytes of free space. only used once data is
+    // known to be waiting, so an inactive buffer is activated first
+    std::vector<asio::mutable_buffer>& mutable_buffer(std::size_t max_len);
     const std::vector<asio::const_buffer>& const_buffer();
     std::vector<write_data>& write_buffer();
     const std::vector<read_data>& read_buffer();
@@ -164,6 +227,8 @@ private:
 
     void adjust_index(std::size_t len, buffer_iter& iter, std::size_t& index);
 private:
+    std::shared_ptr<block_pool>         pool_;
+    block_ptr                           fake_block_;
     std::list<block_ptr>                buffer_;
     std::vector<asio::mutable_buffer>   mutable_buffer_;
     std::vector<asio::const_buffer>     const_buffer_;
@@ -174,7 +239,7 @@ private:
     std::size_t                         read_index_;
     std::size_t                         write_index_;
     std::size_t                         block_size_;
-    std::size_t                         readable_bytes_;
+    std::atomic_size_t                  readable_bytes_;    // appender and reader threads
     std::size_t                         writable_bytes_;
     std::size_t                         total_bytes_;
     std::size_t                         low_use_count_;
@@ -0,0 +1,247 @@
+#ifndef ENGINE_NET_BINARY_READER_H
+#define ENGINE_NET_BINARY_READER_H
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <engine/net/asio_buffer.h>
+#include <engine/net/endian.h>
+
+namespace engine
+{
+
+/**
+ * reads what binary_writer wrote straight out of the blocks of an
+ * asio_buffer, without a data_block in between.
+ *
+ * reading only moves the offset of the reader. commit() retrieves the
+ * bytes read so far from the buffer, rewind() goes back to the last
+ * commit, so a message that is still on its way is read again from its
+ * start once more bytes are in.
+ *
+ * a read that fails leaves the reader failed until rewind(), truncated()
+ * tells a message that is not complete yet from a malformed one
+ */
+class binary_reader
+{
+public:
+    static const std::size_t kMaxLength = 1 << 20;     // of a string or vector
+
+    binary_reader(const binary_reader&) = delete;
+    binary_reader& operator=(const binary_reader&) = delete;
+    explicit binary_reader(asio_buffer& buffer)
+        : buffer_(buffer)
+        , offset_(0)
+        , good_(true)
+        , truncated_(false)
+    {
+    }
+
+    bool good() const
+    {
+        return good_;
+    }
+
+    bool truncated() const
+    {
+        return truncated_;
+    }
+
+    // bytes read since the last commit
+    std::size_t offset() const
+    {
+        return offset_;
+    }
+
+    std::size_t remaining() const
+    {
+        return buffer_.readable_bytes() - offset_;
+    }
+
+    bool read_bytes(void* data, std::size_t len)
+    {
+        if (!good_) {
+            return false;
+        }
+        if (len > remaining()) {
+            return fail(true);
+        }
+        buffer_.peek_index(offset_, data, len);
+        offset_ += len;
+        return true;
+    }
+
+    template<typename BASE_DATA_TYPE>
+    bool read_fixed(BASE_DATA_TYPE& value, bool big_endian = true)
+    {
+        if (!read_bytes(&value, sizeof value)) {
+            return false;
+        }
+        value = adapte_endian<BASE_DATA_TYPE>(value, big_endian);
+        return true;
+    }
+
+    bool read_varint(uint64_t& value)
+    {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!read_bytes(&byte, 1)) {
+                return false;
+            }
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return fail(false);
+    }
+
+    bool read_svarint(int64_t& value)
+    {
+        uint64_t zigzag;
+        if (!read_varint(zigzag)) {
+            return false;
+        }
+        value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+        return true;
+    }
+
+    bool read_string(std::string& str)
+    {
+        uint64_t len;
+        if (!read_length(len)) {
+            return false;
+        }
+        if (len > remaining()) {
+            return fail(true);
+        }
+        str.resize(len);
+        return read_bytes(&str[0], len);
+    }
+
+    template<typename BASE_DATA_TYPE>
+    bool read_array(BASE_DATA_TYPE* values, std::size_t count, bool big_endian = true)
+    {
+        if (!read_bytes(values, count * sizeof(BASE_DATA_TYPE))) {
+            return false;
+        }
+        adapte_endian<BASE_DATA_TYPE>(values, values, count, big_endian);
+        return true;
+    }
+
+    // a value of any type the struct description allows
+    template<typename T>
+    bool read(T& value)
+    {
+        read_value(value);
+        return good_;
+    }
+
+    // the visitor a fields member template is called with
+    template<typename... FIELDS>
+    void operator()(FIELDS&... fields)
+    {
+        int expand[] = {0, (read_value(fields), 0)...};
+        (void)expand;
+    }
+
+    // the bytes read so far leave the buffer
+    void commit()
+    {
+        buffer_.retrieve(offset_);
+        offset_ = 0;
+    }
+
+    void rewind()
+    {
+        offset_     = 0;
+        good_       = true;
+        truncated_  = false;
+    }
+
+private:
+    bool fail(bool truncated)
+    {
+        good_       = false;
+        truncated_  = truncated;
+        return false;
+    }
+
+    bool read_length(uint64_t& len)
+    {
+        if (!read_varint(len)) {
+            return false;
+        }
+        if (len > kMaxLength) {
+            return fail(false);
+        }
+        return true;
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type
+    read_value(T& value)
+    {
+        read_fixed<T>(value);
+    }
+
+    void read_value(std::string& str)
+    {
+        read_string(str);
+    }
+
+    template<typename T>
+    void read_value(std::vector<T>& values)
+    {
+        uint64_t count;
+        if (!read_length(count)) {
+            return;
+        }
+        read_elements(values, count, std::is_arithmetic<T>());
+    }
+
+    template<typename T>
+    typename std::enable_if<std::is_class<T>::value>::type
+    read_value(T& value)
+    {
+        value.fields(*this);
+    }
+
+    template<typename T>
+    void read_elements(std::vector<T>& values, std::size_t count, std::true_type)
+    {
+        if (count * sizeof(T) > remaining()) {
+            fail(true);
+            return;
+        }
+        values.resize(count);
+        read_array(values.data(), count);
+    }
+
+    // every element takes at least a byte, a count the bytes left can not
+    // hold never reaches the resize
+    template<typename T>
+    void read_elements(std::vector<T>& values, std::size_t count, std::false_type)
+    {
+        if (count > remaining()) {
+            fail(true);
+            return;
+        }
+        values.resize(count);
+        for (std::size_t i = 0; i < count && good_; ++i) {
+            read_value(values[i]);
+        }
+    }
+
+    asio_buffer&    buffer_;
+    std::size_t     offset_;
+    bool            good_;
+    bool            truncated_;
+}; // class binary_reader
+
+} // namespace engine
+
+#endif // ENGINE_NET_BINARY_READER_H
@@ -0,0 +1,242 @@
+#ifndef ENGINE_NET_BINARY_WRITER_H
+#define ENGINE_NET_BINARY_WRITER_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <engine/net/asio_buffer.h>
+#include <engine/net/endian.h>
+
+namespace engine
+{
+
+/**
+ * appends typed values to an asio_buffer: fixed ints in either byte
+ * order, varints, strings with a varint length and whole structs.
+ *
+ * small values gather in an inline stage of kStageBytes that goes to the
+ * buffer in one append when it fills, on flush() and on destruction, so
+ * no value costs a block or an append of its own.
+ *
+ * a struct describes itself with a member template that hands every
+ * field to the visitor, binary_reader decodes it the same way
+ *
+ *     struct move_request
+ *     {
+ *         uint32_t                id;
+ *         std::vector<int32_t>    path;
+ *         std::string             note;
+ *
+ *         template<typename FIELDS>
+ *         void fields(FIELDS& f) {f(id, path, note);}
+ *     };
+ *
+ * arithmetic and enum fields are written big endian, strings and vectors
+ * after a varint count, nested structs by their own fields.
+ *
+ * offsets count from the read position of the buffer, nothing may be
+ * retrieved from it while a reserved header waits for its backpatch
+ */
+class binary_writer
+{
+public:
+    static const std::size_t kStageBytes = 256;
+
+    binary_writer(const binary_writer&) = delete;
+    binary_writer& operator=(const binary_writer&) = delete;
+    explicit binary_writer(asio_buffer& buffer)
+        : buffer_(buffer)
+        , flushed_(buffer.readable_bytes())
+        , staged_(0)
+    {
+    }
+
+    ~binary_writer()
+    {
+        flush();
+    }
+
+    // where the next byte goes
+    std::size_t offset() const
+    {
+        return flushed_ + staged_;
+    }
+
+    binary_writer& write_bytes(const void* data, std::size_t len)
+    {
+        if (staged_ + len > kStageBytes) {
+            flush();
+            if (len > kStageBytes) {
+                buffer_.append(data, len);
+                flushed_ += len;
+                return *this;
+            }
+        }
+        std::memcpy(stage_ + staged_, data, len);
+        staged_ += len;
+        return *this;
+    }
+
+    template<typename BASE_DATA_TYPE>
+    binary_writer& write_fixed(BASE_DATA_TYPE value, bool big_endian = true)
+    {
+        BASE_DATA_TYPE base = adapte_endian<BASE_DATA_TYPE>(value, big_endian);
+        return write_bytes(&base, sizeof base);
+    }
+
+    // 7 bits a byte, low bits first, the high bit set on all but the last
+    binary_writer& write_varint(uint64_t value)
+    {
+        char bytes[10];
+        std::size_t len = 0;
+        while (value >= 0x80) {
+            bytes[len++] = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        bytes[len++] = static_cast<char>(value);
+        return write_bytes(bytes, len);
+    }
+
+    // zigzag, so small negative values stay short
+    binary_writer& write_svarint(int64_t value)
+    {
+        return write_varint((static_cast<uint64_t>(value) << 1)
+                ^ static_cast<uint64_t>(value >> 63));
+    }
+
+    binary_writer& write_string(const std::string& str)
+    {
+        write_varint(str.size());
+        return write_bytes(str.data(), str.size());
+    }
+
+    // a larger array skips the stage and goes through the bulk swap
+    template<typename BASE_DATA_TYPE>
+    binary_writer& write_array(const BASE_DATA_TYPE* values, std::size_t count,
+            bool big_endian = true)
+    {
+        std::size_t len = count * sizeof(BASE_DATA_TYPE);
+        if (staged_ + len <= kStageBytes) {
+            for (std::size_t i = 0; i < count; ++i) {
+                write_fixed<BASE_DATA_TYPE>(values[i], big_endian);
+            }
+            return *this;
+        }
+        flush();
+        buffer_.append_endian(values, count, big_endian);
+        flushed_ += len;
+        return *this;
+    }
+
+    // room for a header that is written once the body is known, returns
+    // its offset for backpatch
+    template<typename BASE_DATA_TYPE>
+    std::size_t reserve()
+    {
+        std::size_t at = offset();
+        BASE_DATA_TYPE zero = BASE_DATA_TYPE();
+        write_bytes(&zero, sizeof zero);
+        return at;
+    }
+
+    template<typename BASE_DATA_TYPE>
+    binary_writer& backpatch(std::size_t at, BASE_DATA_TYPE value, bool big_endian = true)
+    {
+        assert(at + sizeof(BASE_DATA_TYPE) <= offset());
+        BASE_DATA_TYPE base = adapte_endian<BASE_DATA_TYPE>(value, big_endian);
+        const char* data = reinterpret_cast<const char*>(&base);
+        std::size_t len = sizeof base;
+        if (at < flushed_) {
+            std::size_t flushed_len = std::min(len, flushed_ - at);
+            buffer_.overwrite(at, data, flushed_len);
+            at      += flushed_len;
+            data    += flushed_len;
+            len     -= flushed_len;
+        }
+        // a header flushed whole leaves at below flushed_, no stage pointer
+        // is formed for it
+        if (len > 0) {
+            std::memcpy(stage_ + (at - flushed_), data, len);
+        }
+        return *this;
+    }
+
+    // a value of any type the struct description allows
+    template<typename T>
+    binary_writer& write(const T& value)
+    {
+        write_value(value);
+        return *this;
+    }
+
+    // the visitor a fields member template is called with
+    template<typename... FIELDS>
+    void operator()(const FIELDS&... fields)
+    {
+        int expand[] = {0, (write_value(fields), 0)...};
+        (void)expand;
+    }
+
+    void flush()
+    {
+        if (staged_ > 0) {
+            buffer_.append(stage_, staged_);
+            flushed_ += staged_;
+            staged_ = 0;
+        }
+    }
+
+private:
+    template<typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value || std::is_enum<T>::value>::type
+    write_value(T value)
+    {
+        write_fixed<T>(value);
+    }
+
+    void write_value(const std::string& str)
+    {
+        write_string(str);
+    }
+
+    template<typename T>
+    void write_value(const std::vector<T>& values)
+    {
+        write_varint(values.size());
+        write_elements(values, std::is_arithmetic<T>());
+    }
+
+    // fields does not change the struct, it only lists its members
+    template<typename T>
+    typename std::enable_if<std::is_class<T>::value>::type
+    write_value(const T& value)
+    {
+        const_cast<T&>(value).fields(*this);
+    }
+
+    template<typename T>
+    void write_elements(const std::vector<T>& values, std::true_type)
+    {
+        write_array(values.data(), values.size());
+    }
+
+    template<typename T>
+    void write_elements(const std::vector<T>& values, std::false_type)
+    {
+        for (const T& value : values) {
+            write_value(value);
+        }
+    }
+
+    asio_buffer&    buffer_;
+    std::size_t     flushed_;           // bytes of the buffer before the stage
+    std::size_t     staged_;
+    char            stage_[kStageBytes];
+}; // class binary_writer
+
+} // namespace engine
+
+#endif // ENGINE_NET_BINARY_WRITER_H
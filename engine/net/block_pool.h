@@ -0,0 +1,87 @@
+#ifndef ENGINE_NET_BLOCK_POOL_H
+#define ENGINE_NET_BLOCK_POOL_H
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <engine/common/data_block.h>
+
+namespace engine
+{
+
+// free list of equally sized buffer blocks shared by every asio_buffer
+// using that block size, so memory given back by idle sessions is reused
+// by busy ones instead of going back to the allocator
+class block_pool
+{
+public:
+    typedef std::shared_ptr<data_block> block_ptr;
+
+    static const std::size_t kMaxCachedBytes = 64 * 1024 * 1024;
+
+    block_pool(const block_pool&) = delete;
+    block_pool& operator=(const block_pool&) = delete;
+    explicit block_pool(std::size_t block_size,
+            std::size_t max_cached_bytes = kMaxCachedBytes)
+        : block_size_(block_size)
+        , max_cached_blocks_(max_cached_bytes / block_size)
+    {
+    }
+
+    block_ptr acquire()
+    {
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            if (!free_blocks_.empty()) {
+                block_ptr block = std::move(free_blocks_.back());
+                free_blocks_.pop_back();
+                return block;
+            }
+        }
+        return std::make_shared<data_block>(block_size_);
+    }
+
+    void release(block_ptr block)
+    {
+        if (!block || block->len != block_size_) {
+            return;
+        }
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (free_blocks_.size() < max_cached_blocks_) {
+            free_blocks_.push_back(std::move(block));
+        }
+    }
+
+    std::size_t block_size() const
+    {
+        return block_size_;
+    }
+
+    std::size_t cached_blocks()
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        return free_blocks_.size();
+    }
+
+    static std::shared_ptr<block_pool> shared(std::size_t block_size)
+    {
+        static std::mutex mutex;
+        static std::map<std::size_t, std::shared_ptr<block_pool>> pools;
+        std::lock_guard<std::mutex> guard(mutex);
+        std::shared_ptr<block_pool>& pool = pools[block_size];
+        if (!pool) {
+            pool = std::make_shared<block_pool>(block_size);
+        }
+        return pool;
+    }
+private:
+    std::size_t             block_size_;
+    std::size_t             max_cached_blocks_;
+    std::vector<block_ptr>  free_blocks_;
+    std::mutex              mutex_;
+}; // class block_pool
+
+} // namespace engine
+
+#endif // ENGINE_NET_BLOCK_POOL_H
@@ -24,6 +24,7 @@ public:
         , read_high_water_mask_(0)
         , write_high_water_mask_(0)
         , write_high_water_mask_handler_(nullptr)
+        , write_pause_handler_(nullptr)
         , init_handlers_(nullptr)
     {
         session_ = std::make_shared<session>(get_session_increase_id(),
@@ -60,6 +61,18 @@ public:
         write_high_water_mask_handler_  = handler;
     }
 
+    void set_send_budget(const send_budget& budget,
+            const std::function<void(std::shared_ptr<session>, bool)>& pause_handler = nullptr)
+    {
+        send_budget_         = budget;
+        write_pause_handler_ = pause_handler;
+    }
+
+    void set_lazy_buffers(bool lazy)
+    {
+        session_->set_lazy_buffers(lazy);
+    }
+
     void set_init_handlers(const std::function<void(std::shared_ptr<session>)>& handler)
     {
         init_handlers_ = handler;
@@ -99,6 +112,7 @@ private:
             if (read_high_water_mask_ != 0) {
                 session_->set_read_high_water_mask(read_high_water_mask_);
             }
+            session_->set_send_budget(send_budget_, write_pause_handler_);
             if (write_high_water_mask_ != 0 && write_high_water_mask_handler_ != nullptr) {
                 session_->set_write_high_water_mask_handler(
                     write_high_water_mask_handler_, write_high_water_mask_);
@@ -117,6 +131,9 @@ private:
     std::size_t                                     write_high_water_mask_;
     std::function<void(std::shared_ptr<session>, std::size_t)>
                                                     write_high_water_mask_handler_;
+    send_budget                                     send_budget_;
+    std::function<void(std::shared_ptr<session>, bool)>
+                                                    write_pause_handler_;
     std::function<void(std::shared_ptr<session>)>   init_handlers_;
     std::shared_ptr<session>                        session_;
 }; // class client
@@ -0,0 +1,429 @@
+#ifndef ENGINE_NET_CLIENT_MANAGER_H
+#define ENGINE_NET_CLIENT_MANAGER_H
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include <third_party/asio.hpp>
+#include <third_party/asio/steady_timer.hpp>
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/common/common.h>
+#include <engine/common/scalable_rw_lock.h>
+#include <engine/net/io_service_pool.h>
+#include <engine/net/send_budget.h>
+#include <engine/net/session.h>
+
+namespace engine
+{
+
+using asio::ip::tcp;
+
+/**
+ * many outbound client sessions on one sized io_service_pool, instead of
+ * a thread per engine::client. sessions are grouped by destination and
+ * every destination keeps a pool of connections.
+ *
+ * a connection resolves and connects asynchronously under one connect
+ * timeout. a failed or dropped connection comes back after an exponential
+ * backoff between the min and max reconnect delay, jittered so that many
+ * connections to a restarted server do not return all at once. an address
+ * is resolved once per destination and reused until a connect fails
+ */
+class client_manager
+{
+public:
+    static const uint32_t kConnectTimeout       = 5000;     // ms
+    static const uint32_t kMinReconnectDelay    = 100;      // ms
+    static const uint32_t kMaxReconnectDelay    = 30000;    // ms
+
+    client_manager(const client_manager&) = delete;
+    client_manager& operator=(const client_manager&) = delete;
+    explicit client_manager(std::size_t io_service_pool_size)
+        : io_service_pool_(io_service_pool_size, "client_pool")
+        , connect_timeout_(kConnectTimeout)
+        , min_reconnect_delay_(kMinReconnectDelay)
+        , max_reconnect_delay_(kMaxReconnectDelay)
+        , read_high_water_mask_(0)
+        , write_pause_handler_(nullptr)
+        , init_handlers_(nullptr)
+        , close_handler_(nullptr)
+        , lazy_buffers_(false)
+        , next_destination_id_(0)
+        , next_slot_(0)
+        , stopped_(false)
+        , connected_(0)
+        , connect_failures_(0)
+    {
+    }
+
+    ~client_manager()
+    {
+        destinations_.clear();
+    }
+
+    void run()
+    {
+        io_service_pool_.run();
+    }
+
+    void stop()
+    {
+        stopped_ = true;
+        {
+            auto read_guard = lock_.read_guard();
+            for (auto& pair : destinations_) {
+                for (auto& link : pair.second->sessions) {
+                    if (link) {
+                        link->close();
+                    }
+                }
+            }
+        }
+        io_service_pool_.stop();
+
+        // the posted closes above never run on a stopped pool, close the
+        // sockets here and drop the sessions, their close handlers hold
+        // the destination they sit in
+        std::error_code ignore;
+        auto write_guard = lock_.write_guard();
+        for (auto& pair : destinations_) {
+            for (auto& link : pair.second->sessions) {
+                if (link) {
+                    link->socket().close(ignore);
+                    link.reset();
+                }
+            }
+        }
+    }
+
+    // settings below apply to connections made after the call, set them
+    // before add_destination
+    void set_connect_timeout(uint32_t timeout)
+    {
+        connect_timeout_ = timeout;
+    }
+
+    void set_reconnect_delay(uint32_t min_delay, uint32_t max_delay)
+    {
+        min_reconnect_delay_ = min_delay ? min_delay : 1;
+        max_reconnect_delay_ = std::max(min_reconnect_delay_, max_delay);
+    }
+
+    void set_read_high_water_mask(std::size_t mask)
+    {
+        read_high_water_mask_ = mask;
+    }
+
+    void set_send_budget(const send_budget& budget,
+            const std::function<void(std::shared_ptr<session>, bool)>& pause_handler = nullptr)
+    {
+        send_budget_         = budget;
+        write_pause_handler_ = pause_handler;
+    }
+
+    void set_lazy_buffers(bool lazy)
+    {
+        lazy_buffers_ = lazy;
+    }
+
+    // runs on the io thread of a connection each time it is established
+    void set_init_handlers(const std::function<void(std::shared_ptr<session>)>& handler)
+    {
+        init_handlers_ = handler;
+    }
+
+    // close_handler(destination_id, session_id), before the reconnect is
+    // scheduled
+    void set_close_handler(const std::function<void(uint32_t, uint32_t)>& handler)
+    {
+        close_handler_ = handler;
+    }
+
+    // opens pool_size connections to address:port and returns the
+    // destination id for get_session
+    uint32_t add_destination(const std::string& address, unsigned short port,
+            std::size_t pool_size = 1)
+    {
+        auto target         = std::make_shared<destination>();
+        target->address     = address;
+        target->port        = port;
+        target->sessions.resize(pool_size ? pool_size : 1);
+        target->retries.resize(target->sessions.size(), 0);
+        target->next        = 0;
+        {
+            auto write_guard = lock_.write_guard();
+            target->id          = ++next_destination_id_;
+            target->first_slot  = next_slot_;
+            next_slot_         += target->sessions.size();
+            destinations_[target->id] = target;
+        }
+        for (std::size_t i = 0; i < target->sessions.size(); ++i) {
+            slot_io_service(target, i).post([this, target, i](){connect(target, i);});
+        }
+        return target->id;
+    }
+
+    // any thread. a connected session of the destination, the same key
+    // keeps the same connection while it is up. nullptr when none is
+    std::shared_ptr<session> get_session(uint32_t destination_id, uint32_t key)
+    {
+        auto read_guard = lock_.read_guard();
+        auto it = destinations_.find(destination_id);
+        if (it == destinations_.end()) {
+            return nullptr;
+        }
+        std::vector<std::shared_ptr<session>>& sessions = it->second->sessions;
+        for (std::size_t i = 0; i < sessions.size(); ++i) {
+            std::shared_ptr<session>& link = sessions[(key + i) % sessions.size()];
+            if (link) {
+                return link;
+            }
+        }
+        return nullptr;
+    }
+
+    // round robin over the connected sessions of the destination
+    std::shared_ptr<session> get_session(uint32_t destination_id)
+    {
+        std::shared_ptr<destination> target;
+        {
+            auto read_guard = lock_.read_guard();
+            auto it = destinations_.find(destination_id);
+            if (it == destinations_.end()) {
+                return nullptr;
+            }
+            target = it->second;
+        }
+        return get_session(destination_id, target->next++);
+    }
+
+    std::size_t connected_count() const
+    {
+        return connected_;
+    }
+
+    std::size_t connect_failures() const
+    {
+        return connect_failures_;
+    }
+private:
+    struct destination
+    {
+        uint32_t                                id;
+        std::string                             address;
+        unsigned short                          port;
+        std::size_t                             first_slot;     // spreads slots over the pool
+        std::vector<std::shared_ptr<session>>   sessions;       // null while connecting
+        std::vector<uint32_t>                   retries;        // io thread of the slot
+        std::atomic<uint32_t>                   next;
+        std::vector<tcp::endpoint>              endpoints;      // cached resolve result
+        std::mutex                              endpoint_mutex;
+    };
+
+    // one connect attempt, touched only by the io thread of its slot
+    struct attempt
+    {
+        attempt(asio::io_service& io_service, std::shared_ptr<session> link)
+            : link(link)
+            , resolver(io_service)
+            , timer(io_service)
+            , finished(false)
+            , timed_out(false)
+        {
+        }
+
+        std::shared_ptr<session>    link;
+        tcp::resolver               resolver;
+        asio::steady_timer          timer;
+        bool                        finished;
+        bool                        timed_out;
+    };
+
+    // a slot keeps its io thread across reconnects
+    asio::io_service& slot_io_service(const std::shared_ptr<destination>& target,
+            std::size_t index)
+    {
+        return io_service_pool_.get_io_service(
+                (target->first_slot + index) % io_service_pool_.size());
+    }
+
+    void connect(std::shared_ptr<destination> target, std::size_t index)
+    {
+        if (stopped_) {
+            return;
+        }
+        asio::io_service& io_service = slot_io_service(target, index);
+        std::shared_ptr<session> link = std::make_shared<session>(get_session_increase_id(),
+                io_service, io_service);
+        link->set_lazy_buffers(lazy_buffers_);
+        auto current = std::make_shared<attempt>(io_service, link);
+
+        current->timer.expires_from_now(
+                std::chrono::milliseconds(static_cast<int64_t>(connect_timeout_)));
+        current->timer.async_wait([current](std::error_code ec){
+            if (ec || current->finished) {
+                return;
+            }
+            current->timed_out = true;
+            current->resolver.cancel();
+            current->link->socket().close(ec);
+        });
+
+        std::vector<tcp::endpoint> endpoints;
+        {
+            std::lock_guard<std::mutex> guard(target->endpoint_mutex);
+            endpoints = target->endpoints;
+        }
+        if (!endpoints.empty()) {
+            connect_endpoint(target, index, current, endpoints);
+            return;
+        }
+
+        tcp::resolver::query query(target->address, std::to_string(target->port));
+        current->resolver.async_resolve(query,
+                [this, target, index, current](std::error_code ec, tcp::resolver::iterator iter){
+                    if (!ec && iter == tcp::resolver::iterator()) {
+                        ec = asio::error::host_not_found;
+                    }
+                    if (ec) {
+                        handle_connect(target, index, current, ec);
+                        return;
+                    }
+                    std::vector<tcp::endpoint> endpoints(iter, tcp::resolver::iterator());
+                    {
+                        std::lock_guard<std::mutex> guard(target->endpoint_mutex);
+                        target->endpoints = endpoints;
+                    }
+                    connect_endpoint(target, index, current, endpoints);
+                });
+    }
+
+    // retries walk through the resolved endpoints
+    void connect_endpoint(std::shared_ptr<destination> target, std::size_t index,
+            std::shared_ptr<attempt> current, const std::vector<tcp::endpoint>& endpoints)
+    {
+        if (current->timed_out) {
+            std::error_code ec = asio::error::timed_out;
+            handle_connect(target, index, current, ec);
+            return;
+        }
+        const tcp::endpoint& endpoint = endpoints[target->retries[index] % endpoints.size()];
+        current->link->socket().async_connect(endpoint,
+                [this, target, index, current](std::error_code ec){
+                    handle_connect(target, index, current, ec);
+                });
+    }
+
+    void handle_connect(std::shared_ptr<destination> target, std::size_t index,
+            std::shared_ptr<attempt> current, std::error_code& ec)
+    {
+        current->finished = true;
+        std::error_code ignore;
+        current->timer.cancel(ignore);
+        if (current->timed_out) {
+            ec = asio::error::timed_out;
+        }
+        if (ec) {
+            handle_failure(target, index, ec);
+            return;
+        }
+
+        std::shared_ptr<session> link = current->link;
+        link->socket().set_option(tcp::no_delay(true), ignore);
+        if (read_high_water_mask_ != 0) {
+            link->set_read_high_water_mask(read_high_water_mask_);
+        }
+        link->set_send_budget(send_budget_, write_pause_handler_);
+        link->set_close_handler([this, target, index](uint32_t session_id){
+            {
+                auto write_guard = lock_.write_guard();
+                target->sessions[index].reset();
+            }
+            --connected_;
+            if (close_handler_) {
+                close_handler_(target->id, session_id);
+            }
+            reconnect(target, index);
+        });
+        target->retries[index] = 0;
+        {
+            auto write_guard = lock_.write_guard();
+            target->sessions[index] = link;
+        }
+        ++connected_;
+        link->start(init_handlers_);
+    }
+
+    void handle_failure(std::shared_ptr<destination> target, std::size_t index,
+            const std::error_code& ec)
+    {
+        ++connect_failures_;
+        // only the first failure in a row is worth a line, a load tester
+        // may have thousands of slots waiting for the same server
+        if (target->retries[index] == 0) {
+            LOGF(WARNING, "client connect address = %s, port = %d, slot = %zu, error = %s",
+                    target->address.c_str(), target->port, index, ec.message().c_str());
+        }
+        {
+            std::lock_guard<std::mutex> guard(target->endpoint_mutex);
+            target->endpoints.clear();
+        }
+        // the delay of the first retry already backs off once
+        ++target->retries[index];
+        reconnect(target, index);
+    }
+
+    void reconnect(std::shared_ptr<destination> target, std::size_t index)
+    {
+        if (stopped_) {
+            return;
+        }
+        auto timer = std::make_shared<asio::steady_timer>(slot_io_service(target, index));
+        timer->expires_from_now(std::chrono::milliseconds(
+                    static_cast<int64_t>(reconnect_delay(target->retries[index]))));
+        timer->async_wait([this, target, index, timer](std::error_code ec){
+            if (!ec) {
+                connect(target, index);
+            }
+        });
+    }
+
+    // min_delay * 2^retries capped at max_delay, then a random point in
+    // its upper half, never below min_delay. a link that dropped after it
+    // was up reconnects with no retry counted
+    uint32_t reconnect_delay(uint32_t retries)
+    {
+        static thread_local std::minstd_rand random(std::random_device{}());
+        uint64_t delay = static_cast<uint64_t>(min_reconnect_delay_) << std::min<uint32_t>(retries, 20);
+        delay = std::min<uint64_t>(delay, max_reconnect_delay_);
+        delay = delay / 2 + random() % (delay / 2 + 1);
+        return static_cast<uint32_t>(std::max<uint64_t>(delay, min_reconnect_delay_));
+    }
+private:
+    io_service_pool                                     io_service_pool_;
+    uint32_t                                            connect_timeout_;
+    uint32_t                                            min_reconnect_delay_;
+    uint32_t                                            max_reconnect_delay_;
+    std::size_t                                         read_high_water_mask_;
+    send_budget                                         send_budget_;
+    std::function<void(std::shared_ptr<session>, bool)> write_pause_handler_;
+    std::function<void(std::shared_ptr<session>)>       init_handlers_;
+    std::function<void(uint32_t, uint32_t)>             close_handler_;
+    bool                                                lazy_buffers_;
+    std::map<uint32_t, std::shared_ptr<destination>>    destinations_;
+    scalable_rw_lock                                    lock_;
+    uint32_t                                            next_destination_id_;
+    std::size_t                                         next_slot_;
+    std::atomic_bool                                    stopped_;
+    std::atomic_size_t                                  connected_;
+    std::atomic_size_t                                  connect_failures_;
+}; // class client_manager
+
+} // namespace engine
+
+#endif // ENGINE_NET_CLIENT_MANAGER_H
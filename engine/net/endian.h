@@ -3,45 +3,134 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
 
 namespace engine
 {
 
-static bool is_small_endian()
+// the byte order is known to the compiler, every check below folds away
+static constexpr bool is_small_endian()
 {
-    union
-    {
-        int     i;
-        char    ch;
-    } endian;
-    endian.i = 1;
-    return endian.ch;
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+    return __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__;
+#else
+    return true;
+#endif
 }
 
+// the unsigned integer of a size and the instruction that swaps it, the
+// bytes are reversed one by one for sizes without one, like long double
+template<std::size_t BYTES>
+struct byte_swap
+{
+    struct type
+    {
+        unsigned char bytes[BYTES];
+    };
+
+    static type swap(type value)
+    {
+        type result;
+        for (std::size_t i = 0; i < BYTES; ++i) {
+            result.bytes[i] = value.bytes[BYTES - i - 1];
+        }
+        return result;
+    }
+}; // struct byte_swap
+
+template<>
+struct byte_swap<1>
+{
+    typedef uint8_t type;
+    static type swap(type value) {return value;}
+}; // struct byte_swap<1>
+
+template<>
+struct byte_swap<2>
+{
+    typedef uint16_t type;
+    static type swap(type value) {return __builtin_bswap16(value);}
+}; // struct byte_swap<2>
+
+template<>
+struct byte_swap<4>
+{
+    typedef uint32_t type;
+    static type swap(type value) {return __builtin_bswap32(value);}
+}; // struct byte_swap<4>
+
+template<>
+struct byte_swap<8>
+{
+    typedef uint64_t type;
+    static type swap(type value) {return __builtin_bswap64(value);}
+}; // struct byte_swap<8>
+
+// works for floats and enums too, they are swapped as the integer of
+// their size
 template<typename BASE_DATA_TYPE>
 static BASE_DATA_TYPE change_endian(BASE_DATA_TYPE value)
 {
-    BASE_DATA_TYPE result = 0;
-    unsigned char* value_p = reinterpret_cast<unsigned char*>(&value);
-    unsigned char* result_p = reinterpret_cast<unsigned char*>(&result);
-    std::size_t byte = sizeof(BASE_DATA_TYPE);
-    for (std::size_t i = 0; i < byte; ++i) {
-        result_p[i] = value_p[byte-i-1];
-    }
-    return result;
+    typedef byte_swap<sizeof(BASE_DATA_TYPE)> swapper;
+    typename swapper::type bits;
+    std::memcpy(&bits, &value, sizeof bits);
+    bits = swapper::swap(bits);
+    std::memcpy(&value, &bits, sizeof bits);
+    return value;
 }
 
 template<typename BASE_DATA_TYPE>
 static BASE_DATA_TYPE adapte_endian(BASE_DATA_TYPE value, bool big_endian = true)
 {
-    bool system_small_endian = is_small_endian();
-    if ((system_small_endian && big_endian) ||
-            (!system_small_endian && !big_endian)) {
+    if (is_small_endian() == big_endian) {
         return change_endian<BASE_DATA_TYPE>(value);
     }
     return value;
 }
 
+// copies count values from src to dst with every value swapped, 16 bytes
+// at a time with ssse3. dst and src may be the same
+template<typename BASE_DATA_TYPE>
+static void change_endian(BASE_DATA_TYPE* dst, const BASE_DATA_TYPE* src, std::size_t count)
+{
+    std::size_t i = 0;
+#if defined(__SSSE3__)
+    const std::size_t bytes = sizeof(BASE_DATA_TYPE);
+    if (bytes == 2 || bytes == 4 || bytes == 8) {
+        // the byte of a lane that goes to each position
+        char mask[16];
+        for (std::size_t b = 0; b < 16; ++b) {
+            mask[b] = static_cast<char>(b - b % bytes + bytes - 1 - b % bytes);
+        }
+        const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+        const std::size_t lanes = 16 / bytes;
+        for (; i + lanes <= count; i += lanes) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                    _mm_shuffle_epi8(block, shuffle));
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = change_endian<BASE_DATA_TYPE>(src[i]);
+    }
+}
+
+template<typename BASE_DATA_TYPE>
+static void adapte_endian(BASE_DATA_TYPE* dst, const BASE_DATA_TYPE* src, std::size_t count,
+        bool big_endian = true)
+{
+    if (is_small_endian() == big_endian) {
+        change_endian<BASE_DATA_TYPE>(dst, src, count);
+    } else if (dst != src) {
+        std::memmove(dst, src, count * sizeof(BASE_DATA_TYPE));
+    }
+}
+
 } // namespace engine
 
 #endif // ENGINE_NET_ENDIAN_H
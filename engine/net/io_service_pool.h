@@ -4,6 +4,7 @@
 #include <thread>
 #include <third_party/asio.hpp>
 #include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/common/metrics.h>
 
 namespace engine
 {
@@ -32,7 +33,10 @@ public:
     void run()
     {
         for (std::size_t i = 0; i < io_services_.size(); ++i) {
-            std::shared_ptr<std::thread> thread(new std::thread([=]() {io_services_[i]->run(); }));
+            std::shared_ptr<std::thread> thread(new std::thread([=]() {
+                metrics::set_thread_name(pool_name_ + "_thread_" + std::to_string(i));
+                io_services_[i]->run();
+            }));
             LOGF(INFO, "%s_thread_%d : %04X", pool_name_.c_str(), i, thread->get_id());
             threads_.push_back(thread);
         }
@@ -58,6 +62,27 @@ public:
         }
         return io_service;
     }
+
+    asio::io_service& get_io_service(std::size_t index)
+    {
+        return *io_services_[index];
+    }
+
+    std::size_t size() const
+    {
+        return io_services_.size();
+    }
+
+    // the index of an io_service of the pool, size() if it is not one
+    std::size_t index_of(const asio::io_service& io_service) const
+    {
+        for (std::size_t i = 0; i < io_services_.size(); ++i) {
+            if (io_services_[i].get() == &io_service) {
+                return i;
+            }
+        }
+        return io_services_.size();
+    }
 private:
     typedef std::shared_ptr<asio::io_service>           io_service_ptr;
     typedef std::shared_ptr<asio::io_service::work>     work_ptr;
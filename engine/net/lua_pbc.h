@@ -0,0 +1,357 @@
+#ifndef ENGINE_NET_LUA_PBC_H
+#define ENGINE_NET_LUA_PBC_H
+
+extern "C" {
+#include "lua.h"
+#include "lauxlib.h"
+}
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <engine/common/logger.h>
+#include <engine/handler/pbc_codec.h>
+
+namespace engine
+{
+
+// moves pbc messages in and out of one lua state without going through
+// lua strings of the encoded bytes. decoded messages are written into a
+// table taken from a pool per message type, field keys are interned once
+// per type. the table, and every table inside it, goes back to the pool
+// when the script handler returns, so scripts copy what must outlive it
+class lua_pbc
+{
+public:
+    static const int kMaxDepth          = 32;
+    static const int kMaxPooledTables   = 64;
+
+    lua_pbc(const lua_pbc&) = delete;
+    lua_pbc& operator=(const lua_pbc&) = delete;
+    lua_pbc()
+        : L_(nullptr)
+    {
+    }
+
+    void init(lua_State* L, std::shared_ptr<pbc_registry> registry)
+    {
+        L_          = L;
+        registry_   = registry;
+        refs_.clear();
+    }
+
+    std::shared_ptr<pbc_registry> registry()
+    {
+        return registry_;
+    }
+
+    // push the message as a table, the type of the message needs a pattern
+    bool push(const pbc_message& message)
+    {
+        if (!message.data) {
+            return false;
+        }
+        type_refs& refs = get_refs(*message.type);
+        lua_rawgeti(L_, LUA_REGISTRYINDEX, refs.pool);
+        lua_Integer count = static_cast<lua_Integer>(lua_rawlen(L_, -1));
+        if (count > 0) {
+            lua_rawgeti(L_, -1, count);
+            lua_pushnil(L_);
+            lua_rawseti(L_, -3, count);
+        } else {
+            lua_createtable(L_, 0, static_cast<int>(message.type->fields.size()));
+        }
+        lua_remove(L_, -2);
+        fill(lua_gettop(L_), *message.type, static_cast<const char*>(message.data), 0);
+        return true;
+    }
+
+    // give the table on top of the stack back to the pool of the type
+    void recycle(const pbc_message_type& type)
+    {
+        type_refs& refs = get_refs(type);
+        lua_rawgeti(L_, LUA_REGISTRYINDEX, refs.pool);
+        lua_Integer count = static_cast<lua_Integer>(lua_rawlen(L_, -1));
+        if (count < kMaxPooledTables) {
+            lua_insert(L_, -2);
+            lua_rawseti(L_, -2, count + 1);
+            lua_pop(L_, 1);
+        } else {
+            lua_pop(L_, 2);
+        }
+    }
+
+    // write the fields of the table at index into message, fields whose
+    // value does not match the declared type are skipped
+    void build(int index, const pbc_message_type& type, pbc_wmessage* message, int depth = 0)
+    {
+        if (depth >= kMaxDepth) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "lua pbc encode %s nested too deep", type.name.c_str());
+            return;
+        }
+        index = lua_absindex(L_, index);
+        type_refs& refs = get_refs(type);
+        lua_rawgeti(L_, LUA_REGISTRYINDEX, refs.keys);
+        int keys = lua_gettop(L_);
+        for (std::size_t i = 0; i < type.fields.size(); ++i) {
+            const pbc_field_layout& field = type.fields[i];
+            lua_rawgeti(L_, keys, static_cast<lua_Integer>(i + 1));
+            lua_rawget(L_, index);
+            if (lua_isnil(L_, -1)) {
+            } else if (field.ctype == 'a') {
+                if (lua_istable(L_, -1)) {
+                    lua_Integer count = static_cast<lua_Integer>(lua_rawlen(L_, -1));
+                    for (lua_Integer j = 1; j <= count; ++j) {
+                        lua_rawgeti(L_, -1, j);
+                        write_value(field, message, depth);
+                        lua_pop(L_, 1);
+                    }
+                } else {
+                    JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "lua pbc encode %s.%s expects a table",
+                            type.name.c_str(), field.name.c_str());
+                }
+            } else {
+                write_value(field, message, depth);
+            }
+            lua_pop(L_, 1);
+        }
+        lua_pop(L_, 1);
+    }
+private:
+    struct type_refs
+    {
+        int keys;   // field index -> interned field name
+        int pool;   // free tables of the type
+    }; // struct type_refs
+
+    type_refs& get_refs(const pbc_message_type& type)
+    {
+        auto it = refs_.find(&type);
+        if (it != refs_.end()) {
+            return it->second;
+        }
+        type_refs refs;
+        lua_createtable(L_, static_cast<int>(type.fields.size()), 0);
+        for (std::size_t i = 0; i < type.fields.size(); ++i) {
+            lua_pushlstring(L_, type.fields[i].name.data(), type.fields[i].name.size());
+            lua_rawseti(L_, -2, static_cast<lua_Integer>(i + 1));
+        }
+        refs.keys = luaL_ref(L_, LUA_REGISTRYINDEX);
+        lua_createtable(L_, kMaxPooledTables, 0);
+        refs.pool = luaL_ref(L_, LUA_REGISTRYINDEX);
+        return refs_[&type] = refs;
+    }
+
+    // fill the table at index from data unpacked by the type's pattern,
+    // tables already held by the fields are refilled in place
+    void fill(int index, const pbc_message_type& type, const char* data, int depth)
+    {
+        type_refs& refs = get_refs(type);
+        lua_rawgeti(L_, LUA_REGISTRYINDEX, refs.keys);
+        int keys = lua_gettop(L_);
+        for (std::size_t i = 0; i < type.fields.size(); ++i) {
+            const pbc_field_layout& field = type.fields[i];
+            const char* value = data + field.offset;
+            lua_rawgeti(L_, keys, static_cast<lua_Integer>(i + 1));
+            if (field.ctype == 'a') {
+                reuse_table(index);
+                fill_array(lua_gettop(L_), field,
+                        reinterpret_cast<_pbc_array*>(const_cast<char*>(value)), depth);
+            } else if (field.type == PBC_FIELD_MESSAGE) {
+                reuse_table(index);
+                fill_message(lua_gettop(L_), field,
+                        reinterpret_cast<const pbc_slice*>(value), depth);
+            } else {
+                push_scalar(field, value);
+            }
+            lua_rawset(L_, index);
+        }
+        lua_pop(L_, 1);
+    }
+
+    // with the key on top, push the table the field already holds or a new one
+    void reuse_table(int index)
+    {
+        lua_pushvalue(L_, -1);
+        lua_rawget(L_, index);
+        if (!lua_istable(L_, -1)) {
+            lua_pop(L_, 1);
+            lua_newtable(L_);
+        }
+    }
+
+    void fill_array(int index, const pbc_field_layout& field, _pbc_array* array, int depth)
+    {
+        int size = pbc_array_size(array);
+        for (int i = 0; i < size; ++i) {
+            uint32_t hi = 0;
+            switch (field.type) {
+                case PBC_FIELD_FLOAT:
+                case PBC_FIELD_DOUBLE:
+                    lua_pushnumber(L_, pbc_array_real(array, i));
+                    break;
+                case PBC_FIELD_BOOL:
+                    lua_pushboolean(L_, pbc_array_integer(array, i, nullptr) != 0);
+                    break;
+                case PBC_FIELD_STRING:
+                case PBC_FIELD_BYTES: {
+                    pbc_slice* slice = pbc_array_slice(array, i);
+                    lua_pushlstring(L_, static_cast<const char*>(slice->buffer), slice->len);
+                    break;
+                }
+                case PBC_FIELD_MESSAGE:
+                    lua_rawgeti(L_, index, i + 1);
+                    if (!lua_istable(L_, -1)) {
+                        lua_pop(L_, 1);
+                        lua_newtable(L_);
+                    }
+                    fill_message(lua_gettop(L_), field, pbc_array_slice(array, i), depth);
+                    break;
+                default: {
+                    uint32_t low = pbc_array_integer(array, i, &hi);
+                    lua_pushinteger(L_, static_cast<lua_Integer>(
+                                (static_cast<uint64_t>(hi) << 32) | low));
+                    break;
+                }
+            }
+            lua_rawseti(L_, index, i + 1);
+        }
+        for (lua_Integer i = static_cast<lua_Integer>(lua_rawlen(L_, index)); i > size; --i) {
+            lua_pushnil(L_);
+            lua_rawseti(L_, index, i);
+        }
+    }
+
+    void fill_message(int index, const pbc_field_layout& field, const pbc_slice* value, int depth)
+    {
+        const pbc_message_type* nested = registry_->find_type(field.type_name);
+        if (!nested || !nested->pattern || depth + 1 >= kMaxDepth) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "lua pbc can not decode %s of %s",
+                    field.name.c_str(), field.type_name.c_str());
+            return;
+        }
+        if (scratch_.size() <= static_cast<std::size_t>(depth)) {
+            scratch_.resize(depth + 1);
+        }
+        if (scratch_[depth].size() < nested->pattern_size) {
+            scratch_[depth].resize(nested->pattern_size);
+        }
+        // deeper levels may grow scratch_, the buffer itself stays put
+        char* data = scratch_[depth].data();
+        pbc_slice slice = *value;
+        if (!slice.buffer) {
+            slice.len = 0;
+        }
+        if (pbc_pattern_unpack(nested->pattern, &slice, data) < 0) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "lua pbc unpack %s error = %s", nested->name.c_str(),
+                    pbc_error(registry_->env()));
+            return;
+        }
+        fill(index, *nested, data, depth + 1);
+        pbc_pattern_close_arrays(nested->pattern, data);
+    }
+
+    void push_scalar(const pbc_field_layout& field, const char* value)
+    {
+        switch (field.ctype) {
+            case 'D':
+                lua_pushinteger(L_, *reinterpret_cast<const int64_t*>(value));
+                break;
+            case 'd':
+                if (field.type == PBC_FIELD_UINT32 || field.type == PBC_FIELD_FIXED32) {
+                    lua_pushinteger(L_, *reinterpret_cast<const uint32_t*>(value));
+                } else {
+                    lua_pushinteger(L_, *reinterpret_cast<const int32_t*>(value));
+                }
+                break;
+            case 'h':
+                lua_pushinteger(L_, *reinterpret_cast<const int16_t*>(value));
+                break;
+            case 'c':
+                lua_pushinteger(L_, *reinterpret_cast<const int8_t*>(value));
+                break;
+            case 'f':
+                lua_pushnumber(L_, *reinterpret_cast<const float*>(value));
+                break;
+            case 'F':
+                lua_pushnumber(L_, *reinterpret_cast<const double*>(value));
+                break;
+            case 'b':
+                lua_pushboolean(L_, *reinterpret_cast<const bool*>(value));
+                break;
+            case 's': {
+                const pbc_slice* slice = reinterpret_cast<const pbc_slice*>(value);
+                lua_pushlstring(L_, static_cast<const char*>(slice->buffer),
+                        slice->buffer ? slice->len : 0);
+                break;
+            }
+            default:
+                lua_pushnil(L_);
+                break;
+        }
+    }
+
+    // write the value on top of the stack
+    void write_value(const pbc_field_layout& field, pbc_wmessage* message, int depth)
+    {
+        const char* key = field.name.c_str();
+        int type = lua_type(L_, -1);
+        switch (field.type) {
+            case PBC_FIELD_MESSAGE:
+                if (type == LUA_TTABLE) {
+                    const pbc_message_type* nested = registry_->find_type(field.type_name);
+                    if (nested) {
+                        build(-1, *nested, pbc_wmessage_message(message, key), depth + 1);
+                        return;
+                    }
+                }
+                break;
+            case PBC_FIELD_STRING:
+            case PBC_FIELD_BYTES:
+                if (type == LUA_TSTRING) {
+                    std::size_t len = 0;
+                    const char* str = lua_tolstring(L_, -1, &len);
+                    pbc_wmessage_string(message, key, str, static_cast<int>(len));
+                    return;
+                }
+                break;
+            case PBC_FIELD_FLOAT:
+            case PBC_FIELD_DOUBLE:
+                if (type == LUA_TNUMBER) {
+                    pbc_wmessage_real(message, key, lua_tonumber(L_, -1));
+                    return;
+                }
+                break;
+            case PBC_FIELD_BOOL:
+                if (type == LUA_TBOOLEAN) {
+                    pbc_wmessage_integer(message, key, lua_toboolean(L_, -1) ? 1 : 0, 0);
+                    return;
+                }
+                break;
+            case PBC_FIELD_ENUM:
+                if (type == LUA_TSTRING) {
+                    pbc_wmessage_string(message, key, lua_tostring(L_, -1), 0);
+                    return;
+                }
+                // fall through, enums also take their number
+            default:
+                if (type == LUA_TNUMBER) {
+                    uint64_t value = static_cast<uint64_t>(lua_tointeger(L_, -1));
+                    pbc_wmessage_integer(message, key, static_cast<uint32_t>(value),
+                            static_cast<uint32_t>(value >> 32));
+                    return;
+                }
+                break;
+        }
+        JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "lua pbc encode field %s got a %s", key, lua_typename(L_, type));
+    }
+
+    lua_State*                                                  L_;
+    std::shared_ptr<pbc_registry>                               registry_;
+    std::unordered_map<const pbc_message_type*, type_refs>      refs_;
+    std::vector<std::vector<char>>                              scratch_;   // pattern output per depth
+}; // class lua_pbc
+
+} // namespace engine
+
+#endif // ENGINE_NET_LUA_PBC_H
@@ -7,14 +7,26 @@ extern "C" {
 #include "lualib.h"
 }
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
 #include <map>
 #include <mutex>
+#include <vector>
 #include <third_party/asio.hpp>
-#include <third_party/asio/steady_timer.hpp>
 #include <third_party/g3log/g3log/g3log.hpp>
-#include <engine/common/timer.h>
+#include <engine/common/metrics.h>
+#include <engine/common/mpsc_queue.h>
+#include <engine/common/trace.h>
 #include <engine/handler/context.h>
+#include <engine/handler/pbc_codec.h>
 #include <engine/net/io_service_pool.h>
+#include <engine/net/lua_pbc.h>
+#include <engine/net/tick_driver.h>
+#include <engine/net/timer_service.h>
+#include <engine/scene/aoi_grid.h>
 
 namespace engine
 {
@@ -35,7 +47,35 @@ public:
 
         lua_register(lua_state_, "remove_timer", net_manager::remove_timer);
 
-        check_timer();
+        lua_register(lua_state_, "load_proto", net_manager::load_proto);
+
+        lua_register(lua_state_, "register_message", net_manager::register_message);
+
+        lua_register(lua_state_, "write_pbc_message", net_manager::write_pbc_message);
+
+        lua_register(lua_state_, "broadcast_message", net_manager::broadcast_message);
+
+        lua_register(lua_state_, "broadcast_pbc_message", net_manager::broadcast_pbc_message);
+
+        lua_register(lua_state_, "aoi_create", net_manager::aoi_create);
+
+        lua_register(lua_state_, "aoi_destroy", net_manager::aoi_destroy);
+
+        lua_register(lua_state_, "aoi_enter", net_manager::aoi_enter);
+
+        lua_register(lua_state_, "aoi_move", net_manager::aoi_move);
+
+        lua_register(lua_state_, "aoi_leave", net_manager::aoi_leave);
+
+        lua_register(lua_state_, "aoi_events", net_manager::aoi_events);
+
+        lua_register(lua_state_, "aoi_watchers", net_manager::aoi_watchers);
+
+        lua_register(lua_state_, "aoi_broadcast", net_manager::aoi_broadcast);
+
+        lua_register(lua_state_, "get_tick_stats", net_manager::get_tick_stats);
+
+        lua_pbc_.init(lua_state_, std::make_shared<pbc_registry>());
 
         timer_service_pool_.run();
     }
@@ -47,93 +87,414 @@ public:
 
     static void close()
     {
+        if (tick_driver_) {
+            tick_driver_->stop();
+            logic_service_pool_.stop();
+            tick_driver_.reset();
+        }
+        // no timer may fire into the state once it is closed
+        timer_service_pool_.stop();
+
+        std::lock_guard<std::mutex> lock(mutex_);
         lua_close(lua_state_);
+        aoi_map_.clear();
+    }
 
-        timer_service_pool_.stop();
+    // guards the lua state, hold it when calling into lua from outside
+    static std::mutex& mutex()
+    {
+        return mutex_;
     }
 
-    static void check_timer()
+    // schemas and message ids are registered by the scripts while they
+    // load, before any session shares the registry
+    static std::shared_ptr<pbc_registry> get_pbc_registry()
     {
-        asio_timer_.expires_from_now(std::chrono::seconds(30));
-        asio_timer_.async_wait([=](std::error_code ec){handle_check_timer(ec);});
+        return lua_pbc_.registry();
     }
 
-    static void handle_check_timer(std::error_code& ec)
+    typedef std::function<std::size_t(const std::vector<uint32_t>&,
+            std::shared_ptr<const data_block>)> broadcast_handler;
+
+    // the owner of the sessions, usually server::broadcast
+    static void set_broadcast_handler(const broadcast_handler& handler)
     {
-        if (!ec) {
-            {
-                std::lock_guard<std::mutex> lock(mutex_);
-                timer_.detect_timer_list();
-            }
-        } else {
-            LOGF(FATAL, "check timer error = %s", ec.message().c_str());
+        broadcast_handler_ = handler;
+    }
+
+    // from now on connects, messages and closes are queued and handed to lua
+    // in one batch before each on_tick(dt), all on the logic thread. handler
+    // is an optional C++ on_tick called right before the lua one
+    static void start_tick(uint32_t rate, const std::function<void(double)>& handler = nullptr)
+    {
+        if (tick_driver_) {
+            return;
         }
+        tick_driver_.reset(new tick_driver(logic_service_pool_.get_io_service(), rate));
+        tick_driver_->set_drain_handler(drain_inbound);
+        tick_driver_->set_tick_handler([handler](double dt){
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (handler) {
+                handler(dt);
+            }
+            dispatch_tick(dt);
+        });
+        ticking_ = true;
+        logic_service_pool_.run();
+        tick_driver_->start();
+    }
 
-        check_timer();
+    static tick_driver* get_tick_driver()
+    {
+        return tick_driver_.get();
     }
 
-    static void on_connect(context* ctx)
+    static timer_service& get_timer_service()
     {
-        std::lock_guard<std::mutex> lock(mutex_); 
-        context_map_[ctx->session_id()] = ctx;
-        lua_getglobal(lua_state_, "on_connect");
-        lua_pushinteger(lua_state_, ctx->session_id());
+        return timer_service_;
+    }
+
+    static void on_timer(uint32_t index)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lua_getglobal(lua_state_, "on_timer");
+        lua_pushinteger(lua_state_, index);
 
-        if (lua_pcall(lua_state_, 1, 0, 0) != 0) {
-            luaL_error(lua_state_, "on_connect error! %s \n", lua_tostring(lua_state_, -1)); 
+        if (pcall(1, get_stats().on_timer) != 0) {
+            LOGF(WARNING, "on_timer error! %s", lua_tostring(lua_state_, -1));
+            lua_pop(lua_state_, 1);
         }
     }
 
-    static void on_message(uint32_t session_id, const char* msg, std::size_t msg_len)
+    // on_send_pause(session_id, paused) is optional in the scripts, called
+    // with true once the session is over its send budget and with false
+    // once it drained. never from inside a write, which may hold mutex_
+    static void on_send_pause(uint32_t session_id, bool paused)
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        lua_getglobal(lua_state_, "on_message");
+        lua_getglobal(lua_state_, "on_send_pause");
+        if (!lua_isfunction(lua_state_, -1)) {
+            lua_pop(lua_state_, 1);
+            return;
+        }
         lua_pushinteger(lua_state_, session_id);
-        lua_pushlstring(lua_state_, msg, msg_len);
+        lua_pushboolean(lua_state_, paused);
+
+        if (pcall(2, get_stats().on_send_pause) != 0) {
+            LOGF(WARNING, "on_send_pause error! %s", lua_tostring(lua_state_, -1));
+            lua_pop(lua_state_, 1);
+        }
+    }
+
+    static void on_connect(context* ctx)
+    {
+        {
+            std::lock_guard<std::mutex> lock(context_mutex_);
+            context_map_[ctx->session_id()] = ctx;
+        }
+        if (ticking_) {
+            queue_inbound(inbound_type::CONNECT, ctx->session_id());
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_); 
+        dispatch_connect(ctx->session_id());
+    }
 
-        if (lua_pcall(lua_state_, 2, 0, 0) != 0) {
-            luaL_error(lua_state_, "on_message error! %s \n", lua_tostring(lua_state_, -1));
+    // on_message(session_id, msg_id, msg), msg is a pooled table reused
+    // once on_message returns, or the raw body when the id has no pattern.
+    // with a tick running the message waits for the next tick
+    static void on_message(uint32_t session_id, const pbc_message& message)
+    {
+        if (ticking_) {
+            // the body only lives while the codec decodes, keep a copy
+            inbound event;
+            event.type          = inbound_type::MESSAGE;
+            event.session_id    = session_id;
+            event.msg_id        = message.id;
+            event.body.reset(new data_block(message.body.data, message.body.len));
+            event.trace_id      = trace::current();
+            if (event.trace_id) {
+                event.queued    = trace::clock::now();
+            }
+            get_stats().inbound_depth.add();
+            inbound_.push(std::move(event));
+            return;
         }
+
+        std::unique_lock<std::mutex> lock = lock_traced(session_id);
+        dispatch_body(session_id, message);
     }
 
     static void on_passive_clean(uint32_t session_id)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
-        std::map<uint32_t, context*>::iterator it;
-        it = context_map_.find(session_id);
-        if (it != context_map_.end()) {
-            context_map_.erase(it);
+        {
+            std::lock_guard<std::mutex> lock(context_mutex_);
+            context_map_.erase(session_id);
+        }
+        if (ticking_) {
+            queue_inbound(inbound_type::CLOSED, session_id);
+            return;
         }
 
-        lua_getglobal(lua_state_, "on_passive_clean");
-        lua_pushinteger(lua_state_, session_id);
+        std::lock_guard<std::mutex> lock(mutex_);
+        dispatch_passive_clean(session_id);
+    }
 
-        if (lua_pcall(lua_state_, 1, 0, 0) != 0) {
-            luaL_error(lua_state_, "on_passive_clean error! %s \n", lua_tostring(lua_state_, -1));
+    // the lua C functions below only run inside a lua call, which always
+    // holds mutex_ already
+    static int get_tick_stats(lua_State* L)
+    {
+        tick_stats stats;
+        memset(&stats, 0, sizeof stats);
+        if (tick_driver_) {
+            stats = tick_driver_->stats();
         }
+        lua_createtable(L, 0, 6);
+        lua_pushinteger(L, static_cast<lua_Integer>(stats.ticks));
+        lua_setfield(L, -2, "ticks");
+        lua_pushinteger(L, static_cast<lua_Integer>(stats.overruns));
+        lua_setfield(L, -2, "overruns");
+        lua_pushinteger(L, static_cast<lua_Integer>(stats.skipped));
+        lua_setfield(L, -2, "skipped");
+        lua_pushinteger(L, static_cast<lua_Integer>(stats.avg_us));
+        lua_setfield(L, -2, "avg_us");
+        lua_pushinteger(L, static_cast<lua_Integer>(stats.max_us));
+        lua_setfield(L, -2, "max_us");
+        lua_pushinteger(L, static_cast<lua_Integer>(stats.max_late_us));
+        lua_setfield(L, -2, "max_late_us");
+        return 1;
     }
 
+    // a luaL_check* error longjmps past the lock guard, every argument is
+    // checked before context_mutex_ is taken
+    // write_message(session_id, msg [, droppable]), a droppable msg may be
+    // dropped while the session is over its send budget
     static int write_message(lua_State* L)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
         uint32_t session_id = luaL_checkinteger(L, 1);
+        read_data msg;
+        msg.data = luaL_checklstring(L, 2, &msg.len);
+        bool droppable = lua_toboolean(L, 3) != 0;
+        std::lock_guard<std::mutex> lock(context_mutex_);
         std::map<uint32_t, context*>::iterator it;
         it = context_map_.find(session_id);
         if (it != context_map_.end()) {
-            read_data msg;
-            msg.data = luaL_checklstring(L, 2, &msg.len);
-            auto response = new any(msg);
+            any* response = nullptr;
+            if (droppable) {
+                droppable_data data;
+                data.block = std::make_shared<data_block>(msg.data, msg.len);
+                response = new any(data);
+            } else {
+                response = new any(msg);
+            }
             it->second->fire_write(std::unique_ptr<any>(response));
         }
         return 0;
     }
 
+    // write_pbc_message(session_id, msg_id, msg [, droppable]), the table is
+    // encoded by pbc and copied by the codec straight into the session's
+    // write buffer
+    static int write_pbc_message(lua_State* L)
+    {
+        uint32_t session_id = luaL_checkinteger(L, 1);
+        uint32_t id         = luaL_checkinteger(L, 2);
+        luaL_checktype(L, 3, LUA_TTABLE);
+        bool droppable      = lua_toboolean(L, 4) != 0;
+        std::lock_guard<std::mutex> lock(context_mutex_);
+        auto it = context_map_.find(session_id);
+        const pbc_message_type* type = lua_pbc_.registry()->find(id);
+        if (it == context_map_.end() || !type) {
+            lua_pushboolean(L, false);
+            return 1;
+        }
+
+        pbc_out_message message;
+        message.id          = id;
+        message.wmessage    = lua_pbc_.registry()->new_wmessage(id);
+        message.droppable   = droppable;
+        lua_pbc_.build(3, *type, message.wmessage.get());
+        it->second->fire_write(std::unique_ptr<any>(new any(message)));
+        lua_pushboolean(L, true);
+        return 1;
+    }
+
+    // broadcast_message(session_ids, msg), msg is copied once and the block
+    // is shared by every session's write queue
+    static int broadcast_message(lua_State* L)
+    {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        std::size_t len = 0;
+        const char* data = luaL_checklstring(L, 2, &len);
+        lua_pushinteger(L, static_cast<lua_Integer>(
+                    broadcast(L, std::make_shared<data_block>(data, len))));
+        return 1;
+    }
+
+    // broadcast_pbc_message(session_ids, msg_id, msg), the table is encoded
+    // into a single frame for all the sessions
+    static int broadcast_pbc_message(lua_State* L)
+    {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        uint32_t id = luaL_checkinteger(L, 2);
+        luaL_checktype(L, 3, LUA_TTABLE);
+        const pbc_message_type* type = lua_pbc_.registry()->find(id);
+        if (!type) {
+            lua_pushinteger(L, 0);
+            return 1;
+        }
+
+        std::shared_ptr<pbc_wmessage> wmessage = lua_pbc_.registry()->new_wmessage(id);
+        lua_pbc_.build(3, *type, wmessage.get());
+        lua_pushinteger(L, static_cast<lua_Integer>(
+                    broadcast(L, pbc_codec::encode_frame(id, wmessage.get()))));
+        return 1;
+    }
+
+    // aoi_create(width, height, cell_size [, radius [, record_events]]),
+    // returns the scene handle. a scene that records events has to drain
+    // them with aoi_events, e.g. every tick
+    static int aoi_create(lua_State* L)
+    {
+        float width         = static_cast<float>(luaL_checknumber(L, 1));
+        float height        = static_cast<float>(luaL_checknumber(L, 2));
+        float cell_size     = static_cast<float>(luaL_checknumber(L, 3));
+        lua_Integer radius  = luaL_optinteger(L, 4, 1);
+        bool record_events  = lua_toboolean(L, 5) != 0;
+        if (!std::isfinite(width) || !std::isfinite(height) || !std::isfinite(cell_size)
+                || width <= 0 || height <= 0 || cell_size <= 0) {
+            return luaL_error(L, "aoi_create width, height and cell_size must be positive");
+        }
+        if (radius < 1 || radius > aoi_grid::kMaxRadius) {
+            return luaL_error(L, "aoi_create radius must be in [1, %d]",
+                    static_cast<int>(aoi_grid::kMaxRadius));
+        }
+        if (aoi_grid::cell_count(width, height, cell_size) > aoi_grid::kMaxCells) {
+            return luaL_error(L, "aoi_create grid over %d cells",
+                    static_cast<int>(aoi_grid::kMaxCells));
+        }
+        uint32_t handle = ++aoi_handle_;
+        aoi_map_[handle].reset(new aoi_grid(width, height, cell_size,
+                    static_cast<uint32_t>(radius), record_events));
+        lua_pushinteger(L, handle);
+        return 1;
+    }
+
+    static int aoi_destroy(lua_State* L)
+    {
+        aoi_map_.erase(static_cast<uint32_t>(luaL_checkinteger(L, 1)));
+        return 0;
+    }
+
+    // aoi_enter(handle, id, x, z [, watcher]), for a player id is its session id
+    static int aoi_enter(lua_State* L)
+    {
+        aoi_grid& grid  = check_aoi(L, 1);
+        uint32_t id     = luaL_checkinteger(L, 2);
+        float x         = static_cast<float>(luaL_checknumber(L, 3));
+        float z         = static_cast<float>(luaL_checknumber(L, 4));
+        bool watcher    = lua_isnoneornil(L, 5) || lua_toboolean(L, 5);
+        lua_pushboolean(L, grid.enter(id, x, z, watcher));
+        return 1;
+    }
+
+    static int aoi_move(lua_State* L)
+    {
+        aoi_grid& grid  = check_aoi(L, 1);
+        uint32_t id     = luaL_checkinteger(L, 2);
+        float x         = static_cast<float>(luaL_checknumber(L, 3));
+        float z         = static_cast<float>(luaL_checknumber(L, 4));
+        lua_pushboolean(L, grid.move(id, x, z));
+        return 1;
+    }
+
+    static int aoi_leave(lua_State* L)
+    {
+        aoi_grid& grid  = check_aoi(L, 1);
+        lua_pushboolean(L, grid.leave(luaL_checkinteger(L, 2)));
+        return 1;
+    }
+
+    // aoi_events(handle) returns the events since the last call flattened
+    // as {type, watcher, target, type, watcher, target, ...}
+    static int aoi_events(lua_State* L)
+    {
+        aoi_grid& grid = check_aoi(L, 1);
+        const std::vector<aoi_event>& events = grid.events();
+        lua_createtable(L, static_cast<int>(events.size() * 3), 0);
+        lua_Integer index = 0;
+        for (auto& event : events) {
+            lua_pushinteger(L, static_cast<lua_Integer>(event.type));
+            lua_rawseti(L, -2, ++index);
+            lua_pushinteger(L, event.watcher);
+            lua_rawseti(L, -2, ++index);
+            lua_pushinteger(L, event.target);
+            lua_rawseti(L, -2, ++index);
+        }
+        grid.clear_events();
+        return 1;
+    }
+
+    static int aoi_watchers(lua_State* L)
+    {
+        aoi_grid& grid = check_aoi(L, 1);
+        broadcast_ids_.clear();
+        grid.watchers(luaL_checkinteger(L, 2), broadcast_ids_, lua_toboolean(L, 3) != 0);
+        lua_createtable(L, static_cast<int>(broadcast_ids_.size()), 0);
+        for (std::size_t i = 0; i < broadcast_ids_.size(); ++i) {
+            lua_pushinteger(L, broadcast_ids_[i]);
+            lua_rawseti(L, -2, static_cast<lua_Integer>(i + 1));
+        }
+        return 1;
+    }
+
+    // aoi_broadcast(handle, id, msg_id, msg [, include_self]), encodes msg
+    // once for every watcher of id without building the id list in lua
+    static int aoi_broadcast(lua_State* L)
+    {
+        aoi_grid& grid  = check_aoi(L, 1);
+        uint32_t id     = luaL_checkinteger(L, 2);
+        uint32_t msg_id = luaL_checkinteger(L, 3);
+        luaL_checktype(L, 4, LUA_TTABLE);
+        const pbc_message_type* type = lua_pbc_.registry()->find(msg_id);
+        broadcast_ids_.clear();
+        if (!type || !broadcast_handler_
+                || grid.watchers(id, broadcast_ids_, lua_toboolean(L, 5) != 0) == 0) {
+            lua_pushinteger(L, 0);
+            return 1;
+        }
+
+        std::shared_ptr<pbc_wmessage> wmessage = lua_pbc_.registry()->new_wmessage(msg_id);
+        lua_pbc_.build(4, *type, wmessage.get());
+        std::shared_ptr<data_block> frame = pbc_codec::encode_frame(msg_id, wmessage.get());
+        lua_pushinteger(L, static_cast<lua_Integer>(
+                    frame ? broadcast_handler_(broadcast_ids_, frame) : 0));
+        return 1;
+    }
+
+    static int load_proto(lua_State* L)
+    {
+        const char* filename = luaL_checkstring(L, 1);
+        lua_pushboolean(L, lua_pbc_.registry()->load(filename));
+        return 1;
+    }
+
+    static int register_message(lua_State* L)
+    {
+        uint32_t id             = luaL_checkinteger(L, 1);
+        const char* type_name   = luaL_checkstring(L, 2);
+        lua_pushboolean(L, lua_pbc_.registry()->register_message(id, type_name));
+        return 1;
+    }
+
     static int close_connection(lua_State* L)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
         uint32_t session_id = luaL_checkinteger(L, 1);
         context* result = nullptr;
+        std::lock_guard<std::mutex> lock(context_mutex_);
         std::map<uint32_t, context*>::iterator it;
+        it = context_map_.find(session_id);
         if (it != context_map_.end()) {
             result = it->second;
             context_map_.erase(it);
@@ -142,40 +503,303 @@ public:
         return 0;
     }
 
+    // the timer wheel lives on its own thread, scheduling only enqueues
+    // the command
     static int add_timer(lua_State* L)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
         uint32_t interval   = luaL_checkinteger(L, 1);
         uint32_t type       = luaL_checkinteger(L, 2);
         uint32_t index      = luaL_checkinteger(L, 3);
 
-        uint32_t id = timer_.add_task(interval, static_cast<timer_type>(type), 
-                [type, index](){
-                    
-                });
+        timer_handle handle = timer_service_.add_task(interval, 
+                static_cast<timer_type>(type), [index](){on_timer(index);});
+        lua_pushinteger(L, static_cast<lua_Integer>(handle));
+        return 1;
     }
 
     static int remove_timer(lua_State* L)
+    {
+        timer_handle handle = static_cast<timer_handle>(luaL_checkinteger(L, 1));
+        timer_service_.remove_task(handle);
+        return 0;
+    }
+private:
+    // a null payload, a frame that could not be encoded, goes nowhere
+    static std::size_t broadcast(lua_State* L, std::shared_ptr<const data_block> payload)
+    {
+        if (!payload) {
+            return 0;
+        }
+        if (!broadcast_handler_) {
+            LOGF(WARNING, "broadcast without broadcast handler");
+            return 0;
+        }
+        std::vector<uint32_t>& session_ids = broadcast_ids_;
+        session_ids.clear();
+        lua_Integer count = luaL_len(L, 1);
+        for (lua_Integer i = 1; i <= count; ++i) {
+            lua_rawgeti(L, 1, i);
+            session_ids.push_back(static_cast<uint32_t>(lua_tointeger(L, -1)));
+            lua_pop(L, 1);
+        }
+        return broadcast_handler_(session_ids, payload);
+    }
+
+    enum class inbound_type : uint8_t
+    {
+        CONNECT,
+        MESSAGE,
+        CLOSED,
+    };
+
+    struct inbound
+    {
+        inbound_type                type;
+        uint32_t                    session_id;
+        uint32_t                    msg_id;
+        std::unique_ptr<data_block> body;
+        uint64_t                    trace_id = 0;   // a sampled message
+        trace::clock::time_point    queued;
+    };
+
+    static void queue_inbound(inbound_type type, uint32_t session_id)
+    {
+        inbound event;
+        event.type          = type;
+        event.session_id    = session_id;
+        event.msg_id        = 0;
+        get_stats().inbound_depth.add();
+        inbound_.push(std::move(event));
+    }
+
+    // logic thread, everything that arrived since the last tick under a
+    // single hold of mutex_
+    static void drain_inbound()
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        uint32_t index      = luaL_checkinteger(L, 1);
+        inbound event;
+        while (inbound_.pop(event)) {
+            get_stats().inbound_depth.sub();
+            switch (event.type) {
+                case inbound_type::CONNECT:
+                    dispatch_connect(event.session_id);
+                    break;
+                case inbound_type::MESSAGE:
+                    if (event.trace_id) {
+                        trace::record(event.trace_id, "tick_queue", event.queued,
+                                event.session_id);
+                        trace::scope scope(event.trace_id);
+                        dispatch_inbound_message(event);
+                    } else {
+                        dispatch_inbound_message(event);
+                    }
+                    break;
+                case inbound_type::CLOSED:
+                    dispatch_passive_clean(event.session_id);
+                    break;
+            }
+        }
+    }
+
+    static void dispatch_inbound_message(const inbound& event)
+    {
+        pbc_message message;
+        message.id          = event.msg_id;
+        message.type        = lua_pbc_.registry()->find(event.msg_id);
+        message.rmessage    = nullptr;
+        message.data        = nullptr;
+        message.body.data   = event.body->data;
+        message.body.len    = event.body->len;
+        if (!message.type) {
+            return;
+        }
+        dispatch_body(event.session_id, message);
+    }
 
+    // a codec without decode_body leaves the unpacking to the logic thread,
+    // only pattern types become tables, the rest go to lua as raw bytes
+    static void dispatch_body(uint32_t session_id, pbc_message message)
+    {
+        if (!message.type->pattern || message.data) {
+            dispatch_message(session_id, message);
+            return;
+        }
+        pbc_codec::unpack(*lua_pbc_.registry(), message, unpacked_,
+                [session_id](pbc_message& decoded){dispatch_message(session_id, decoded);});
     }
+
+    // the dispatch functions below call into lua and expect mutex_ held
+    static void dispatch_connect(uint32_t session_id)
+    {
+        lua_getglobal(lua_state_, "on_connect");
+        lua_pushinteger(lua_state_, session_id);
+
+        if (pcall(1, get_stats().on_connect) != 0) {
+            LOGF(WARNING, "on_connect error! %s", lua_tostring(lua_state_, -1));
+            lua_pop(lua_state_, 1);
+        }
+    }
+
+    static void dispatch_message(uint32_t session_id, const pbc_message& message)
+    {
+        bool pooled = lua_pbc_.push(message);
+        if (!pooled) {
+            lua_pushlstring(lua_state_, message.body.data, message.body.len);
+        }
+        lua_getglobal(lua_state_, "on_message");
+        lua_pushinteger(lua_state_, session_id);
+        lua_pushinteger(lua_state_, message.id);
+        lua_pushvalue(lua_state_, -4);
+
+        if (pcall(3, get_stats().on_message) != 0) {
+            LOGF(WARNING, "on_message error! %s", lua_tostring(lua_state_, -1));
+            lua_pop(lua_state_, 1);
+        }
+
+        if (pooled) {
+            lua_pbc_.recycle(*message.type);
+        } else {
+            lua_pop(lua_state_, 1);
+        }
+    }
+
+    static void dispatch_passive_clean(uint32_t session_id)
+    {
+        lua_getglobal(lua_state_, "on_passive_clean");
+        lua_pushinteger(lua_state_, session_id);
+
+        if (pcall(1, get_stats().on_passive_clean) != 0) {
+            LOGF(WARNING, "on_passive_clean error! %s", lua_tostring(lua_state_, -1));
+            lua_pop(lua_state_, 1);
+        }
+    }
+
+    // on_tick(dt) is optional in the scripts
+    static void dispatch_tick(double dt)
+    {
+        lua_getglobal(lua_state_, "on_tick");
+        if (!lua_isfunction(lua_state_, -1)) {
+            lua_pop(lua_state_, 1);
+            return;
+        }
+        lua_pushnumber(lua_state_, dt);
+
+        if (pcall(1, get_stats().on_tick) != 0) {
+            LOGF(WARNING, "on_tick error! %s", lua_tostring(lua_state_, -1));
+            lua_pop(lua_state_, 1);
+        }
+    }
+
+    static aoi_grid& check_aoi(lua_State* L, int index)
+    {
+        auto it = aoi_map_.find(static_cast<uint32_t>(luaL_checkinteger(L, index)));
+        if (it == aoi_map_.end()) {
+            luaL_error(L, "unknown aoi handle");
+        }
+        return *it->second;
+    }
+
 private:
+    // takes mutex_, a sampled message records the wait for it
+    static std::unique_lock<std::mutex> lock_traced(uint32_t session_id)
+    {
+        uint64_t traced = trace::current();
+        if (!traced) {
+            return std::unique_lock<std::mutex>(mutex_);
+        }
+        auto begin = trace::clock::now();
+        std::unique_lock<std::mutex> lock(mutex_);
+        trace::record(traced, "lua_lock_wait", begin, session_id);
+        return lock;
+    }
+
+    // latency and errors of one lua entry point, callback names its trace
+    // stage too
+    struct lua_call_stats
+    {
+        explicit lua_call_stats(const char* callback)
+            : name(callback)
+            , latency("joker_lua_call_seconds", "time spent in a lua callback",
+                    std::string("callback=\"") + callback + "\"")
+            , errors("joker_lua_errors_total", "lua callbacks that raised an error",
+                    std::string("callback=\"") + callback + "\"")
+        {
+        }
+
+        const char*         name;
+        metrics::histogram  latency;
+        metrics::counter    errors;
+    };
+
+    struct stats
+    {
+        lua_call_stats      on_connect{"on_connect"};
+        lua_call_stats      on_message{"on_message"};
+        lua_call_stats      on_passive_clean{"on_passive_clean"};
+        lua_call_stats      on_tick{"on_tick"};
+        lua_call_stats      on_timer{"on_timer"};
+        lua_call_stats      on_send_pause{"on_send_pause"};
+        metrics::gauge      inbound_depth{"joker_lua_inbound_depth",
+            "connects, messages and closes waiting for the next tick"};
+    };
+
+    static const stats& get_stats()
+    {
+        static stats s;
+        return s;
+    }
+
+    // lua_pcall of a callback with nargs arguments and no results
+    static int pcall(int nargs, const lua_call_stats& call)
+    {
+        auto start = std::chrono::steady_clock::now();
+        int status = lua_pcall(lua_state_, nargs, 0, 0);
+        call.latency.record_since(start);
+        uint64_t traced = trace::current();
+        if (traced) {
+            trace::record(traced, call.name, start, 0);
+        }
+        if (status != 0) {
+            call.errors.add();
+        }
+        return status;
+    }
+
     static lua_State*                   lua_state_;
     static std::map<uint32_t, context*> context_map_;
-    static timer                        timer_;
+    static std::mutex                   context_mutex_;     // only guards context_map_
     static std::mutex                   mutex_;
     static io_service_pool              timer_service_pool_;
-    static asio::steady_timer           asio_timer_;
+    static timer_service                timer_service_;
+    static lua_pbc                      lua_pbc_;
+    static broadcast_handler            broadcast_handler_;
+    static std::vector<uint32_t>        broadcast_ids_;
+    static std::map<uint32_t, std::unique_ptr<aoi_grid>>
+                                        aoi_map_;
+    static uint32_t                     aoi_handle_;
+    static io_service_pool              logic_service_pool_;
+    static std::unique_ptr<tick_driver> tick_driver_;
+    static std::atomic_bool             ticking_;
+    static mpsc_queue<inbound>          inbound_;
+    static std::vector<char>            unpacked_;
 }; // class net_manager
 
 lua_State* net_manager::lua_state_;
 std::map<uint32_t, context*> net_manager::context_map_;
-timer net_manager::timer_;
+std::mutex net_manager::context_mutex_;
 std::mutex net_manager::mutex_;
 io_service_pool net_manager::timer_service_pool_(1, "timer_pool");
-asio::steady_timer net_manager::asio_timer_(timer_service_pool_.get_io_service());
+timer_service net_manager::timer_service_(timer_service_pool_);
+lua_pbc net_manager::lua_pbc_;
+net_manager::broadcast_handler net_manager::broadcast_handler_;
+std::vector<uint32_t> net_manager::broadcast_ids_;
+std::map<uint32_t, std::unique_ptr<aoi_grid>> net_manager::aoi_map_;
+uint32_t net_manager::aoi_handle_ = 0;
+io_service_pool net_manager::logic_service_pool_(1, "logic_pool");
+std::unique_ptr<tick_driver> net_manager::tick_driver_;
+std::atomic_bool net_manager::ticking_(false);
+mpsc_queue<net_manager::inbound> net_manager::inbound_;
+std::vector<char> net_manager::unpacked_;
 
 } // namespace engine
 
@@ -0,0 +1,240 @@
+#ifndef ENGINE_NET_ROUTER_H
+#define ENGINE_NET_ROUTER_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <third_party/asio.hpp>
+#include <third_party/asio/steady_timer.hpp>
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/common/common.h>
+#include <engine/common/scalable_rw_lock.h>
+#include <engine/net/io_service_pool.h>
+#include <engine/net/session.h>
+
+namespace engine
+{
+
+using asio::ip::tcp;
+
+/**
+ * persistent links from a route to its backend servers. every backend has
+ * a few links that carry the traffic of many client sessions, all links
+ * share one io_service_pool. the frames of one source always take the
+ * same link, so they stay in order. a dropped link reconnects after
+ * kReconnectDelay, the frames of its sources are dropped until then
+ * rather than sent ahead of the ones still queued on the old link
+ */
+class router
+{
+public:
+    static const uint32_t kReconnectDelay = 1000;   // ms
+
+    router(const router&) = delete;
+    router& operator=(const router&) = delete;
+    explicit router(std::size_t io_service_pool_size)
+        : io_service_pool_(io_service_pool_size, "route_pool")
+        , init_handlers_(nullptr)
+        , stopped_(false)
+        , dropped_frames_(0)
+        , next_link_(0)
+    {
+    }
+
+    ~router()
+    {
+        backends_.clear();
+    }
+
+    void run()
+    {
+        io_service_pool_.run();
+    }
+
+    void stop()
+    {
+        stopped_ = true;
+        {
+            auto read_guard = lock_.read_guard();
+            for (auto& pair : backends_) {
+                for (auto& link : pair.second->links) {
+                    if (link) {
+                        link->close();
+                    }
+                }
+            }
+        }
+        io_service_pool_.stop();
+
+        // the posted closes above never run on a stopped pool, close the
+        // sockets here and drop the sessions, their close handlers hold
+        // the backend they sit in
+        std::error_code ignore;
+        auto write_guard = lock_.write_guard();
+        for (auto& pair : backends_) {
+            for (auto& link : pair.second->links) {
+                if (link) {
+                    link->socket().close(ignore);
+                    link.reset();
+                }
+            }
+        }
+    }
+
+    // handlers of every backend link, usually a route_handler that sends
+    // the answers back to the client sessions
+    void set_init_handlers(const std::function<void(std::shared_ptr<session>)>& handler)
+    {
+        init_handlers_ = handler;
+    }
+
+    void add_backend(uint32_t server_id, const std::string& address, unsigned short port,
+            std::size_t link_count = 2)
+    {
+        auto target         = std::make_shared<backend>();
+        target->id          = server_id;
+        target->address     = address;
+        target->port        = port;
+        target->links.resize(link_count ? link_count : 1);
+        {
+            auto write_guard = lock_.write_guard();
+            target->first_link  = next_link_;
+            next_link_         += target->links.size();
+            backends_[server_id] = target;
+        }
+        for (std::size_t i = 0; i < target->links.size(); ++i) {
+            connect(target, i);
+        }
+    }
+
+    // any thread. false when the backend is unknown or the source's link
+    // is down, the frame is dropped then
+    bool forward(uint32_t server_id, uint32_t source, std::shared_ptr<const data_block> frame)
+    {
+        std::shared_ptr<session> link;
+        {
+            auto read_guard = lock_.read_guard();
+            auto it = backends_.find(server_id);
+            if (it != backends_.end()) {
+                std::vector<std::shared_ptr<session>>& links = it->second->links;
+                link = links[source % links.size()];
+            }
+        }
+        if (!link) {
+            ++dropped_frames_;
+            return false;
+        }
+        link->write_shared(frame);
+        return true;
+    }
+
+    std::size_t connected_links()
+    {
+        auto read_guard = lock_.read_guard();
+        std::size_t count = 0;
+        for (auto& pair : backends_) {
+            for (auto& link : pair.second->links) {
+                count += link ? 1 : 0;
+            }
+        }
+        return count;
+    }
+
+    std::size_t dropped_frames() const
+    {
+        return dropped_frames_;
+    }
+private:
+    struct backend
+    {
+        uint32_t                                id;
+        std::string                             address;
+        unsigned short                          port;
+        std::size_t                             first_link;     // spreads links over the pool
+        std::vector<std::shared_ptr<session>>   links;          // null while connecting
+    };
+
+    // a link keeps its io thread across reconnects, which may run on any
+    // thread of the pool
+    asio::io_service& link_io_service(const std::shared_ptr<backend>& target,
+            std::size_t index)
+    {
+        return io_service_pool_.get_io_service(
+                (target->first_link + index) % io_service_pool_.size());
+    }
+
+    void connect(std::shared_ptr<backend> target, std::size_t index)
+    {
+        if (stopped_) {
+            return;
+        }
+        asio::io_service& io_service = link_io_service(target, index);
+        std::shared_ptr<session> link = std::make_shared<session>(get_session_increase_id(),
+                io_service, io_service);
+        std::error_code ec;
+        tcp::endpoint endpoint(asio::ip::address::from_string(target->address, ec), target->port);
+        if (ec) {
+            LOGF(WARNING, "route backend id = %d, address = %s, error = %s",
+                    target->id, target->address.c_str(), ec.message().c_str());
+            return;
+        }
+        link->socket().async_connect(endpoint,
+                [this, target, index, link](std::error_code ec){
+                    handle_connect(target, index, link, ec);
+                });
+    }
+
+    void handle_connect(std::shared_ptr<backend> target, std::size_t index,
+            std::shared_ptr<session> link, std::error_code& ec)
+    {
+        if (ec) {
+            LOGF(WARNING, "route backend id = %d, link = %zu, connect error = %s",
+                    target->id, index, ec.message().c_str());
+            reconnect(target, index);
+            return;
+        }
+
+        link->socket().set_option(tcp::no_delay(true));
+        link->set_close_handler([this, target, index](uint32_t){
+            {
+                auto write_guard = lock_.write_guard();
+                target->links[index].reset();
+            }
+            reconnect(target, index);
+        });
+        {
+            auto write_guard = lock_.write_guard();
+            target->links[index] = link;
+        }
+        link->start(init_handlers_);
+        LOGF(INFO, "route backend id = %d, link = %zu connected", target->id, index);
+    }
+
+    void reconnect(std::shared_ptr<backend> target, std::size_t index)
+    {
+        if (stopped_) {
+            return;
+        }
+        auto timer = std::make_shared<asio::steady_timer>(link_io_service(target, index));
+        timer->expires_from_now(std::chrono::milliseconds(static_cast<int64_t>(kReconnectDelay)));
+        timer->async_wait([this, target, index, timer](std::error_code ec){
+            if (!ec) {
+                connect(target, index);
+            }
+        });
+    }
+private:
+    io_service_pool                                     io_service_pool_;
+    std::function<void(std::shared_ptr<session>)>       init_handlers_;
+    std::map<uint32_t, std::shared_ptr<backend>>        backends_;
+    scalable_rw_lock                                    lock_;
+    std::atomic_bool                                    stopped_;
+    std::atomic_size_t                                  dropped_frames_;
+    std::size_t                                         next_link_;
+}; // class router
+
+} // namespace engine
+
+#endif // ENGINE_NET_ROUTER_H
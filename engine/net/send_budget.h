@@ -0,0 +1,96 @@
+#ifndef ENGINE_NET_SEND_BUDGET_H
+#define ENGINE_NET_SEND_BUDGET_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace engine
+{
+
+enum class send_overflow_policy
+{
+    PAUSE_PRODUCER  = 0,    // tell the producer to stop until drained to low water
+    DROP_OLDEST     = 1,    // drop the oldest queued droppable messages
+    DISCONNECT      = 2,    // abort the session, its backlog is not sent
+}; // enum class send_overflow_policy
+
+// outbound budget of one session, measured in bytes queued but not yet
+// written to the socket. a zero mask disables the check
+struct send_budget
+{
+    std::size_t             high_water_mask = 0;
+    std::size_t             low_water_mask  = 0;
+    std::size_t             hard_limit      = 0;
+    send_overflow_policy    policy          = send_overflow_policy::PAUSE_PRODUCER;
+}; // struct send_budget
+
+// pending outbound bytes summed over every session of the process. once
+// the limit is passed, the sessions with the most pending bytes are
+// disconnected, whatever their own budget, so a few slow readers cannot
+// exhaust memory
+class send_memory
+{
+public:
+    static void add(std::size_t len)
+    {
+        pending().fetch_add(len, std::memory_order_relaxed);
+    }
+
+    static void sub(std::size_t len)
+    {
+        pending().fetch_sub(len, std::memory_order_relaxed);
+    }
+
+    static void add_dropped(std::size_t len)
+    {
+        dropped().fetch_add(len, std::memory_order_relaxed);
+    }
+
+    static std::size_t pending_bytes()
+    {
+        return pending().load(std::memory_order_relaxed);
+    }
+
+    static std::size_t dropped_bytes()
+    {
+        return dropped().load(std::memory_order_relaxed);
+    }
+
+    static void set_limit(std::size_t limit)
+    {
+        limit_bytes().store(limit, std::memory_order_relaxed);
+    }
+
+    static std::size_t limit()
+    {
+        return limit_bytes().load(std::memory_order_relaxed);
+    }
+
+    static bool over_limit()
+    {
+        std::size_t max = limit();
+        return max != 0 && pending_bytes() > max;
+    }
+private:
+    static std::atomic_size_t& pending()
+    {
+        static std::atomic_size_t bytes{0};
+        return bytes;
+    }
+
+    static std::atomic_size_t& dropped()
+    {
+        static std::atomic_size_t bytes{0};
+        return bytes;
+    }
+
+    static std::atomic_size_t& limit_bytes()
+    {
+        static std::atomic_size_t bytes{0};
+        return bytes;
+    }
+}; // class send_memory
+
+} // namespace engine
+
+#endif // ENGINE_NET_SEND_BUDGET_H
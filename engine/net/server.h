@@ -1,14 +1,20 @@
 #ifndef ENGINE_NET_SERVER_H
 #define ENGINE_NET_SERVER_H
 
+#include <algorithm>
+#include <atomic>
 #include <map>
+#include <vector>
 #include <third_party/asio.hpp>
 #include <third_party/asio/steady_timer.hpp>
 #include <third_party/g3log/g3log/g3log.hpp>
 #include <engine/common/common.h>
-#include <engine/common/wfirst_rw_lock.h>
+#include <engine/common/logger.h>
+#include <engine/common/metrics.h>
+#include <engine/common/scalable_rw_lock.h>
 #include <engine/net/io_service_pool.h>
 #include <engine/net/session.h>
+#include <engine/net/timer_service.h>
 
 namespace engine
 {
@@ -24,14 +30,26 @@ public:
         : io_service_accept_pool_(1, "accept_pool")
         , io_service_pool_(io_service_pool_size, "io_pool")
         , io_service_work_pool_(io_service_pool_size, "work_pool")
+        , io_timer_service_(io_service_pool_)
+        , work_timer_service_(io_service_work_pool_)
         , acceptor_(io_service_accept_pool_.get_io_service(), 
                 tcp::endpoint(asio::ip::address_v4::from_string(address), port),
                 true)
         , read_high_water_mask_(0)
         , write_high_water_mask_(0)
         , write_high_water_mask_handler_(nullptr)
+        , write_pause_handler_(nullptr)
         , init_handlers_(nullptr)
+        , lazy_buffers_(false)
+        , over_limit_posted_(false)
         , timer_(io_service_accept_pool_.get_io_service())
+        , accepted_("joker_server_accepted_total", "connections accepted",
+                "port=\"" + std::to_string(port) + "\"")
+        , idle_closed_("joker_server_idle_closed_total", "sessions closed by the idle check",
+                "port=\"" + std::to_string(port) + "\"")
+        , over_limit_closed_("joker_server_over_limit_closed_total",
+                "sessions closed while the pending bytes of the process were over the limit",
+                "port=\"" + std::to_string(port) + "\"")
     {
         acceptor_.set_option(asio::socket_base::debug(true));
         acceptor_.set_option(asio::socket_base::enable_connection_aborted(true));
@@ -40,10 +58,32 @@ public:
 
         accept();
         check_idle();        
+
+        metrics_collector_ = metrics::add_collector("joker_server_sessions",
+                "sessions of a server per io thread",
+                [this, port](std::vector<metrics::sample>& samples){
+                    std::vector<std::size_t> counts(io_service_pool_.size(), 0);
+                    {
+                        auto read_guard = lock_.read_guard();
+                        for (auto& pair : session_map_) {
+                            std::size_t index = io_service_pool_.index_of(
+                                    pair.second->socket().get_io_service());
+                            if (index < counts.size()) {
+                                ++counts[index];
+                            }
+                        }
+                    }
+                    for (std::size_t i = 0; i < counts.size(); ++i) {
+                        samples.push_back(metrics::sample{"port=\"" + std::to_string(port)
+                                + "\",io_thread=\"" + std::to_string(i) + "\"",
+                                static_cast<double>(counts[i])});
+                    }
+                });
     }
 
     ~server()
     {
+        metrics::remove_collector(metrics_collector_);
         session_map_.clear();
         wait_remove_session_map_.clear();
     }
@@ -75,11 +115,96 @@ public:
         write_high_water_mask_handler_  = handler;
     }
 
+    void set_send_budget(const send_budget& budget,
+            const std::function<void(std::shared_ptr<session>, bool)>& pause_handler = nullptr)
+    {
+        send_budget_         = budget;
+        write_pause_handler_ = pause_handler;
+    }
+
+    void set_lazy_buffers(bool lazy)
+    {
+        lazy_buffers_ = lazy;
+    }
+
+    std::size_t session_count()
+    {
+        auto read_guard = lock_.read_guard();
+        return session_map_.size();
+    }
+
+    std::size_t resident_bytes()
+    {
+        auto read_guard = lock_.read_guard();
+        std::size_t bytes = 0;
+        for (auto& pair : session_map_) {
+            bytes += pair.second->resident_bytes();
+        }
+        return bytes;
+    }
+
+    // one encoded payload shared by every target session, looked up under a
+    // single read lock and posted once per work thread. returns how many
+    // sessions it was queued on
+    std::size_t broadcast(const std::vector<uint32_t>& session_ids,
+            std::shared_ptr<const data_block> payload)
+    {
+        std::map<asio::io_service*, std::vector<std::shared_ptr<session>>> work_groups;
+        {
+            auto read_guard = lock_.read_guard();
+            for (uint32_t session_id : session_ids) {
+                auto it = session_map_.find(session_id);
+                if (it != session_map_.end()) {
+                    work_groups[&it->second->work_service()].push_back(it->second);
+                }
+            }
+        }
+        return post_broadcast(work_groups, payload);
+    }
+
+    // a shared payload for one session, e.g. a frame passed through a route
+    bool write_shared(uint32_t session_id, std::shared_ptr<const data_block> payload)
+    {
+        std::shared_ptr<session> target;
+        {
+            auto read_guard = lock_.read_guard();
+            auto it = session_map_.find(session_id);
+            if (it == session_map_.end()) {
+                return false;
+            }
+            target = it->second;
+        }
+        target->write_shared(payload);
+        return true;
+    }
+
+    std::size_t broadcast(std::shared_ptr<const data_block> payload)
+    {
+        std::map<asio::io_service*, std::vector<std::shared_ptr<session>>> work_groups;
+        {
+            auto read_guard = lock_.read_guard();
+            for (auto& pair : session_map_) {
+                work_groups[&pair.second->work_service()].push_back(pair.second);
+            }
+        }
+        return post_broadcast(work_groups, payload);
+    }
+
     void set_init_handlers(const std::function<void(std::shared_ptr<session>)>& handler)
     {
         init_handlers_ = handler;
     }
 
+    timer_service& io_timer_service()
+    {
+        return io_timer_service_;
+    }
+
+    timer_service& work_timer_service()
+    {
+        return work_timer_service_;
+    }
+
     void close_session(uint32_t session_id)
     {
         auto write_guard = lock_.write_guard();
@@ -102,11 +227,27 @@ public:
         return result;
     }
 private:
+    static std::size_t post_broadcast(
+            std::map<asio::io_service*, std::vector<std::shared_ptr<session>>>& work_groups,
+            const std::shared_ptr<const data_block>& payload)
+    {
+        std::size_t count = 0;
+        for (auto& group : work_groups) {
+            count += group.second.size();
+            auto targets = std::make_shared<std::vector<std::shared_ptr<session>>>(
+                    std::move(group.second));
+            group.first->post([targets, payload](){session::write_shared(*targets, payload);});
+        }
+        return count;
+    }
+
     void accept()
     {
         std::shared_ptr<session> new_session(new session(get_session_increase_id(),
                 io_service_work_pool_.get_io_service(),
                 io_service_pool_.get_io_service()));
+        new_session->set_timer_worker(&io_timer_service_.get_worker(
+                    new_session->socket().get_io_service()));
         acceptor_.async_accept(new_session->socket(),
                 [=](std::error_code ec){handle_accept(new_session, ec);});
     }
@@ -117,23 +258,76 @@ private:
             if (read_high_water_mask_ != 0) {
                 session->set_read_high_water_mask(read_high_water_mask_);
             }
+            session->set_send_budget(send_budget_, write_pause_handler_);
+            session->set_lazy_buffers(lazy_buffers_);
             if (write_high_water_mask_ != 0 && write_high_water_mask_handler_ != nullptr) {
                 session->set_write_high_water_mask_handler(
                         write_high_water_mask_handler_, write_high_water_mask_);
             }
             session->set_close_handler([this](uint32_t session_id){close_session(session_id);});
+            session->set_over_limit_handler([this](){post_close_over_limit();});
+            accepted_.add();
             {
                 auto write_guard = lock_.write_guard();
                 session_map_[session->id()] = session;
             }
             session->start(init_handlers_);
         } else {
-            LOGF(FATAL, "accept error = %s", ec.message().c_str());
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "accept error = %s", ec.message().c_str());
         }
 
         accept();
     }
 
+    // any work thread, the sessions are picked once on the accept thread
+    // however many of them find the limit passed
+    void post_close_over_limit()
+    {
+        if (!over_limit_posted_.exchange(true)) {
+            timer_.get_io_service().post([this](){close_over_limit();});
+        }
+    }
+
+    // closes the sessions with the most pending bytes until the rest fits
+    // the limit. bytes of a closing session count as freed already
+    void close_over_limit()
+    {
+        over_limit_posted_ = false;
+        std::size_t limit = send_memory::limit();
+        std::size_t total = send_memory::pending_bytes();
+        if (limit == 0 || total <= limit) {
+            return;
+        }
+
+        std::vector<std::pair<std::size_t, std::shared_ptr<session>>> senders;
+        {
+            auto read_guard = lock_.read_guard();
+            for (auto& pair : session_map_) {
+                std::size_t pending = pair.second->pending_write_bytes();
+                if (pair.second->closing()) {
+                    total -= std::min(pending, total);
+                } else if (pending > 0) {
+                    senders.emplace_back(pending, pair.second);
+                }
+            }
+        }
+        std::sort(senders.begin(), senders.end(),
+                [](const std::pair<std::size_t, std::shared_ptr<session>>& a,
+                    const std::pair<std::size_t, std::shared_ptr<session>>& b){
+                    return a.first > b.first;
+                });
+        for (auto& sender : senders) {
+            if (total <= limit) {
+                break;
+            }
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "session id = %d, pending write bytes = %zu, total pending = %zu over limit = %zu",
+                    sender.second->id(), sender.first, total, limit);
+            over_limit_closed_.add();
+            sender.second->abort();
+            total -= sender.first;
+        }
+    }
+
     void check_idle()
     {
         timer_.expires_from_now(std::chrono::seconds(30));
@@ -147,7 +341,8 @@ private:
             for (auto it = session_map_.begin(); it != session_map_.end();) {
                 if (it->second->check_idle()) {
                     wait_remove_session_map_[it->first] = it->second;
-                    LOGF(INFO, "check idle session id = %d", it->second->id());
+                    JOKER_LOGF_RATE(INFO, logger::kLinesPerSecond, "check idle session id = %d", it->second->id());
+                    idle_closed_.add();
                     it->second->close();
                     it = session_map_.erase(it); 
                 }
@@ -170,16 +365,27 @@ private:
     io_service_pool                                 io_service_accept_pool_;
     io_service_pool                                 io_service_pool_;
     io_service_pool                                 io_service_work_pool_;
+    timer_service                                   io_timer_service_;
+    timer_service                                   work_timer_service_;
     tcp::acceptor                                   acceptor_;
     std::size_t                                     read_high_water_mask_;
     std::size_t                                     write_high_water_mask_;
     std::function<void(std::shared_ptr<session>, std::size_t)>   
                                                     write_high_water_mask_handler_;
+    send_budget                                     send_budget_;
+    std::function<void(std::shared_ptr<session>, bool)>
+                                                    write_pause_handler_;
     std::function<void(std::shared_ptr<session>)>   init_handlers_;
+    bool                                            lazy_buffers_;
+    std::atomic_bool                                over_limit_posted_;
     std::map<uint32_t, std::shared_ptr<session>>    session_map_;
     std::map<uint32_t, std::shared_ptr<session>>    wait_remove_session_map_;
-    wfirst_rw_lock                                  lock_;
+    scalable_rw_lock                                lock_;
     asio::steady_timer                              timer_;
+    metrics::counter                                accepted_;
+    metrics::counter                                idle_closed_;
+    metrics::counter                                over_limit_closed_;
+    uint32_t                                        metrics_collector_;
 }; // class server
 
 } // namespace engine
@@ -1,10 +1,21 @@
 #ifndef ENGINE_NET_SESSION_H
 #define ENGINE_NET_SESSION_H
 
+#include <algorithm>
 #include <atomic>
+#include <deque>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <vector>
 #include <third_party/asio.hpp>
 #include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/common/logger.h>
+#include <engine/common/metrics.h>
+#include <engine/common/trace.h>
 #include <engine/handler/pipeline.h>
+#include <engine/net/send_budget.h>
+#include <engine/net/timer_service.h>
 
 namespace engine
 {
@@ -28,13 +39,25 @@ public:
         , reading_(false)
         , writing_(false)
         , work_read_count_(0)
+        , read_expected_(0)
         , close_flag_(false)
         , handle_count_(0)
+        , timer_worker_(nullptr)
+        , write_pause_handler_(nullptr)
+        , over_limit_handler_(nullptr)
+        , write_paused_(false)
+        , droppable_bytes_(0)
+        , droppable_flush_pending_(false)
+        , lazy_buffers_(false)
+        , read_resident_(0)
+        , buffer_appended_(0)
+        , buffer_written_(0)
+        , shared_offset_(0)
+        , write_trace_(0)
     {
-        pipeline_       = std::make_shared<pipeline>(this);
-        read_buffer_    = std::make_shared<asio_buffer>();
-        write_buffer_   = std::make_shared<asio_buffer>();
-        LOGF(DEBUG, "session create id = %d", id());
+        pipeline_       = pipeline::create(this);
+        get_stats().alive.add();
+        JOKER_LOGF_DEFERRED(DEBUG, "session create id = %d", id());
     }
 
     ~session()
@@ -42,7 +65,9 @@ public:
         pipeline_.reset();
         read_buffer_.reset();
         write_buffer_.reset();
-        LOGF(DEBUG, "session destroy id = %d", id());
+        send_memory::sub(pending_write_len_ + droppable_bytes_);
+        get_stats().alive.sub();
+        JOKER_LOGF_DEFERRED(DEBUG, "session destroy id = %d", id());
     }
 
     tcp::socket& socket()
@@ -55,13 +80,26 @@ public:
         return id_;
     }
 
+    asio::io_service& work_service()
+    {
+        return io_work_service_;
+    }
+
     void start(const std::function<void(std::shared_ptr<session>)>& init_handlers)
     {
         auto self(shared_from_this());
+        if (!lazy_buffers_) {
+            read_buffer_    = std::make_shared<asio_buffer>();
+            write_buffer_   = std::make_shared<asio_buffer>();
+            update_read_resident();
+        }
         if (init_handlers) {
             init_handlers(self);
         }
+        get_stats().started.add();
         pipeline_->fire_connect();
+        std::error_code ec;
+        socket_.non_blocking(true, ec);
         read();
     }
 
@@ -70,11 +108,55 @@ public:
         return read_buffer_;
     }
 
+    // work thread, the decoder can do nothing before the read buffer holds
+    // readable bytes, 0 once any byte will do. reads are not handed to the
+    // work thread while they fall short of it
+    void expect_read(std::size_t readable)
+    {
+        read_expected_ = readable;
+    }
+
+    // any thread that writes to the session, held from an append to its
+    // notify_write so the write buffer is not released or replaced in
+    // between. recursive, a send budget handler may write again
+    std::unique_lock<std::recursive_mutex> lock_write()
+    {
+        return std::unique_lock<std::recursive_mutex>(write_mutex_);
+    }
+
+    // under lock_write(), other sessions' work threads append too
     std::shared_ptr<asio_buffer> write_buffer()
     {
+        if (!write_buffer_) {
+            write_buffer_ = std::make_shared<asio_buffer>();
+        }
         return write_buffer_;
     }
 
+    // with lazy buffers the read and write asio_buffer only exist while data
+    // is in flight in that direction, must be set before start
+    void set_lazy_buffers(bool lazy)
+    {
+        lazy_buffers_ = lazy;
+    }
+
+    // approximate heap bytes the session holds, excluding the socket
+    std::size_t resident_bytes()
+    {
+        // the io thread replaces the read buffer with no lock, its size is
+        // only known through the count it keeps
+        std::size_t bytes = sizeof(session) + sizeof(pipeline) + read_resident_;
+        std::shared_ptr<asio_buffer> write_buffer;
+        {
+            auto lock = lock_write();
+            write_buffer = write_buffer_;
+        }
+        if (write_buffer) {
+            bytes += sizeof(asio_buffer) + write_buffer->total_bytes();
+        }
+        return bytes;
+    }
+
     std::shared_ptr<session> add_handler(const std::string& name, 
         std::shared_ptr<abstract_handler> handler)
     {
@@ -101,11 +183,66 @@ public:
         write_high_water_mask_handler_  = handler;
     }
 
+    // pause_handler is called with true when the producer should stop
+    // writing and with false once the backlog drained to low water
+    void set_send_budget(const send_budget& budget,
+            const std::function<void(std::shared_ptr<session>, bool)>& pause_handler)
+    {
+        send_budget_         = budget;
+        write_pause_handler_ = pause_handler;
+    }
+
+    bool write_paused()
+    {
+        return write_paused_;
+    }
+
+    std::size_t pending_write_bytes()
+    {
+        return pending_write_len_ + droppable_bytes_;
+    }
+
+    bool closing()
+    {
+        return close_flag_;
+    }
+
+    // any work thread that finds send_memory over its limit calls it, it
+    // picks the sessions to close. without one the session that queued
+    // the bytes closes itself
+    void set_over_limit_handler(const std::function<void()>& handler)
+    {
+        over_limit_handler_ = handler;
+    }
+
     void set_close_handler(const std::function<void(uint32_t)>& handler)
     {
         close_handler_ = handler;
     }
 
+    // timers of a session run on the wheel of its io thread
+    void set_timer_worker(timer_worker* worker)
+    {
+        timer_worker_ = worker;
+    }
+
+    timer_handle add_timer(uint32_t interval, timer_type type,
+            const std::function<void()>& callback)
+    {
+        if (!timer_worker_) {
+            JOKER_LOGF(WARNING, "session id = %d, add timer without timer worker", id());
+            return 0;
+        }
+        return timer_worker_->add_task(interval, type, callback);
+    }
+
+    void remove_timer(timer_handle handle)
+    {
+        if (timer_worker_) {
+            timer_worker_->remove_task(handle);
+        }
+    }
+
     bool check_idle()
     {
         return handle_count_ == 0;
@@ -116,7 +253,11 @@ public:
         auto block = std::make_shared<data_block>(data, len);
         auto self(shared_from_this());
         io_work_service_.post([=,&self](){
-            write_buffer_->append(block->data, block->len); 
+            auto lock = lock_write();
+            if (close_flag_) {
+                return;
+            }
+            write_buffer()->append(block->data, block->len); 
             notify_write(block->len);       
         });
     }
@@ -126,7 +267,11 @@ public:
     {
         auto self(shared_from_this());
         io_work_service_.post([=,&self](){
-            write_buffer_->append_endian(x, big_endian);
+            auto lock = lock_write();
+            if (close_flag_) {
+                return;
+            }
+            write_buffer()->append_endian(x, big_endian);
             notify_write(sizeof(BASE_DATA_TYPE));
         });
     }
@@ -136,7 +281,11 @@ public:
     {
         auto self(shared_from_this());
         io_work_service_.post([=,&self](){
-            write_buffer_->append(x);
+            auto lock = lock_write();
+            if (close_flag_) {
+                return;
+            }
+            write_buffer()->append(x);
             notify_write(sizeof(BASE_DATA_TYPE));
         });
     }
@@ -145,7 +294,11 @@ public:
     {
         auto self(shared_from_this());
         io_work_service_.post([=,&self](){
-            write_buffer_->append(str, strlen(str)); 
+            auto lock = lock_write();
+            if (close_flag_) {
+                return;
+            }
+            write_buffer()->append(str, strlen(str)); 
             notify_write(strlen(str));       
         });
     }
@@ -154,20 +307,98 @@ public:
     {
         auto self(shared_from_this());
         io_work_service_.post([=,&self](){
-            write_buffer_->append(str);
+            auto lock = lock_write();
+            if (close_flag_) {
+                return;
+            }
+            write_buffer()->append(str);
             notify_write(str.size());
         });
     }
 
+    // the payload is shared with other sessions and never copied, it goes
+    // out after everything written before and before everything after
+    void write_shared(std::shared_ptr<const data_block> payload)
+    {
+        auto self(shared_from_this());
+        io_work_service_.post([this, self, payload](){
+            if (queue_shared(payload)) {
+                socket_.get_io_service().post([this, self](){write();});
+            }
+        });
+    }
+
+    // work thread of every session in sessions, one post per io thread
+    // instead of one per session
+    static void write_shared(const std::vector<std::shared_ptr<session>>& sessions,
+            const std::shared_ptr<const data_block>& payload)
+    {
+        std::map<asio::io_service*, std::vector<std::shared_ptr<session>>> io_groups;
+        for (auto& s : sessions) {
+            if (s->queue_shared(payload)) {
+                io_groups[&s->socket_.get_io_service()].push_back(s);
+            }
+        }
+        for (auto& group : io_groups) {
+            auto targets = std::make_shared<std::vector<std::shared_ptr<session>>>(
+                    std::move(group.second));
+            group.first->post([targets](){
+                for (auto& s : *targets) {
+                    s->write();
+                }
+            });
+        }
+    }
+
+    // a droppable message (e.g. a position update) waits in a side queue
+    // while the session is over its high water mask, and the oldest ones are
+    // dropped first. it may therefore overtake or fall behind plain writes
+    void write_droppable(const char* data, std::size_t len)
+    {
+        auto block = std::make_shared<data_block>(data, len);
+        auto self(shared_from_this());
+        io_work_service_.post([this, self, block](){
+            auto lock = lock_write();
+            queue_droppable(block);
+        });
+    }
+
+    // under lock_write(), the pipeline's path for a droppable_data
+    void queue_droppable(const std::shared_ptr<data_block>& block)
+    {
+        if (close_flag_ || block->len == 0) {
+            return;
+        }
+        if (droppable_queue_.empty() && !over_high_water(pending_write_len_)) {
+            write_buffer()->append(block->data, block->len);
+            notify_write(block->len);
+            return;
+        }
+        droppable_queue_.push_back(block);
+        droppable_bytes_ += block->len;
+        send_memory::add(block->len);
+        drop_oldest(pending_write_len_ + droppable_bytes_);
+    }
+
     void notify_write(std::size_t length)
     {
         auto self(shared_from_this());
-        pending_write_len_ += length;
-        socket_.get_io_service().post([this, &self](){write();});
-        if (write_high_water_mask_ != 0 && write_high_water_mask_handler_ 
-                && write_buffer_->writable_bytes() > write_high_water_mask_) {
-            write_high_water_mask_handler_(self, write_high_water_mask_);
+        buffer_appended_ += length;
+        // pending before the post, a write that finds nothing pending
+        // would leave the bytes in the buffer
+        queue_write(length);
+        uint64_t traced = trace::current();
+        trace::clock::time_point posted;
+        if (traced) {
+            posted = trace::clock::now();
         }
+        socket_.get_io_service().post([this, self, traced, posted](){
+            if (traced) {
+                trace::record(traced, "write_post", posted, id());
+                write_trace_ = traced;
+            }
+            write();
+        });
     }
 
     void close()
@@ -176,23 +407,148 @@ public:
         close_flag_ = true;
         close_if_necessary();
     }
+
+    // any thread, a close that does not wait for the peer to read what is
+    // queued: the socket resets under the write and the read in flight,
+    // no other write starts and the pending bytes go with the session. a
+    // zero linger keeps the close from blocking the io thread on the
+    // unsent bytes
+    void abort()
+    {
+        auto self(shared_from_this());
+        close_flag_ = true;
+        socket_.get_io_service().post([this, self](){
+            std::error_code ignore;
+            socket_.set_option(asio::socket_base::linger(true, 0), ignore);
+            socket_.close(ignore);
+        });
+    }
 private:
+    // work thread, accounts bytes queued by either write path
+    void queue_write(std::size_t length)
+    {
+        std::size_t pending = (pending_write_len_ += length);
+        send_memory::add(length);
+        if (write_high_water_mask_ != 0 && write_high_water_mask_handler_ 
+                && pending >= write_high_water_mask_
+                && pending - length < write_high_water_mask_) {
+            write_high_water_mask_handler_(shared_from_this(), write_high_water_mask_);
+        }
+        check_send_budget(pending);
+    }
+
+    // work thread, the payload is ordered behind the buffer bytes notified
+    // so far, by this or any other thread. a posted task never runs inside
+    // a frame being written
+    bool queue_shared(const std::shared_ptr<const data_block>& payload)
+    {
+        if (close_flag_ || payload->len == 0) {
+            return false;
+        }
+        auto lock = lock_write();
+        {
+            std::lock_guard<std::mutex> guard(shared_mutex_);
+            shared_queue_.push_back(shared_write{payload, buffer_appended_});
+        }
+        queue_write(payload->len);
+        return true;
+    }
+
+    // wait for readability without lending the read buffer to the socket,
+    // so a drained buffer can go back to the pool while the peer is quiet
     void read()
     {
         reading_ = true;
         auto self(shared_from_this());
-        socket_.async_read_some(read_buffer_->mutable_buffer(),
-            [this, &self](std::error_code ec, std::size_t length){handle_read(ec, length);});
+        socket_.async_read_some(asio::null_buffers(),
+            [this, self](std::error_code ec, std::size_t){handle_ready(ec);});
+    }
+
+    void handle_ready(std::error_code& ec)
+    {
+        std::size_t length = 0;
+        uint64_t traced = 0;
+        if (!ec) {
+            if (!read_buffer_) {
+                read_buffer_ = std::make_shared<asio_buffer>();
+            }
+            traced = trace::sample();
+            trace::clock::time_point begin;
+            if (traced) {
+                begin = trace::clock::now();
+            }
+            length = socket_.read_some(read_buffer_->mutable_buffer(read_window()), ec);
+            update_read_resident();
+            if (ec == asio::error::would_block || ec == asio::error::try_again) {
+                read();
+                return;
+            }
+            if (traced && !ec) {
+                trace::record(traced, "socket_read", begin, id());
+            }
+        }
+        handle_read(ec, length, traced);
     }
 
-    void handle_read(std::error_code& ec, std::size_t length)
+    // a single read never takes more than the room left below the read
+    // high water mask. it is not capped at the frame in progress, a read
+    // may take that frame and the ones after it in one syscall
+    std::size_t read_window()
+    {
+        if (read_high_water_mask_ == 0) {
+            return std::numeric_limits<std::size_t>::max();
+        }
+        std::size_t readable = read_buffer_ ? read_buffer_->readable_bytes() : 0;
+        return readable < read_high_water_mask_ ? read_high_water_mask_ - readable : 1;
+    }
+
+    // io thread only, no read is in flight here and no work handler is
+    // parsing the buffer once work_read_count_ dropped to zero
+    void release_read_buffer()
+    {
+        if (work_read_count_ == 0 && read_buffer_ && read_buffer_->readable_bytes() == 0) {
+            if (lazy_buffers_) {
+                read_buffer_.reset();
+            } else {
+                read_buffer_->release();
+            }
+            update_read_resident();
+        }
+    }
+
+    // io thread, whenever the read buffer is created, grown or released
+    void update_read_resident()
+    {
+        read_resident_ = read_buffer_
+            ? sizeof(asio_buffer) + read_buffer_->total_bytes() : 0;
+    }
+
+    // work thread. appends from other threads count their bytes as pending
+    // under the same lock, and nothing is being written to the socket
+    // while pending_write_len_ is zero
+    void release_write_buffer()
+    {
+        auto lock = lock_write();
+        if (pending_write_len_ == 0 && droppable_bytes_ == 0 && !writing_ && write_buffer_) {
+            if (lazy_buffers_) {
+                write_buffer_.reset();
+            } else {
+                write_buffer_->release();
+            }
+        }
+    }
+
+    // traced is the trace id of a sampled read, 0 for the others
+    void handle_read(std::error_code& ec, std::size_t length, uint64_t traced)
     {
         handle_count_++;
         reading_ = false;
         auto close_after_last_read = [this]()->bool{
             if (close_flag_ && !writing_) {
-                socket_.shutdown(tcp::socket::shutdown_both);
-                socket_.close();
+                // the other direction may have closed the socket already
+                std::error_code ignore;
+                socket_.shutdown(tcp::socket::shutdown_both, ignore);
+                socket_.close(ignore);
                 if (work_read_count_ == 0) {
                     pipeline_->fire_closed();
                     if (close_handler_) {
@@ -205,6 +561,7 @@ private:
         };
 
         if (!ec) {
+            get_stats().read_bytes.add(length);
             read_buffer_->has_written(length);
             if (close_after_last_read()) {
                 return;
@@ -214,23 +571,50 @@ private:
             if (read_high_water_mask_ == 0 
                     || read_buffer_->readable_bytes() < read_high_water_mask_) {
                 read();
+                // with no work queued the expectation is about the bytes in
+                // the buffer now, a frame that is still short wakes nobody
+                if (work_read_count_ == 0
+                        && read_buffer_->readable_bytes() < read_expected_) {
+                    get_stats().reads_held.add();
+                    handle_count_--;
+                    return;
+                }
             } else {
                 read_buffer_->set_notify_behind_high_water_mask(
                         [this, &self](){read();}, read_high_water_mask_);
             }
             work_read_count_++;
-            io_work_service_.post([this, &self](){
-                pipeline_->fire_read();
+            get_stats().work_queue_depth.add();
+            auto queued = std::chrono::steady_clock::now();
+            io_work_service_.post([this, self, queued, traced](){
+                const stats& s = get_stats();
+                s.work_queue_depth.sub();
+                s.work_queue_wait.record_since(queued);
+                if (traced) {
+                    trace::record(traced, "work_queue", queued, id());
+                    trace::scope scope(traced);
+                    auto begin = trace::clock::now();
+                    pipeline_->fire_read();
+                    trace::record(traced, "fire_read", begin, id());
+                } else {
+                    pipeline_->fire_read();
+                }
+                // once the count is 0 an io thread release may free the
+                // buffer, so it is looked at before
+                bool drained = read_buffer_->readable_bytes() == 0;
                 handle_count_--;
                 work_read_count_--;
+                if (drained) {
+                    socket_.get_io_service().post([this, self](){release_read_buffer();});
+                }
                 close_if_necessary(); 
             });
         } else {
             if (ec == asio::error::operation_aborted ||
                     ec == asio::error::eof) {
-                LOGF(INFO, "session id = %d, read error = %s", id(), ec.message().c_str());
+                JOKER_LOGF_RATE(INFO, logger::kLinesPerSecond, "session id = %d, read error = %s", id(), ec.message().c_str());
             } else {
-                LOGF(FATAL, "session id = %d, read error = %s", id(), ec.message().c_str());
+                JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "session id = %d, read error = %s", id(), ec.message().c_str());
             }
             close_flag_ = true;
             close_after_last_read();
@@ -239,12 +623,97 @@ private:
 
     void write()
     {
-        if (!writing_ && pending_write_len_ > 0) {
+        if (!writing_ && pending_write_len_ > 0 && socket_.is_open()) {
             writing_ = true;
             handle_count_++;
             auto self(shared_from_this());
-            socket_.async_write_some(write_buffer_->const_buffer(),
-                [this, &self](std::error_code ec, std::size_t length){handle_write(ec, length);});
+            // the traced bytes are in this write or, if one was in flight
+            // when they were posted, in the next one
+            uint64_t traced = write_trace_;
+            write_trace_ = 0;
+            trace::clock::time_point begin;
+            if (traced) {
+                begin = trace::clock::now();
+            }
+            socket_.async_write_some(prepare_write(),
+                [this, self, traced, begin](std::error_code ec, std::size_t length){
+                    if (traced) {
+                        trace::record(traced, "socket_write", begin, id());
+                    }
+                    handle_write(ec, length);
+                });
+        }
+    }
+
+    // io thread, buffer bytes and shared payloads gathered into one write in
+    // the order they were queued
+    const std::vector<asio::const_buffer>& prepare_write()
+    {
+        std::lock_guard<std::mutex> guard(shared_mutex_);
+        if (shared_queue_.empty()) {
+            return write_buffer_->const_buffer();
+        }
+
+        write_buffers_.clear();
+        const std::vector<asio::const_buffer>* buffers = nullptr;
+        std::size_t block = 0;
+        std::size_t block_offset = 0;
+        auto gather_buffer = [&](std::size_t length) {
+            if (length == 0 || !write_buffer_) {
+                return;
+            }
+            if (!buffers) {
+                buffers = &write_buffer_->const_buffer();
+            }
+            while (length > 0 && block < buffers->size()) {
+                std::size_t size = asio::buffer_size((*buffers)[block]) - block_offset;
+                std::size_t take = std::min(size, length);
+                write_buffers_.push_back(asio::buffer((*buffers)[block] + block_offset, take));
+                length -= take;
+                block_offset += take;
+                if (block_offset == asio::buffer_size((*buffers)[block])) {
+                    ++block;
+                    block_offset = 0;
+                }
+            }
+        };
+
+        uint64_t written = buffer_written_;
+        std::size_t offset = shared_offset_;
+        for (auto& shared : shared_queue_) {
+            gather_buffer(shared.after - written);
+            written = shared.after;
+            write_buffers_.push_back(asio::const_buffer(
+                    shared.payload->data + offset, shared.payload->len - offset));
+            offset = 0;
+        }
+        gather_buffer(std::numeric_limits<std::size_t>::max());
+        return write_buffers_;
+    }
+
+    // io thread, replays the order of prepare_write over the bytes written
+    void retrieve(std::size_t length)
+    {
+        std::lock_guard<std::mutex> guard(shared_mutex_);
+        while (length > 0) {
+            if (!shared_queue_.empty() && shared_queue_.front().after == buffer_written_) {
+                std::size_t remain = shared_queue_.front().payload->len - shared_offset_;
+                if (length < remain) {
+                    shared_offset_ += length;
+                    break;
+                }
+                length -= remain;
+                shared_offset_ = 0;
+                shared_queue_.pop_front();
+                continue;
+            }
+            std::size_t take = length;
+            if (!shared_queue_.empty()) {
+                take = std::min<uint64_t>(take, shared_queue_.front().after - buffer_written_);
+            }
+            write_buffer_->retrieve(take);
+            buffer_written_ += take;
+            length -= take;
         }
     }
 
@@ -254,9 +723,10 @@ private:
         writing_ = false;
         auto close_after_last_write = [this]()->bool {
             if (close_flag_) {
-                socket_.shutdown(tcp::socket::shutdown_both);
+                std::error_code ignore;
+                socket_.shutdown(tcp::socket::shutdown_both, ignore);
                 if (!reading_) {
-                    socket_.close();
+                    socket_.close(ignore);
                     if (work_read_count_ == 0) {
                         pipeline_->fire_closed();
                         if (close_handler_) {
@@ -270,25 +740,130 @@ private:
         };
 
         if (!ec) {
-            write_buffer_->retrieve(length);
+            get_stats().write_bytes.add(length);
+            retrieve(length);
             pending_write_len_ -= length;
+            send_memory::sub(length);
+            check_send_drained();
             if (pending_write_len_ > 0) {
                 write();
             }
             else {
-                close_after_last_write();
+                if (!close_after_last_write()) {
+                    auto self(shared_from_this());
+                    io_work_service_.post([this, self](){release_write_buffer();});
+                }
             }
         } else {
             if (ec == asio::error::operation_aborted) {
-                LOGF(INFO, "session id = %d, read error = %s", id(), ec.message().c_str());
+                JOKER_LOGF_RATE(INFO, logger::kLinesPerSecond, "session id = %d, write error = %s", id(), ec.message().c_str());
             } else {
-                LOGF(FATAL, "session id = %d, read error = %s", id(), ec.message().c_str());
+                JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "session id = %d, write error = %s", id(), ec.message().c_str());
             }
             close_flag_ = true;
             close_after_last_write();
         }
     }
 
+    bool over_high_water(std::size_t pending)
+    {
+        return send_budget_.high_water_mask != 0 
+            && pending >= send_budget_.high_water_mask;
+    }
+
+    // runs on the work thread right after bytes were queued. a session over
+    // its budget aborts, a graceful close would still send the backlog
+    // and keep the buffer growing until it drained
+    void check_send_budget(std::size_t pending)
+    {
+        if (send_budget_.hard_limit != 0 && pending > send_budget_.hard_limit) {
+            JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "session id = %d, pending write bytes = %zu over hard limit = %zu",
+                    id(), pending, send_budget_.hard_limit);
+            abort();
+            return;
+        }
+
+        // the process wide limit holds whatever the session's own mask is
+        if (send_memory::over_limit()) {
+            if (!over_limit_handler_) {
+                JOKER_LOGF_RATE(WARNING, logger::kLinesPerSecond, "session id = %d, pending write bytes = %zu, total pending = %zu over limit = %zu",
+                        id(), pending, send_memory::pending_bytes(), send_memory::limit());
+                abort();
+                return;
+            }
+            over_limit_handler_();
+        }
+
+        if (!over_high_water(pending)) {
+            return;
+        }
+
+        switch (send_budget_.policy) {
+            case send_overflow_policy::PAUSE_PRODUCER:
+                if (!write_paused_.exchange(true) && write_pause_handler_) {
+                    write_pause_handler_(shared_from_this(), true);
+                }
+                break;
+            case send_overflow_policy::DROP_OLDEST:
+                drop_oldest(pending + droppable_bytes_);
+                break;
+            case send_overflow_policy::DISCONNECT:
+                abort();
+                break;
+        }
+    }
+
+    // work thread only, keeps at least the newest droppable message
+    void drop_oldest(std::size_t pending)
+    {
+        while (droppable_queue_.size() > 1 && over_high_water(pending)) {
+            std::size_t len = droppable_queue_.front()->len;
+            droppable_queue_.pop_front();
+            droppable_bytes_ -= len;
+            pending -= len;
+            send_memory::sub(len);
+            send_memory::add_dropped(len);
+        }
+    }
+
+    // runs on the io thread after a write completed
+    void check_send_drained()
+    {
+        if (pending_write_len_ > send_budget_.low_water_mask) {
+            return;
+        }
+
+        auto self(shared_from_this());
+        if (write_paused_.exchange(false) && write_pause_handler_) {
+            io_work_service_.post([this, self](){write_pause_handler_(self, false);});
+        }
+        if (droppable_bytes_ > 0 && !droppable_flush_pending_.exchange(true)) {
+            io_work_service_.post([this, self](){flush_droppable();});
+        }
+    }
+
+    void flush_droppable()
+    {
+        auto lock = lock_write();
+        droppable_flush_pending_ = false;
+        if (close_flag_) {
+            return;
+        }
+        std::size_t flushed = 0;
+        while (!droppable_queue_.empty() 
+                && !over_high_water(pending_write_len_ + flushed)) {
+            auto block = droppable_queue_.front();
+            droppable_queue_.pop_front();
+            droppable_bytes_ -= block->len;
+            send_memory::sub(block->len);
+            write_buffer()->append(block->data, block->len);
+            flushed += block->len;
+        }
+        if (flushed > 0) {
+            notify_write(flushed);
+        }
+    }
+
     void close_if_necessary()
     {
         auto self(shared_from_this());
@@ -298,9 +873,12 @@ private:
             }
             else {
                 auto self(shared_from_this());
-                socket_.get_io_service().post([this, &self](){
-                    socket_.shutdown(tcp::socket::shutdown_both);
-                    socket_.close();
+                socket_.get_io_service().post([this, self](){
+                    // the read path closes the socket too when the peer
+                    // hung up while the last read was being decoded
+                    std::error_code ignore;
+                    socket_.shutdown(tcp::socket::shutdown_both, ignore);
+                    socket_.close(ignore);
                     pipeline_->fire_closed();
                     if (close_handler_) {
                         close_handler_(id());
@@ -311,6 +889,53 @@ private:
     }
     
 private:
+    // shared by every session, io thread counters are kept per thread
+    struct stats
+    {
+        stats()
+        {
+            metrics::add_collector("joker_send_pending_bytes",
+                    "bytes queued on all sessions and not yet written",
+                    [](std::vector<metrics::sample>& samples){
+                        samples.push_back(metrics::sample{"",
+                                static_cast<double>(send_memory::pending_bytes())});
+                    });
+            metrics::add_collector("joker_send_dropped_bytes",
+                    "droppable bytes discarded by send budgets",
+                    [](std::vector<metrics::sample>& samples){
+                        samples.push_back(metrics::sample{"",
+                                static_cast<double>(send_memory::dropped_bytes())});
+                    });
+        }
+
+        metrics::counter    read_bytes{"joker_session_read_bytes_total",
+            "bytes read from sockets", "", true};
+        metrics::counter    write_bytes{"joker_session_write_bytes_total",
+            "bytes written to sockets", "", true};
+        metrics::counter    started{"joker_session_started_total",
+            "sessions started"};
+        metrics::gauge      alive{"joker_sessions_alive",
+            "session objects alive, including one waiting accept per server"};
+        metrics::gauge      work_queue_depth{"joker_work_queue_depth",
+            "reads posted to the work io_services and not yet decoded"};
+        metrics::histogram  work_queue_wait{"joker_work_queue_wait_seconds",
+            "time a read waits on the work io_service before it is decoded"};
+        metrics::counter    reads_held{"joker_session_reads_held_total",
+            "reads kept on the io thread, the frame in progress was still short"};
+    };
+
+    static const stats& get_stats()
+    {
+        static stats s;
+        return s;
+    }
+
+    struct shared_write
+    {
+        std::shared_ptr<const data_block>   payload;
+        uint64_t                            after;  // buffer bytes to send first
+    };
+
     uint32_t                                        id_;
     asio::io_service&                               io_work_service_;
     tcp::socket                                     socket_;
@@ -326,8 +951,28 @@ private:
     std::atomic_bool                                reading_;
     std::atomic_bool                                writing_;
     std::atomic_size_t                              work_read_count_; 
+    std::atomic_size_t                              read_expected_;     // set by the work thread
     std::atomic_bool                                close_flag_;
     std::atomic_size_t                              handle_count_;    
+    timer_worker*                                   timer_worker_;
+    send_budget                                     send_budget_;
+    std::function<void(std::shared_ptr<session>, bool)>
+                                                    write_pause_handler_;
+    std::function<void()>                           over_limit_handler_;
+    std::atomic_bool                                write_paused_;
+    std::deque<std::shared_ptr<data_block>>         droppable_queue_;
+    std::atomic_size_t                              droppable_bytes_;
+    std::atomic_bool                                droppable_flush_pending_;
+    bool                                            lazy_buffers_;
+    std::deque<shared_write>                        shared_queue_;
+    std::mutex                                      shared_mutex_;
+    std::recursive_mutex                            write_mutex_;
+    std::atomic_size_t                              read_resident_;     // set by the io thread
+    std::atomic<uint64_t>                           buffer_appended_;   // any appending thread
+    uint64_t                                        buffer_written_;    // io thread
+    std::size_t                                     shared_offset_;     // io thread
+    std::vector<asio::const_buffer>                 write_buffers_;     // io thread
+    uint64_t                                        write_trace_;       // io thread
 }; // class session
 
 } // namespace engine
@@ -0,0 +1,174 @@
+#ifndef ENGINE_NET_TICK_DRIVER_H
+#define ENGINE_NET_TICK_DRIVER_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <third_party/asio.hpp>
+#include <third_party/asio/steady_timer.hpp>
+#include <third_party/g3log/g3log/g3log.hpp>
+
+namespace engine
+{
+
+struct tick_stats
+{
+    uint64_t    ticks;
+    uint64_t    overruns;       // ticks that took longer than the period
+    uint64_t    skipped;        // ticks dropped after falling too far behind
+    uint64_t    avg_us;
+    uint64_t    max_us;
+    uint64_t    max_late_us;    // worst start after the scheduled deadline
+}; // struct tick_stats
+
+/**
+ * fixed timestep loop on the thread running io_service. every tick first
+ * calls the drain handler, then the tick handler with the fixed dt.
+ *
+ * deadlines advance by whole periods, so a slow tick is caught up by
+ * running the next ones back to back. once the loop is more than
+ * kMaxCatchUp periods behind the missed ticks are skipped instead
+ */
+class tick_driver
+{
+public:
+    static const uint32_t kMaxCatchUp = 5;
+
+    typedef std::chrono::steady_clock clock;
+
+    tick_driver(const tick_driver&) = delete;
+    tick_driver& operator=(const tick_driver&) = delete;
+    tick_driver(asio::io_service& io_service, uint32_t rate)
+        : io_service_(io_service)
+        , timer_(io_service)
+        , period_(std::chrono::microseconds(1000000 / (rate ? rate : 1)))
+        , dt_(1.0 / (rate ? rate : 1))
+        , drain_handler_(nullptr)
+        , tick_handler_(nullptr)
+        , running_(false)
+        , ticks_(0)
+        , overruns_(0)
+        , skipped_(0)
+        , total_us_(0)
+        , max_us_(0)
+        , max_late_us_(0)
+    {
+    }
+
+    // handlers are set before start and run on the io_service thread
+    void set_drain_handler(const std::function<void()>& handler)
+    {
+        drain_handler_ = handler;
+    }
+
+    void set_tick_handler(const std::function<void(double)>& handler)
+    {
+        tick_handler_ = handler;
+    }
+
+    void start()
+    {
+        io_service_.post([this](){
+            running_    = true;
+            next_       = clock::now() + period_;
+            schedule();
+        });
+    }
+
+    void stop()
+    {
+        io_service_.post([this](){
+            running_ = false;
+            std::error_code ec;
+            timer_.cancel(ec);
+        });
+    }
+
+    double dt() const
+    {
+        return dt_;
+    }
+
+    // may be read from any thread while the loop runs
+    tick_stats stats() const
+    {
+        tick_stats stats;
+        stats.ticks         = ticks_;
+        stats.overruns      = overruns_;
+        stats.skipped       = skipped_;
+        stats.avg_us        = stats.ticks ? total_us_ / stats.ticks : 0;
+        stats.max_us        = max_us_;
+        stats.max_late_us   = max_late_us_;
+        return stats;
+    }
+private:
+    void schedule()
+    {
+        timer_.expires_at(next_);
+        timer_.async_wait([this](std::error_code ec){
+            if (!ec && running_) {
+                tick();
+            }
+        });
+    }
+
+    void tick()
+    {
+        clock::time_point start = clock::now();
+        if (drain_handler_) {
+            drain_handler_();
+        }
+        if (tick_handler_) {
+            tick_handler_(dt_);
+        }
+        clock::time_point end = clock::now();
+
+        uint64_t used = to_us(end - start);
+        uint64_t late = start > next_ ? to_us(start - next_) : 0;
+        ++ticks_;
+        total_us_ += used;
+        if (used > max_us_) {
+            max_us_ = used;
+        }
+        if (late > max_late_us_) {
+            max_late_us_ = late;
+        }
+        if (end - start > period_) {
+            ++overruns_;
+        }
+
+        next_ += period_;
+        if (end - next_ > period_ * static_cast<int64_t>(kMaxCatchUp)) {
+            uint64_t missed = (end - next_) / period_;
+            skipped_ += missed;
+            next_ += period_ * static_cast<int64_t>(missed);
+            LOGF(WARNING, "tick driver behind, skip %llu ticks",
+                    static_cast<unsigned long long>(missed));
+        }
+        schedule();
+    }
+
+    static uint64_t to_us(clock::duration duration)
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    }
+private:
+    asio::io_service&                   io_service_;
+    asio::steady_timer                  timer_;
+    clock::duration                     period_;
+    double                              dt_;
+    std::function<void()>               drain_handler_;
+    std::function<void(double)>         tick_handler_;
+    bool                                running_;
+    clock::time_point                   next_;
+    std::atomic<uint64_t>               ticks_;
+    std::atomic<uint64_t>               overruns_;
+    std::atomic<uint64_t>               skipped_;
+    std::atomic<uint64_t>               total_us_;
+    std::atomic<uint64_t>               max_us_;
+    std::atomic<uint64_t>               max_late_us_;
+}; // class tick_driver
+
+} // namespace engine
+
+#endif // ENGINE_NET_TICK_DRIVER_H
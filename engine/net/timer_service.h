@@ -0,0 +1,267 @@
+#ifndef ENGINE_NET_TIMER_SERVICE_H
+#define ENGINE_NET_TIMER_SERVICE_H
+
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#include <third_party/asio.hpp>
+#include <third_party/asio/steady_timer.hpp>
+#include <engine/common/mpsc_queue.h>
+#include <engine/common/timer.h>
+#include <engine/net/io_service_pool.h>
+
+namespace engine
+{
+
+// high 16 bits are the index of the owning worker, low 48 bits a ticket
+// minted by the submitting thread
+typedef uint64_t timer_handle;
+
+#define TIMER_HANDLE_WORKER_SHIFT 48
+#define TIMER_HANDLE_TICKET_MASK ((static_cast<uint64_t>(1) << TIMER_HANDLE_WORKER_SHIFT) - 1)
+
+struct timer_command
+{
+    timer_handle            handle;
+    bool                    cancel;
+    uint32_t                interval;
+    timer_type              type;
+    std::function<void()>   callback;
+}; // struct timer_command
+
+// one timer wheel bound to one io_service thread. add_task and remove_task
+// may be called from any thread, commands travel through a lock free queue
+// and every callback runs on the owning thread
+class timer_worker
+{
+public:
+    timer_worker(const timer_worker&) = delete;
+    timer_worker& operator=(const timer_worker&) = delete;
+    timer_worker(asio::io_service& io_service, uint32_t index)
+        : io_service_(io_service)
+        , tick_timer_(io_service)
+        , index_(index)
+        , next_ticket_(0)
+        , wake_pending_(false)
+        , ticking_(false)
+    {
+    }
+
+    // bind the worker to the thread running its io_service
+    void start()
+    {
+        io_service_.post([this](){ current() = this; });
+    }
+
+    asio::io_service& get_io_service()
+    {
+        return io_service_;
+    }
+
+    bool in_owner_thread() const
+    {
+        return current() == this;
+    }
+
+    timer_handle add_task(uint32_t interval, timer_type type,
+            const std::function<void()>& callback)
+    {
+        timer_command command;
+        command.handle      = (static_cast<uint64_t>(index_) << TIMER_HANDLE_WORKER_SHIFT)
+            | ((++next_ticket_) & TIMER_HANDLE_TICKET_MASK);
+        command.cancel      = false;
+        command.interval    = interval;
+        command.type        = type;
+        command.callback    = callback;
+        timer_handle handle = command.handle;
+        submit(std::move(command));
+        return handle;
+    }
+
+    void remove_task(timer_handle handle)
+    {
+        timer_command command;
+        command.handle      = handle;
+        command.cancel      = true;
+        command.interval    = 0;
+        command.type        = TIMER_ONCE;
+        submit(std::move(command));
+    }
+
+    static timer_worker*& current()
+    {
+        static thread_local timer_worker* worker = nullptr;
+        return worker;
+    }
+private:
+    void submit(timer_command&& command)
+    {
+        if (in_owner_thread()) {
+            // keep commands in submission order with the ones already queued
+            drain();
+            apply(command);
+            check_tick();
+            return;
+        }
+
+        queue_.push(std::move(command));
+        if (!wake_pending_.exchange(true)) {
+            io_service_.post([this](){
+                wake_pending_ = false;
+                drain();
+                check_tick();
+            });
+        }
+    }
+
+    void drain()
+    {
+        timer_command command;
+        while (queue_.pop(command)) {
+            apply(command);
+        }
+    }
+
+    void apply(timer_command& command)
+    {
+        if (command.cancel) {
+            auto it = tasks_.find(command.handle);
+            if (it != tasks_.end()) {
+                wheel_.remove_task(it->second);
+                tasks_.erase(it);
+            }
+            return;
+        }
+
+        if (wheel_.size() == 0) {
+            // an idle wheel stops ticking, catch it up before inserting
+            wheel_.detect_timer_list();
+        }
+
+        timer_handle handle = command.handle;
+        timer_id id;
+        if (command.type == TIMER_ONCE) {
+            std::function<void()> callback = std::move(command.callback);
+            id = wheel_.add_task(command.interval, command.type,
+                    [this, handle, callback](){
+                        tasks_.erase(handle);
+                        callback();
+                    });
+        } else {
+            id = wheel_.add_task(command.interval, command.type, command.callback);
+        }
+        tasks_[handle] = id;
+    }
+
+    void check_tick()
+    {
+        if (!ticking_ && wheel_.size() > 0) {
+            ticking_ = true;
+            tick();
+        }
+    }
+
+    void tick()
+    {
+        tick_timer_.expires_from_now(std::chrono::milliseconds(GRANULARITY));
+        tick_timer_.async_wait([this](std::error_code ec){handle_tick(ec);});
+    }
+
+    void handle_tick(std::error_code& ec)
+    {
+        if (ec) {
+            ticking_ = false;
+            return;
+        }
+
+        drain();
+        wheel_.detect_timer_list();
+        if (wheel_.size() > 0) {
+            tick();
+        } else {
+            ticking_ = false;
+        }
+    }
+
+    asio::io_service&                           io_service_;
+    asio::steady_timer                          tick_timer_;
+    uint32_t                                    index_;
+    timer                                       wheel_;
+    mpsc_queue<timer_command>                   queue_;
+    std::unordered_map<timer_handle, timer_id>  tasks_;
+    std::atomic<uint64_t>                       next_ticket_;
+    std::atomic_bool                            wake_pending_;
+    bool                                        ticking_;
+}; // class timer_worker
+
+// one timer_worker per thread of an io_service_pool, a pool should be
+// shared by at most one timer_service
+class timer_service
+{
+public:
+    timer_service(const timer_service&) = delete;
+    timer_service& operator=(const timer_service&) = delete;
+    explicit timer_service(io_service_pool& pool)
+        : next_worker_(0)
+    {
+        for (std::size_t i = 0; i < pool.size(); ++i) {
+            std::unique_ptr<timer_worker> worker(
+                    new timer_worker(pool.get_io_service(i), i));
+            worker->start();
+            workers_.push_back(std::move(worker));
+        }
+    }
+
+    timer_worker& get_worker(asio::io_service& io_service)
+    {
+        for (auto& worker : workers_) {
+            if (&worker->get_io_service() == &io_service) {
+                return *worker;
+            }
+        }
+        throw std::runtime_error("io_service is not served by this timer_service");
+    }
+
+    // the calling thread's worker when it belongs to this service,
+    // otherwise the workers are picked in turn
+    timer_worker& get_worker()
+    {
+        timer_worker* worker = timer_worker::current();
+        for (auto& owned : workers_) {
+            if (owned.get() == worker) {
+                return *worker;
+            }
+        }
+        std::size_t index = next_worker_++ % workers_.size();
+        return *workers_[index];
+    }
+
+    timer_handle add_task(uint32_t interval, timer_type type,
+            const std::function<void()>& callback)
+    {
+        return get_worker().add_task(interval, type, callback);
+    }
+
+    timer_handle add_task(asio::io_service& io_service, uint32_t interval,
+            timer_type type, const std::function<void()>& callback)
+    {
+        return get_worker(io_service).add_task(interval, type, callback);
+    }
+
+    void remove_task(timer_handle handle)
+    {
+        std::size_t index = handle >> TIMER_HANDLE_WORKER_SHIFT;
+        if (index < workers_.size()) {
+            workers_[index]->remove_task(handle);
+        }
+    }
+private:
+    std::vector<std::unique_ptr<timer_worker>>  workers_;
+    std::atomic_size_t                          next_worker_;
+}; // class timer_service
+
+} // namespace engine
+
+#endif // ENGINE_NET_TIMER_SERVICE_H
@@ -0,0 +1,305 @@
+#ifndef ENGINE_SCENE_AOI_GRID_H
+#define ENGINE_SCENE_AOI_GRID_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace engine
+{
+
+enum class aoi_event_type : uint8_t
+{
+    ENTER   = 1,
+    LEAVE   = 2,
+};
+
+// target came into or went out of the view of watcher
+struct aoi_event
+{
+    aoi_event_type  type;
+    uint32_t        watcher;
+    uint32_t        target;
+}; // struct aoi_event
+
+/**
+ * uniform grid area of interest. an entity sees every entity whose cell is
+ * within radius cells of its own cell, so a move inside a cell costs one
+ * position store and crossing a cell only visits the cells that left or
+ * joined the view.
+ *
+ * entities live in dense slots, one array per field, and each cell keeps
+ * the slots inside it. only watchers (usually players, id = session id)
+ * receive events, every entity can be seen. events are only recorded by a
+ * grid made with record_events, whose owner drains them every tick.
+ *
+ * not thread safe, a scene belongs to the thread that ticks it
+ */
+class aoi_grid
+{
+public:
+    static const uint32_t kMaxCells     = 1 << 22;
+    static const uint32_t kMaxRadius    = 64;
+
+    // cells a grid of that size needs, the caller keeps it at kMaxCells or
+    // below. width, height and cell_size are finite, cell_size positive
+    static double cell_count(float width, float height, float cell_size)
+    {
+        return (std::floor(width / cell_size) + 1.0) * (std::floor(height / cell_size) + 1.0);
+    }
+
+    aoi_grid(const aoi_grid&) = delete;
+    aoi_grid& operator=(const aoi_grid&) = delete;
+    aoi_grid(float width, float height, float cell_size, uint32_t radius = 1,
+            bool record_events = false)
+        : columns_(std::max<uint32_t>(1, static_cast<uint32_t>(width / cell_size) + 1))
+        , rows_(std::max<uint32_t>(1, static_cast<uint32_t>(height / cell_size) + 1))
+        , inv_cell_size_(1.0f / cell_size)
+        , radius_(radius)
+        , record_events_(record_events)
+        , cells_(columns_ * rows_)
+    {
+    }
+
+    bool enter(uint32_t id, float x, float z, bool watcher = true)
+    {
+        if (slots_.find(id) != slots_.end()) {
+            return false;
+        }
+        uint32_t slot = static_cast<uint32_t>(ids_.size());
+        uint32_t cell = cell_of(x, z);
+        slots_[id] = slot;
+        ids_.push_back(id);
+        xs_.push_back(x);
+        zs_.push_back(z);
+        cell_of_.push_back(cell);
+        cell_pos_.push_back(0);
+        watcher_.push_back(watcher ? 1 : 0);
+
+        rect view = view_of(cell);
+        for_each_cell(view, [&](uint32_t c){notify(aoi_event_type::ENTER, slot, c);});
+        add_to_cell(slot, cell);
+        return true;
+    }
+
+    bool move(uint32_t id, float x, float z)
+    {
+        auto it = slots_.find(id);
+        if (it == slots_.end()) {
+            return false;
+        }
+        uint32_t slot = it->second;
+        xs_[slot] = x;
+        zs_[slot] = z;
+        uint32_t cell = cell_of(x, z);
+        uint32_t old_cell = cell_of_[slot];
+        if (cell == old_cell) {
+            return true;
+        }
+
+        remove_from_cell(slot);
+        rect old_view = view_of(old_cell);
+        rect new_view = view_of(cell);
+        for_each_cell(old_view, [&](uint32_t c){
+            if (!new_view.contains(c % columns_, c / columns_)) {
+                notify(aoi_event_type::LEAVE, slot, c);
+            }
+        });
+        for_each_cell(new_view, [&](uint32_t c){
+            if (!old_view.contains(c % columns_, c / columns_)) {
+                notify(aoi_event_type::ENTER, slot, c);
+            }
+        });
+        add_to_cell(slot, cell);
+        return true;
+    }
+
+    bool leave(uint32_t id)
+    {
+        auto it = slots_.find(id);
+        if (it == slots_.end()) {
+            return false;
+        }
+        uint32_t slot = it->second;
+        slots_.erase(it);
+        remove_from_cell(slot);
+        rect view = view_of(cell_of_[slot]);
+        for_each_cell(view, [&](uint32_t c){notify(aoi_event_type::LEAVE, slot, c);});
+
+        // the last slot fills the hole so the arrays stay dense
+        uint32_t last = static_cast<uint32_t>(ids_.size() - 1);
+        if (slot != last) {
+            ids_[slot]      = ids_[last];
+            xs_[slot]       = xs_[last];
+            zs_[slot]       = zs_[last];
+            cell_of_[slot]  = cell_of_[last];
+            cell_pos_[slot] = cell_pos_[last];
+            watcher_[slot]  = watcher_[last];
+            cells_[cell_of_[slot]][cell_pos_[slot]] = slot;
+            slots_[ids_[slot]] = slot;
+        }
+        ids_.pop_back();
+        xs_.pop_back();
+        zs_.pop_back();
+        cell_of_.pop_back();
+        cell_pos_.pop_back();
+        watcher_.pop_back();
+        return true;
+    }
+
+    bool position(uint32_t id, float& x, float& z) const
+    {
+        auto it = slots_.find(id);
+        if (it == slots_.end()) {
+            return false;
+        }
+        x = xs_[it->second];
+        z = zs_[it->second];
+        return true;
+    }
+
+    // watchers that see id, the targets of a broadcast of its updates.
+    // appends to out and returns how many were added
+    std::size_t watchers(uint32_t id, std::vector<uint32_t>& out, bool include_self = false) const
+    {
+        return collect(id, out, include_self, true);
+    }
+
+    // every entity id sees
+    std::size_t visible(uint32_t id, std::vector<uint32_t>& out) const
+    {
+        return collect(id, out, false, false);
+    }
+
+    // events since the last clear_events, in the order they happened,
+    // always empty without record_events
+    const std::vector<aoi_event>& events() const
+    {
+        return events_;
+    }
+
+    void clear_events()
+    {
+        events_.clear();
+    }
+
+    std::size_t size() const
+    {
+        return ids_.size();
+    }
+private:
+    struct rect
+    {
+        uint32_t    x0, z0, x1, z1;     // inclusive
+
+        bool contains(uint32_t x, uint32_t z) const
+        {
+            return x >= x0 && x <= x1 && z >= z0 && z <= z1;
+        }
+    };
+
+    // positions come from clients, clamped as floats so the cast is always
+    // defined. nan goes to 0, max returns its first argument for it
+    uint32_t cell_of(float x, float z) const
+    {
+        float cx = std::min(std::max(0.0f, x * inv_cell_size_), static_cast<float>(columns_ - 1));
+        float cz = std::min(std::max(0.0f, z * inv_cell_size_), static_cast<float>(rows_ - 1));
+        return static_cast<uint32_t>(cz) * columns_ + static_cast<uint32_t>(cx);
+    }
+
+    rect view_of(uint32_t cell) const
+    {
+        uint32_t x = cell % columns_;
+        uint32_t z = cell / columns_;
+        rect r;
+        r.x0 = x > radius_ ? x - radius_ : 0;
+        r.z0 = z > radius_ ? z - radius_ : 0;
+        r.x1 = std::min(columns_ - 1, x + radius_);
+        r.z1 = std::min(rows_ - 1, z + radius_);
+        return r;
+    }
+
+    template<typename FUNC>
+    void for_each_cell(const rect& r, FUNC func) const
+    {
+        for (uint32_t z = r.z0; z <= r.z1; ++z) {
+            for (uint32_t x = r.x0; x <= r.x1; ++x) {
+                func(z * columns_ + x);
+            }
+        }
+    }
+
+    // slot and everything in cell came into or went out of each other's view
+    void notify(aoi_event_type type, uint32_t slot, uint32_t cell)
+    {
+        if (!record_events_) {
+            return;
+        }
+        uint32_t id = ids_[slot];
+        bool watcher = watcher_[slot] != 0;
+        for (uint32_t other : cells_[cell]) {
+            if (watcher_[other]) {
+                events_.push_back(aoi_event{type, ids_[other], id});
+            }
+            if (watcher) {
+                events_.push_back(aoi_event{type, id, ids_[other]});
+            }
+        }
+    }
+
+    std::size_t collect(uint32_t id, std::vector<uint32_t>& out,
+            bool include_self, bool watchers_only) const
+    {
+        auto it = slots_.find(id);
+        if (it == slots_.end()) {
+            return 0;
+        }
+        std::size_t count = out.size();
+        uint32_t slot = it->second;
+        for_each_cell(view_of(cell_of_[slot]), [&](uint32_t c){
+            for (uint32_t other : cells_[c]) {
+                if ((other != slot || include_self) && (!watchers_only || watcher_[other])) {
+                    out.push_back(ids_[other]);
+                }
+            }
+        });
+        return out.size() - count;
+    }
+
+    void add_to_cell(uint32_t slot, uint32_t cell)
+    {
+        cell_of_[slot]  = cell;
+        cell_pos_[slot] = static_cast<uint32_t>(cells_[cell].size());
+        cells_[cell].push_back(slot);
+    }
+
+    void remove_from_cell(uint32_t slot)
+    {
+        std::vector<uint32_t>& cell = cells_[cell_of_[slot]];
+        uint32_t pos = cell_pos_[slot];
+        cell[pos] = cell.back();
+        cell_pos_[cell[pos]] = pos;
+        cell.pop_back();
+    }
+private:
+    uint32_t                                columns_;
+    uint32_t                                rows_;
+    float                                   inv_cell_size_;
+    uint32_t                                radius_;
+    bool                                    record_events_;
+    std::vector<std::vector<uint32_t>>      cells_;     // slots inside each cell
+    std::unordered_map<uint32_t, uint32_t>  slots_;     // id to slot
+    std::vector<uint32_t>                   ids_;
+    std::vector<float>                      xs_;
+    std::vector<float>                      zs_;
+    std::vector<uint32_t>                   cell_of_;
+    std::vector<uint32_t>                   cell_pos_;  // index inside its cell
+    std::vector<uint8_t>                    watcher_;
+    std::vector<aoi_event>                  events_;
+}; // class aoi_grid
+
+} // namespace engine
+
+#endif // ENGINE_SCENE_AOI_GRID_H
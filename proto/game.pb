@@ -0,0 +1,55 @@
+
+
+
+game.protogame"3
+vector3
+x (Rx
+y (Ry
+z (Rz"?
+login_request
+account (	Raccount
+token (	Rtoken"A
+login_response
+result (Rresult
+role_id (RroleId"
+move_request
+role_id (RroleId
+x (Rx
+y (Ry
+z (Rz
+	direction (R	direction
+speed (Rspeed
+	timestamp (R	timestamp"u
+chat_message
+role_id (RroleId
+channel (Rchannel
+content (	Rcontent
+targets (Rtargets"
+	move_sync
+role_id (RroleId
+map_id (RmapId
+scene_id (RsceneId
+x (Rx
+y (Ry
+z (Rz
+	direction (R	direction
+pitch (Rpitch
+
+velocity_x	 (R	velocityX
+
+velocity_y
+ (R	velocityY
+
+velocity_z (R	velocityZ
+speed (Rspeed
+
+move_state (R	moveState
+	move_mode (RmoveMode
+	animation (R	animation
+	on_ground (RonGround
+jumping (Rjumping
+client_time (R
+clientTime
+server_time (R
+serverTime
+sequence (Rsequence
\ No newline at end of file
@@ -0,0 +1,27 @@
+local modname = "message"
+local M = {}
+_G[modname] = M
+package.loaded[modname] = M
+setmetatable(M, {__index = _G})
+_ENV[modname] = M
+
+M.LOGIN_REQUEST = 1
+M.LOGIN_RESPONSE = 2
+M.MOVE_REQUEST = 3
+M.CHAT_MESSAGE = 4
+M.MOVE_SYNC = 5
+
+local types = {
+    [M.LOGIN_REQUEST] = "game.login_request",
+    [M.LOGIN_RESPONSE] = "game.login_response",
+    [M.MOVE_REQUEST] = "game.move_request",
+    [M.CHAT_MESSAGE] = "game.chat_message",
+    [M.MOVE_SYNC] = "game.move_sync",
+}
+
+assert(load_proto("./proto/game.pb"), "load ./proto/game.pb failed")
+for id, type_name in pairs(types) do
+    assert(register_message(id, type_name), "register message " .. type_name .. " failed")
+end
+
+return M
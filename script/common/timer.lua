@@ -18,7 +18,27 @@ function M.add_timer(interval, timer_type, func, ...)
         func = func,
         arg = { ... }
     }
-    return add_timer(interval, timer_type, g_timer_index)
+    g_timer[g_timer_index].id = add_timer(interval, timer_type, g_timer_index)
+    return g_timer_index
+end
+
+function M.remove_timer(index)
+    local t = g_timer[index]
+    if t then
+        g_timer[index] = nil
+        remove_timer(t.id)
+    end
+end
+
+function on_timer(index)
+    local t = g_timer[index]
+    if not t then
+        return
+    end
+    if t.timer_type == g_timer_type_once then
+        g_timer[index] = nil
+    end
+    t.func(table.unpack(t.arg))
 end
 
 return M
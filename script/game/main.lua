@@ -1,14 +1,53 @@
 package.path = "./script/?.lua;"
 
+local message = require("common/message")
+
+-- logged in sessions are watchers of the scene, move updates go to the
+-- sessions that can see the mover. the scene records no enter/leave
+-- events, nothing here would drain them
+local scene = aoi_create(1024, 1024, 32)
+
 function on_connect(session_id)
     print("test on connect")
 end
 
-function on_message(session_id, msg)
-    print("test on message: ", msg)
+-- msg is reused once on_message returns, copy what must be kept
+function on_message(session_id, msg_id, msg)
+    print("test on message: ", msg_id)
+    if msg_id == message.LOGIN_REQUEST then
+        write_pbc_message(session_id, message.LOGIN_RESPONSE, {
+            result = 0,
+            role_id = 10001,
+        })
+        aoi_enter(scene, session_id, 0, 0)
+    elseif msg_id == message.MOVE_REQUEST then
+        aoi_move(scene, session_id, msg.x, msg.z)
+        aoi_broadcast(scene, session_id, message.MOVE_SYNC, {
+            role_id = msg.role_id,
+            x = msg.x,
+            y = msg.y,
+            z = msg.z,
+            direction = msg.direction,
+            speed = msg.speed,
+        }, true)
+    end
+end
+
+-- inputs that arrived since the last tick were dispatched right before it
+local tick_count = 0
+function on_tick(dt)
+    tick_count = tick_count + 1
+    if tick_count % 200 == 0 then
+        local stats = get_tick_stats()
+        if stats.overruns > 0 or stats.skipped > 0 then
+            print("tick overruns: ", stats.overruns, "skipped: ", stats.skipped,
+                "max us: ", stats.max_us)
+        end
+    end
 end
 
 function on_passive_clean(session_id)
+    aoi_leave(scene, session_id)
     print("test passive clean session there")
 end
 
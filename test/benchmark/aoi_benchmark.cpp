@@ -0,0 +1,98 @@
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <engine/scene/aoi_grid.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+
+static const std::size_t kEntityCount   = 10000;
+static const std::size_t kTickRate      = 20;
+static const std::size_t kTickCount     = 200;
+static const float kMapSize             = 2000.0f;
+static const float kCellSize            = 25.0f;   // radius 1, about 50 units of view
+static const float kSpeed               = 6.0f;    // units per second
+
+struct walker
+{
+    float x, z, dx, dz;
+};
+
+int main()
+{
+    std::mt19937 rng(20161018);
+    std::uniform_real_distribution<float> position(0, kMapSize);
+    std::uniform_real_distribution<float> angle(0, 6.2831853f);
+    const float step = kSpeed / kTickRate;
+
+    std::vector<walker> walkers(kEntityCount);
+    aoi_grid grid(kMapSize, kMapSize, kCellSize, 1, true);
+    {
+        stopwatch sw;
+        for (uint32_t id = 0; id < kEntityCount; ++id) {
+            walker& w = walkers[id];
+            float a = angle(rng);
+            w = walker{position(rng), position(rng), std::cos(a) * step, std::sin(a) * step};
+            grid.enter(id + 1, w.x, w.z, id % 2 == 0);  // half players, half npcs
+        }
+        printf("enter %zu entities %10.2f ms, %zu events\n",
+                kEntityCount, sw.elapsed_ms(), grid.events().size());
+        grid.clear_events();
+    }
+
+    // every tick all entities move, then each one collects the watchers its
+    // move sync would be broadcast to
+    std::vector<uint32_t> targets;
+    std::size_t events = 0;
+    std::size_t broadcast_targets = 0;
+    double worst_ms = 0;
+    stopwatch total;
+    for (std::size_t tick = 0; tick < kTickCount; ++tick) {
+        stopwatch sw;
+        for (uint32_t id = 0; id < kEntityCount; ++id) {
+            walker& w = walkers[id];
+            w.x += w.dx;
+            w.z += w.dz;
+            if (w.x < 0 || w.x > kMapSize) {
+                w.dx = -w.dx;
+            }
+            if (w.z < 0 || w.z > kMapSize) {
+                w.dz = -w.dz;
+            }
+            grid.move(id + 1, w.x, w.z);
+        }
+        events += grid.events().size();
+        grid.clear_events();
+        for (uint32_t id = 0; id < kEntityCount; ++id) {
+            targets.clear();
+            broadcast_targets += grid.watchers(id + 1, targets);
+        }
+        worst_ms = std::max(worst_ms, sw.elapsed_ms());
+    }
+    double tick_ms = total.elapsed_ms() / kTickCount;
+    printf("%zu entities at %zu Hz, %zu ticks\n", kEntityCount, kTickRate, kTickCount);
+    printf("  tick     %8.3f ms avg %8.3f ms worst, %5.1f%% of the %zu ms budget\n",
+            tick_ms, worst_ms, tick_ms * kTickRate / 10.0, 1000 / kTickRate);
+    printf("  events   %8.1f enter/leave per tick\n", double(events) / kTickCount);
+    printf("  targets  %8.1f broadcast targets per entity\n",
+            double(broadcast_targets) / kTickCount / kEntityCount);
+
+    // what a script computing who sees whom by brute force would pay
+    {
+        const float view = kCellSize * 2;
+        std::size_t pairs = 0;
+        stopwatch sw;
+        for (std::size_t i = 0; i < kEntityCount; ++i) {
+            for (std::size_t j = 0; j < kEntityCount; ++j) {
+                float dx = walkers[i].x - walkers[j].x;
+                float dz = walkers[i].z - walkers[j].z;
+                pairs += (i != j && dx * dx + dz * dz <= view * view);
+            }
+        }
+        printf("  n^2 scan %8.3f ms for one tick (%zu pairs)\n", sw.elapsed_ms(), pairs);
+    }
+    return 0;
+}
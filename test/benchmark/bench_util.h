@@ -0,0 +1,60 @@
+#ifndef TEST_BENCHMARK_BENCH_UTIL_H
+#define TEST_BENCHMARK_BENCH_UTIL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <third_party/g3log/g3log/logworker.hpp>
+
+// what the stand alone benchmarks and joker_bench share
+namespace bench_util
+{
+
+class stopwatch
+{
+public:
+    stopwatch()
+        : start_(std::chrono::steady_clock::now())
+    {
+    }
+
+    double elapsed_ms() const
+    {
+        return std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+}; // class stopwatch
+
+// one line of ops, total time and time per op
+inline void report(const char* name, std::size_t ops, double ms)
+{
+    printf("%-28s %10zu ops %10.2f ms %8.1f ns/op\n",
+            name, ops, ms, ms * 1e6 / (ops ? ops : 1));
+}
+
+struct null_sink
+{
+    void receive(g3::LogMessageMover message)
+    {
+    }
+}; // struct null_sink
+
+// g3log initialized with a sink that drops every line, for as long as the
+// returned worker lives
+inline std::unique_ptr<g3::LogWorker> null_logging()
+{
+    std::unique_ptr<g3::LogWorker> logworker{ g3::LogWorker::createLogWorker() };
+    logworker->addSink(std2::make_unique<null_sink>(), &null_sink::receive);
+    g3::initializeLogging(logworker.get());
+    return logworker;
+}
+
+} // namespace bench_util
+
+#endif // TEST_BENCHMARK_BENCH_UTIL_H
@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <engine/net/server.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+
+static const std::size_t kSessionCount  = 200;
+static const std::size_t kFrameCount    = 2000;
+static const std::size_t kFrameSize     = 64;
+
+enum class send_mode
+{
+    COPY_PER_SESSION,
+    BROADCAST,
+    INTERLEAVED,    // odd frames per session, even frames broadcast
+};
+
+static void make_frame(char* frame, uint32_t sequence)
+{
+    memset(frame, 'x', kFrameSize);
+    memcpy(frame, &sequence, sizeof sequence);
+}
+
+// every socket must see the frames in sequence order
+static bool drain(std::vector<std::shared_ptr<tcp::socket>>& sockets)
+{
+    std::vector<char> received(kFrameCount * kFrameSize);
+    for (auto& socket : sockets) {
+        asio::read(*socket, asio::buffer(received));
+        for (uint32_t i = 0; i < kFrameCount; ++i) {
+            uint32_t sequence;
+            memcpy(&sequence, &received[i * kFrameSize], sizeof sequence);
+            if (sequence != i) {
+                printf("frame %u out of order, got %u\n", i, sequence);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool run(send_mode mode, unsigned short port)
+{
+    server s("127.0.0.1", port, 4);
+    std::mutex mutex;
+    std::vector<std::shared_ptr<session>> sessions;
+    s.set_init_handlers([&](std::shared_ptr<session> session){
+        std::lock_guard<std::mutex> lock(mutex);
+        sessions.push_back(session);
+    });
+    s.run();
+
+    asio::io_service io_service;
+    std::vector<std::shared_ptr<tcp::socket>> sockets;
+    for (std::size_t i = 0; i < kSessionCount; ++i) {
+        auto socket = std::make_shared<tcp::socket>(io_service);
+        socket->connect(tcp::endpoint(asio::ip::address_v4::from_string("127.0.0.1"), port));
+        sockets.push_back(socket);
+    }
+    while (s.session_count() < kSessionCount) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::vector<uint32_t> session_ids;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& session : sessions) {
+            session_ids.push_back(session->id());
+        }
+    }
+
+    stopwatch sw;
+    char frame[kFrameSize];
+    for (uint32_t i = 0; i < kFrameCount; ++i) {
+        make_frame(frame, i);
+        if (mode == send_mode::COPY_PER_SESSION
+                || (mode == send_mode::INTERLEAVED && (i & 1))) {
+            for (auto& session : sessions) {
+                session->write(frame, kFrameSize);
+            }
+        } else {
+            s.broadcast(session_ids, std::make_shared<data_block>(frame, kFrameSize));
+        }
+    }
+    double queued_ms = sw.elapsed_ms();
+    bool ordered = drain(sockets);
+    double delivered_ms = sw.elapsed_ms();
+
+    const char* name = mode == send_mode::COPY_PER_SESSION ? "copy per session"
+        : mode == send_mode::BROADCAST ? "broadcast" : "interleaved";
+    printf("%-18s %6zu sessions %6zu frames queued %8.2f ms delivered %8.2f ms %s\n",
+            name, kSessionCount, kFrameCount, queued_ms, delivered_ms,
+            ordered ? "in order" : "OUT OF ORDER");
+
+    for (auto& socket : sockets) {
+        socket->close();
+    }
+    sessions.clear();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    s.stop();
+    return ordered;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned short port = argc > 1 ? atoi(argv[1]) : 18775;
+
+    std::unique_ptr<g3::LogWorker> logworker = null_logging();
+
+    bool ordered = run(send_mode::COPY_PER_SESSION, port);
+    ordered = run(send_mode::BROADCAST, port + 1) && ordered;
+    ordered = run(send_mode::INTERLEAVED, port + 2) && ordered;
+
+    return ordered ? 0 : 1;
+}
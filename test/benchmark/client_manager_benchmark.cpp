@@ -0,0 +1,162 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/net/client.h>
+#include <engine/net/client_manager.h>
+#include <engine/net/server.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+
+static const std::size_t kClientCount   = 200;     // one thread each
+static const std::size_t kPooledCount   = 4000;    // on a shared pool
+static const std::size_t kPoolThreads   = 2;
+
+class echo_handler : public abstract_handler
+{
+public:
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        read_data data = any_cast<read_data>(*msg);
+        ctx->fire_write(std::unique_ptr<any>(new any(static_cast<uint16_t>(data.len))));
+        ctx->fire_write(std::move(msg));
+    }
+};
+
+// counts the echoed frames a client session gets back
+class count_handler : public abstract_handler
+{
+public:
+    explicit count_handler(std::atomic_size_t& replies)
+        : replies_(replies)
+    {
+    }
+
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        ++replies_;
+    }
+private:
+    std::atomic_size_t& replies_;
+};
+
+static void wait_for(const std::function<bool()>& done)
+{
+    while (!done()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+static void add_client_handlers(std::shared_ptr<session> session, std::atomic_size_t& replies)
+{
+    session->add_handler("decoder", std::make_shared<length_field_base_frame_decoder>(1024, 0, 2, 0, 2))
+        ->add_handler("count", std::make_shared<count_handler>(replies));
+}
+
+static void echo_round(const std::vector<std::shared_ptr<session>>& sessions,
+        std::atomic_size_t& replies)
+{
+    const char frame[] = {0, 5, 'l', 'o', 'b', 'b', 'y'};
+    std::size_t expected = replies + sessions.size();
+    for (auto& s : sessions) {
+        s->write(frame, sizeof frame);
+    }
+    wait_for([&](){return replies >= expected;});
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned short port = argc > 1 ? atoi(argv[1]) : 18795;
+
+    std::unique_ptr<g3::LogWorker> logworker = null_logging();
+
+    server s("127.0.0.1", port, 4);
+    s.set_init_handlers([](std::shared_ptr<session> session){
+        session->add_handler("decoder", std::make_shared<length_field_base_frame_decoder>(1024, 0, 2, 0, 2))
+            ->add_handler("echo", std::make_shared<echo_handler>());
+    });
+    s.run();
+
+    // an engine::client per connection, each with its own io thread
+    {
+        std::atomic_size_t connected(0);
+        std::atomic_size_t replies(0);
+        std::vector<std::shared_ptr<client>> clients;
+        stopwatch sw;
+        for (std::size_t i = 0; i < kClientCount; ++i) {
+            auto c = std::make_shared<client>("127.0.0.1", port);
+            c->set_init_handlers([&](std::shared_ptr<session> session){
+                add_client_handlers(session, replies);
+                ++connected;
+            });
+            c->run();
+            clients.push_back(c);
+        }
+        wait_for([&](){return connected == kClientCount;});
+        double connect_ms = sw.elapsed_ms();
+
+        std::vector<std::shared_ptr<session>> sessions;
+        for (auto& c : clients) {
+            sessions.push_back(c->get_session());
+        }
+        stopwatch echo_sw;
+        echo_round(sessions, replies);
+        printf("%-22s %6zu sessions %6zu threads connect %9.2f ms echo %9.2f ms\n",
+                "client per session", kClientCount, kClientCount, connect_ms, echo_sw.elapsed_ms());
+
+        for (auto& session : sessions) {
+            session->close();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        for (auto& c : clients) {
+            c->stop();
+        }
+    }
+
+    // the same sessions and more on a shared pool of kPoolThreads
+    {
+        std::atomic_size_t replies(0);
+        client_manager manager(kPoolThreads);
+        manager.set_init_handlers([&](std::shared_ptr<session> session){
+            add_client_handlers(session, replies);
+        });
+        manager.run();
+
+        stopwatch sw;
+        uint32_t destination = manager.add_destination("localhost", port, kPooledCount);
+        wait_for([&](){return manager.connected_count() == kPooledCount;});
+        double connect_ms = sw.elapsed_ms();
+
+        std::vector<std::shared_ptr<session>> sessions;
+        for (uint32_t i = 0; i < kPooledCount; ++i) {
+            sessions.push_back(manager.get_session(destination, i));
+        }
+        stopwatch echo_sw;
+        echo_round(sessions, replies);
+        printf("%-22s %6zu sessions %6zu threads connect %9.2f ms echo %9.2f ms\n",
+                "client_manager", kPooledCount, kPoolThreads, connect_ms, echo_sw.elapsed_ms());
+        manager.stop();
+    }
+
+    // nothing listens on port + 1, attempts back off from 50 ms to 400 ms
+    {
+        client_manager manager(1);
+        manager.set_reconnect_delay(50, 400);
+        manager.run();
+        manager.add_destination("127.0.0.1", port + 1, 1);
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+        manager.stop();
+        printf("%-22s %6zu attempts in 2 s, about 40 without backoff\n",
+                "refused, backoff", manager.connect_failures());
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    s.stop();
+    return 0;
+}
@@ -0,0 +1,669 @@
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <third_party/benchmark/benchmark.h>
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/common/any.h>
+#include <engine/common/logger.h>
+#include <engine/common/raii.h>
+#include <engine/common/scalable_rw_lock.h>
+#include <engine/common/timer.h>
+#include <engine/common/trace.h>
+#include <engine/common/wfirst_rw_lock.h>
+#include <engine/handler/context.h>
+#include <engine/handler/delimiter_based_frame_decoder.h>
+#include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/handler/length_field_prepender.h>
+#include <engine/handler/pipeline.h>
+#include <engine/net/asio_buffer.h>
+#include <engine/net/binary_reader.h>
+#include <engine/net/binary_writer.h>
+#include <engine/net/session.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+using namespace g3;
+
+// the read size a session sees from one segment on the wire
+static const std::size_t kSegmentLength = 1460;
+static const std::size_t kStreamFrames  = 256;
+
+// counts the frames a decoder fires
+class count_handler : public abstract_handler
+{
+public:
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        ++frames;
+    }
+
+    std::size_t frames = 0;
+};
+
+// ---------------------------------------------------------------- asio_buffer
+
+// one chunk in and out, the buffer stays on its first block
+static void BM_asio_buffer_append_retrieve(benchmark::State& state)
+{
+    std::size_t chunk = state.range(0);
+    std::vector<char> data(chunk, 'x');
+    asio_buffer buffer;
+    for (auto _ : state) {
+        buffer.append(data.data(), chunk);
+        buffer.retrieve(chunk);
+    }
+    state.SetBytesProcessed(state.iterations() * chunk);
+}
+BENCHMARK(BM_asio_buffer_append_retrieve)->Range(8, 16 << 10);
+
+// a burst of 64 chunks in before any go out, the buffer grows blocks
+static void BM_asio_buffer_burst(benchmark::State& state)
+{
+    const std::size_t kBurst = 64;
+    std::size_t chunk = state.range(0);
+    std::vector<char> data(chunk, 'x');
+    asio_buffer buffer;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < kBurst; ++i) {
+            buffer.append(data.data(), chunk);
+        }
+        for (std::size_t i = 0; i < kBurst; ++i) {
+            buffer.retrieve(chunk);
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * kBurst * chunk);
+}
+BENCHMARK(BM_asio_buffer_burst)->Range(8, 16 << 10);
+
+// a position array of range(0) big endian ints, one append each or in bulk
+static void BM_asio_buffer_append_ints(benchmark::State& state)
+{
+    std::vector<uint32_t> positions(state.range(0), 0x01020304);
+    std::size_t bytes = positions.size() * sizeof(uint32_t);
+    asio_buffer buffer;
+    for (auto _ : state) {
+        for (uint32_t position : positions) {
+            buffer.append(position);
+        }
+        buffer.retrieve(bytes);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_asio_buffer_append_ints)->Range(8, 4 << 10);
+
+static void BM_asio_buffer_append_bulk(benchmark::State& state)
+{
+    std::vector<uint32_t> positions(state.range(0), 0x01020304);
+    std::size_t bytes = positions.size() * sizeof(uint32_t);
+    asio_buffer buffer;
+    for (auto _ : state) {
+        buffer.append(positions);
+        buffer.retrieve(bytes);
+    }
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+BENCHMARK(BM_asio_buffer_append_bulk)->Range(8, 4 << 10);
+
+// ----------------------------------------------------------------- endian
+
+static void BM_endian_adapte(benchmark::State& state)
+{
+    uint32_t value = 0x01020304;
+    for (auto _ : state) {
+        value = adapte_endian<uint32_t>(value, true);
+        benchmark::DoNotOptimize(value);
+    }
+}
+BENCHMARK(BM_endian_adapte);
+
+static void BM_endian_bulk(benchmark::State& state)
+{
+    std::vector<uint32_t> values(state.range(0), 0x01020304);
+    for (auto _ : state) {
+        adapte_endian<uint32_t>(values.data(), values.data(), values.size(), true);
+        benchmark::DoNotOptimize(values.data());
+    }
+    state.SetBytesProcessed(state.iterations() * values.size() * sizeof(uint32_t));
+}
+BENCHMARK(BM_endian_bulk)->Range(8, 4 << 10);
+
+// ----------------------------------------------------------------- binary
+
+struct bench_position
+{
+    int32_t x;
+    int32_t y;
+
+    template<typename FIELDS>
+    void fields(FIELDS& f) {f(x, y);}
+}; // struct bench_position
+
+struct bench_message
+{
+    uint32_t                    id;
+    std::string                 name;
+    std::vector<bench_position> positions;
+    std::vector<uint32_t>       targets;
+
+    template<typename FIELDS>
+    void fields(FIELDS& f) {f(id, name, positions, targets);}
+}; // struct bench_message
+
+static bench_message make_bench_message()
+{
+    bench_message message;
+    message.id      = 7;
+    message.name    = "joker";
+    message.positions.assign(16, bench_position{100, -100});
+    message.targets.assign(32, 12345);
+    return message;
+}
+
+// a length header reserved and backpatched around the encoded struct
+static void BM_binary_writer_message(benchmark::State& state)
+{
+    bench_message message = make_bench_message();
+    asio_buffer buffer;
+    for (auto _ : state) {
+        std::size_t len;
+        {
+            binary_writer writer(buffer);
+            std::size_t at = writer.reserve<uint16_t>();
+            writer.write(message);
+            len = writer.offset();
+            writer.backpatch<uint16_t>(at, static_cast<uint16_t>(len - sizeof(uint16_t)));
+        }
+        buffer.retrieve(len);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_binary_writer_message);
+
+static void BM_binary_reader_message(benchmark::State& state)
+{
+    bench_message message = make_bench_message();
+    asio_buffer buffer;
+    {
+        binary_writer writer(buffer);
+        writer.write(message);
+    }
+    binary_reader reader(buffer);
+    bench_message decoded;
+    for (auto _ : state) {
+        reader.read(decoded);
+        reader.rewind();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_binary_reader_message);
+
+// ------------------------------------------------------------------- decoders
+
+// feeds a stream to a decoder in segments, as the read path does
+static std::size_t decode_stream(const std::string& stream,
+        std::shared_ptr<abstract_handler> decoder)
+{
+    pipeline p(nullptr);
+    auto sink = std::make_shared<count_handler>();
+    context decoder_ctx(&p, "decoder", decoder);
+    context sink_ctx(&p, "sink", sink);
+    decoder_ctx.next = &sink_ctx;
+    sink_ctx.prev = &decoder_ctx;
+
+    auto buffer = std::make_shared<asio_buffer>();
+    for (std::size_t offset = 0; offset < stream.size(); offset += kSegmentLength) {
+        buffer->append(stream.data() + offset, std::min(kSegmentLength, stream.size() - offset));
+        decoder_ctx.read(std::unique_ptr<any>(new any(buffer)));
+    }
+    return sink->frames;
+}
+
+// 2 byte big endian length, then the payload
+static void BM_length_field_decoder(benchmark::State& state)
+{
+    std::size_t payload = state.range(0);
+    std::string stream;
+    for (std::size_t i = 0; i < kStreamFrames; ++i) {
+        stream += static_cast<char>(payload >> 8);
+        stream += static_cast<char>(payload & 0xff);
+        stream += std::string(payload, 'x');
+    }
+    auto decoder = std::make_shared<length_field_base_frame_decoder>(64 << 10, 0, 2, 0, 2);
+    std::size_t frames = 0;
+    for (auto _ : state) {
+        frames += decode_stream(stream, decoder);
+    }
+    state.SetItemsProcessed(frames);
+    state.SetBytesProcessed(state.iterations() * stream.size());
+}
+BENCHMARK(BM_length_field_decoder)->Range(8, 4 << 10);
+
+// payload then '\n'
+static void BM_delimiter_decoder(benchmark::State& state)
+{
+    std::size_t payload = state.range(0);
+    std::string stream;
+    for (std::size_t i = 0; i < kStreamFrames; ++i) {
+        stream += std::string(payload, 'x');
+        stream += '\n';
+    }
+    auto decoder = std::make_shared<delimiter_based_frame_decoder>(64 << 10, "\n");
+    std::size_t frames = 0;
+    for (auto _ : state) {
+        frames += decode_stream(stream, decoder);
+    }
+    state.SetItemsProcessed(frames);
+    state.SetBytesProcessed(state.iterations() * stream.size());
+}
+BENCHMARK(BM_delimiter_decoder)->Range(8, 512);
+
+// --------------------------------------------------------------- pipeline
+
+// pipeline::write tries the message types in order, the arg picks the type
+static std::unique_ptr<any> make_message(int64_t type, const std::string& text,
+        const data_block& block)
+{
+    switch (type) {
+    case 0:     return std::unique_ptr<any>(new any(read_data(block)));
+    case 1:     return std::unique_ptr<any>(new any(write_data(block)));
+    case 2:     return std::unique_ptr<any>(new any(text));
+    case 3:     return std::unique_ptr<any>(new any(static_cast<char>('x')));
+    case 4:     return std::unique_ptr<any>(new any(static_cast<int32_t>(7)));
+    case 5:     return std::unique_ptr<any>(new any(static_cast<uint16_t>(7)));
+    case 6:     return std::unique_ptr<any>(new any(static_cast<uint64_t>(7)));
+    default:    return std::unique_ptr<any>(new any(static_cast<double>(7)));
+    }
+}
+
+static void BM_pipeline_write(benchmark::State& state)
+{
+    static const char* kTypeNames[] = {"read_data", "write_data", "std::string", "char",
+        "int32_t", "uint16_t", "uint64_t", "double"};
+    const std::size_t kDrainEvery = 256;
+
+    // nothing listens on the socket, the posted writes find it closed and
+    // the bytes are drained here
+    asio::io_service io_service;
+    auto s = std::make_shared<session>(1, io_service, io_service);
+    pipeline p(s.get());
+    std::string text(32, 'x');
+    data_block block(text.data(), text.size());
+
+    std::size_t count = 0;
+    for (auto _ : state) {
+        p.write(make_message(state.range(0), text, block));
+        if (++count % kDrainEvery == 0) {
+            state.PauseTiming();
+            io_service.poll();
+            io_service.reset();
+            s->write_buffer()->retrieve(s->write_buffer()->readable_bytes());
+            state.ResumeTiming();
+        }
+    }
+    io_service.poll();
+    state.SetLabel(kTypeNames[state.range(0)]);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_pipeline_write)->DenseRange(0, 7);
+
+// a 2 byte length and a 32 byte body as two pipeline writes, the way the
+// codecs frame today, against the prepender with range(0) frames a batch
+static void BM_frame_header_then_body(benchmark::State& state)
+{
+    const std::size_t kDrainEvery = 256;
+    asio::io_service io_service;
+    auto s = std::make_shared<session>(1, io_service, io_service);
+    pipeline p(s.get());
+    std::string text(32, 'x');
+
+    std::size_t count = 0;
+    for (auto _ : state) {
+        uint16_t header = adapte_endian<uint16_t>(static_cast<uint16_t>(text.size()), true);
+        read_data data;
+        data.data   = reinterpret_cast<const char*>(&header);
+        data.len    = sizeof header;
+        p.write(std::unique_ptr<any>(new any(data)));
+        data.data   = text.data();
+        data.len    = text.size();
+        p.write(std::unique_ptr<any>(new any(data)));
+        if (++count % kDrainEvery == 0) {
+            state.PauseTiming();
+            io_service.poll();
+            io_service.reset();
+            s->write_buffer()->retrieve(s->write_buffer()->readable_bytes());
+            state.ResumeTiming();
+        }
+    }
+    io_service.poll();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_frame_header_then_body);
+
+static void BM_frame_prepender(benchmark::State& state)
+{
+    const std::size_t kDrainEvery = 256;
+    asio::io_service io_service;
+    auto s = std::make_shared<session>(1, io_service, io_service);
+    pipeline p(s.get());
+    auto prepender = std::make_shared<length_field_prepender>(0, 2);
+    context ctx(&p, "prepender", prepender);
+    std::string text(32, 'x');
+    std::vector<read_data> batch(state.range(0));
+    for (auto& body : batch) {
+        body.data   = text.data();
+        body.len    = text.size();
+    }
+
+    std::size_t count = 0;
+    for (auto _ : state) {
+        if (batch.size() == 1) {
+            prepender->encode(&ctx, std::unique_ptr<any>(new any(batch[0])));
+        } else {
+            prepender->encode(&ctx, std::unique_ptr<any>(new any(batch)));
+        }
+        count += batch.size();
+        if (count >= kDrainEvery) {
+            count = 0;
+            state.PauseTiming();
+            io_service.poll();
+            io_service.reset();
+            s->write_buffer()->retrieve(s->write_buffer()->readable_bytes());
+            state.ResumeTiming();
+        }
+    }
+    io_service.poll();
+    state.SetItemsProcessed(state.iterations() * batch.size());
+}
+BENCHMARK(BM_frame_prepender)->Arg(1)->Arg(16);
+
+// -------------------------------------------------------------------- any
+
+static void BM_any_copy_int(benchmark::State& state)
+{
+    any source(static_cast<int32_t>(7));
+    for (auto _ : state) {
+        any copy(source);
+        benchmark::DoNotOptimize(copy);
+    }
+}
+BENCHMARK(BM_any_copy_int);
+
+static void BM_any_copy_string(benchmark::State& state)
+{
+    any source(std::string(state.range(0), 'x'));
+    for (auto _ : state) {
+        any copy(source);
+        benchmark::DoNotOptimize(copy);
+    }
+}
+BENCHMARK(BM_any_copy_string)->Arg(8)->Arg(64)->Arg(1024);
+
+// the unique_ptr<any> every fire_read and fire_write allocates
+static void BM_any_make_message(benchmark::State& state)
+{
+    std::string text(32, 'x');
+    data_block block(text.data(), text.size());
+    for (auto _ : state) {
+        std::unique_ptr<any> msg(new any(read_data(block)));
+        benchmark::DoNotOptimize(msg);
+    }
+}
+BENCHMARK(BM_any_make_message);
+
+static void BM_any_cast(benchmark::State& state)
+{
+    any value(static_cast<int32_t>(7));
+    for (auto _ : state) {
+        int32_t x = any_cast<int32_t>(value);
+        benchmark::DoNotOptimize(x);
+    }
+}
+BENCHMARK(BM_any_cast);
+
+// the type test pipeline::write makes for every type before the right one
+static void BM_any_type_miss(benchmark::State& state)
+{
+    any value(static_cast<double>(7));
+    for (auto _ : state) {
+        bool hit = value.type() == typeid(int32_t);
+        benchmark::DoNotOptimize(hit);
+    }
+}
+BENCHMARK(BM_any_type_miss);
+
+// -------------------------------------------------------------------- raii
+
+struct guarded
+{
+    void acquire()
+    {
+        ++count;
+    }
+
+    void release()
+    {
+        --count;
+    }
+
+    std::size_t count = 0;
+}; // struct guarded
+
+// what make_raii built before, two std::functions over std::bind
+static void BM_raii_std_function(benchmark::State& state)
+{
+    guarded res;
+    for (auto _ : state) {
+        raii guard(std::bind(&guarded::release, &res), std::bind(&guarded::acquire, &res));
+        benchmark::DoNotOptimize(res.count);
+    }
+}
+BENCHMARK(BM_raii_std_function);
+
+static void BM_raii_make_raii(benchmark::State& state)
+{
+    guarded res;
+    for (auto _ : state) {
+        auto guard = make_raii(res, &guarded::release, &guarded::acquire);
+        benchmark::DoNotOptimize(res.count);
+    }
+}
+BENCHMARK(BM_raii_make_raii);
+
+static void BM_raii_scope_guard(benchmark::State& state)
+{
+    guarded res;
+    for (auto _ : state) {
+        auto guard = make_scope_guard([&res]{res.release();}, [&res]{res.acquire();});
+        benchmark::DoNotOptimize(res.count);
+    }
+}
+BENCHMARK(BM_raii_scope_guard);
+
+// ---------------------------------------------------------- wfirst_rw_lock
+
+static wfirst_rw_lock shared_lock;
+static std::size_t shared_value = 0;
+
+static void BM_wfirst_rw_lock_read(benchmark::State& state)
+{
+    for (auto _ : state) {
+        auto read_guard = shared_lock.read_guard();
+        benchmark::DoNotOptimize(shared_value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_wfirst_rw_lock_read)->ThreadRange(1, 32)->UseRealTime();
+
+// one write in every 16 operations
+static void BM_wfirst_rw_lock_mixed(benchmark::State& state)
+{
+    std::size_t count = 0;
+    for (auto _ : state) {
+        if (++count % 16 == 0) {
+            auto write_guard = shared_lock.write_guard();
+            ++shared_value;
+        } else {
+            auto read_guard = shared_lock.read_guard();
+            benchmark::DoNotOptimize(shared_value);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_wfirst_rw_lock_mixed)->ThreadRange(1, 32)->UseRealTime();
+
+// -------------------------------------------------------- scalable_rw_lock
+
+static scalable_rw_lock scalable_lock;
+
+static void BM_scalable_rw_lock_read(benchmark::State& state)
+{
+    for (auto _ : state) {
+        auto read_guard = scalable_lock.read_guard();
+        benchmark::DoNotOptimize(shared_value);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_scalable_rw_lock_read)->ThreadRange(1, 32)->UseRealTime();
+
+// one write in every 16 operations
+static void BM_scalable_rw_lock_mixed(benchmark::State& state)
+{
+    std::size_t count = 0;
+    for (auto _ : state) {
+        if (++count % 16 == 0) {
+            auto write_guard = scalable_lock.write_guard();
+            ++shared_value;
+        } else {
+            auto read_guard = scalable_lock.read_guard();
+            benchmark::DoNotOptimize(shared_value);
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_scalable_rw_lock_mixed)->ThreadRange(1, 32)->UseRealTime();
+
+// ------------------------------------------------------------------ timer
+
+// the arg is the count of timers already waiting in the wheels
+static void BM_timer_add_cancel(benchmark::State& state)
+{
+    timer t;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        t.add_task(60000 + i % 60000, TIMER_ONCE, [](){});
+    }
+    for (auto _ : state) {
+        timer_id id = t.add_task(30000, TIMER_ONCE, [](){});
+        t.remove_task(id);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_timer_add_cancel)->Arg(0)->Arg(100000);
+
+// one detect_timer_list firing the arg count of timers, the wait for the
+// wheel to turn is not timed
+static void BM_timer_fire(benchmark::State& state)
+{
+    timer t;
+    t.reserve(state.range(0));
+    std::size_t fired = 0;
+    auto callback = [&fired](){ ++fired; };
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            t.add_task(0, TIMER_ONCE, callback);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(GRANULARITY));
+        state.ResumeTiming();
+        t.detect_timer_list();
+    }
+    state.SetItemsProcessed(fired);
+}
+BENCHMARK(BM_timer_fire)->Arg(4096)->Arg(65536)->MinTime(0.1);
+
+// ------------------------------------------------------------------ trace
+
+// the check every read makes, the arg is the sample rate, 0 is off
+static void BM_trace_sample(benchmark::State& state)
+{
+    trace::set_sample_rate(static_cast<uint32_t>(state.range(0)));
+    for (auto _ : state) {
+        uint64_t id = trace::sample();
+        benchmark::DoNotOptimize(id);
+    }
+    trace::set_sample_rate(0);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_trace_sample)->Arg(0)->Arg(1)->Arg(100);
+
+// one stage of a sampled message, the clock read included
+static void BM_trace_record(benchmark::State& state)
+{
+    for (auto _ : state) {
+        trace::record(1, "stage", trace::clock::now(), 1);
+    }
+    trace::clear();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_trace_record);
+
+// -------------------------------------------------------------------- log
+
+// the format and the push to the g3log worker, the sink drops it
+static void BM_log_logf(benchmark::State& state)
+{
+    std::size_t count = 0;
+    for (auto _ : state) {
+        LOGF(INFO, "session id = %d, pending write bytes = %d", 7, ++count);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_log_logf);
+
+// below the runtime level
+static void BM_log_filtered(benchmark::State& state)
+{
+    logger::set_level(logger::kINFO);
+    std::size_t count = 0;
+    for (auto _ : state) {
+        JOKER_LOGF(DEBUG, "session id = %d, pending write bytes = %d", 7, ++count);
+    }
+    logger::set_level(0);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_log_filtered);
+
+// a record in the ring of the thread, the log thread formats it. the
+// ring is flushed untimed at half full, so no iteration takes the drop path
+// of a full ring, the label shows the records dropped anyway
+static void BM_log_deferred(benchmark::State& state)
+{
+    logger::start();
+    uint64_t dropped = logger::dropped();
+    std::size_t count = 0;
+    for (auto _ : state) {
+        JOKER_LOGF_DEFERRED(INFO, "session id = %d, pending write bytes = %d", 7, ++count);
+        if (count % (logger::kRingRecords / 2) == 0) {
+            state.PauseTiming();
+            logger::flush();
+            state.ResumeTiming();
+        }
+    }
+    logger::stop();
+    state.SetItemsProcessed(state.iterations());
+    state.SetLabel("dropped " + std::to_string(logger::dropped() - dropped));
+}
+BENCHMARK(BM_log_deferred);
+
+int main(int argc, char** argv)
+{
+    std::unique_ptr<LogWorker> logworker = null_logging();
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -0,0 +1,124 @@
+#include <cstddef>
+#include <cstdio>
+
+#include <engine/handler/pbc_registry.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+
+static const std::size_t kDecodeCount = 1000000;
+static const uint32_t kMoveSync = 1;
+
+// layout of the compiled game.move_sync pattern: 8 byte fields, 4 byte
+// fields, then bools, each group in field number order
+struct move_sync
+{
+    int64_t role_id;
+    int64_t client_time;
+    int64_t server_time;
+    int32_t map_id;
+    int32_t scene_id;
+    float   x;
+    float   y;
+    float   z;
+    float   direction;
+    float   pitch;
+    float   velocity_x;
+    float   velocity_y;
+    float   velocity_z;
+    int32_t speed;
+    int32_t move_state;
+    int32_t move_mode;
+    int32_t animation;
+    int32_t sequence;
+    bool    on_ground;
+    bool    jumping;
+};
+
+static const char* kIntegerFields[] = {
+    "role_id", "map_id", "scene_id", "speed", "move_state", "move_mode",
+    "animation", "on_ground", "jumping", "client_time", "server_time", "sequence",
+};
+
+static const char* kRealFields[] = {
+    "x", "y", "z", "direction", "pitch", "velocity_x", "velocity_y", "velocity_z",
+};
+
+int main(int argc, char* argv[])
+{
+    std::unique_ptr<g3::LogWorker> logworker = null_logging();
+
+    pbc_registry registry;
+    if (!registry.load(argc > 1 ? argv[1] : "proto/game.pb")
+            || !registry.register_message(kMoveSync, "game.move_sync")) {
+        printf("Usage: pbc_benchmark <game.pb> \n");
+        return 1;
+    }
+    const pbc_message_type* type = registry.find(kMoveSync);
+    for (auto& field : type->fields) {
+        if (field.name == "on_ground" && field.offset != offsetof(move_sync, on_ground)) {
+            printf("move_sync layout does not match the compiled pattern\n");
+            return 1;
+        }
+    }
+
+    std::shared_ptr<pbc_wmessage> wmessage = registry.new_wmessage(kMoveSync);
+    for (auto key : kIntegerFields) {
+        pbc_wmessage_integer(wmessage.get(), key, 1000, 0);
+    }
+    for (auto key : kRealFields) {
+        pbc_wmessage_real(wmessage.get(), key, 12.5);
+    }
+    struct pbc_slice encoded;
+    pbc_wmessage_buffer(wmessage.get(), &encoded);
+    printf("game.move_sync: 20 fields, %d bytes\n", encoded.len);
+
+    double sum = 0;
+    {
+        stopwatch sw;
+        for (std::size_t i = 0; i < kDecodeCount; ++i) {
+            struct pbc_slice slice = encoded;
+            pbc_rmessage* message = pbc_rmessage_new(registry.env(), "game.move_sync", &slice);
+            for (auto key : kIntegerFields) {
+                sum += pbc_rmessage_integer(message, key, 0, nullptr);
+            }
+            for (auto key : kRealFields) {
+                sum += pbc_rmessage_real(message, key, 0);
+            }
+            pbc_rmessage_delete(message);
+        }
+        report("rmessage + 20 key lookups", kDecodeCount, sw.elapsed_ms());
+    }
+
+    {
+        stopwatch sw;
+        for (std::size_t i = 0; i < kDecodeCount; ++i) {
+            struct pbc_slice slice = encoded;
+            pbc_pattern* pattern = pbc_pattern_new(registry.env(), "game.move_sync",
+                    "@role_id %D client_time %D server_time %D map_id %d scene_id %d"
+                    " x %f y %f z %f direction %f pitch %f velocity_x %f velocity_y %f"
+                    " velocity_z %f speed %d move_state %d move_mode %d animation %d"
+                    " sequence %d on_ground %b jumping %b");
+            move_sync move;
+            pbc_pattern_unpack(pattern, &slice, &move);
+            sum += move.role_id + move.x + move.sequence + move.on_ground;
+            pbc_pattern_delete(pattern);
+        }
+        report("pattern built per decode", kDecodeCount, sw.elapsed_ms());
+    }
+
+    {
+        stopwatch sw;
+        for (std::size_t i = 0; i < kDecodeCount; ++i) {
+            struct pbc_slice slice = encoded;
+            move_sync move;
+            pbc_pattern_unpack(type->pattern, &slice, &move);
+            sum += move.role_id + move.x + move.sequence + move.on_ground;
+        }
+        report("cached pattern", kDecodeCount, sw.elapsed_ms());
+    }
+
+    printf("checksum %.1f\n", sum);
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <engine/handler/route_handler.h>
+#include <engine/net/router.h>
+#include <engine/net/server.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+
+static const uint32_t kBackendId        = 1;
+static const uint32_t kMaxFrameLength   = 64 * 1024;
+static const std::size_t kClientCount   = 32;
+static const std::size_t kWindow        = 64;      // frames in flight per client
+
+// a run stays well below the 30 s idle check of the servers
+static bool run(std::size_t payload_length, std::size_t rounds, unsigned short port)
+{
+    unsigned short backend_port = port;
+    unsigned short route_port   = port + 1;
+
+    // the backend answers every frame to its source
+    server backend("127.0.0.1", backend_port, 2);
+    backend.set_init_handlers([](std::shared_ptr<session> session){
+        session->add_handler("route", std::make_shared<route_handler>(kMaxFrameLength,
+                    [](context* ctx, uint32_t destination, uint32_t source,
+                        std::shared_ptr<data_block> frame){
+                        route_handler::write_header(frame->data, source, destination,
+                                frame->len - route_handler::kHeaderLength);
+                        ctx->fire_write(std::unique_ptr<any>(new any(read_data(*frame))));
+                    }, false));
+    });
+    backend.run();
+
+    server route("127.0.0.1", route_port, 2);
+    router links(2);
+    route.set_init_handlers([&links](std::shared_ptr<session> session){
+        session->add_handler("route", std::make_shared<route_handler>(kMaxFrameLength,
+                    [&links](context*, uint32_t destination, uint32_t source,
+                        std::shared_ptr<data_block> frame){
+                        links.forward(destination, source, frame);
+                    }, true));
+    });
+    links.set_init_handlers([&route](std::shared_ptr<session> session){
+        session->add_handler("route", std::make_shared<route_handler>(kMaxFrameLength,
+                    [&route](context*, uint32_t destination, uint32_t,
+                        std::shared_ptr<data_block> frame){
+                        route.write_shared(destination, frame);
+                    }, false));
+    });
+    links.add_backend(kBackendId, "127.0.0.1", backend_port, 2);
+    links.run();
+    route.run();
+    while (links.connected_links() < 2) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    asio::io_service io_service;
+    std::vector<std::shared_ptr<tcp::socket>> sockets;
+    for (std::size_t i = 0; i < kClientCount; ++i) {
+        auto socket = std::make_shared<tcp::socket>(io_service);
+        socket->connect(tcp::endpoint(asio::ip::address_v4::from_string("127.0.0.1"), route_port));
+        socket->set_option(tcp::no_delay(true));
+        sockets.push_back(socket);
+    }
+
+    std::size_t frame_length = route_handler::kHeaderLength + payload_length;
+    std::vector<char> window(frame_length * kWindow);
+    for (std::size_t i = 0; i < kWindow; ++i) {
+        char* frame = &window[i * frame_length];
+        route_handler::write_header(frame, kBackendId, 0, payload_length);
+        memset(frame + route_handler::kHeaderLength, static_cast<int>('a' + i % 26), payload_length);
+    }
+
+    std::vector<char> received(window.size());
+    bool intact = true;
+    stopwatch sw;
+    for (std::size_t round = 0; round < rounds && intact; ++round) {
+        for (auto& socket : sockets) {
+            asio::write(*socket, asio::buffer(window));
+        }
+        for (auto& socket : sockets) {
+            asio::read(*socket, asio::buffer(received));
+            for (std::size_t i = 0; i < kWindow; ++i) {
+                const char* payload = &received[i * frame_length + route_handler::kHeaderLength];
+                if (payload[0] != static_cast<char>('a' + i % 26)
+                        || payload[payload_length - 1] != payload[0]) {
+                    intact = false;
+                }
+            }
+        }
+    }
+    double ms = sw.elapsed_ms();
+
+    std::size_t frames = kClientCount * kWindow * rounds;
+    printf("%6zu byte payload %8zu round trips %9.2f ms %10.0f frames/s forwarded %8.1f MB/s %s\n",
+            payload_length, frames, ms, 2 * frames * 1000.0 / ms,
+            2.0 * frames * frame_length / 1024 / 1024 * 1000.0 / ms,
+            intact ? "" : "CORRUPTED");
+
+    for (auto& socket : sockets) {
+        socket->close();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    route.stop();
+    links.stop();
+    backend.stop();
+    return intact;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned short port = argc > 1 ? atoi(argv[1]) : 18785;
+
+    std::unique_ptr<g3::LogWorker> logworker = null_logging();
+
+    // client -> route -> link -> backend, and back through the route
+    bool intact = run(64, 100, port);
+    intact = run(1024, 40, port + 2) && intact;
+    intact = run(8192, 10, port + 4) && intact;
+    return intact ? 0 : 1;
+}
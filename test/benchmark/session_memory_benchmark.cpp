@@ -0,0 +1,162 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include <malloc.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/net/server.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+
+static const std::size_t kSessionCount = 500;
+
+class echo_handler : public abstract_handler
+{
+public:
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        read_data data = any_cast<read_data>(*msg);
+        ctx->fire_write(std::unique_ptr<any>(new any(static_cast<uint16_t>(data.len))));
+        ctx->fire_write(std::move(msg));
+    }
+};
+
+// the clients live in a child forked before any thread starts, so the
+// heap of this process is the server's alone. the child connects
+// kSessionCount sockets to the port it is sent, echoes one frame on each
+// and closes them all on port 0
+class client_process
+{
+public:
+    client_process()
+    {
+        int commands[2];
+        int acks[2];
+        if (pipe(commands) != 0 || pipe(acks) != 0) {
+            perror("pipe");
+            exit(1);
+        }
+        pid_ = fork();
+        if (pid_ == 0) {
+            close(commands[1]);
+            close(acks[0]);
+            run(commands[0], acks[1]);
+            _exit(0);
+        }
+        close(commands[0]);
+        close(acks[1]);
+        command_ = commands[1];
+        ack_ = acks[0];
+    }
+
+    ~client_process()
+    {
+        close(command_);
+        close(ack_);
+        waitpid(pid_, nullptr, 0);
+    }
+
+    void send(unsigned short port)
+    {
+        char ack;
+        if (write(command_, &port, sizeof port) != sizeof port
+                || read(ack_, &ack, sizeof ack) != sizeof ack) {
+            perror("client process");
+            exit(1);
+        }
+    }
+
+private:
+    static void run(int command, int ack)
+    {
+        asio::io_service io_service;
+        std::vector<std::shared_ptr<tcp::socket>> sockets;
+        const char frame[] = {0, 5, 'l', 'o', 'b', 'b', 'y'};
+        char reply[sizeof frame];
+        unsigned short port;
+        while (read(command, &port, sizeof port) == sizeof port) {
+            if (port == 0) {
+                sockets.clear();
+            } else {
+                for (std::size_t i = 0; i < kSessionCount; ++i) {
+                    auto socket = std::make_shared<tcp::socket>(io_service);
+                    socket->connect(tcp::endpoint(asio::ip::address_v4::from_string("127.0.0.1"), port));
+                    asio::write(*socket, asio::buffer(frame, sizeof frame));
+                    sockets.push_back(socket);
+                }
+                for (auto& socket : sockets) {
+                    asio::read(*socket, asio::buffer(reply, sizeof reply));
+                }
+            }
+            char done = 1;
+            if (write(ack, &done, sizeof done) != sizeof done) {
+                break;
+            }
+        }
+    }
+
+    pid_t   pid_;
+    int     command_;
+    int     ack_;
+}; // class client_process
+
+// every thread allocates from the main arena, see main
+static std::size_t heap_bytes()
+{
+    return mallinfo2().uordblks;
+}
+
+static void run(client_process& clients, bool lazy, unsigned short port)
+{
+    server s("127.0.0.1", port, 4);
+    s.set_lazy_buffers(lazy);
+    s.set_init_handlers([](std::shared_ptr<session> session){
+        session->add_handler("decoder", std::make_shared<length_field_base_frame_decoder>(1024, 0, 2, 0, 2))
+            ->add_handler("echo", std::make_shared<echo_handler>());
+    });
+    s.run();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::size_t heap_before = heap_bytes();
+
+    clients.send(port);
+    // let the io and work threads notice both directions went quiet
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::size_t count = s.session_count();
+    std::size_t heap = heap_bytes() - heap_before;
+    std::size_t resident = s.resident_bytes();
+    printf("%-22s %6zu sessions %8zu heap bytes/session %8zu resident_bytes/session\n",
+            lazy ? "lazy buffers, idle" : "eager buffers, idle",
+            count, count ? heap / count : 0, count ? resident / count : 0);
+
+    clients.send(0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    s.stop();
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned short port = argc > 1 ? atoi(argv[1]) : 18765;
+
+    // before any thread, so the fork is safe and mallinfo2 sees the heap
+    // of every thread
+    mallopt(M_ARENA_MAX, 1);
+    client_process clients;
+
+    std::unique_ptr<g3::LogWorker> logworker = null_logging();
+
+    // the baseline tree, before the pooled and lazy buffers, runs this
+    // program without the lazy run and the server counters at 4584 heap
+    // bytes/session
+    run(clients, false, port);
+    run(clients, true, port + 1);
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <engine/common/mpsc_queue.h>
+#include <engine/net/io_service_pool.h>
+#include <engine/net/tick_driver.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+
+static const std::size_t kProducerCount     = 4;
+static const std::size_t kMessageCount      = 250000;  // per producer
+static const uint32_t kTickRate             = 60;
+
+// stands in for the lua state, touched only under its mutex
+struct logic_state
+{
+    std::mutex  mutex;
+    uint64_t    sum = 0;
+    uint64_t    handled = 0;
+};
+
+static void produce(const std::function<void(uint32_t)>& send)
+{
+    std::vector<std::thread> producers;
+    for (std::size_t p = 0; p < kProducerCount; ++p) {
+        producers.emplace_back([&send](){
+            for (uint32_t i = 0; i < kMessageCount; ++i) {
+                send(i);
+            }
+        });
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+}
+
+static void print_stats(const char* name, const tick_stats& stats)
+{
+    printf("%-28s ticks %5llu overruns %3llu skipped %3llu avg %6llu us max %6llu us late %6llu us\n",
+            name,
+            static_cast<unsigned long long>(stats.ticks),
+            static_cast<unsigned long long>(stats.overruns),
+            static_cast<unsigned long long>(stats.skipped),
+            static_cast<unsigned long long>(stats.avg_us),
+            static_cast<unsigned long long>(stats.max_us),
+            static_cast<unsigned long long>(stats.max_late_us));
+}
+
+int main()
+{
+    std::unique_ptr<g3::LogWorker> logworker = null_logging();
+
+    const std::size_t total = kProducerCount * kMessageCount;
+
+    // every input takes the logic mutex on its own producer thread
+    {
+        logic_state state;
+        stopwatch sw;
+        produce([&state](uint32_t i){
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.sum += i;
+            ++state.handled;
+        });
+        printf("%-28s %8zu msgs %10.2f ms\n", "mutex per message", total, sw.elapsed_ms());
+    }
+
+    // inputs queue lock free and are drained in one batch before each tick
+    {
+        logic_state state;
+        mpsc_queue<uint32_t> inbound;
+        io_service_pool pool(1, "logic_pool");
+        tick_driver driver(pool.get_io_service(), kTickRate);
+        driver.set_drain_handler([&](){
+            std::lock_guard<std::mutex> lock(state.mutex);
+            uint32_t i;
+            while (inbound.pop(i)) {
+                state.sum += i;
+                ++state.handled;
+            }
+        });
+        pool.run();
+        driver.start();
+
+        stopwatch sw;
+        produce([&inbound](uint32_t i){inbound.push(i);});
+        double queued_ms = sw.elapsed_ms();
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (state.handled == total) {
+                    break;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        printf("%-28s %8zu msgs %10.2f ms queued, %.2f ms drained\n",
+                "batched per tick", total, queued_ms, sw.elapsed_ms());
+        driver.stop();
+        pool.stop();
+        print_stats("  drain ticks", driver.stats());
+    }
+
+    // a tick that needs 1.5 periods every tenth tick, and one long stall
+    {
+        io_service_pool pool(1, "logic_pool");
+        tick_driver driver(pool.get_io_service(), kTickRate);
+        std::atomic<uint32_t> ticks(0);
+        driver.set_tick_handler([&ticks](double dt){
+            uint32_t n = ++ticks;
+            if (n == 60) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            } else if (n % 10 == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(
+                            static_cast<int64_t>(dt * 1.5e6)));
+            }
+        });
+        pool.run();
+        driver.start();
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+        driver.stop();
+        pool.stop();
+        print_stats("slow ticks, 2 s", driver.stats());
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <engine/common/timer.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+
+static const std::size_t kTimerCount = 1000000;
+
+int main()
+{
+    std::mt19937 rng(20161018);
+    std::uniform_int_distribution<uint32_t> long_interval(1000, 600000);
+    std::uniform_int_distribution<uint32_t> short_interval(0, 500);
+    std::vector<timer_id> ids(kTimerCount);
+    std::size_t fired = 0;
+    auto callback = [&fired](){ ++fired; };
+
+    timer t;
+    {
+        stopwatch sw;
+        for (std::size_t i = 0; i < kTimerCount; ++i) {
+            ids[i] = t.add_task(long_interval(rng), TIMER_ONCE, callback);
+        }
+        report("add (cold slab)", kTimerCount, sw.elapsed_ms());
+    }
+
+    std::shuffle(ids.begin(), ids.end(), rng);
+    {
+        stopwatch sw;
+        for (std::size_t i = 0; i < kTimerCount; ++i) {
+            t.remove_task(ids[i]);
+        }
+        report("cancel", kTimerCount, sw.elapsed_ms());
+    }
+
+    {
+        stopwatch sw;
+        for (std::size_t i = 0; i < kTimerCount; ++i) {
+            t.remove_task(ids[i]);
+        }
+        report("cancel (stale id)", kTimerCount, sw.elapsed_ms());
+    }
+
+    {
+        stopwatch sw;
+        for (std::size_t i = 0; i < kTimerCount; ++i) {
+            ids[i] = t.add_task(long_interval(rng), TIMER_ONCE, callback);
+        }
+        report("add (warm slab)", kTimerCount, sw.elapsed_ms());
+    }
+
+    {
+        stopwatch sw;
+        for (std::size_t i = 0; i < kTimerCount; ++i) {
+            t.remove_task(ids[i]);
+            ids[i] = t.add_task(long_interval(rng), TIMER_ONCE, callback);
+        }
+        report("cancel + re-add churn", kTimerCount, sw.elapsed_ms());
+    }
+
+    for (std::size_t i = 0; i < kTimerCount; ++i) {
+        t.remove_task(ids[i]);
+    }
+
+    // fire churn: most timers are one shot buffs, every tenth one is a
+    // periodic cooldown tick that is reinserted in place on each firing
+    std::size_t circle_count = 0;
+    for (std::size_t i = 0; i < kTimerCount; ++i) {
+        if (i % 10 == 0) {
+            t.add_task(100, TIMER_CIRCLE, callback);
+            ++circle_count;
+        } else {
+            t.add_task(short_interval(rng), TIMER_ONCE, callback);
+        }
+    }
+
+    double detect_ms = 0;
+    stopwatch wall;
+    while (wall.elapsed_ms() < 1500) {
+        stopwatch sw;
+        t.detect_timer_list();
+        detect_ms += sw.elapsed_ms();
+        std::this_thread::sleep_for(std::chrono::milliseconds(GRANULARITY));
+    }
+    report("fire", fired, detect_ms);
+    printf("%-24s %10zu timers left (%zu periodic)\n", "after fire", t.size(), circle_count);
+
+    return 0;
+}
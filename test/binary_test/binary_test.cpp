@@ -0,0 +1,382 @@
+// round trips of binary_writer through binary_reader, over asio_buffers
+// large enough that values straddle their blocks
+
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <engine/net/binary_reader.h>
+#include <engine/net/binary_writer.h>
+#include "../any_test/test.hpp"
+
+namespace binary_tests
+{
+    typedef any_tests::test<const char *, void (*)()> test_case;
+    typedef const test_case * test_case_iterator;
+
+    extern const test_case_iterator begin, end;
+}
+
+int main()
+{
+    using namespace binary_tests;
+    any_tests::tester<test_case_iterator> test_suite(begin, end);
+    return test_suite() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+namespace binary_tests // test suite
+{
+    void test_fixed();
+    void test_varint();
+    void test_svarint();
+    void test_string();
+    void test_array();
+    void test_struct();
+    void test_backpatch_staged();
+    void test_backpatch_flushed();
+    void test_cross_block();
+    void test_truncated();
+    void test_malformed();
+    void test_oversized_count();
+
+    const test_case test_cases[] =
+    {
+        { "fixed values in both byte orders",   test_fixed             },
+        { "varint boundaries",                  test_varint            },
+        { "zigzag varints",                     test_svarint           },
+        { "strings around the stage size",      test_string            },
+        { "staged and bulk arrays",             test_array             },
+        { "nested structs and vectors",         test_struct            },
+        { "backpatch inside the stage",         test_backpatch_staged  },
+        { "backpatch of a flushed header",      test_backpatch_flushed },
+        { "peek_index and overwrite over blocks", test_cross_block     },
+        { "truncated message, rewind and retry", test_truncated        },
+        { "malformed varint and length",        test_malformed         },
+        { "count larger than the bytes left",   test_oversized_count   },
+    };
+
+    const test_case_iterator begin = test_cases;
+    const test_case_iterator end =
+        test_cases + (sizeof test_cases / sizeof *test_cases);
+}
+
+namespace binary_tests // test definitions
+{
+    using namespace any_tests;
+    using namespace engine;
+
+    struct point
+    {
+        int32_t                 x;
+        int32_t                 z;
+
+        template<typename FIELDS>
+        void fields(FIELDS& f) {f(x, z);}
+    };
+
+    struct path
+    {
+        uint32_t                id;
+        std::string             name;
+        std::vector<point>      points;
+        std::vector<uint16_t>   flags;
+
+        template<typename FIELDS>
+        void fields(FIELDS& f) {f(id, name, points, flags);}
+    };
+
+    // a string of len bytes that differ from their neighbours
+    std::string pattern(std::size_t len)
+    {
+        std::string str(len, 0);
+        for (std::size_t i = 0; i < len; ++i) {
+            str[i] = static_cast<char>(i * 7 + 1);
+        }
+        return str;
+    }
+
+    void test_fixed()
+    {
+        asio_buffer buffer;
+        {
+            binary_writer writer(buffer);
+            writer.write_fixed<uint16_t>(0x0102);
+            writer.write_fixed<uint32_t>(0x01020304, false);
+            writer.write_fixed<int64_t>(-2);
+            writer.write_fixed<double>(3.25, false);
+        }
+        check_equal(buffer.readable_bytes(), 2u + 4 + 8 + 8, "written bytes");
+        char first[2];
+        buffer.peek_index(0, first, sizeof first);
+        check_true(first[0] == 1 && first[1] == 2, "big endian on the wire");
+
+        binary_reader reader(buffer);
+        uint16_t u16;
+        uint32_t u32;
+        int64_t i64;
+        double d;
+        check_true(reader.read_fixed(u16) && reader.read_fixed(u32, false)
+                && reader.read_fixed(i64) && reader.read_fixed(d, false), "read");
+        check_equal(u16, 0x0102, "uint16_t");
+        check_equal(u32, 0x01020304u, "little endian uint32_t");
+        check_equal(i64, -2, "int64_t");
+        check_equal(d, 3.25, "little endian double");
+        check_equal(reader.remaining(), 0u, "nothing left");
+    }
+
+    void test_varint()
+    {
+        const uint64_t values[] = {0, 1, 127, 128, 16383, 16384,
+            (1ull << 32) - 1, 1ull << 63, std::numeric_limits<uint64_t>::max()};
+        const std::size_t sizes[] = {1, 1, 1, 2, 2, 3, 5, 10, 10};
+        asio_buffer buffer;
+        for (std::size_t i = 0; i < sizeof values / sizeof *values; ++i) {
+            std::size_t before = buffer.readable_bytes();
+            {
+                binary_writer writer(buffer);
+                writer.write_varint(values[i]);
+            }
+            check_equal(buffer.readable_bytes() - before, sizes[i], "varint size");
+        }
+        binary_reader reader(buffer);
+        for (uint64_t expected : values) {
+            uint64_t value;
+            check_true(reader.read_varint(value), "read varint");
+            check_equal(value, expected, "varint value");
+        }
+    }
+
+    void test_svarint()
+    {
+        const int64_t values[] = {0, -1, 1, -64, 64, std::numeric_limits<int64_t>::min(),
+            std::numeric_limits<int64_t>::max()};
+        asio_buffer buffer;
+        {
+            binary_writer writer(buffer);
+            for (int64_t value : values) {
+                writer.write_svarint(value);
+            }
+        }
+        check_equal(buffer.readable_bytes(), 1u + 1 + 1 + 1 + 2 + 10 + 10, "zigzag sizes");
+        binary_reader reader(buffer);
+        for (int64_t expected : values) {
+            int64_t value;
+            check_true(reader.read_svarint(value), "read svarint");
+            check_equal(value, expected, "svarint value");
+        }
+    }
+
+    void test_string()
+    {
+        const std::size_t lengths[] = {0, 1, binary_writer::kStageBytes - 1,
+            binary_writer::kStageBytes, binary_writer::kStageBytes + 1, 3000};
+        asio_buffer buffer;
+        {
+            binary_writer writer(buffer);
+            for (std::size_t len : lengths) {
+                writer.write_string(pattern(len));
+            }
+        }
+        binary_reader reader(buffer);
+        for (std::size_t len : lengths) {
+            std::string str;
+            check_true(reader.read_string(str), "read string");
+            check_equal(str, pattern(len), "string bytes");
+        }
+        check_equal(reader.remaining(), 0u, "nothing left");
+    }
+
+    void test_array()
+    {
+        std::vector<uint32_t> small(10);
+        std::vector<uint32_t> large(1000);
+        for (std::size_t i = 0; i < large.size(); ++i) {
+            large[i] = static_cast<uint32_t>(i * 0x01010101u);
+            if (i < small.size()) {
+                small[i] = static_cast<uint32_t>(~i);
+            }
+        }
+        asio_buffer buffer;
+        {
+            binary_writer writer(buffer);
+            writer.write_array(small.data(), small.size());
+            writer.write_array(large.data(), large.size(), false);
+        }
+        binary_reader reader(buffer);
+        std::vector<uint32_t> small_read(small.size());
+        std::vector<uint32_t> large_read(large.size());
+        check_true(reader.read_array(small_read.data(), small_read.size())
+                && reader.read_array(large_read.data(), large_read.size(), false), "read arrays");
+        check_true(small_read == small, "staged array");
+        check_true(large_read == large, "bulk array");
+    }
+
+    void test_struct()
+    {
+        path written;
+        written.id      = 42;
+        written.name    = pattern(300);
+        for (int32_t i = 0; i < 200; ++i) {
+            written.points.push_back(point{i, -i});
+            written.flags.push_back(static_cast<uint16_t>(i * 3));
+        }
+        asio_buffer buffer;
+        {
+            binary_writer writer(buffer);
+            writer.write(written).write(written);
+        }
+
+        binary_reader reader(buffer);
+        for (int round = 0; round < 2; ++round) {
+            path read;
+            check_true(reader.read(read), "read struct");
+            check_equal(read.id, written.id, "id");
+            check_equal(read.name, written.name, "name");
+            check_equal(read.points.size(), written.points.size(), "point count");
+            for (std::size_t i = 0; i < read.points.size(); ++i) {
+                check_true(read.points[i].x == written.points[i].x
+                        && read.points[i].z == written.points[i].z, "point");
+            }
+            check_true(read.flags == written.flags, "flags");
+        }
+        reader.commit();
+        check_equal(buffer.readable_bytes(), 0u, "commit retrieves what was read");
+    }
+
+    void test_backpatch_staged()
+    {
+        asio_buffer buffer;
+        {
+            binary_writer writer(buffer);
+            std::size_t at = writer.reserve<uint16_t>();
+            writer.write_string("joker");
+            writer.backpatch<uint16_t>(at, static_cast<uint16_t>(writer.offset() - at - 2));
+        }
+        binary_reader reader(buffer);
+        uint16_t length;
+        std::string body;
+        check_true(reader.read_fixed(length) && reader.read_string(body), "read");
+        check_equal(length, 6, "patched length");
+        check_equal(body, std::string("joker"), "body");
+    }
+
+    void test_backpatch_flushed()
+    {
+        // the header is flushed with the first stage and goes to the
+        // buffer through overwrite, a body of 3000 bytes spans blocks
+        asio_buffer buffer;
+        {
+            binary_writer writer(buffer);
+            writer.write_bytes("x", 1);
+            std::size_t at = writer.reserve<uint32_t>();
+            writer.write_string(pattern(3000));
+            writer.backpatch<uint32_t>(at, 0xa1b2c3d4u);
+        }
+        binary_reader reader(buffer);
+        char x;
+        uint32_t header;
+        std::string body;
+        check_true(reader.read_bytes(&x, 1) && reader.read_fixed(header)
+                && reader.read_string(body), "read");
+        check_equal(header, 0xa1b2c3d4u, "patched header");
+        check_equal(body, pattern(3000), "body");
+    }
+
+    void test_cross_block()
+    {
+        asio_buffer buffer;
+        std::string data = pattern(4000);
+        buffer.append(data);
+        // offsets count from the read position, move it off the block start
+        buffer.retrieve(100);
+        data.erase(0, 100);
+
+        const std::size_t at[] = {0, asio_buffer::kInitialSize - 103,
+            asio_buffer::kInitialSize - 100, 2 * asio_buffer::kInitialSize - 150, 3800};
+        for (std::size_t index : at) {
+            std::string peeked(90, 0);
+            buffer.peek_index(index, &peeked[0], peeked.size());
+            check_equal(peeked, data.substr(index, 90), "peek_index");
+
+            std::string patch = pattern(90 + index % 7).substr(index % 7);
+            buffer.overwrite(index, patch.data(), patch.size());
+            data.replace(index, patch.size(), patch);
+        }
+        std::string all(buffer.readable_bytes(), 0);
+        buffer.peek_index(0, &all[0], all.size());
+        check_equal(all, data, "whole buffer after overwrites");
+    }
+
+    void test_truncated()
+    {
+        path written;
+        written.id      = 7;
+        written.name    = "joker";
+        written.points.push_back(point{1, 2});
+        asio_buffer whole;
+        {
+            binary_writer writer(whole);
+            writer.write(written);
+        }
+        std::string bytes(whole.readable_bytes(), 0);
+        whole.peek_index(0, &bytes[0], bytes.size());
+
+        // the message arrives a byte at a time
+        asio_buffer buffer;
+        binary_reader reader(buffer);
+        path read;
+        for (std::size_t i = 0; i + 1 < bytes.size(); ++i) {
+            buffer.append(&bytes[i], 1);
+            check_false(reader.read(read), "read of a partial message");
+            check_true(reader.truncated(), "partial message is truncated");
+            reader.rewind();
+        }
+        buffer.append(&bytes[bytes.size() - 1], 1);
+        check_true(reader.read(read), "read of the whole message");
+        check_equal(read.id, 7u, "id");
+        check_equal(read.name, std::string("joker"), "name");
+        check_true(read.points.size() == 1 && read.points[0].z == 2, "points");
+    }
+
+    void test_malformed()
+    {
+        asio_buffer overlong;
+        std::string continued(11, static_cast<char>(0x80));
+        overlong.append(continued);
+        binary_reader overlong_reader(overlong);
+        uint64_t value;
+        check_false(overlong_reader.read_varint(value), "varint over 10 bytes");
+        check_false(overlong_reader.truncated(), "overlong varint is malformed");
+
+        asio_buffer too_long;
+        {
+            binary_writer writer(too_long);
+            writer.write_varint(binary_reader::kMaxLength + 1);
+            writer.write_bytes("abc", 3);
+        }
+        binary_reader too_long_reader(too_long);
+        std::string str;
+        check_false(too_long_reader.read_string(str), "string over kMaxLength");
+        check_false(too_long_reader.truncated(), "oversized length is malformed");
+    }
+
+    void test_oversized_count()
+    {
+        // a few bytes claim kMaxLength structs, nothing is allocated for them
+        asio_buffer buffer;
+        {
+            binary_writer writer(buffer);
+            writer.write_fixed<uint32_t>(1);
+            writer.write_string("joker");
+            writer.write_varint(binary_reader::kMaxLength);
+            writer.write_fixed<int32_t>(0);
+        }
+        binary_reader reader(buffer);
+        path read;
+        check_false(reader.read(read), "count larger than the bytes left");
+        check_true(reader.truncated(), "it may still be on its way");
+        check_equal(read.points.capacity(), 0u, "no element was allocated");
+    }
+}
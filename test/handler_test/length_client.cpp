@@ -4,6 +4,7 @@
 #include <third_party/g3log/g3log/g3log.hpp>
 #include <third_party/g3log/g3log/logworker.hpp>
 #include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/handler/length_field_prepender.h>
 #include <engine/net/client.h>
 #include <engine/net/endian.h>
 
@@ -20,15 +21,8 @@ public:
         LOGF(INFO, "echo client receive %s", str.c_str());
         std::string joker; 
         joker.append(std::to_string(rd_())).append(" fool jokers");
-        uint16_t len = adapte_endian<uint16_t>(static_cast<uint16_t>(joker.size() + 4), false);
-        data_block block(joker.size() + sizeof(uint16_t) + 2);
-        std::string test1 = "T", test2 = "E";
-        std::copy(test1.c_str(), test1.c_str() + test1.size(), block.data);
-        *(reinterpret_cast<uint16_t*>(block.data + 1)) = len;
-        std::copy(test2.c_str(), test2.c_str() + test2.size(), block.data + 3);
-        std::copy(joker.c_str(), joker.c_str() + joker.size(), block.data + 4);
-        write_data w_data(block);
-        auto response = new any(w_data);
+        // the prepender puts the length between "T" and "E"
+        auto response = new any(std::string("TE") + joker);
         ctx->fire_write(std::unique_ptr<any>(response));
     }
 private:
@@ -51,6 +45,7 @@ int main(int argc, char* argv[])
 
         c.set_init_handlers([](std::shared_ptr<session> session){
             session->add_handler("decoder", std::make_shared<length_field_base_frame_decoder>(1024, 1, 2, -3, 3, false))
+                ->add_handler("prepender", std::make_shared<length_field_prepender>(1, 2, -3, false))
                 ->add_handler("echo", std::make_shared<handler>());        
         });
 
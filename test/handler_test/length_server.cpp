@@ -3,6 +3,7 @@
 #include <third_party/g3log/g3log/g3log.hpp>
 #include <third_party/g3log/g3log/logworker.hpp>
 #include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/handler/length_field_prepender.h>
 #include <engine/net/server.h>
 
 using namespace engine;
@@ -16,14 +17,8 @@ public:
         read_data data = any_cast<read_data>(*msg);
         std::string str(data.data + 1, data.len - 1);
         LOGF(INFO, "echo server receive %s", str.c_str());
-        data_block block(str.size() + sizeof(uint16_t) + 2);
-        std::string test1 = "T", test2 = "E";
-        std::copy(test1.c_str(), test1.c_str() + test1.size(), block.data);
-        *(reinterpret_cast<uint16_t*>(block.data + 1)) = adapte_endian<uint16_t>(static_cast<uint16_t>(data.len + 3), false);
-        std::copy(test2.c_str(), test2.c_str() + test2.size(), block.data + 3);
-        std::copy(str.c_str(), str.c_str() + str.size(), block.data + 4);
-        write_data w_data(block);
-        auto response = new any(w_data);
+        // the prepender puts the length between "T" and "E"
+        auto response = new any(std::string("TE") + str);
         ctx->fire_write(std::unique_ptr<any>(response));
         //ctx->fire_write(std::move(msg));
     }
@@ -45,6 +40,7 @@ int main(int argc, char* argv[])
 
         s.set_init_handlers([](std::shared_ptr<session> session){
             session->add_handler("decoder", std::make_shared<length_field_base_frame_decoder>(1024, 1, 2, -3, 3, false))
+                ->add_handler("prepender", std::make_shared<length_field_prepender>(1, 2, -3, false))
                 ->add_handler("echo", std::make_shared<handler>());
         });
 
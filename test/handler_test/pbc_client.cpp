@@ -0,0 +1,109 @@
+#include <cstdio>
+
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <third_party/g3log/g3log/logworker.hpp>
+#include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/handler/pbc_codec.h>
+#include <engine/net/client.h>
+
+using namespace engine;
+using namespace g3;
+
+enum message_id
+{
+    LOGIN_REQUEST   = 1,
+    LOGIN_RESPONSE  = 2,
+    MOVE_REQUEST    = 3,
+    MOVE_SYNC       = 5,
+};
+
+class handler : public abstract_handler
+{
+public:
+    explicit handler(std::shared_ptr<pbc_registry> registry)
+        : registry_(registry)
+    {
+    }
+
+    virtual void connect(context* ctx)
+    {
+        pbc_out_message request;
+        request.id          = LOGIN_REQUEST;
+        request.wmessage    = registry_->new_wmessage(LOGIN_REQUEST);
+        pbc_wmessage_string(request.wmessage.get(), "account", "joker", 0);
+        pbc_wmessage_string(request.wmessage.get(), "token", "fool", 0);
+        ctx->fire_write(std::unique_ptr<any>(new any(request)));
+    }
+
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        pbc_message message = any_cast<pbc_message>(*msg);
+        if (message.id == MOVE_SYNC) {
+            LOGF(INFO, "pbc client move sync x = %f, z = %f",
+                    pbc_rmessage_real(message.rmessage, "x", 0),
+                    pbc_rmessage_real(message.rmessage, "z", 0));
+            return;
+        }
+        if (message.id != LOGIN_RESPONSE) {
+            return;
+        }
+        uint32_t hi = 0;
+        uint32_t lo = pbc_rmessage_integer(message.rmessage, "role_id", 0, &hi);
+        int64_t role_id = (static_cast<int64_t>(hi) << 32) | lo;
+        LOGF(INFO, "pbc client login result = %d, role_id = %lld",
+                pbc_rmessage_integer(message.rmessage, "result", 0, nullptr),
+                static_cast<long long>(role_id));
+
+        pbc_out_message move;
+        move.id         = MOVE_REQUEST;
+        move.wmessage   = registry_->new_wmessage(MOVE_REQUEST);
+        pbc_wmessage_integer(move.wmessage.get(), "role_id", lo, hi);
+        pbc_wmessage_real(move.wmessage.get(), "x", 1.5);
+        pbc_wmessage_real(move.wmessage.get(), "y", 0);
+        pbc_wmessage_real(move.wmessage.get(), "z", -3.25);
+        pbc_wmessage_integer(move.wmessage.get(), "speed", 5, 0);
+        ctx->fire_write(std::unique_ptr<any>(new any(move)));
+    }
+private:
+    std::shared_ptr<pbc_registry> registry_;
+};
+
+int main(int argc, char* argv[])
+{
+    try {
+        if (argc != 4) {
+            printf("Usage: pbc_client <host> <port> <game.pb> \n");
+            return 1;
+        }
+
+        std::unique_ptr<LogWorker> logworker{ LogWorker::createLogWorker() };
+        initializeLogging(logworker.get());
+
+        auto registry = std::make_shared<pbc_registry>();
+        if (!registry->load(argv[3])
+                || !registry->register_message(LOGIN_REQUEST, "game.login_request")
+                || !registry->register_message(LOGIN_RESPONSE, "game.login_response", false)
+                || !registry->register_message(MOVE_REQUEST, "game.move_request")
+                || !registry->register_message(MOVE_SYNC, "game.move_sync", false)) {
+            return 1;
+        }
+
+        client c(argv[1], atoi(argv[2]));
+
+        c.set_init_handlers([registry](std::shared_ptr<session> session){
+            session->add_handler("decoder", std::make_shared<length_field_base_frame_decoder>(1024, 0, 2, 0, 2))
+                ->add_handler("codec", std::make_shared<pbc_codec>(registry))
+                ->add_handler("handler", std::make_shared<handler>(registry));
+        });
+
+        c.run();
+
+        getchar();
+
+        c.stop();
+    } catch (std::exception& e) {
+        printf("exception: %s \n", e.what());
+    }
+
+    return 0;
+}
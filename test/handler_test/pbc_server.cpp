@@ -0,0 +1,104 @@
+#include <cstdio>
+
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <third_party/g3log/g3log/logworker.hpp>
+#include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/handler/pbc_codec.h>
+#include <engine/net/server.h>
+
+using namespace engine;
+using namespace g3;
+
+enum message_id
+{
+    LOGIN_REQUEST   = 1,
+    LOGIN_RESPONSE  = 2,
+    MOVE_REQUEST    = 3,
+};
+
+// layouts of the compiled patterns, slices and 8 byte fields first
+struct login_request
+{
+    pbc_slice   account;
+    pbc_slice   token;
+};
+
+struct move_request
+{
+    int64_t role_id;
+    float   x;
+    float   y;
+    float   z;
+    float   direction;
+    int32_t speed;
+    int32_t timestamp;
+};
+
+class handler : public abstract_handler
+{
+public:
+    explicit handler(std::shared_ptr<pbc_registry> registry)
+        : registry_(registry)
+    {
+    }
+
+    virtual void decode(context* ctx, std::unique_ptr<any> msg)
+    {
+        pbc_message message = any_cast<pbc_message>(*msg);
+        if (message.id == LOGIN_REQUEST) {
+            const login_request* login = static_cast<const login_request*>(message.data);
+            std::string account(static_cast<const char*>(login->account.buffer), login->account.len);
+            LOGF(INFO, "pbc server receive login %s", account.c_str());
+            pbc_out_message response;
+            response.id         = LOGIN_RESPONSE;
+            response.wmessage   = registry_->new_wmessage(LOGIN_RESPONSE);
+            pbc_wmessage_integer(response.wmessage.get(), "result", 0, 0);
+            pbc_wmessage_integer(response.wmessage.get(), "role_id", 10001, 0);
+            ctx->fire_write(std::unique_ptr<any>(new any(response)));
+        } else if (message.id == MOVE_REQUEST) {
+            const move_request* move = static_cast<const move_request*>(message.data);
+            LOGF(INFO, "pbc server receive move %lld (%f, %f, %f)",
+                    static_cast<long long>(move->role_id), move->x, move->y, move->z);
+        }
+    }
+private:
+    std::shared_ptr<pbc_registry> registry_;
+};
+
+int main(int argc, char* argv[])
+{
+    try {
+        if (argc != 3) {
+            printf("Usage: pbc_server <port> <game.pb> \n");
+            return 1;
+        }
+
+        std::unique_ptr<LogWorker> logworker{ LogWorker::createLogWorker() };
+        initializeLogging(logworker.get());
+
+        auto registry = std::make_shared<pbc_registry>();
+        if (!registry->load(argv[2])
+                || !registry->register_message(LOGIN_REQUEST, "game.login_request")
+                || !registry->register_message(LOGIN_RESPONSE, "game.login_response")
+                || !registry->register_message(MOVE_REQUEST, "game.move_request")) {
+            return 1;
+        }
+
+        server s("127.0.0.1", atoi(argv[1]), 10);
+
+        s.set_init_handlers([registry](std::shared_ptr<session> session){
+            session->add_handler("decoder", std::make_shared<length_field_base_frame_decoder>(1024, 0, 2, 0, 2))
+                ->add_handler("codec", std::make_shared<pbc_codec>(registry))
+                ->add_handler("handler", std::make_shared<handler>(registry));
+        });
+
+        s.run();
+
+        getchar();
+
+        s.stop();
+    } catch (std::exception& e) {
+        printf("Exception：%s \n", e.what());
+    }
+    return 0;
+}
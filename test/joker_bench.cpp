@@ -0,0 +1,499 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <third_party/asio/steady_timer.hpp>
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/handler/delimiter_based_frame_decoder.h>
+#include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/net/client_manager.h>
+#include <engine/net/endian.h>
+#include <test/benchmark/bench_util.h>
+
+using namespace bench_util;
+using namespace engine;
+
+typedef std::chrono::steady_clock clock_type;
+
+// frames of echo_server and length_server are at most this long
+static const std::size_t kMaxFrameLength = 1024;
+
+struct options
+{
+    std::string     host;
+    unsigned short  port            = 0;
+    std::string     scenario        = "echo";   // connect, echo, rate, pipeline, stream
+    std::string     proto           = "line";   // line: echo_server, length: length_server
+    std::size_t     connections     = 100;
+    std::size_t     threads         = 2;
+    double          duration        = 5.0;      // s
+    std::size_t     size            = 64;       // bytes per frame, framing included
+    std::size_t     depth           = 1;        // frames in flight per connection
+    double          rate            = 10000;    // frames/s over all connections, rate only
+};
+
+/**
+ * log linear latency histogram in microseconds. values below 64 are exact,
+ * above that every power of two is split into 32 buckets, so a reported
+ * percentile is at most about 3% off
+ */
+class latency_histogram
+{
+public:
+    static const std::size_t kSubBuckets    = 32;
+    static const std::size_t kBucketCount   = 64 * kSubBuckets;
+
+    latency_histogram()
+        : counts_(kBucketCount)
+        , total_(0)
+        , max_(0)
+    {
+    }
+
+    void record(uint64_t us)
+    {
+        counts_[index_of(us)].fetch_add(1, std::memory_order_relaxed);
+        total_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (us > max && !max_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+        }
+    }
+
+    uint64_t total() const
+    {
+        return total_;
+    }
+
+    uint64_t max() const
+    {
+        return max_;
+    }
+
+    uint64_t percentile(double p) const
+    {
+        uint64_t total = total_;
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+        rank = rank ? rank : 1;
+        uint64_t seen = 0;
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min<uint64_t>(upper_bound_of(i), max_);
+            }
+        }
+        return max_;
+    }
+private:
+    static std::size_t index_of(uint64_t us)
+    {
+        if (us < 2 * kSubBuckets) {
+            return static_cast<std::size_t>(us);
+        }
+        std::size_t shift = 63 - __builtin_clzll(us) - 5;
+        std::size_t index = kSubBuckets * shift + static_cast<std::size_t>(us >> shift);
+        return std::min(index, kBucketCount - 1);
+    }
+
+    static uint64_t upper_bound_of(std::size_t index)
+    {
+        if (index < 2 * kSubBuckets) {
+            return index;
+        }
+        std::size_t shift = index / kSubBuckets - 1;
+        return ((static_cast<uint64_t>(index - kSubBuckets * shift) + 1) << shift) - 1;
+    }
+private:
+    std::vector<std::atomic<uint64_t>>  counts_;
+    std::atomic<uint64_t>               total_;
+    std::atomic<uint64_t>               max_;
+}; // class latency_histogram
+
+static uint64_t to_us(clock_type::duration duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+// one frame of size bytes in the framing of the target server
+static std::string make_frame(const options& opts)
+{
+    std::string frame(opts.size, 'j');
+    if (opts.proto == "length") {
+        // 'T' | uint16 little endian frame length | 'E' | payload
+        frame[0] = 'T';
+        uint16_t len = adapte_endian<uint16_t>(static_cast<uint16_t>(opts.size), false);
+        memcpy(&frame[1], &len, sizeof len);
+        frame[3] = 'E';
+    } else {
+        frame[opts.size - 1] = '\n';
+    }
+    return frame;
+}
+
+/**
+ * state of one connection, touched only by its io thread. replies come
+ * back in order, so the send times of frames in flight form a queue
+ */
+class connection
+{
+public:
+    connection(std::shared_ptr<session> s)
+        : session_(s)
+        , timer_(s->work_service())
+    {
+    }
+
+    std::shared_ptr<session> get_session()
+    {
+        return session_;
+    }
+
+    asio::steady_timer& timer()
+    {
+        return timer_;
+    }
+
+    void send(const std::string& frames, std::size_t count, clock_type::time_point at)
+    {
+        for (std::size_t i = 0; i < count; ++i) {
+            inflight_.push_back(at);
+        }
+        session_->write(frames.data(), frames.size());
+    }
+
+    // send time of the oldest frame in flight
+    bool pop(clock_type::time_point& at)
+    {
+        if (inflight_.empty()) {
+            return false;
+        }
+        at = inflight_.front();
+        inflight_.pop_front();
+        return true;
+    }
+
+    std::size_t inflight() const
+    {
+        return inflight_.size();
+    }
+private:
+    std::shared_ptr<session>            session_;
+    asio::steady_timer                  timer_;
+    std::deque<clock_type::time_point>  inflight_;
+}; // class connection
+
+class bench
+{
+public:
+    explicit bench(const options& opts)
+        : opts_(opts)
+        , frame_(make_frame(opts))
+        , manager_(opts.threads)
+        , running_(false)
+        , sent_(0)
+        , received_(0)
+    {
+        for (std::size_t i = 0; i < (opts_.scenario == "pipeline" ? opts_.depth : 1); ++i) {
+            batch_ += frame_;
+        }
+    }
+
+    void run()
+    {
+        manager_.set_connect_timeout(static_cast<uint32_t>(opts_.duration * 1000));
+        manager_.set_init_handlers([this](std::shared_ptr<session> s){on_connect(s);});
+        manager_.run();
+
+        if (opts_.scenario == "connect") {
+            run_connect();
+        } else {
+            run_traffic();
+        }
+        manager_.stop();
+    }
+private:
+    void on_connect(std::shared_ptr<session> s)
+    {
+        connect_latency_.record(to_us(clock_type::now() - start_));
+        auto conn = std::make_shared<connection>(s);
+        if (opts_.proto == "length") {
+            s->add_handler("decoder", std::make_shared<length_field_base_frame_decoder>(
+                        kMaxFrameLength, 1, 2, -3, 3, false));
+        } else {
+            s->add_handler("decoder", std::make_shared<delimiter_based_frame_decoder>(
+                        kMaxFrameLength, "\n", false));
+        }
+        s->add_handler("reply", std::make_shared<reply_handler>(this, conn));
+        std::lock_guard<std::mutex> guard(mutex_);
+        connections_.push_back(conn);
+    }
+
+    class reply_handler : public abstract_handler
+    {
+    public:
+        reply_handler(bench* owner, const std::shared_ptr<connection>& conn)
+            : owner_(owner)
+            , conn_(conn)
+        {
+        }
+
+        virtual void decode(context* ctx, std::unique_ptr<any> msg)
+        {
+            auto conn = conn_.lock();
+            if (conn) {
+                owner_->on_reply(conn);
+            }
+        }
+    private:
+        bench*                      owner_;
+        std::weak_ptr<connection>   conn_;  // the connection owns the session
+    }; // class reply_handler
+
+    void on_reply(const std::shared_ptr<connection>& conn)
+    {
+        clock_type::time_point at;
+        if (!conn->pop(at)) {
+            return;
+        }
+        ++received_;
+        if (!running_) {
+            return;
+        }
+        latency_.record(to_us(clock_type::now() - at));
+        // closed loop scenarios refill the window, pipeline waits for the
+        // whole batch
+        if (opts_.scenario == "echo" || opts_.scenario == "stream") {
+            send(conn, frame_, 1);
+        } else if (opts_.scenario == "pipeline" && conn->inflight() == 0) {
+            send(conn, batch_, opts_.depth);
+        }
+    }
+
+    void send(const std::shared_ptr<connection>& conn, const std::string& frames,
+            std::size_t count)
+    {
+        conn->send(frames, count, clock_type::now());
+        sent_ += count;
+    }
+
+    // open loop, each connection sends at its share of the rate. latency
+    // is taken from the intended send time, so a stalled server is not
+    // hidden by the sender waiting for it
+    void schedule(std::shared_ptr<connection> conn, clock_type::time_point at,
+            clock_type::duration interval)
+    {
+        conn->timer().expires_at(at);
+        conn->timer().async_wait([this, conn, at, interval](std::error_code ec){
+            if (ec || !running_) {
+                return;
+            }
+            conn->send(frame_, 1, at);
+            ++sent_;
+            schedule(conn, at + interval, interval);
+        });
+    }
+
+    bool wait_connected(double seconds)
+    {
+        clock_type::time_point deadline = clock_type::now()
+            + std::chrono::microseconds(static_cast<int64_t>(seconds * 1e6));
+        while (manager_.connected_count() < opts_.connections) {
+            if (clock_type::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    void run_connect()
+    {
+        start_ = clock_type::now();
+        manager_.add_destination(opts_.host, opts_.port, opts_.connections);
+        wait_connected(opts_.duration);
+        double seconds = std::chrono::duration<double>(clock_type::now() - start_).count();
+        print(seconds, manager_.connected_count(), connect_latency_);
+    }
+
+    void run_traffic()
+    {
+        start_ = clock_type::now();
+        manager_.add_destination(opts_.host, opts_.port, opts_.connections);
+        if (!wait_connected(opts_.duration)) {
+            fprintf(stderr, "only %zu of %zu connections up\n",
+                    manager_.connected_count(), opts_.connections);
+        }
+
+        std::vector<std::shared_ptr<connection>> connections;
+        {
+            std::lock_guard<std::mutex> guard(mutex_);
+            connections = connections_;
+        }
+        running_ = true;
+        clock_type::time_point begin = clock_type::now();
+        clock_type::duration interval = std::chrono::microseconds(static_cast<int64_t>(
+                    1e6 * connections.size() / (opts_.rate > 0 ? opts_.rate : 1)));
+        for (std::size_t i = 0; i < connections.size(); ++i) {
+            auto conn = connections[i];
+            // spread the first sends of the open loop over one interval
+            clock_type::time_point first = begin + interval * i / connections.size();
+            conn->get_session()->work_service().post([this, conn, first, interval](){
+                if (opts_.scenario == "rate") {
+                    schedule(conn, first, interval);
+                } else if (opts_.scenario == "pipeline") {
+                    send(conn, batch_, opts_.depth);
+                } else {
+                    for (std::size_t n = 0; n < opts_.depth; ++n) {
+                        send(conn, frame_, 1);
+                    }
+                }
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(
+                    static_cast<int64_t>(opts_.duration * 1e6)));
+        running_ = false;
+        uint64_t received = received_;
+        double seconds = std::chrono::duration<double>(clock_type::now() - begin).count();
+        // let the frames in flight come back before counting errors
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        print(seconds, received, latency_);
+    }
+
+    void print(double seconds, uint64_t done, const latency_histogram& latency)
+    {
+        uint64_t sent = opts_.scenario == "connect" ? opts_.connections : sent_.load();
+        uint64_t lost = sent > received_ ? sent - received_ : 0;
+        printf("{\"scenario\":\"%s\",\"proto\":\"%s\",\"connections\":%zu,\"threads\":%zu,"
+                "\"size\":%zu,\"depth\":%zu,\"seconds\":%.3f,\"sent\":%llu,\"done\":%llu,"
+                "\"lost\":%llu,\"per_second\":%.1f,\"mb_per_second\":%.3f,"
+                "\"p50_us\":%llu,\"p99_us\":%llu,\"p999_us\":%llu,\"max_us\":%llu}\n",
+                opts_.scenario.c_str(), opts_.proto.c_str(), opts_.connections, opts_.threads,
+                opts_.size, opts_.depth, seconds,
+                static_cast<unsigned long long>(sent),
+                static_cast<unsigned long long>(done),
+                static_cast<unsigned long long>(opts_.scenario == "connect"
+                    ? opts_.connections - done : lost),
+                done / seconds,
+                opts_.scenario == "connect" ? 0.0 : done * opts_.size / seconds / 1024 / 1024,
+                static_cast<unsigned long long>(latency.percentile(50)),
+                static_cast<unsigned long long>(latency.percentile(99)),
+                static_cast<unsigned long long>(latency.percentile(99.9)),
+                static_cast<unsigned long long>(latency.max()));
+        fflush(stdout);
+    }
+private:
+    options                                     opts_;
+    std::string                                 frame_;
+    std::string                                 batch_;
+    client_manager                              manager_;
+    std::mutex                                  mutex_;
+    std::vector<std::shared_ptr<connection>>    connections_;
+    clock_type::time_point                      start_;
+    std::atomic_bool                            running_;
+    std::atomic<uint64_t>                       sent_;
+    std::atomic<uint64_t>                       received_;
+    latency_histogram                           latency_;
+    latency_histogram                           connect_latency_;
+}; // class bench
+
+static void usage()
+{
+    printf("Usage: joker_bench <host> <port> [--option=value ...]\n"
+           "  --scenario=echo      connect, echo, rate, pipeline or stream\n"
+           "  --proto=line         line for echo_server, length for length_server\n"
+           "  --connections=100    client sessions\n"
+           "  --threads=2          io threads shared by all sessions\n"
+           "  --duration=5         seconds of traffic, or the connect timeout\n"
+           "  --size=64            bytes per frame including framing, at most 1024,\n"
+           "                       1024 for stream\n"
+           "  --depth=1            frames in flight per session, the batch of pipeline,\n"
+           "                       16 for stream\n"
+           "  --rate=10000         frames per second over all sessions, rate only\n"
+           "every run prints one json line\n");
+}
+
+static bool parse(int argc, char* argv[], options& opts)
+{
+    if (argc < 3) {
+        return false;
+    }
+    opts.host = argv[1];
+    opts.port = static_cast<unsigned short>(atoi(argv[2]));
+    std::set<std::string> given;
+    for (int i = 3; i < argc; ++i) {
+        std::string arg = argv[i];
+        std::size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) {
+            return false;
+        }
+        std::string key = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        given.insert(key);
+        if (key == "scenario") {
+            opts.scenario = value;
+        } else if (key == "proto") {
+            opts.proto = value;
+        } else if (key == "connections") {
+            opts.connections = std::stoul(value);
+        } else if (key == "threads") {
+            opts.threads = std::stoul(value);
+        } else if (key == "duration") {
+            opts.duration = std::stod(value);
+        } else if (key == "size") {
+            opts.size = std::stoul(value);
+        } else if (key == "depth") {
+            opts.depth = std::stoul(value);
+        } else if (key == "rate") {
+            opts.rate = std::stod(value);
+        } else {
+            return false;
+        }
+    }
+    // stream defaults to full frames with a window of them in flight
+    if (opts.scenario == "stream") {
+        opts.size  = given.count("size") ? opts.size : kMaxFrameLength;
+        opts.depth = given.count("depth") ? opts.depth : 16;
+    }
+    std::size_t min_size = opts.proto == "length" ? 5 : 2;
+    return opts.size >= min_size && opts.size <= kMaxFrameLength
+        && opts.connections > 0 && opts.threads > 0 && opts.depth > 0
+        && (opts.proto == "line" || opts.proto == "length")
+        && (opts.scenario == "connect" || opts.scenario == "echo" || opts.scenario == "rate"
+                || opts.scenario == "pipeline" || opts.scenario == "stream");
+}
+
+int main(int argc, char* argv[])
+{
+    options opts;
+    try {
+        if (!parse(argc, argv, opts)) {
+            usage();
+            return 1;
+        }
+    } catch (std::exception& e) {
+        usage();
+        return 1;
+    }
+
+    std::unique_ptr<g3::LogWorker> logworker = null_logging();
+
+    try {
+        bench b(opts);
+        b.run();
+    } catch (std::exception& e) {
+        printf("exception: %s \n", e.what());
+        return 1;
+    }
+    return 0;
+}
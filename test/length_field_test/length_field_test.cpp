@@ -0,0 +1,371 @@
+// frames written by length_field_prepender into a session's write buffer
+// and read back by a length_field_base_frame_decoder of the same layout,
+// whole or one byte at a time
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <engine/handler/length_field_base_frame_decoder.h>
+#include <engine/handler/length_field_prepender.h>
+#include <engine/net/session.h>
+#include <test/benchmark/bench_util.h>
+#include "../any_test/test.hpp"
+
+namespace length_field_tests
+{
+    typedef any_tests::test<const char *, void (*)()> test_case;
+    typedef const test_case * test_case_iterator;
+
+    extern const test_case_iterator begin, end;
+}
+
+int main()
+{
+    using namespace length_field_tests;
+    std::unique_ptr<g3::LogWorker> logworker = bench_util::null_logging();
+    any_tests::tester<test_case_iterator> test_suite(begin, end);
+    return test_suite() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+namespace length_field_tests // test suite
+{
+    void test_layouts();
+    void test_byte_by_byte();
+    void test_empty_body();
+    void test_batch();
+    void test_over_max();
+    void test_field_overflow();
+    void test_negative_adjustment();
+
+    const test_case test_cases[] =
+    {
+        { "round trip of every layout",             test_layouts             },
+        { "frames delivered one byte at a time",    test_byte_by_byte        },
+        { "frames of an empty body",                test_empty_body          },
+        { "a batch keeps its frames in order",      test_batch               },
+        { "a frame over max is never delivered",    test_over_max            },
+        { "a body too long for its field is dropped", test_field_overflow    },
+        { "negative adjustments, partial delivery", test_negative_adjustment },
+    };
+
+    const test_case_iterator begin = test_cases;
+    const test_case_iterator end =
+        test_cases + (sizeof test_cases / sizeof *test_cases);
+}
+
+namespace length_field_tests // test definitions
+{
+    using namespace any_tests;
+    using namespace engine;
+
+    struct layout
+    {
+        uint32_t    offset;
+        uint32_t    length;
+        int32_t     adjustment;
+        uint32_t    strip;
+        bool        big_endian;
+    };
+
+    // the layouts of the decoder's doc comment, and wider fields
+    const layout kLayouts[] =
+    {
+        {0, 2,  0, 0, true},
+        {0, 2,  0, 2, true},
+        {0, 2, -2, 0, true},
+        {2, 2,  0, 0, true},
+        {0, 2,  2, 0, true},
+        {1, 2,  1, 3, true},
+        {1, 2, -3, 3, true},
+        {0, 1,  0, 1, true},
+        {3, 4, -7, 0, false},
+        {0, 8,  0, 8, true},
+    };
+
+    // keeps a copy of every frame it is handed
+    class frame_sink : public abstract_handler
+    {
+    public:
+        virtual void decode(context* ctx, std::unique_ptr<any> msg)
+        {
+            const read_data& frame = *any_cast<read_data>(msg.get());
+            frames.push_back(std::string(frame.data, frame.len));
+        }
+
+        std::vector<std::string> frames;
+    };
+
+    // a string of len bytes that differ from their neighbours
+    std::string pattern(std::size_t len, std::size_t seed)
+    {
+        std::string str(len, 0);
+        for (std::size_t i = 0; i < len; ++i) {
+            str[i] = static_cast<char>(i * 7 + seed);
+        }
+        return str;
+    }
+
+    // the frame of message as the prepender should write it, built here
+    // byte by byte rather than through the encoder
+    std::string frame_of(const layout& l, const std::string& message)
+    {
+        uint64_t value = message.size() - l.offset - l.adjustment;
+        std::string field(l.length, 0);
+        for (uint32_t i = 0; i < l.length; ++i) {
+            uint32_t shift = 8 * (l.big_endian ? l.length - 1 - i : i);
+            field[i] = static_cast<char>(value >> shift);
+        }
+        return message.substr(0, l.offset) + field + message.substr(l.offset);
+    }
+
+    // messages of layout l around and over the buffer's block size
+    std::vector<std::string> messages_of(const layout& l)
+    {
+        std::vector<std::string> messages;
+        const std::size_t kSizes[] = {0, 1, 12, 255, 1000, 5000};
+        for (std::size_t i = 0; i < sizeof kSizes / sizeof *kSizes; ++i) {
+            std::size_t len = l.offset + kSizes[i];
+            if (l.adjustment > 0 && kSizes[i] < static_cast<std::size_t>(l.adjustment)) {
+                continue;
+            }
+            if (l.length == 1 && len - l.offset - l.adjustment > 0xff) {
+                continue;
+            }
+            messages.push_back(pattern(len, i + 1));
+        }
+        return messages;
+    }
+
+    // what the prepender wrote to a session that never sends it
+    class encoder
+    {
+    public:
+        explicit encoder(const layout& l)
+            : session_(std::make_shared<session>(1, io_service_, io_service_))
+            , pipeline_(session_.get())
+            , prepender_(std::make_shared<length_field_prepender>(
+                        l.offset, l.length, l.adjustment, l.big_endian))
+            , ctx_(&pipeline_, "prepender", prepender_)
+        {
+        }
+
+        ~encoder()
+        {
+            io_service_.poll();
+        }
+
+        void encode(const std::string& message)
+        {
+            read_data body;
+            body.data   = message.data();
+            body.len    = message.size();
+            prepender_->encode(&ctx_, std::unique_ptr<any>(new any(body)));
+        }
+
+        void encode(const std::vector<std::string>& messages)
+        {
+            std::vector<read_data> bodies(messages.size());
+            for (std::size_t i = 0; i < messages.size(); ++i) {
+                bodies[i].data  = messages[i].data();
+                bodies[i].len   = messages[i].size();
+            }
+            prepender_->encode(&ctx_, std::unique_ptr<any>(new any(bodies)));
+        }
+
+        std::string written()
+        {
+            std::shared_ptr<asio_buffer> buffer = session_->write_buffer();
+            std::string bytes(buffer->readable_bytes(), 0);
+            if (!bytes.empty()) {
+                buffer->peek_index(0, &bytes[0], bytes.size());
+            }
+            return bytes;
+        }
+
+    private:
+        asio::io_service                        io_service_;
+        std::shared_ptr<session>                session_;
+        pipeline                                pipeline_;
+        std::shared_ptr<length_field_prepender> prepender_;
+        context                                 ctx_;
+    };
+
+    // a decoder on a pipeline of no session, fed as the read path does
+    class decoder
+    {
+    public:
+        decoder(const layout& l, uint32_t max_frame_length = 1 << 20)
+            : pipeline_(nullptr)
+            , sink_(std::make_shared<frame_sink>())
+            , decoder_ctx_(&pipeline_, "decoder", std::make_shared<length_field_base_frame_decoder>(
+                        max_frame_length, l.offset, l.length, l.adjustment, l.strip, l.big_endian))
+            , sink_ctx_(&pipeline_, "sink", sink_)
+            , buffer_(std::make_shared<asio_buffer>())
+        {
+            decoder_ctx_.next   = &sink_ctx_;
+            sink_ctx_.prev      = &decoder_ctx_;
+        }
+
+        void feed(const std::string& stream, std::size_t segment)
+        {
+            for (std::size_t offset = 0; offset < stream.size(); offset += segment) {
+                buffer_->append(stream.data() + offset, std::min(segment, stream.size() - offset));
+                decoder_ctx_.read(std::unique_ptr<any>(new any(buffer_)));
+            }
+        }
+
+        const std::vector<std::string>& frames() const
+        {
+            return sink_->frames;
+        }
+
+        std::size_t readable_bytes() const
+        {
+            return buffer_->readable_bytes();
+        }
+
+    private:
+        pipeline                        pipeline_;
+        std::shared_ptr<frame_sink>     sink_;
+        context                         decoder_ctx_;
+        context                         sink_ctx_;
+        std::shared_ptr<asio_buffer>    buffer_;
+    };
+
+    // encodes messages one by one, checks the bytes against frame_of and
+    // decodes them fed in segments of segment bytes
+    void round_trip(const layout& l, const std::vector<std::string>& messages,
+            std::size_t segment)
+    {
+        encoder out(l);
+        std::string expected;
+        for (auto& message : messages) {
+            out.encode(message);
+            expected += frame_of(l, message);
+        }
+        std::string stream = out.written();
+        check_true(stream == expected, "the prepender's bytes");
+
+        decoder in(l);
+        in.feed(stream, segment);
+        check_equal(in.frames().size(), messages.size(), "decoded frames");
+        for (std::size_t i = 0; i < messages.size(); ++i) {
+            check_true(in.frames()[i] == frame_of(l, messages[i]).substr(l.strip),
+                    "decoded frame");
+        }
+        check_equal(in.readable_bytes(), 0u, "bytes left in the read buffer");
+    }
+
+    void test_layouts()
+    {
+        for (auto& l : kLayouts) {
+            round_trip(l, messages_of(l), 1 << 20);
+            round_trip(l, messages_of(l), 4096);
+        }
+    }
+
+    void test_byte_by_byte()
+    {
+        for (auto& l : kLayouts) {
+            round_trip(l, messages_of(l), 1);
+        }
+    }
+
+    void test_empty_body()
+    {
+        const layout kEmpty[] =
+        {
+            {0, 2,  0, 0, true},
+            {0, 2,  0, 2, true},
+            {0, 4, -4, 4, true},
+        };
+        for (auto& l : kEmpty) {
+            std::vector<std::string> messages(3);
+            messages[1] = "x";
+            round_trip(l, messages, 1);
+        }
+
+        encoder out(kEmpty[0]);
+        out.encode(std::string());
+        check_true(out.written() == std::string(2, 0), "an empty body is a zero length field");
+    }
+
+    void test_batch()
+    {
+        const layout& l = kLayouts[6];
+        std::vector<std::string> messages = messages_of(l);
+        encoder out(l);
+        out.encode(messages);
+        std::string expected;
+        for (auto& message : messages) {
+            expected += frame_of(l, message);
+        }
+        check_true(out.written() == expected, "the batch's bytes");
+    }
+
+    void test_over_max()
+    {
+        const layout l = {0, 2, 0, 2, true};
+        std::string stream = frame_of(l, "first") + frame_of(l, pattern(100, 1))
+            + frame_of(l, "after");
+        const std::size_t kSegments[] = {1, 1 << 20};
+        for (auto segment : kSegments) {
+            decoder in(l, 64);
+            in.feed(stream, segment);
+            check_equal(in.frames().size(), 1u, "frames before the long one");
+            check_true(in.frames()[0] == "first", "the frame before the long one");
+            check_true(in.readable_bytes() > 0, "the long frame is left in the buffer");
+        }
+    }
+
+    void test_field_overflow()
+    {
+        const layout l = {0, 1, 0, 1, true};
+        std::vector<std::string> messages;
+        messages.push_back("a");
+        messages.push_back(pattern(300, 1));
+        messages.push_back("b");
+        messages.push_back(std::string());
+
+        encoder out(l);
+        out.encode(messages);
+        out.encode(pattern(256, 2));
+        std::string expected = frame_of(l, "a") + frame_of(l, "b") + frame_of(l, "");
+        check_true(out.written() == expected, "only the bodies that fit are written");
+
+        // a body shorter than the offset has no place for the field
+        const layout offset = {2, 2, 0, 0, true};
+        encoder short_body(offset);
+        short_body.encode("x");
+        check_equal(short_body.written().size(), 0u, "a body shorter than the offset");
+    }
+
+    void test_negative_adjustment()
+    {
+        const layout kNegative[] =
+        {
+            {0, 2, -2, 0, true},
+            {0, 2, -2, 2, true},
+            {1, 2, -3, 3, true},
+            {1, 2, -3, 1, false},
+            {3, 4, -7, 0, false},
+        };
+        for (auto& l : kNegative) {
+            std::vector<std::string> messages = messages_of(l);
+            for (std::size_t segment = 1; segment < 8; ++segment) {
+                round_trip(l, messages, segment);
+            }
+        }
+
+        // a field smaller than its own bytes can never be decoded
+        const layout l = {0, 2, -2, 0, true};
+        std::string stream("\x00\x01", 2);
+        stream += "after";
+        decoder in(l);
+        in.feed(stream, 1);
+        check_equal(in.frames().size(), 0u, "frames of a field below its own length");
+    }
+}
@@ -0,0 +1,392 @@
+// client messages through a route server and its links to a backend whose
+// route_backend_handler hands them to the lua logic as virtual sessions
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <third_party/asio/steady_timer.hpp>
+#include <third_party/g3log/g3log/g3log.hpp>
+#include <engine/handler/route_backend_handler.h>
+#include <engine/handler/route_handler.h>
+#include <engine/net/net_manager.h>
+#include <engine/net/router.h>
+#include <engine/net/server.h>
+#include <test/benchmark/bench_util.h>
+#include "../any_test/test.hpp"
+
+namespace route_tests
+{
+    typedef any_tests::test<const char *, void (*)()> test_case;
+    typedef const test_case * test_case_iterator;
+
+    extern const test_case_iterator begin, end;
+}
+
+namespace route_tests // lua logic
+{
+    using namespace engine;
+
+    const uint32_t kLoginRequest    = 1;
+    const uint32_t kLoginResponse   = 2;
+
+    // every login is answered with the session id it came from, a login of
+    // account "bye" closes its session instead
+    const char* kLogic =
+        "connects = 0\n"
+        "cleans = 0\n"
+        "function on_connect(session_id) connects = connects + 1 end\n"
+        "function on_passive_clean(session_id) cleans = cleans + 1 end\n"
+        "function on_message(session_id, msg_id, msg)\n"
+        "    if msg.account == 'bye' then\n"
+        "        close_connection(session_id)\n"
+        "        return\n"
+        "    end\n"
+        "    write_pbc_message(session_id, 2, {result = 0, role_id = session_id})\n"
+        "end\n";
+
+    bool load_logic()
+    {
+        std::shared_ptr<pbc_registry> registry = net_manager::get_pbc_registry();
+        if (!registry->load(ROUTE_TEST_PROTO)
+                || !registry->register_message(kLoginRequest, "game.login_request")
+                || !registry->register_message(kLoginResponse, "game.login_response")) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(net_manager::mutex());
+        return luaL_dostring(net_manager::get_lua_state(), kLogic) == 0;
+    }
+
+    lua_Integer lua_counter(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(net_manager::mutex());
+        lua_State* L = net_manager::get_lua_state();
+        lua_getglobal(L, name);
+        lua_Integer value = lua_tointeger(L, -1);
+        lua_pop(L, 1);
+        return value;
+    }
+
+    // the counter reaches value within a second
+    bool wait_counter(const char* name, lua_Integer value)
+    {
+        for (int i = 0; i < 100 && lua_counter(name) != value; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return lua_counter(name) == value;
+    }
+}
+
+int main()
+{
+    using namespace route_tests;
+    std::unique_ptr<g3::LogWorker> logworker = bench_util::null_logging();
+    net_manager::init();
+    if (!load_logic()) {
+        printf("route_test: loading %s or the logic failed\n", ROUTE_TEST_PROTO);
+        return EXIT_FAILURE;
+    }
+    any_tests::tester<test_case_iterator> test_suite(begin, end);
+    bool passed = test_suite();
+    net_manager::close();
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+namespace route_tests // test suite
+{
+    void test_round_trip();
+    void test_clients();
+    void test_close_connection();
+    void test_link_closed();
+
+    const test_case test_cases[] =
+    {
+        { "a login round trips through the route and the backend", test_round_trip },
+        { "each client behind a link is a session of its own",  test_clients          },
+        { "close_connection ends a virtual session",            test_close_connection },
+        { "the virtual sessions close with their links",        test_link_closed      },
+    };
+
+    const test_case_iterator begin = test_cases;
+    const test_case_iterator end =
+        test_cases + (sizeof test_cases / sizeof *test_cases);
+}
+
+namespace route_tests // test definitions
+{
+    using namespace any_tests;
+
+    const uint32_t kBackendId       = 7;
+    const uint32_t kMaxFrameLength  = 64 * 1024;
+    unsigned short next_port        = 18795;
+
+    // client -> route -> links -> backend, and back through the route
+    class topology
+    {
+    public:
+        topology()
+            : backend_port_(next_port++)
+            , route_port_(next_port++)
+            , backend_("127.0.0.1", backend_port_, 2)
+            , route_("127.0.0.1", route_port_, 2)
+            , links_(2)
+        {
+            std::shared_ptr<pbc_registry> registry = net_manager::get_pbc_registry();
+            backend_.set_init_handlers([registry](std::shared_ptr<session> session){
+                session->add_handler("route", std::make_shared<route_backend_handler>(kMaxFrameLength,
+                            kBackendId, registry, true, [](pipeline& client){
+                                client.add_handler("logic", std::make_shared<logic_handler>());
+                            }));
+            });
+            route_.set_init_handlers([this](std::shared_ptr<session> session){
+                session->add_handler("route", std::make_shared<route_handler>(kMaxFrameLength,
+                            [this](context*, uint32_t destination, uint32_t source,
+                                std::shared_ptr<data_block> frame){
+                                links_.forward(destination, source, frame);
+                            }, true));
+            });
+            links_.set_init_handlers([this](std::shared_ptr<session> session){
+                session->add_handler("route", std::make_shared<route_handler>(kMaxFrameLength,
+                            [this](context*, uint32_t destination, uint32_t,
+                                std::shared_ptr<data_block> frame){
+                                route_.write_shared(destination, frame);
+                            }, false));
+            });
+            links_.add_backend(kBackendId, "127.0.0.1", backend_port_, 2);
+            backend_.run();
+            links_.run();
+            route_.run();
+            for (int i = 0; i < 200 && links_.connected_links() < 2; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            check_equal(links_.connected_links(), 2u, "connected links");
+        }
+
+        ~topology()
+        {
+            stop_links();
+            route_.stop();
+            backend_.stop();
+        }
+
+        unsigned short route_port() const
+        {
+            return route_port_;
+        }
+
+        void stop_links()
+        {
+            if (!links_stopped_) {
+                links_stopped_ = true;
+                links_.stop();
+            }
+        }
+    private:
+        // what main puts behind the codec of a GAME session
+        class logic_handler : public abstract_handler
+        {
+        public:
+            virtual void connect(context* ctx)
+            {
+                net_manager::on_connect(ctx);
+            }
+
+            virtual void decode(context* ctx, std::unique_ptr<any> msg)
+            {
+                net_manager::on_message(ctx->session_id(), *any_cast<pbc_message>(msg.get()));
+            }
+
+            virtual void notify_closed(context* ctx)
+            {
+                net_manager::on_passive_clean(ctx->session_id());
+            }
+        }; // class logic_handler
+
+        unsigned short  backend_port_;
+        unsigned short  route_port_;
+        server          backend_;
+        server          route_;
+        router          links_;
+        bool            links_stopped_ = false;
+    }; // class topology
+
+    struct reply
+    {
+        uint32_t    destination;
+        uint32_t    source;
+        uint32_t    msg_id;
+        int64_t     role_id;
+    };
+
+    class client
+    {
+    public:
+        explicit client(unsigned short port)
+            : socket_(io_service_)
+        {
+            socket_.connect(tcp::endpoint(asio::ip::address_v4::from_string("127.0.0.1"), port));
+        }
+
+        void login(const std::string& account)
+        {
+            std::shared_ptr<pbc_wmessage> wmessage =
+                net_manager::get_pbc_registry()->new_wmessage(kLoginRequest);
+            pbc_wmessage_string(wmessage.get(), "account", account.c_str(),
+                    static_cast<int>(account.size()));
+            struct pbc_slice slice;
+            pbc_wmessage_buffer(wmessage.get(), &slice);
+
+            std::vector<char> frame(route_handler::kHeaderLength + sizeof(uint16_t) + slice.len);
+            route_handler::write_header(&frame[0], kBackendId, 0, frame.size() - route_handler::kHeaderLength);
+            pbc_codec::write_header(&frame[route_handler::kHeaderLength], kLoginRequest, slice.len, 0, true);
+            memcpy(&frame[route_handler::kHeaderLength + sizeof(uint16_t)], slice.buffer, slice.len);
+            asio::write(socket_, asio::buffer(frame));
+        }
+
+        // a login response within two seconds
+        bool receive(reply& result)
+        {
+            char header[route_handler::kHeaderLength];
+            if (!read(header, sizeof header)) {
+                return false;
+            }
+            result.destination  = adapte_endian<uint32_t>(
+                    *reinterpret_cast<uint32_t*>(header + route_handler::kDestinationOffset), true);
+            result.source       = adapte_endian<uint32_t>(
+                    *reinterpret_cast<uint32_t*>(header + route_handler::kSourceOffset), true);
+            std::size_t length  = adapte_endian<uint32_t>(*reinterpret_cast<uint32_t*>(header), true)
+                - (route_handler::kHeaderLength - sizeof(uint32_t));
+            std::vector<char> payload(length);
+            if (length < sizeof(uint16_t) || !read(&payload[0], length)) {
+                return false;
+            }
+            result.msg_id = adapte_endian<uint16_t>(*reinterpret_cast<uint16_t*>(&payload[0]), true);
+
+            struct pbc_slice slice;
+            slice.buffer    = &payload[sizeof(uint16_t)];
+            slice.len       = static_cast<int>(length - sizeof(uint16_t));
+            pbc_rmessage* message = pbc_rmessage_new(net_manager::get_pbc_registry()->env(),
+                    "game.login_response", &slice);
+            if (!message) {
+                return false;
+            }
+            uint32_t hi = 0;
+            uint32_t lo = pbc_rmessage_integer(message, "role_id", 0, &hi);
+            result.role_id = (static_cast<int64_t>(hi) << 32) | lo;
+            pbc_rmessage_delete(message);
+            return true;
+        }
+
+        // nothing arrives within 200 ms
+        bool quiet()
+        {
+            char byte;
+            return !read(&byte, 1, std::chrono::milliseconds(200));
+        }
+    private:
+        bool read(char* data, std::size_t len,
+                std::chrono::milliseconds timeout = std::chrono::milliseconds(2000))
+        {
+            std::error_code result = asio::error::timed_out;
+            asio::steady_timer timer(io_service_, timeout);
+            timer.async_wait([this](const std::error_code& ec){
+                if (!ec) {
+                    socket_.cancel();
+                }
+            });
+            asio::async_read(socket_, asio::buffer(data, len),
+                    [&result, &timer](const std::error_code& ec, std::size_t){
+                        result = ec;
+                        timer.cancel();
+                    });
+            io_service_.reset();
+            io_service_.run();
+            return !result;
+        }
+
+        asio::io_service    io_service_;
+        tcp::socket         socket_;
+    }; // class client
+
+    void test_round_trip()
+    {
+        topology route;
+        lua_Integer connects = lua_counter("connects");
+        client player(route.route_port());
+        reply first;
+        reply second;
+        player.login("joker");
+        check_true(player.receive(first), "first reply");
+        player.login("joker");
+        check_true(player.receive(second), "second reply");
+
+        check_equal(first.msg_id, kLoginResponse, "reply message id");
+        check_equal(first.source, kBackendId, "reply Source is the backend");
+        check_true(first.destination != 0, "reply Destination is the client's route session");
+        check_equal(second.destination, first.destination, "same route session");
+        check_true(first.role_id != 0, "virtual session id");
+        check_equal(second.role_id, first.role_id, "one virtual session for one client");
+        check_equal(lua_counter("connects"), connects + 1, "one on_connect");
+    }
+
+    void test_clients()
+    {
+        topology route;
+        lua_Integer connects = lua_counter("connects");
+        client first(route.route_port());
+        client second(route.route_port());
+        reply first_reply;
+        reply second_reply;
+        first.login("first");
+        second.login("second");
+        check_true(first.receive(first_reply), "first client's reply");
+        check_true(second.receive(second_reply), "second client's reply");
+
+        check_true(first_reply.destination != second_reply.destination, "route sessions differ");
+        check_true(first_reply.role_id != second_reply.role_id, "virtual sessions differ");
+        check_true(first.quiet() && second.quiet(), "no reply to the other client");
+        check_equal(lua_counter("connects"), connects + 2, "one on_connect per client");
+    }
+
+    void test_close_connection()
+    {
+        topology route;
+        lua_Integer connects = lua_counter("connects");
+        lua_Integer cleans = lua_counter("cleans");
+        client player(route.route_port());
+        reply before;
+        reply after;
+        player.login("joker");
+        check_true(player.receive(before), "reply before the close");
+        player.login("bye");
+        check_true(player.quiet(), "no reply to bye");
+
+        // the closed session is let go of on the next frame of the link
+        player.login("joker");
+        check_true(player.receive(after), "reply after the close");
+        check_true(after.role_id != before.role_id, "a new virtual session");
+        check_true(wait_counter("cleans", cleans + 1), "on_passive_clean of the closed session");
+        check_equal(lua_counter("connects"), connects + 2, "on_connect of the new session");
+    }
+
+    void test_link_closed()
+    {
+        topology route;
+        lua_Integer cleans = lua_counter("cleans");
+        client first(route.route_port());
+        client second(route.route_port());
+        reply result;
+        first.login("first");
+        check_true(first.receive(result), "first client's reply");
+        second.login("second");
+        check_true(second.receive(result), "second client's reply");
+
+        route.stop_links();
+        check_true(wait_counter("cleans", cleans + 2), "on_passive_clean of both clients");
+    }
+}
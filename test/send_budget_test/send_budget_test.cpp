@@ -0,0 +1,254 @@
+// send budgets of a session connected to a peer that reads only when told
+// to: the byte accounting, each overflow policy, the hard limit and the
+// process wide limit
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <engine/handler/pipeline.h>
+#include <engine/net/send_budget.h>
+#include <engine/net/session.h>
+#include <test/benchmark/bench_util.h>
+#include "../any_test/test.hpp"
+
+namespace send_budget_tests
+{
+    typedef any_tests::test<const char *, void (*)()> test_case;
+    typedef const test_case * test_case_iterator;
+
+    extern const test_case_iterator begin, end;
+}
+
+int main()
+{
+    using namespace send_budget_tests;
+    std::unique_ptr<g3::LogWorker> logworker = bench_util::null_logging();
+    any_tests::tester<test_case_iterator> test_suite(begin, end);
+    return test_suite() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+namespace send_budget_tests // test suite
+{
+    void test_accounting();
+    void test_pause();
+    void test_drop_oldest();
+    void test_disconnect();
+    void test_hard_limit();
+    void test_process_limit();
+
+    const test_case test_cases[] =
+    {
+        { "pending bytes of the session and the process", test_accounting    },
+        { "a paused producer resumes at low water",       test_pause         },
+        { "the oldest droppable messages are dropped",    test_drop_oldest   },
+        { "a disconnect aborts and appends no more",      test_disconnect    },
+        { "the hard limit aborts whatever the policy",    test_hard_limit    },
+        { "the process limit aborts the session over it", test_process_limit },
+    };
+
+    const test_case_iterator begin = test_cases;
+    const test_case_iterator end =
+        test_cases + (sizeof test_cases / sizeof *test_cases);
+}
+
+namespace send_budget_tests // test definitions
+{
+    using namespace any_tests;
+    using namespace engine;
+    using asio::ip::tcp;
+
+    send_budget make_budget(std::size_t high, std::size_t low, std::size_t hard,
+            send_overflow_policy policy)
+    {
+        send_budget budget;
+        budget.high_water_mask  = high;
+        budget.low_water_mask   = low;
+        budget.hard_limit       = hard;
+        budget.policy           = policy;
+        return budget;
+    }
+
+    // a session whose writes only reach the socket when the io_service is
+    // polled, its peer reads when read_peer is called
+    class harness
+    {
+    public:
+        explicit harness(const send_budget& budget)
+            : acceptor_(io_service_, tcp::endpoint(asio::ip::address_v4::loopback(), 0))
+            , peer_(io_service_)
+            , session_(std::make_shared<session>(1, io_service_, io_service_))
+            , pipeline_(session_.get())
+        {
+            session_->socket().connect(acceptor_.local_endpoint());
+            acceptor_.accept(peer_);
+            session_->set_send_budget(budget, [this](std::shared_ptr<session>, bool paused){
+                pauses.push_back(paused);
+            });
+        }
+
+        ~harness()
+        {
+            poll();
+        }
+
+        void write(char fill, std::size_t len, bool droppable = false)
+        {
+            std::string bytes(len, fill);
+            if (droppable) {
+                droppable_data data;
+                data.block = std::make_shared<data_block>(bytes.data(), bytes.size());
+                pipeline_.write(std::unique_ptr<any>(new any(data)));
+            } else {
+                read_data data;
+                data.data   = bytes.data();
+                data.len    = bytes.size();
+                pipeline_.write(std::unique_ptr<any>(new any(data)));
+            }
+        }
+
+        void poll()
+        {
+            io_service_.poll();
+            io_service_.reset();
+        }
+
+        // runs the io_service until nothing is pending, the peer's socket
+        // buffer holds far more than a test writes
+        void drain()
+        {
+            for (int i = 0; i < 200 && session_->pending_write_bytes() > 0; ++i) {
+                poll();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            poll();
+        }
+
+        std::string read_peer(std::size_t len)
+        {
+            std::string bytes(len, 0);
+            asio::read(peer_, asio::buffer(&bytes[0], len));
+            return bytes;
+        }
+
+        std::shared_ptr<session> target()
+        {
+            return session_;
+        }
+
+        std::vector<bool>   pauses;
+    private:
+        asio::io_service            io_service_;
+        tcp::acceptor               acceptor_;
+        tcp::socket                 peer_;
+        std::shared_ptr<session>    session_;
+        pipeline                    pipeline_;
+    };
+
+    void test_accounting()
+    {
+        std::size_t before = send_memory::pending_bytes();
+        {
+            harness h(make_budget(0, 0, 0, send_overflow_policy::PAUSE_PRODUCER));
+            for (int i = 0; i < 3; ++i) {
+                h.write('a', 100);
+            }
+            check_equal(h.target()->pending_write_bytes(), 300u, "session pending bytes");
+            check_equal(send_memory::pending_bytes(), before + 300, "process pending bytes");
+            h.drain();
+            check_equal(h.target()->pending_write_bytes(), 0u, "session pending after the drain");
+            check_equal(send_memory::pending_bytes(), before, "process pending after the drain");
+            check_true(h.read_peer(300) == std::string(300, 'a'), "the peer's bytes");
+
+            h.write('b', 100);
+        }
+        check_equal(send_memory::pending_bytes(), before, "bytes of a destroyed session");
+    }
+
+    void test_pause()
+    {
+        harness h(make_budget(1000, 100, 0, send_overflow_policy::PAUSE_PRODUCER));
+        for (int i = 0; i < 7; ++i) {
+            h.write('a', 128);
+        }
+        check_equal(h.pauses.size(), 0u, "no pause below high water");
+        for (int i = 0; i < 4; ++i) {
+            h.write('a', 128);
+        }
+        check_equal(h.pauses.size(), 1u, "one pause however many writes pass high water");
+        check_true(h.pauses[0] && h.target()->write_paused(), "paused");
+        check_equal(h.target()->pending_write_bytes(), 11u * 128, "a pause drops nothing");
+
+        h.drain();
+        check_equal(h.pauses.size(), 2u, "a resume once drained");
+        check_true(!h.pauses[1] && !h.target()->write_paused(), "resumed");
+        check_equal(h.read_peer(11 * 128).size(), 11u * 128, "every byte sent");
+    }
+
+    void test_drop_oldest()
+    {
+        std::size_t dropped = send_memory::dropped_bytes();
+        harness h(make_budget(1000, 0, 0, send_overflow_policy::DROP_OLDEST));
+        h.write('p', 900);
+        // below high water the first one is appended as any other write
+        for (char fill = 'a'; fill <= 'e'; ++fill) {
+            h.write(fill, 200, true);
+        }
+        check_equal(send_memory::dropped_bytes(), dropped + 600, "dropped bytes");
+        check_equal(h.target()->pending_write_bytes(), 900u + 200 + 200, "pending bytes");
+
+        h.drain();
+        std::string expected = std::string(900, 'p') + std::string(200, 'a')
+            + std::string(200, 'e');
+        check_true(h.read_peer(expected.size()) == expected, "plain bytes, then the newest");
+    }
+
+    void test_disconnect()
+    {
+        harness h(make_budget(1000, 0, 0, send_overflow_policy::DISCONNECT));
+        for (int i = 0; i < 7; ++i) {
+            h.write('a', 128);
+        }
+        check_true(!h.target()->closing(), "open below high water");
+        h.write('a', 128);
+        check_true(h.target()->closing(), "aborted over high water");
+
+        std::size_t pending = h.target()->pending_write_bytes();
+        h.write('a', 128);
+        h.write('a', 128, true);
+        check_equal(h.target()->pending_write_bytes(), pending, "nothing appended once closing");
+    }
+
+    void test_hard_limit()
+    {
+        harness h(make_budget(1000, 100, 2000, send_overflow_policy::PAUSE_PRODUCER));
+        for (int i = 0; i < 15; ++i) {
+            h.write('a', 128);
+        }
+        check_true(!h.target()->closing(), "open below the hard limit");
+        h.write('a', 128);
+        check_true(h.target()->closing(), "aborted over the hard limit");
+
+        std::size_t pending = h.target()->pending_write_bytes();
+        h.write('a', 128);
+        check_equal(h.target()->pending_write_bytes(), pending, "nothing appended once closing");
+    }
+
+    void test_process_limit()
+    {
+        harness h(make_budget(0, 0, 0, send_overflow_policy::PAUSE_PRODUCER));
+        send_memory::set_limit(send_memory::pending_bytes() + 1000);
+        for (int i = 0; i < 7; ++i) {
+            h.write('a', 128);
+        }
+        check_true(!h.target()->closing(), "open below the process limit");
+        h.write('a', 128);
+        bool closing = h.target()->closing();
+        send_memory::set_limit(0);
+        check_true(closing, "aborted over the process limit");
+    }
+}
@@ -0,0 +1,900 @@
+// A header-only subset of the Google Benchmark API (github.com/google/benchmark).
+//
+// Benchmarks written against it use the upstream names, so they build
+// unchanged against the real library:
+//
+//   static void BM_append(benchmark::State& state)
+//   {
+//       for (auto _ : state) {
+//           ...
+//       }
+//       state.SetBytesProcessed(state.iterations() * state.range(0));
+//   }
+//   BENCHMARK(BM_append)->Range(8, 8 << 10);
+//   BENCHMARK_MAIN();
+//
+// Supported: State (range-for and KeepRunning, range, iterations,
+// PauseTiming/ResumeTiming, SetBytesProcessed, SetItemsProcessed, SetLabel,
+// thread_index, threads), Benchmark (Arg, Range, RangeMultiplier,
+// DenseRange, Threads, ThreadRange, UseRealTime, MinTime), DoNotOptimize,
+// ClobberMemory.
+//
+// Flags: --benchmark_filter=<regex> --benchmark_min_time=<seconds>
+// --benchmark_repetitions=<n> --benchmark_format=<console|json>
+// --benchmark_out=<file> --benchmark_list_tests
+//
+// The JSON output has the upstream layout, upstream tools/compare.py can
+// diff two runs of different commits.
+
+#ifndef THIRD_PARTY_BENCHMARK_BENCHMARK_H
+#define THIRD_PARTY_BENCHMARK_BENCHMARK_H
+
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace benchmark
+{
+
+template <class Tp>
+inline void DoNotOptimize(Tp const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <class Tp>
+inline void DoNotOptimize(Tp& value)
+{
+#if defined(__clang__)
+    asm volatile("" : "+r,m"(value) : : "memory");
+#else
+    // gcc can not always satisfy "+r,m", memory first
+    asm volatile("" : "+m,r"(value) : : "memory");
+#endif
+}
+
+inline void ClobberMemory()
+{
+    asm volatile("" : : : "memory");
+}
+
+namespace internal
+{
+
+inline double thread_cpu_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+inline double real_seconds()
+{
+    return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// lets the threads of one run start timing together
+class barrier
+{
+public:
+    explicit barrier(int count)
+        : count_(count)
+        , waiting_(0)
+        , phase_(0)
+    {
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        int phase = phase_;
+        if (++waiting_ == count_) {
+            waiting_ = 0;
+            ++phase_;
+            cond_.notify_all();
+            return;
+        }
+        cond_.wait(lock, [&](){return phase_ != phase;});
+    }
+private:
+    std::mutex              mutex_;
+    std::condition_variable cond_;
+    int                     count_;
+    int                     waiting_;
+    int                     phase_;
+};
+
+} // namespace internal
+
+class State
+{
+public:
+    struct StateIterator
+    {
+        typedef int Value;
+
+        StateIterator()
+            : remaining(0)
+            , parent(nullptr)
+        {
+        }
+
+        StateIterator(std::size_t count, State* state)
+            : remaining(count)
+            , parent(state)
+        {
+        }
+
+        Value operator*() const
+        {
+            return 0;
+        }
+
+        StateIterator& operator++()
+        {
+            --remaining;
+            return *this;
+        }
+
+        bool operator!=(const StateIterator&)
+        {
+            if (remaining != 0) {
+                return true;
+            }
+            parent->FinishKeepRunning();
+            return false;
+        }
+
+        std::size_t remaining;
+        State*      parent;
+    };
+
+    State(std::size_t max_iters, const std::vector<int64_t>& ranges,
+            int thread_i, int n_threads, internal::barrier* start)
+        : thread_index(thread_i)
+        , threads(n_threads)
+        , max_iterations_(max_iters)
+        , remaining_(max_iters)
+        , ranges_(ranges)
+        , start_(start)
+        , started_(false)
+        , finished_(false)
+        , running_(false)
+        , real_start_(0)
+        , cpu_start_(0)
+        , real_seconds_(0)
+        , cpu_seconds_(0)
+        , bytes_processed_(0)
+        , items_processed_(0)
+    {
+    }
+
+    StateIterator begin()
+    {
+        StartKeepRunning();
+        return StateIterator(max_iterations_, this);
+    }
+
+    StateIterator end()
+    {
+        return StateIterator();
+    }
+
+    bool KeepRunning()
+    {
+        if (!started_) {
+            StartKeepRunning();
+        }
+        if (remaining_ > 0) {
+            --remaining_;
+            return true;
+        }
+        FinishKeepRunning();
+        return false;
+    }
+
+    void PauseTiming()
+    {
+        real_seconds_ += internal::real_seconds() - real_start_;
+        cpu_seconds_ += internal::thread_cpu_seconds() - cpu_start_;
+        running_ = false;
+    }
+
+    void ResumeTiming()
+    {
+        running_ = true;
+        real_start_ = internal::real_seconds();
+        cpu_start_ = internal::thread_cpu_seconds();
+    }
+
+    int64_t range(std::size_t pos = 0) const
+    {
+        return pos < ranges_.size() ? ranges_[pos] : 0;
+    }
+
+    std::size_t iterations() const
+    {
+        return max_iterations_;
+    }
+
+    void SetBytesProcessed(int64_t bytes)
+    {
+        bytes_processed_ = bytes;
+    }
+
+    void SetItemsProcessed(int64_t items)
+    {
+        items_processed_ = items;
+    }
+
+    void SetLabel(const std::string& label)
+    {
+        label_ = label;
+    }
+
+    const int thread_index;
+    const int threads;
+
+    double real_seconds() const
+    {
+        return real_seconds_;
+    }
+
+    double cpu_seconds() const
+    {
+        return cpu_seconds_;
+    }
+
+    int64_t bytes_processed() const
+    {
+        return bytes_processed_;
+    }
+
+    int64_t items_processed() const
+    {
+        return items_processed_;
+    }
+
+    const std::string& label() const
+    {
+        return label_;
+    }
+private:
+    void StartKeepRunning()
+    {
+        started_ = true;
+        if (start_) {
+            start_->wait();
+        }
+        ResumeTiming();
+    }
+
+    void FinishKeepRunning()
+    {
+        if (finished_) {
+            return;
+        }
+        finished_ = true;
+        if (running_) {
+            PauseTiming();
+        }
+    }
+
+    std::size_t             max_iterations_;
+    std::size_t             remaining_;
+    std::vector<int64_t>    ranges_;
+    internal::barrier*      start_;
+    bool                    started_;
+    bool                    finished_;
+    bool                    running_;
+    double                  real_start_;
+    double                  cpu_start_;
+    double                  real_seconds_;
+    double                  cpu_seconds_;
+    int64_t                 bytes_processed_;
+    int64_t                 items_processed_;
+    std::string             label_;
+};
+
+typedef void (Function)(State&);
+
+namespace internal
+{
+
+class Benchmark
+{
+public:
+    Benchmark(const char* name, Function* fn)
+        : name_(name)
+        , fn_(fn)
+        , range_multiplier_(8)
+        , use_real_time_(false)
+        , min_time_(0)
+    {
+    }
+
+    Benchmark* Arg(int64_t x)
+    {
+        args_.push_back(x);
+        return this;
+    }
+
+    Benchmark* RangeMultiplier(int multiplier)
+    {
+        range_multiplier_ = multiplier;
+        return this;
+    }
+
+    // lo, every power of the multiplier in between, hi
+    Benchmark* Range(int64_t lo, int64_t hi)
+    {
+        args_.push_back(lo);
+        for (int64_t x = 1; x < hi; x *= range_multiplier_) {
+            if (x > lo) {
+                args_.push_back(x);
+            }
+        }
+        if (hi != lo) {
+            args_.push_back(hi);
+        }
+        return this;
+    }
+
+    Benchmark* DenseRange(int64_t start, int64_t limit, int step = 1)
+    {
+        for (int64_t x = start; x <= limit; x += step) {
+            args_.push_back(x);
+        }
+        return this;
+    }
+
+    Benchmark* Threads(int t)
+    {
+        threads_.push_back(t);
+        return this;
+    }
+
+    Benchmark* ThreadRange(int min_threads, int max_threads)
+    {
+        for (int t = min_threads; t < max_threads; t *= 2) {
+            threads_.push_back(t);
+        }
+        threads_.push_back(max_threads);
+        return this;
+    }
+
+    Benchmark* UseRealTime()
+    {
+        use_real_time_ = true;
+        return this;
+    }
+
+    Benchmark* MinTime(double seconds)
+    {
+        min_time_ = seconds;
+        return this;
+    }
+
+    const std::string& name() const
+    {
+        return name_;
+    }
+
+    Function* function() const
+    {
+        return fn_;
+    }
+
+    const std::vector<int64_t>& args() const
+    {
+        return args_;
+    }
+
+    const std::vector<int>& threads() const
+    {
+        return threads_;
+    }
+
+    bool use_real_time() const
+    {
+        return use_real_time_;
+    }
+
+    double min_time() const
+    {
+        return min_time_;
+    }
+private:
+    std::string             name_;
+    Function*               fn_;
+    std::vector<int64_t>    args_;
+    std::vector<int>        threads_;
+    int                     range_multiplier_;
+    bool                    use_real_time_;
+    double                  min_time_;
+};
+
+struct options
+{
+    std::string filter          = ".";
+    double      min_time        = 0.5;
+    int         repetitions     = 1;
+    std::string format          = "console";
+    std::string out;
+    bool        list_tests      = false;
+};
+
+inline std::vector<Benchmark*>& registry()
+{
+    static std::vector<Benchmark*> benchmarks;
+    return benchmarks;
+}
+
+inline options& flags()
+{
+    static options opts;
+    return opts;
+}
+
+// one benchmark with one argument and one thread count
+struct instance
+{
+    std::string             name;
+    Benchmark*              benchmark;
+    std::vector<int64_t>    args;
+    int                     threads;
+};
+
+struct run
+{
+    std::string name;
+    std::string run_name;
+    std::string run_type;       // iteration or aggregate
+    std::string aggregate_name;
+    int         repetitions;
+    int         repetition_index;
+    int         threads;
+    std::size_t iterations;
+    double      real_time;      // ns per iteration
+    double      cpu_time;       // ns per iteration
+    double      bytes_per_second;
+    double      items_per_second;
+    std::string label;
+};
+
+inline std::vector<instance> make_instances(Benchmark* benchmark)
+{
+    std::vector<instance> instances;
+    std::vector<int64_t> args = benchmark->args();
+    std::vector<int> threads = benchmark->threads();
+    bool no_args = args.empty();
+    if (no_args) {
+        args.push_back(0);
+    }
+    if (threads.empty()) {
+        threads.push_back(0);
+    }
+    for (int64_t arg : args) {
+        for (int t : threads) {
+            std::ostringstream name;
+            name << benchmark->name();
+            if (!no_args) {
+                name << "/" << arg;
+            }
+            if (benchmark->min_time() > 0) {
+                char min_time[32];
+                snprintf(min_time, sizeof min_time, "/min_time:%.3f", benchmark->min_time());
+                name << min_time;
+            }
+            if (benchmark->use_real_time()) {
+                name << "/real_time";
+            }
+            if (t > 0) {
+                name << "/threads:" << t;
+            }
+            instance i;
+            i.name      = name.str();
+            i.benchmark = benchmark;
+            if (!no_args) {
+                i.args.push_back(arg);
+            }
+            i.threads   = std::max(t, 1);
+            instances.push_back(i);
+        }
+    }
+    return instances;
+}
+
+struct measurement
+{
+    double      real_seconds;
+    double      cpu_seconds;
+    int64_t     bytes;
+    int64_t     items;
+    std::string label;
+};
+
+// every thread runs iters iterations, the slowest thread sets the real
+// time and cpu time is the mean of the threads
+inline measurement run_iterations(const instance& i, std::size_t iters)
+{
+    measurement m = {0, 0, 0, 0, ""};
+    if (i.threads == 1) {
+        State state(iters, i.args, 0, 1, nullptr);
+        i.benchmark->function()(state);
+        m.real_seconds  = state.real_seconds();
+        m.cpu_seconds   = state.cpu_seconds();
+        m.bytes         = state.bytes_processed();
+        m.items         = state.items_processed();
+        m.label         = state.label();
+        return m;
+    }
+
+    barrier start(i.threads);
+    std::vector<State*> states;
+    for (int t = 0; t < i.threads; ++t) {
+        states.push_back(new State(iters, i.args, t, i.threads, &start));
+    }
+    std::vector<std::thread> workers;
+    for (int t = 0; t < i.threads; ++t) {
+        workers.emplace_back([&i, &states, t](){i.benchmark->function()(*states[t]);});
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (State* state : states) {
+        m.real_seconds  = std::max(m.real_seconds, state->real_seconds());
+        m.cpu_seconds   += state->cpu_seconds() / i.threads;
+        m.bytes         += state->bytes_processed();
+        m.items         += state->items_processed();
+        if (!state->label().empty()) {
+            m.label = state->label();
+        }
+        delete state;
+    }
+    return m;
+}
+
+inline run make_run(const instance& i, std::size_t iters, const measurement& m,
+        int repetitions, int repetition_index)
+{
+    double seconds = i.benchmark->use_real_time() ? m.real_seconds : m.cpu_seconds;
+    run r;
+    r.name              = i.name;
+    r.run_name          = i.name;
+    r.run_type          = "iteration";
+    r.repetitions       = repetitions;
+    r.repetition_index  = repetition_index;
+    r.threads           = i.threads;
+    r.iterations        = iters;
+    r.real_time         = m.real_seconds * 1e9 / iters;
+    r.cpu_time          = m.cpu_seconds * 1e9 / iters;
+    r.bytes_per_second  = seconds > 0 ? m.bytes / seconds : 0;
+    r.items_per_second  = seconds > 0 ? m.items / seconds : 0;
+    r.label             = m.label;
+    return r;
+}
+
+inline std::vector<run> aggregate(const std::vector<run>& runs)
+{
+    std::vector<run> aggregates;
+    const char* names[] = {"mean", "median", "stddev"};
+    for (const char* aggregate_name : names) {
+        run r = runs.front();
+        r.name              = r.run_name + "_" + aggregate_name;
+        r.run_type          = "aggregate";
+        r.aggregate_name    = aggregate_name;
+        r.repetition_index  = 0;
+        double run::* fields[] = {&run::real_time, &run::cpu_time,
+            &run::bytes_per_second, &run::items_per_second};
+        for (double run::* field : fields) {
+            std::vector<double> values;
+            for (const run& each : runs) {
+                values.push_back(each.*field);
+            }
+            double mean = 0;
+            for (double v : values) {
+                mean += v / values.size();
+            }
+            if (aggregate_name == names[0]) {
+                r.*field = mean;
+            } else if (aggregate_name == names[1]) {
+                std::sort(values.begin(), values.end());
+                std::size_t mid = values.size() / 2;
+                r.*field = values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2;
+            } else {
+                double sum = 0;
+                for (double v : values) {
+                    sum += (v - mean) * (v - mean);
+                }
+                r.*field = values.size() > 1 ? std::sqrt(sum / (values.size() - 1)) : 0;
+            }
+        }
+        aggregates.push_back(r);
+    }
+    return aggregates;
+}
+
+// grows the iteration count until a run takes the minimum time, then
+// repeats that count
+inline std::vector<run> run_instance(const instance& i)
+{
+    const std::size_t kMaxIterations = 1000000000;
+    double min_time = i.benchmark->min_time() > 0 ? i.benchmark->min_time() : flags().min_time;
+    std::size_t iters = 1;
+    measurement m;
+    for (;;) {
+        m = run_iterations(i, iters);
+        double seconds = i.benchmark->use_real_time() ? m.real_seconds : m.cpu_seconds;
+        if (seconds >= min_time || iters >= kMaxIterations) {
+            break;
+        }
+        double multiplier = min_time * 1.4 / std::max(seconds, 1e-9);
+        if (seconds / min_time <= 0.1) {
+            multiplier = std::min(multiplier, 10.0);
+        }
+        if (multiplier <= 1.0) {
+            multiplier = 2.0;
+        }
+        std::size_t next = static_cast<std::size_t>(std::lround(iters * multiplier));
+        iters = std::min(std::max(next, iters + 1), kMaxIterations);
+    }
+
+    int repetitions = std::max(flags().repetitions, 1);
+    std::vector<run> runs;
+    runs.push_back(make_run(i, iters, m, repetitions, 0));
+    for (int repetition = 1; repetition < repetitions; ++repetition) {
+        runs.push_back(make_run(i, iters, run_iterations(i, iters), repetitions, repetition));
+    }
+    if (repetitions > 1) {
+        std::vector<run> aggregates = aggregate(runs);
+        runs.insert(runs.end(), aggregates.begin(), aggregates.end());
+    }
+    return runs;
+}
+
+inline std::string human_rate(double value, const char* unit)
+{
+    const char* prefixes[] = {"", "k", "M", "G", "T"};
+    std::size_t prefix = 0;
+    double base = strcmp(unit, "B/s") == 0 ? 1024 : 1000;
+    while (value >= base && prefix + 1 < sizeof prefixes / sizeof prefixes[0]) {
+        value /= base;
+        ++prefix;
+    }
+    char text[64];
+    snprintf(text, sizeof text, "%.4g %s%s", value, prefixes[prefix], unit);
+    return text;
+}
+
+inline void print_console_header(std::size_t name_width)
+{
+    std::string line(name_width + 48, '-');
+    printf("%s\n%-*s %13s %13s %10s\n%s\n", line.c_str(), static_cast<int>(name_width),
+            "Benchmark", "Time", "CPU", "Iterations", line.c_str());
+}
+
+inline void print_console(const run& r, std::size_t name_width)
+{
+    std::string counters;
+    if (r.bytes_per_second > 0) {
+        counters += " " + human_rate(r.bytes_per_second, "B/s");
+    }
+    if (r.items_per_second > 0) {
+        counters += " " + human_rate(r.items_per_second, "items/s");
+    }
+    if (!r.label.empty()) {
+        counters += " " + r.label;
+    }
+    if (r.run_type == "aggregate") {
+        printf("%-*s %10.0f ns %10.0f ns %10s%s\n", static_cast<int>(name_width), r.name.c_str(),
+                r.real_time, r.cpu_time, "", counters.c_str());
+    } else {
+        printf("%-*s %10.0f ns %10.0f ns %10zu%s\n", static_cast<int>(name_width), r.name.c_str(),
+                r.real_time, r.cpu_time, r.iterations, counters.c_str());
+    }
+    fflush(stdout);
+}
+
+inline std::string json_escape(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+inline void write_json(std::ostream& out, const std::vector<run>& runs, const char* executable)
+{
+    char host[256] = {0};
+    gethostname(host, sizeof host - 1);
+    char date[64];
+    std::time_t now = std::time(nullptr);
+    strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+#ifdef NDEBUG
+    const char* build_type = "release";
+#else
+    const char* build_type = "debug";
+#endif
+
+    out << "{\n  \"context\": {\n"
+        << "    \"date\": \"" << date << "\",\n"
+        << "    \"host_name\": \"" << json_escape(host) << "\",\n"
+        << "    \"executable\": \"" << json_escape(executable) << "\",\n"
+        << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+        << "    \"library_build_type\": \"" << build_type << "\"\n"
+        << "  },\n  \"benchmarks\": [";
+    for (std::size_t n = 0; n < runs.size(); ++n) {
+        const run& r = runs[n];
+        char times[128];
+        snprintf(times, sizeof times, "\"real_time\": %.6g,\n      \"cpu_time\": %.6g,\n",
+                r.real_time, r.cpu_time);
+        out << (n ? ",\n" : "\n") << "    {\n"
+            << "      \"name\": \"" << json_escape(r.name) << "\",\n"
+            << "      \"run_name\": \"" << json_escape(r.run_name) << "\",\n"
+            << "      \"run_type\": \"" << r.run_type << "\",\n";
+        if (r.run_type == "aggregate") {
+            out << "      \"aggregate_name\": \"" << r.aggregate_name << "\",\n";
+        }
+        out << "      \"repetitions\": " << r.repetitions << ",\n"
+            << "      \"repetition_index\": " << r.repetition_index << ",\n"
+            << "      \"threads\": " << r.threads << ",\n"
+            << "      \"iterations\": " << r.iterations << ",\n"
+            << "      " << times
+            << "      \"time_unit\": \"ns\"";
+        if (r.bytes_per_second > 0) {
+            out << ",\n      \"bytes_per_second\": " << static_cast<uint64_t>(r.bytes_per_second);
+        }
+        if (r.items_per_second > 0) {
+            out << ",\n      \"items_per_second\": " << static_cast<uint64_t>(r.items_per_second);
+        }
+        if (!r.label.empty()) {
+            out << ",\n      \"label\": \"" << json_escape(r.label) << "\"";
+        }
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+inline bool parse_flag(const char* arg, const char* flag, std::string& value)
+{
+    std::size_t length = strlen(flag);
+    if (strncmp(arg, flag, length) != 0 || arg[length] != '=') {
+        return false;
+    }
+    value = arg + length + 1;
+    return true;
+}
+
+inline std::string& executable()
+{
+    static std::string name;
+    return name;
+}
+
+} // namespace internal
+
+inline internal::Benchmark* RegisterBenchmark(const char* name, Function* fn)
+{
+    internal::Benchmark* benchmark = new internal::Benchmark(name, fn);
+    internal::registry().push_back(benchmark);
+    return benchmark;
+}
+
+inline void Initialize(int* argc, char** argv)
+{
+    internal::options& opts = internal::flags();
+    internal::executable() = *argc > 0 ? argv[0] : "";
+    int kept = 1;
+    for (int n = 1; n < *argc; ++n) {
+        std::string value;
+        if (internal::parse_flag(argv[n], "--benchmark_filter", value)) {
+            opts.filter = value;
+        } else if (internal::parse_flag(argv[n], "--benchmark_min_time", value)) {
+            opts.min_time = atof(value.c_str());
+        } else if (internal::parse_flag(argv[n], "--benchmark_repetitions", value)) {
+            opts.repetitions = atoi(value.c_str());
+        } else if (internal::parse_flag(argv[n], "--benchmark_format", value)) {
+            opts.format = value;
+        } else if (internal::parse_flag(argv[n], "--benchmark_out", value)) {
+            opts.out = value;
+        } else if (strcmp(argv[n], "--benchmark_list_tests") == 0) {
+            opts.list_tests = true;
+        } else {
+            argv[kept++] = argv[n];
+        }
+    }
+    *argc = kept;
+}
+
+inline std::size_t RunSpecifiedBenchmarks()
+{
+    const internal::options& opts = internal::flags();
+    std::regex filter(opts.filter);
+    std::vector<internal::instance> instances;
+    for (internal::Benchmark* benchmark : internal::registry()) {
+        for (const internal::instance& i : internal::make_instances(benchmark)) {
+            if (std::regex_search(i.name, filter)) {
+                instances.push_back(i);
+            }
+        }
+    }
+
+    if (opts.list_tests) {
+        for (const internal::instance& i : instances) {
+            printf("%s\n", i.name.c_str());
+        }
+        return instances.size();
+    }
+
+    bool console = opts.format != "json";
+    std::size_t name_width = 10;
+    for (const internal::instance& i : instances) {
+        std::size_t width = i.name.size() + (opts.repetitions > 1 ? 7 : 0);
+        name_width = std::max(name_width, width);
+    }
+    if (console) {
+        internal::print_console_header(name_width);
+    }
+
+    std::vector<internal::run> runs;
+    for (const internal::instance& i : instances) {
+        for (const internal::run& r : internal::run_instance(i)) {
+            if (console) {
+                internal::print_console(r, name_width);
+            }
+            runs.push_back(r);
+        }
+    }
+
+    if (!console) {
+        internal::write_json(std::cout, runs, internal::executable().c_str());
+    }
+    if (!opts.out.empty()) {
+        std::ofstream out(opts.out.c_str());
+        internal::write_json(out, runs, internal::executable().c_str());
+    }
+    return instances.size();
+}
+
+} // namespace benchmark
+
+#define BENCHMARK_CONCAT2(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT2(a, b)
+
+#define BENCHMARK(fn)                                               \
+    static ::benchmark::internal::Benchmark*                        \
+    BENCHMARK_CONCAT(benchmark_registered_, __LINE__) =             \
+        ::benchmark::RegisterBenchmark(#fn, fn)
+
+#define BENCHMARK_MAIN()                                            \
+    int main(int argc, char** argv)                                 \
+    {                                                               \
+        ::benchmark::Initialize(&argc, argv);                       \
+        ::benchmark::RunSpecifiedBenchmarks();                      \
+        return 0;                                                   \
+    }
+
+#endif // THIRD_PARTY_BENCHMARK_BENCHMARK_H
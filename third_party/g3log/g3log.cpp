@@ -47,6 +47,8 @@ namespace {
 
 
    std::atomic<size_t> g_fatal_hook_recursive_counter = {0};
+   std::atomic<size_t> g_log_queue_limit = {0};
+   std::atomic<uint64_t> g_dropped_log_messages = {0};
 }
 
 
@@ -105,6 +107,19 @@ namespace g3 {
 
 
 
+   void setLogQueueLimit(size_t limit) {
+      g_log_queue_limit.store(limit);
+   }
+
+   size_t logQueueLimit() {
+      return g_log_queue_limit.load(std::memory_order_relaxed);
+   }
+
+   uint64_t droppedLogMessages() {
+      return g_dropped_log_messages.load();
+   }
+
+
    // By default this function pointer goes to \ref pushFatalMessageToLogger;
    std::function<void(FatalMessagePtr) > g_fatal_to_g3logworker_function_ptr = internal::pushFatalMessageToLogger;
 
@@ -119,6 +134,10 @@ namespace g3 {
 
    namespace internal {
 
+      void countDroppedLogMessage() {
+         ++g_dropped_log_messages;
+      }
+
       bool isLoggingInitialized() {
          return g_logger_instance != nullptr;
       }
@@ -22,6 +22,7 @@
 #include <thread>
 #include <functional>
 #include <memory>
+#include <cstddef>
 #include "g3log/shared_queue.hpp"
 
 namespace kjellkod {
@@ -56,6 +57,12 @@ namespace kjellkod {
          mq_.push(msg_);
       }
 
+      /// send, unless max_queued messages already wait. 0 is unbounded
+      /// \return false if the message was dropped
+      bool offer(Callback msg_, size_t max_queued) {
+         return mq_.try_push(msg_, max_queued);
+      }
+
       /// Factory: safe construction of object before thread start
       static std::unique_ptr<Active> createActive() {
          std::unique_ptr<Active> aPtr(new Active());
@@ -19,6 +19,8 @@
 #include <sstream>
 #include <thread>
 #include <memory>
+#include <cstddef>
+#include <cstdint>
 
 namespace g3 {
 
@@ -130,6 +132,28 @@ namespace g3 {
    };
 
 
+   /// At most limit log messages wait in the LogWorker queue and in the queue
+   /// of each sink, newer ones are dropped and counted. The next message that
+   /// gets through is preceded by a note of how many were dropped.
+   /// 0, the default, is unbounded. Calls to sinks are never dropped
+   void setLogQueueLimit(size_t limit);
+   size_t logQueueLimit();
+
+   /// log messages dropped on full queues since the start
+   uint64_t droppedLogMessages();
+
+   namespace internal {
+      void countDroppedLogMessage();
+
+      /// a WARNING at the place of next that tells how many messages were dropped before it
+      inline LogMessage droppedMessagesNote(const LogMessage& next, size_t dropped) {
+         LogMessage note(next);
+         note._level = WARNING;
+         note.write() = "log queue full, dropped " + std::to_string(dropped) + " messages";
+         return note;
+      }
+   } // internal
+
    typedef MoveOnCopy<std::unique_ptr<FatalMessage>> FatalMessagePtr;
    typedef MoveOnCopy<std::unique_ptr<LogMessage>> LogMessagePtr;
    typedef MoveOnCopy<LogMessage> LogMessageMover;
@@ -18,6 +18,7 @@
 #include "g3log/logmessage.hpp"
 #include "g3log/std2_make_unique.hpp"
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <vector>
@@ -33,6 +34,7 @@ namespace g3 {
       typedef std::shared_ptr<g3::internal::SinkWrapper> SinkWrapperPtr;
       std::vector<SinkWrapperPtr> _sinks;
       std::unique_ptr<kjellkod::Active> _bg; // do not change declaration order. _bg must be destroyed before sinks
+      std::atomic<size_t> _dropped {0};
 
       LogWorkerImpl();
       ~LogWorkerImpl() = default;
@@ -44,6 +44,20 @@ public:
       data_cond_.notify_one();
    }
 
+   /// push unless max_size items already wait, 0 is unbounded
+   /// \return false if the item was not pushed
+   bool try_push(T item, size_t max_size) {
+      {
+         std::lock_guard<std::mutex> lock(m_);
+         if (max_size != 0 && queue_.size() >= max_size) {
+            return false;
+         }
+         queue_.push(std::move(item));
+      }
+      data_cond_.notify_one();
+      return true;
+   }
+
    /// \return immediately, with true if successful retrieval
    bool try_and_pop(T &popped_item) {
       std::lock_guard<std::mutex> lock(m_);
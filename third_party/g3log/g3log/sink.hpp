@@ -14,6 +14,7 @@
 #include "g3log/future.hpp"
 #include "g3log/logmessage.hpp"
 
+#include <atomic>
 #include <memory>
 #include <functional>
 #include <type_traits>
@@ -39,6 +40,7 @@ namespace g3 {
          std::unique_ptr<T> _real_sink;
          std::unique_ptr<kjellkod::Active> _bg;
          AsyncMessageCall _default_log_call;
+         std::atomic<size_t> _dropped {0};
 
          template<typename DefaultLogCall >
          Sink(std::unique_ptr<T> sink, DefaultLogCall call)
@@ -64,9 +66,17 @@ namespace g3 {
          }
 
          void send(LogMessageMover msg) override {
-            _bg->send([this, msg] {
+            bool queued = _bg->offer([this, msg]() mutable {
+               size_t dropped = _dropped.exchange(0);
+               if (dropped > 0) {
+                  _default_log_call(LogMessageMover(internal::droppedMessagesNote(msg.get(), dropped)));
+               }
                _default_log_call(msg);
-            });
+            }, logQueueLimit());
+            if (!queued) {
+               ++_dropped;
+               internal::countDroppedLogMessage();
+            }
          }
 
          template<typename Call, typename... Args>
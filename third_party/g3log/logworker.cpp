@@ -22,6 +22,14 @@ namespace g3 {
    void LogWorkerImpl::bgSave(g3::LogMessagePtr msgPtr) {
       std::unique_ptr<LogMessage> uniqueMsg(std::move(msgPtr.get()));
 
+      size_t dropped = _dropped.exchange(0);
+      if (dropped > 0) {
+         LogMessage note = internal::droppedMessagesNote(*uniqueMsg, dropped);
+         for (auto& sink : _sinks) {
+            sink->send(LogMessageMover(LogMessage(note)));
+         }
+      }
+
       for (auto& sink : _sinks) {
          LogMessage msg(*(uniqueMsg));
          sink->send(LogMessageMover(std::move(msg)));
@@ -103,7 +111,10 @@ namespace g3 {
    }
 
    void LogWorker::save(LogMessagePtr msg) {
-      _impl._bg->send([this, msg] {_impl.bgSave(msg); });
+      if (!_impl._bg->offer([this, msg] {_impl.bgSave(msg); }, logQueueLimit())) {
+         ++_impl._dropped;
+         internal::countDroppedLogMessage();
+      }
    }
 
    void LogWorker::fatal(FatalMessagePtr fatal_message) {